@@ -0,0 +1,361 @@
+#define _GNU_SOURCE
+#include "bench_util.h"
+
+#include <ftw.h>
+#include <fcntl.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const uint8_t key_chars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} perf_events[BENCH_PERF_COUNTERS] = {
+  { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { "l1d_misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+  { "llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+extern void bench_rng_seed(bench_rng_t *rng, uint64_t seed) {
+  /* splitmix64 of the seed, so that nearby seeds give unrelated streams */
+  uint64_t state = seed + 0x9E3779B97F4A7C15ULL;
+  state = (state ^ (state >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  state = (state ^ (state >> 27)) * 0x94D049BB133111EBULL;
+  state ^= state >> 31;
+  rng->state = state != 0 ? state : 1;
+}
+
+extern uint64_t bench_rng_next(bench_rng_t *rng) {
+  uint64_t state = rng->state;
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  rng->state = state;
+  return state * 0x2545F4914F6CDD1DULL;
+}
+
+extern uint64_t bench_rng_below(bench_rng_t *rng, uint64_t bound) {
+  return (uint64_t)(((unsigned __int128)bench_rng_next(rng) * bound) >> 64);
+}
+
+extern double bench_rng_double(bench_rng_t *rng) {
+  return (bench_rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+static double zeta(uint64_t items, double theta) {
+  double sum = 0;
+  for (uint64_t item = 1; item <= items; item++) {
+    sum += 1 / pow((double)item, theta);
+  }
+  return sum;
+}
+
+extern void bench_zipf_init(bench_zipf_t *zipf, uint64_t items, double theta) {
+  zipf->items = items;
+  zipf->theta = theta;
+  zipf->zetan = zeta(items, theta);
+  zipf->alpha = 1 / (1 - theta);
+  zipf->eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta(2, theta) / zipf->zetan);
+  zipf->half_pow = 1 + pow(0.5, theta);
+}
+
+extern uint64_t bench_zipf_next(bench_zipf_t *zipf, bench_rng_t *rng) {
+  double u = bench_rng_double(rng);
+  double uz = u * zipf->zetan;
+  if (uz < 1) return 0;
+  if (uz < zipf->half_pow) return 1;
+
+  uint64_t item = zipf->items * pow(zipf->eta * u - zipf->eta + 1, zipf->alpha);
+  return item < zipf->items ? item : zipf->items - 1;
+}
+
+extern uint64_t bench_fnv64(uint64_t value) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (uint64_t byte = 0; byte < 8; byte++) {
+    hash ^= value & 0xFF;
+    hash *= 0x100000001B3ULL;
+    value >>= 8;
+  }
+  return hash;
+}
+
+extern void bench_make_key(uint8_t *dest, uint8_t prefix, uint64_t record,
+                           bench_key_len_t key_len, bench_rng_t *rng) {
+  uint64_t len = 0;
+  dest[len++] = prefix;
+
+  /* Record number first, so that the key stays unique whatever the filler */
+  uint8_t digits[16];
+  uint64_t digit_count = 0;
+  do {
+    digits[digit_count++] = key_chars[record % 36];
+    record /= 36;
+  } while (record > 0);
+  dest[len++] = '_';
+  while (digit_count > 0 && len < BENCH_MAX_KEY_LEN) {
+    dest[len++] = digits[--digit_count];
+  }
+
+  uint64_t target = key_len.min;
+  if (key_len.max > key_len.min) {
+    target += bench_rng_below(rng, key_len.max - key_len.min + 1);
+  }
+  if (target > BENCH_MAX_KEY_LEN) {
+    target = BENCH_MAX_KEY_LEN;
+  }
+  if (len < target) {
+    dest[len++] = '_';
+  }
+  while (len < target) {
+    dest[len++] = key_chars[bench_rng_below(rng, 36)];
+  }
+  dest[len] = '\0';
+}
+
+extern int64_t bench_make_value(bench_value_t *dest, uint8_t *type, uint64_t size, bench_rng_t *rng) {
+  int64_t type_id = map_datatype_from_str(type);
+  if (type_id < 0) {
+    return -1;
+  }
+
+  uint64_t capacity = size > BG_BUFFER_SIZE ? size + 1 : BG_BUFFER_SIZE;
+  uint8_t *bytes = malloc(capacity);
+  if (bytes == NULL) {
+    return -1;
+  }
+
+  uint64_t bits = bench_rng_next(rng);
+  int64_t len;
+  switch (type_id) {
+  case INT8_TYPE:
+    len = snprintf(bytes, capacity, "%" PRId8, (int8_t)bits);
+    break;
+  case INT16_TYPE:
+    len = snprintf(bytes, capacity, "%" PRId16, (int16_t)bits);
+    break;
+  case INT32_TYPE:
+    len = snprintf(bytes, capacity, "%" PRId32, (int32_t)bits);
+    break;
+  case INT64_TYPE:
+    len = snprintf(bytes, capacity, "%" PRId64, (int64_t)bits);
+    break;
+  case FLOAT_TYPE:
+    len = snprintf(bytes, capacity, "%.9g", (float)(bench_rng_double(rng) * 1e6 - 5e5));
+    break;
+  case DOUBLE_TYPE:
+    len = snprintf(bytes, capacity, "%.17g", bench_rng_double(rng) * 1e12 - 5e11);
+    break;
+  case BOOL_TYPE:
+    len = snprintf(bytes, capacity, "%s", (bits & 1) != 0 ? "true" : "false");
+    break;
+  case STRING_TYPE:
+    for (uint64_t idx = 0; idx < size; idx++) {
+      bytes[idx] = ' ' + bench_rng_below(rng, 95);
+    }
+    bytes[size] = '\0';
+    len = size;
+    break;
+  default:
+    /* Blobs cover every byte value, NUL and delimiters included */
+    for (uint64_t idx = 0; idx < size; idx++) {
+      bytes[idx] = bench_rng_next(rng) >> 56;
+    }
+    bytes[size] = '\0';
+    len = size;
+    break;
+  }
+
+  dest->bytes = bytes;
+  dest->len = len > 0 ? len : 1;
+  return 0;
+}
+
+extern void bench_record(kv_histogram_t *histogram, uint64_t ns) {
+  histogram->count++;
+  histogram->sum_ns += ns;
+  histogram->buckets[stats_bucket(ns)]++;
+  if (ns > histogram->max_ns) {
+    histogram->max_ns = ns;
+  }
+}
+
+extern void bench_merge(kv_histogram_t *dest, kv_histogram_t *source) {
+  dest->count += source->count;
+  dest->sum_ns += source->sum_ns;
+  if (source->max_ns > dest->max_ns) {
+    dest->max_ns = source->max_ns;
+  }
+  for (uint64_t bucket = 0; bucket < KV_STATS_BUCKETS; bucket++) {
+    dest->buckets[bucket] += source->buckets[bucket];
+  }
+}
+
+extern void bench_write_latency_json(FILE *file, kv_histogram_t *histogram, double seconds) {
+  double mean = histogram->count > 0 ? (double)histogram->sum_ns / histogram->count : 0;
+  fprintf(file, "\"ops\": %" PRIu64 ", \"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+                "\"mean_ns\": %.1f, \"p50_ns\": %" PRIu64 ", \"p90_ns\": %" PRIu64 ", "
+                "\"p99_ns\": %" PRIu64 ", \"p999_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64,
+          histogram->count, seconds, seconds > 0 ? histogram->count / seconds : 0, mean,
+          stats_percentile(histogram, 50), stats_percentile(histogram, 90),
+          stats_percentile(histogram, 99), stats_percentile(histogram, 99.9), histogram->max_ns);
+}
+
+static int remove_tree_entry(const char *path, const struct stat *file_stat, int flag, struct FTW *ftw) {
+  return remove(path);
+}
+
+extern int64_t bench_remove_tree(uint8_t *path) {
+  if (access(path, F_OK) != 0) {
+    return 0;
+  }
+  return nftw(path, remove_tree_entry, 16, FTW_DEPTH | FTW_PHYS) == 0 ? 0 : -1;
+}
+
+extern uint64_t bench_perf_open(bench_perf_t *perf) {
+  perf->available = 0;
+  for (uint64_t counter = 0; counter < BENCH_PERF_COUNTERS; counter++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_events[counter].type;
+    attr.config = perf_events[counter].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    /* Each counter is opened on its own, so one missing event does not hide the others */
+    perf->fds[counter] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    perf->values[counter] = 0;
+    if (perf->fds[counter] >= 0) {
+      perf->available++;
+    }
+  }
+  return perf->available;
+}
+
+extern void bench_perf_start(bench_perf_t *perf) {
+  for (uint64_t counter = 0; counter < BENCH_PERF_COUNTERS; counter++) {
+    if (perf->fds[counter] < 0) continue;
+    ioctl(perf->fds[counter], PERF_EVENT_IOC_RESET, 0);
+    ioctl(perf->fds[counter], PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+extern void bench_perf_stop(bench_perf_t *perf) {
+  for (uint64_t counter = 0; counter < BENCH_PERF_COUNTERS; counter++) {
+    if (perf->fds[counter] >= 0) {
+      ioctl(perf->fds[counter], PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+
+  for (uint64_t counter = 0; counter < BENCH_PERF_COUNTERS; counter++) {
+    uint64_t data[3];
+    perf->values[counter] = 0;
+    if (perf->fds[counter] < 0 || read(perf->fds[counter], data, sizeof(data)) != sizeof(data)) {
+      continue;
+    }
+    /* data holds the count, the time enabled and the time actually counted */
+    perf->values[counter] = data[2] > 0 && data[2] < data[1] ?
+                            (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+  }
+}
+
+extern void bench_perf_write_json(FILE *file, bench_perf_t *perf, uint64_t ops) {
+  if (perf->available == 0) {
+    fprintf(file, "\"perf\": null");
+    return;
+  }
+
+  fprintf(file, "\"perf\": {");
+  bool first = true;
+  for (uint64_t counter = 0; counter < BENCH_PERF_COUNTERS; counter++) {
+    if (perf->fds[counter] < 0) continue;
+    fprintf(file, "%s\"%s\": %" PRIu64 ", \"%s_per_op\": %.2f", first ? "" : ", ",
+            perf_events[counter].name, perf->values[counter], perf_events[counter].name,
+            ops > 0 ? (double)perf->values[counter] / ops : 0);
+    first = false;
+  }
+  if (perf->fds[0] >= 0 && perf->fds[1] >= 0) {
+    fprintf(file, ", \"ipc\": %.3f", perf->values[0] > 0 ? (double)perf->values[1] / perf->values[0] : 0);
+  }
+  fprintf(file, "}");
+}
+
+extern void bench_perf_close(bench_perf_t *perf) {
+  for (uint64_t counter = 0; counter < BENCH_PERF_COUNTERS; counter++) {
+    if (perf->fds[counter] >= 0) {
+      close(perf->fds[counter]);
+      perf->fds[counter] = -1;
+    }
+  }
+  perf->available = 0;
+}
+
+/* nftw() takes no context, the tools calling these helpers are single-threaded */
+static uint64_t tree_bytes;
+
+static int add_tree_entry(const char *path, const struct stat *file_stat, int flag, struct FTW *ftw) {
+  if (flag == FTW_F) {
+    tree_bytes += file_stat->st_size;
+  }
+  return 0;
+}
+
+extern uint64_t bench_path_bytes(uint8_t *path) {
+  tree_bytes = 0;
+  if (access(path, F_OK) != 0 || nftw(path, add_tree_entry, 16, FTW_PHYS) != 0) {
+    return 0;
+  }
+  return tree_bytes;
+}
+
+static int drop_tree_entry(const char *path, const struct stat *file_stat, int flag, struct FTW *ftw) {
+  if (flag != FTW_F) return 0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return -1;
+  int result = fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0 ? 0 : -1;
+  close(fd);
+  return result;
+}
+
+extern int64_t bench_drop_cache(uint8_t *path) {
+  return nftw(path, drop_tree_entry, 16, FTW_PHYS) == 0 ? 0 : -1;
+}
+
+static int warm_tree_entry(const char *path, const struct stat *file_stat, int flag, struct FTW *ftw) {
+  if (flag != FTW_F) return 0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return -1;
+  uint8_t buffer[1 << 16];
+  ssize_t count;
+  while ((count = read(fd, buffer, sizeof(buffer))) > 0);
+  close(fd);
+  return count == 0 ? 0 : -1;
+}
+
+extern int64_t bench_warm_cache(uint8_t *path) {
+  return nftw(path, warm_tree_entry, 16, FTW_PHYS) == 0 ? 0 : -1;
+}
+
+extern uint64_t bench_split(uint8_t *list, uint8_t **items, uint64_t max_items) {
+  uint64_t count = 0;
+  char *save = NULL;
+  for (uint8_t *item = strtok_r(list, ",", &save);
+       item != NULL && count < max_items;
+       item = strtok_r(NULL, ",", &save)) {
+    items[count++] = item;
+  }
+  return count;
+}
@@ -0,0 +1,286 @@
+/**
+ * @file bench_util.h
+ * @brief Helpers shared by the benchmark drivers
+ *
+ * Random numbers, key and value generation, latency recording and JSON
+ * output used by kv_bench and the other drivers of the bench directory.
+ * Latencies are kept in the same log-bucketed histograms as the database
+ * statistics, but locally, so the drivers also work with -DKV_STATS=OFF.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "kv_controller.h"
+
+
+/** @brief Number of hardware counters read by bench_perf_t */
+#define BENCH_PERF_COUNTERS 5
+
+/** @brief Longest key generated, keys must fit SM_BUFFER_SIZE with their NUL */
+#define BENCH_MAX_KEY_LEN (SM_BUFFER_SIZE - 1)
+
+/**
+ * @brief State of a xorshift64* generator
+ */
+typedef struct _bench_rng_t {
+  uint64_t state; /**< Current state, never 0 */
+} bench_rng_t;
+
+/**
+ * @brief Length of the generated keys, drawn uniformly from [min, max]
+ */
+typedef struct _bench_key_len_t {
+  uint64_t min; /**< Shortest key */
+  uint64_t max; /**< Longest key */
+} bench_key_len_t;
+
+/**
+ * @brief Value of an entry, null-terminated except for blobs
+ */
+typedef struct _bench_value_t {
+  uint8_t *bytes; /**< Value in the text form taken by put_entry_span() */
+  uint64_t len;   /**< Number of bytes of the value */
+} bench_value_t;
+
+/**
+ * @brief Zipfian distribution over [0, items), item 0 being the most popular
+ *
+ * Uses the rejection-free method of Gray et al., "Quickly Generating
+ * Billion-Record Synthetic Databases", as the YCSB core workloads do.
+ */
+typedef struct _bench_zipf_t {
+  uint64_t items;  /**< Number of items */
+  double theta;    /**< Skew, 0.99 in YCSB */
+  double zetan;    /**< Zeta of the number of items */
+  double alpha;    /**< 1 / (1 - theta) */
+  double eta;      /**< Correction of the tail of the distribution */
+  double half_pow; /**< 1 + 0.5^theta, the bound of the second item */
+} bench_zipf_t;
+
+/**
+ * @brief Hardware counters of the calling thread, read with perf_event_open
+ *
+ * Counts cycles, instructions, L1 data cache read misses, last level cache
+ * misses and branch misses in user space. Counters the PMU or the kernel do
+ * not provide, e.g. in containers or virtual machines, are left out, and all
+ * of them when perf events are not available at all.
+ */
+typedef struct _bench_perf_t {
+  int fds[BENCH_PERF_COUNTERS];           /**< Event of each counter, -1 if unavailable */
+  uint64_t values[BENCH_PERF_COUNTERS];   /**< Counts of the last measurement */
+  uint64_t available;                     /**< Number of counters opened */
+} bench_perf_t;
+
+/**
+ * @brief Seeds a generator
+ *
+ * @param rng Pointer to the generator
+ * @param seed Any value, 0 included
+ */
+extern void bench_rng_seed(bench_rng_t *rng, uint64_t seed);
+
+/**
+ * @brief Returns the next 64 random bits
+ *
+ * @param rng Pointer to the generator
+ * @return uint64_t Random value
+ */
+extern uint64_t bench_rng_next(bench_rng_t *rng);
+
+/**
+ * @brief Returns a random value in [0, bound)
+ *
+ * @param rng Pointer to the generator
+ * @param bound Exclusive upper bound, must not be 0
+ * @return uint64_t Random value
+ */
+extern uint64_t bench_rng_below(bench_rng_t *rng, uint64_t bound);
+
+/**
+ * @brief Returns a random double in [0, 1)
+ *
+ * @param rng Pointer to the generator
+ * @return double Random value
+ */
+extern double bench_rng_double(bench_rng_t *rng);
+
+/**
+ * @brief Prepares a Zipfian distribution
+ *
+ * @param zipf Pointer to the distribution
+ * @param items Number of items, at least 2
+ * @param theta Skew between 0 and 1 excluded
+ *
+ * @note Takes time linear in the number of items to compute their zeta
+ */
+extern void bench_zipf_init(bench_zipf_t *zipf, uint64_t items, double theta);
+
+/**
+ * @brief Draws an item from a Zipfian distribution
+ *
+ * @param zipf Pointer to the distribution
+ * @param rng Pointer to the generator
+ * @return uint64_t Item in [0, items)
+ */
+extern uint64_t bench_zipf_next(bench_zipf_t *zipf, bench_rng_t *rng);
+
+/**
+ * @brief Returns the 64-bit FNV-1a hash of a value
+ *
+ * Spreads the popular items of a Zipfian distribution over the key space.
+ *
+ * @param value Value to hash
+ * @return uint64_t Hash of the 8 bytes of the value
+ */
+extern uint64_t bench_fnv64(uint64_t value);
+
+/**
+ * @brief Writes the key of a record number
+ *
+ * The key is the prefix, the record number in base 36 and filler
+ * characters up to a length drawn from key_len, so keys of different
+ * records or prefixes never collide.
+ *
+ * @param dest Buffer of at least SM_BUFFER_SIZE bytes
+ * @param prefix Prefix character, e.g. 'k' for stored keys and 'm' for misses
+ * @param record Record number
+ * @param key_len Length distribution of the keys
+ * @param rng Generator of the length and the filler
+ */
+extern void bench_make_key(uint8_t *dest, uint8_t prefix, uint64_t record,
+                           bench_key_len_t key_len, bench_rng_t *rng);
+
+/**
+ * @brief Generates a random value of a type
+ *
+ * @param dest Pointer receiving the value, its bytes are allocated
+ * @param type Name of the type, e.g. "int32" or "blob"
+ * @param size Size of string and blob values
+ * @param rng Generator of the value
+ * @return int64_t 0 on success, -1 for an unknown type or on failure
+ *
+ * @note The caller is responsible for freeing dest->bytes
+ */
+extern int64_t bench_make_value(bench_value_t *dest, uint8_t *type, uint64_t size, bench_rng_t *rng);
+
+/**
+ * @brief Records a latency into a histogram
+ *
+ * @param histogram Pointer to the histogram
+ * @param ns Latency in nanoseconds
+ */
+extern void bench_record(kv_histogram_t *histogram, uint64_t ns);
+
+/**
+ * @brief Adds the counts of a histogram to another
+ *
+ * @param dest Pointer to the histogram receiving the counts
+ * @param source Pointer to the histogram to add
+ */
+extern void bench_merge(kv_histogram_t *dest, kv_histogram_t *source);
+
+/**
+ * @brief Writes the throughput and latency percentiles of a histogram as
+ *        JSON members, without braces
+ *
+ * @param file Stream to write to
+ * @param histogram Pointer to the histogram of the measured operations
+ * @param seconds Wall-clock duration of the measurement
+ */
+extern void bench_write_latency_json(FILE *file, kv_histogram_t *histogram, double seconds);
+
+/**
+ * @brief Removes a file or a directory and its contents
+ *
+ * @param path Path to remove, missing paths are ignored
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t bench_remove_tree(uint8_t *path);
+
+/**
+ * @brief Returns the size of a file, or of all the files under a directory
+ *
+ * @param path Path of the file or directory
+ * @return uint64_t Number of bytes, 0 if the path does not exist
+ */
+extern uint64_t bench_path_bytes(uint8_t *path);
+
+/**
+ * @brief Evicts a file, or all the files under a directory, from the page cache
+ *
+ * The files are synced first, since only clean pages can be dropped.
+ *
+ * @param path Path of the file or directory
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t bench_drop_cache(uint8_t *path);
+
+/**
+ * @brief Reads a file, or all the files under a directory, into the page cache
+ *
+ * @param path Path of the file or directory
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t bench_warm_cache(uint8_t *path);
+
+/**
+ * @brief Opens the hardware counters of the calling thread
+ *
+ * @param perf Pointer to the counters
+ * @return uint64_t Number of counters available, 0 if perf events are not
+ *                  supported or not allowed
+ *
+ * @note Close the counters using bench_perf_close()
+ */
+extern uint64_t bench_perf_open(bench_perf_t *perf);
+
+/**
+ * @brief Resets and starts the counters
+ *
+ * @param perf Pointer to the counters
+ */
+extern void bench_perf_start(bench_perf_t *perf);
+
+/**
+ * @brief Stops the counters and reads their values
+ *
+ * Values are scaled up when the kernel multiplexed the counters.
+ *
+ * @param perf Pointer to the counters
+ */
+extern void bench_perf_stop(bench_perf_t *perf);
+
+/**
+ * @brief Writes the counts of the last measurement as a JSON member "perf",
+ *        without a leading comma
+ *
+ * The member holds the total and per-operation count of each available
+ * counter, and the instructions per cycle, or null if no counter is available.
+ *
+ * @param file Stream to write to
+ * @param perf Pointer to the counters
+ * @param ops Number of operations measured
+ */
+extern void bench_perf_write_json(FILE *file, bench_perf_t *perf, uint64_t ops);
+
+/**
+ * @brief Closes the counters
+ *
+ * @param perf Pointer to the counters
+ */
+extern void bench_perf_close(bench_perf_t *perf);
+
+/**
+ * @brief Splits a comma-separated list in place
+ *
+ * @param list List to split, its commas are replaced by NULs
+ * @param items Array receiving the items
+ * @param max_items Size of the items array
+ * @return uint64_t Number of items
+ */
+extern uint64_t bench_split(uint8_t *list, uint8_t **items, uint64_t max_items);
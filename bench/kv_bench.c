@@ -0,0 +1,346 @@
+/**
+ * @file kv_bench.c
+ * @brief Microbenchmark of every operation of every storage backend
+ *
+ * For each combination of backend, key count and value type, the benchmark
+ * fills a database with put, then measures get of stored keys, get of
+ * missing keys, update, save, load and delete, one phase at a time. Keys and
+ * values are generated before each phase so only the database calls are
+ * timed. Results are written as a JSON array with one object per phase,
+ * holding the throughput and latency percentiles of the phase.
+ *
+ * With --perf, the hardware counters of each phase (cycles, instructions,
+ * cache and branch misses) are added to its object, in total and per
+ * operation. They include the two clock reads timing each operation. When
+ * the PMU is not available, e.g. in containers, "perf" is null.
+ *
+ * Usage:
+ *   kv_bench [--backends L,H,C,B,T] [--keys 1000,10000] [--key-len 16|8-24]
+ *            [--types int32,double,string] [--value-size 64]
+ *            [--dir /tmp/kv_bench] [--seed 1] [--perf] [--output results.json]
+ */
+#include "bench_util.h"
+
+#include <getopt.h>
+
+
+#define BENCH_MAX_ITEMS 16
+
+/**
+ * @brief Parameters of one run of the benchmark phases
+ */
+typedef struct _bench_config_t {
+  uint8_t *backend;        /**< KV_STORAGE_STRUCTURE_* of the database */
+  uint64_t keys;           /**< Number of stored keys */
+  bench_key_len_t key_len; /**< Length distribution of the keys */
+  uint8_t *type;           /**< Type of the values */
+  uint64_t value_size;     /**< Size of string and blob values */
+  uint8_t *dir;            /**< Directory of the files of the run */
+  uint64_t seed;           /**< Seed of the keys and values */
+} bench_config_t;
+
+/**
+ * @brief Keys and values of a run
+ */
+typedef struct _bench_data_t {
+  uint8_t (*keys)[SM_BUFFER_SIZE];   /**< Stored keys */
+  uint8_t (*misses)[SM_BUFFER_SIZE]; /**< Keys that are never stored */
+  bench_value_t *values;             /**< Values of the first put of each key */
+  bench_value_t *updates;            /**< Values of the update of each key */
+  uint64_t *order;                   /**< Random permutation of the keys */
+} bench_data_t;
+
+static bool first_result = true;
+static bool use_perf = false;
+static bench_perf_t perf;
+
+static bool is_disk_backend(uint8_t *backend) {
+  return strcmp(backend, KV_STORAGE_STRUCTURE_BITCASK) == 0 ||
+         strcmp(backend, KV_STORAGE_STRUCTURE_LSM) == 0;
+}
+
+static void write_result(FILE *file, bench_config_t *config, uint8_t *op,
+                         kv_histogram_t *histogram, double seconds) {
+  fprintf(file, "%s  {\"backend\": \"%s\", \"keys\": %" PRIu64 ", "
+                "\"key_len_min\": %" PRIu64 ", \"key_len_max\": %" PRIu64 ", "
+                "\"type\": \"%s\", \"value_size\": %" PRIu64 ", \"op\": \"%s\", ",
+          first_result ? "" : ",\n", config->backend, config->keys,
+          config->key_len.min, config->key_len.max, config->type, config->value_size, op);
+  bench_write_latency_json(file, histogram, seconds);
+  if (use_perf) {
+    fprintf(file, ", ");
+    bench_perf_write_json(file, &perf, histogram->count);
+  }
+  fprintf(file, "}");
+  first_result = false;
+}
+
+static void free_data(bench_data_t *data, uint64_t count) {
+  for (uint64_t idx = 0; idx < count; idx++) {
+    if (data->values != NULL) free(data->values[idx].bytes);
+    if (data->updates != NULL) free(data->updates[idx].bytes);
+  }
+  free(data->keys);
+  free(data->misses);
+  free(data->values);
+  free(data->updates);
+  free(data->order);
+}
+
+static int64_t make_data(bench_data_t *data, bench_config_t *config) {
+  uint64_t count = config->keys;
+  data->keys = malloc(count * SM_BUFFER_SIZE);
+  data->misses = malloc(count * SM_BUFFER_SIZE);
+  data->values = calloc(count, sizeof(bench_value_t));
+  data->updates = calloc(count, sizeof(bench_value_t));
+  data->order = malloc(count * sizeof(uint64_t));
+  if (data->keys == NULL || data->misses == NULL || data->values == NULL ||
+      data->updates == NULL || data->order == NULL) {
+    free_data(data, 0);
+    return -1;
+  }
+
+  bench_rng_t rng;
+  bench_rng_seed(&rng, config->seed);
+  for (uint64_t idx = 0; idx < count; idx++) {
+    bench_make_key(data->keys[idx], 'k', idx, config->key_len, &rng);
+    bench_make_key(data->misses[idx], 'm', idx, config->key_len, &rng);
+    if (bench_make_value(&data->values[idx], config->type, config->value_size, &rng) < 0 ||
+        bench_make_value(&data->updates[idx], config->type, config->value_size, &rng) < 0) {
+      free_data(data, count);
+      return -1;
+    }
+    data->order[idx] = idx;
+  }
+
+  /* Fisher-Yates, so gets and deletes do not follow the insertion order */
+  for (uint64_t idx = count; idx > 1; idx--) {
+    uint64_t other = bench_rng_below(&rng, idx);
+    uint64_t swap = data->order[idx - 1];
+    data->order[idx - 1] = data->order[other];
+    data->order[other] = swap;
+  }
+  return 0;
+}
+
+static db_t *open_db(bench_config_t *config, uint8_t *db_dir, bool fresh) {
+  if (fresh && bench_remove_tree(db_dir) < 0) {
+    fprintf(stderr, "Error: Failed to remove %s\n", db_dir);
+    return NULL;
+  }
+
+  db_t *db = create_db(config->backend);
+  if (db == NULL) {
+    return NULL;
+  }
+  if (is_disk_backend(config->backend) && load_db(db, db_dir) < 0) {
+    free_db(db);
+    return NULL;
+  }
+  return db;
+}
+
+static int64_t run_config(FILE *output, bench_config_t *config) {
+  bench_data_t data;
+  if (make_data(&data, config) < 0) {
+    fprintf(stderr, "Error: Failed to generate the data of type %s\n", config->type);
+    return -1;
+  }
+
+  uint8_t db_dir[BG_BUFFER_SIZE];
+  uint8_t text_path[BG_BUFFER_SIZE];
+  snprintf(db_dir, BG_BUFFER_SIZE, "%s/%s_%" PRIu64 "_%s", config->dir, config->backend, config->keys, config->type);
+  snprintf(text_path, BG_BUFFER_SIZE, "%s.db", db_dir);
+
+  kv_histogram_t *histogram = malloc(sizeof(kv_histogram_t));
+  db_t *db = histogram != NULL ? open_db(config, db_dir, true) : NULL;
+  if (db == NULL) {
+    fprintf(stderr, "Error: Failed to open a database of type %s\n", config->backend);
+    free(histogram);
+    free_data(&data, config->keys);
+    return -1;
+  }
+
+  int64_t result = 0;
+  uint64_t count = config->keys;
+  uint64_t phase_start;
+  uint64_t op_start;
+
+#define BENCH_PHASE(name, call)                                                   \
+  do {                                                                            \
+    memset(histogram, 0, sizeof(kv_histogram_t));                                 \
+    if (use_perf) bench_perf_start(&perf);                                        \
+    phase_start = stats_now_ns();                                                 \
+    for (uint64_t idx = 0; idx < count && result == 0; idx++) {                   \
+      uint64_t record = data.order[idx];                                          \
+      op_start = stats_now_ns();                                                  \
+      call;                                                                       \
+      bench_record(histogram, stats_now_ns() - op_start);                         \
+    }                                                                             \
+    if (use_perf) bench_perf_stop(&perf);                                         \
+    write_result(output, config, name, histogram, (stats_now_ns() - phase_start) / 1e9); \
+  } while (0)
+
+  /* Puts go in key order, the other phases in random order */
+  BENCH_PHASE("put", record = idx;
+              result = put_entry_span(db, data.keys[record], data.values[record].bytes,
+                                      data.values[record].len, config->type));
+  BENCH_PHASE("get_hit", result = get_entry(db, data.keys[record]) != NULL ? 0 : -1);
+  BENCH_PHASE("get_miss", result = get_entry(db, data.misses[record]) == NULL ? 0 : -1);
+  BENCH_PHASE("update", result = put_entry_span(db, data.keys[record], data.updates[record].bytes,
+                                                data.updates[record].len, config->type));
+
+  if (result == 0) {
+    memset(histogram, 0, sizeof(kv_histogram_t));
+    if (use_perf) bench_perf_start(&perf);
+    op_start = stats_now_ns();
+    result = save_db(db, text_path);
+    bench_record(histogram, stats_now_ns() - op_start);
+    if (use_perf) bench_perf_stop(&perf);
+    write_result(output, config, "save", histogram, histogram->sum_ns / 1e9);
+  }
+
+  /* Disk backends reopen their directory, the others load the saved text file */
+  if (result == 0) {
+    free_db(db);
+    memset(histogram, 0, sizeof(kv_histogram_t));
+    if (use_perf) bench_perf_start(&perf);
+    op_start = stats_now_ns();
+    db = open_db(config, db_dir, false);
+    if (db != NULL && !is_disk_backend(config->backend)) {
+      result = load_db(db, text_path);
+    }
+    bench_record(histogram, stats_now_ns() - op_start);
+    if (use_perf) bench_perf_stop(&perf);
+    if (db == NULL) {
+      result = -1;
+    }
+    else {
+      write_result(output, config, "load", histogram, histogram->sum_ns / 1e9);
+    }
+  }
+
+  if (result == 0) {
+    BENCH_PHASE("delete", result = delete_entry(db, data.keys[record]));
+  }
+#undef BENCH_PHASE
+
+  if (result != 0) {
+    fprintf(stderr, "Error: Benchmark of backend %s with %" PRIu64 " keys of type %s failed\n",
+            config->backend, config->keys, config->type);
+  }
+
+  free_db(db);
+  bench_remove_tree(db_dir);
+  remove(text_path);
+  free(histogram);
+  free_data(&data, count);
+  return result;
+}
+
+static void print_usage(char *program) {
+  fprintf(stderr, "Usage: %s [--backends L,H,C,B,T] [--keys 1000,10000] [--key-len 16|8-24]\n"
+                  "       [--types int32,double,string] [--value-size 64] [--dir /tmp/kv_bench]\n"
+                  "       [--seed 1] [--perf] [--output results.json]\n", program);
+}
+
+int main(int argc, char **argv) {
+  uint8_t backends_arg[BG_BUFFER_SIZE] = "L,H,C,B,T";
+  uint8_t keys_arg[BG_BUFFER_SIZE] = "1000,10000";
+  uint8_t types_arg[BG_BUFFER_SIZE] = "int32,double,string";
+  bench_config_t config = {
+    .key_len = { 16, 16 },
+    .value_size = 64,
+    .dir = "/tmp/kv_bench",
+    .seed = 1
+  };
+  uint8_t *output_path = NULL;
+
+  struct option options[] = {
+    { "backends", required_argument, NULL, 'b' },
+    { "keys", required_argument, NULL, 'k' },
+    { "key-len", required_argument, NULL, 'l' },
+    { "types", required_argument, NULL, 't' },
+    { "value-size", required_argument, NULL, 'v' },
+    { "dir", required_argument, NULL, 'd' },
+    { "seed", required_argument, NULL, 's' },
+    { "output", required_argument, NULL, 'o' },
+    { "perf", no_argument, NULL, 'p' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "b:k:l:t:v:d:s:o:p", options, NULL)) != -1) {
+    switch (option) {
+    case 'b': snprintf(backends_arg, BG_BUFFER_SIZE, "%s", optarg); break;
+    case 'k': snprintf(keys_arg, BG_BUFFER_SIZE, "%s", optarg); break;
+    case 't': snprintf(types_arg, BG_BUFFER_SIZE, "%s", optarg); break;
+    case 'v': config.value_size = strtoull(optarg, NULL, 10); break;
+    case 'd': config.dir = optarg; break;
+    case 's': config.seed = strtoull(optarg, NULL, 10); break;
+    case 'o': output_path = optarg; break;
+    case 'p': use_perf = true; break;
+    case 'l':
+      if (sscanf(optarg, "%" SCNu64 "-%" SCNu64, &config.key_len.min, &config.key_len.max) == 1) {
+        config.key_len.max = config.key_len.min;
+      }
+      break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (config.key_len.min == 0 || config.key_len.max < config.key_len.min ||
+      config.key_len.max > BENCH_MAX_KEY_LEN) {
+    fprintf(stderr, "Error: Key lengths must be between 1 and %d\n", BENCH_MAX_KEY_LEN);
+    return 1;
+  }
+
+  uint8_t *backends[BENCH_MAX_ITEMS];
+  uint8_t *key_counts[BENCH_MAX_ITEMS];
+  uint8_t *types[BENCH_MAX_ITEMS];
+  uint64_t backend_count = bench_split(backends_arg, backends, BENCH_MAX_ITEMS);
+  uint64_t key_count_count = bench_split(keys_arg, key_counts, BENCH_MAX_ITEMS);
+  uint64_t type_count = bench_split(types_arg, types, BENCH_MAX_ITEMS);
+
+  if (mkdir(config.dir, 0755) < 0 && errno != EEXIST) {
+    fprintf(stderr, "Error: Failed to create %s\n", config.dir);
+    return 1;
+  }
+
+  if (use_perf && bench_perf_open(&perf) == 0) {
+    fprintf(stderr, "Warning: Hardware counters are not available, perf is reported as null\n");
+  }
+
+  FILE *output = output_path != NULL ? fopen(output_path, "w") : stdout;
+  if (output == NULL) {
+    fprintf(stderr, "Error: Failed to open %s\n", output_path);
+    return 1;
+  }
+
+  int64_t failures = 0;
+  fprintf(output, "[\n");
+  for (uint64_t backend_idx = 0; backend_idx < backend_count; backend_idx++) {
+    for (uint64_t keys_idx = 0; keys_idx < key_count_count; keys_idx++) {
+      for (uint64_t type_idx = 0; type_idx < type_count; type_idx++) {
+        config.backend = backends[backend_idx];
+        config.keys = strtoull(key_counts[keys_idx], NULL, 10);
+        config.type = types[type_idx];
+        if (config.keys == 0 || run_config(output, &config) < 0) {
+          failures++;
+        }
+        fflush(output);
+      }
+    }
+  }
+  fprintf(output, "\n]\n");
+
+  if (use_perf) {
+    bench_perf_close(&perf);
+  }
+  if (output != stdout) {
+    fclose(output);
+  }
+  return failures == 0 ? 0 : 1;
+}
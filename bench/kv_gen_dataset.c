@@ -0,0 +1,253 @@
+/**
+ * @file kv_gen_dataset.c
+ * @brief Generator of synthetic database files
+ *
+ * Writes a database of any number of entries with a weighted mix of value
+ * types and uniform key and value length distributions, as a text file in
+ * the format of save_db() or as a bitcask or LSM tree directory. Text files
+ * are streamed one entry at a time, so their size is only limited by the
+ * disk. The same seed always produces the same dataset.
+ *
+ * Usage:
+ *   kv_gen_dataset --output PATH [--format text|bitcask|lsm] [--entries 1000000]
+ *                  [--types int32:4,double:2,string:3,blob:1] [--key-len 16|8-24]
+ *                  [--value-size 64|16-256] [--seed 1]
+ */
+#include "bench_util.h"
+
+#include <getopt.h>
+
+
+#define GEN_MAX_TYPES 16
+/** @brief Entries between two progress reports */
+#define GEN_PROGRESS_ENTRIES 1000000
+
+/**
+ * @brief Value type of the mix and its weight
+ */
+typedef struct _gen_type_t {
+  uint8_t *name;   /**< Name of the type, e.g. "int32" */
+  uint64_t weight; /**< Relative frequency of the type */
+} gen_type_t;
+
+/**
+ * @brief Options of the generator
+ */
+typedef struct _gen_config_t {
+  uint8_t *output;              /**< File or directory to write */
+  uint8_t *format;              /**< "text", "bitcask" or "lsm" */
+  uint64_t entries;             /**< Number of entries */
+  gen_type_t types[GEN_MAX_TYPES]; /**< Mix of value types */
+  uint64_t type_count;          /**< Number of types of the mix */
+  uint64_t total_weight;        /**< Sum of the weights of the types */
+  bench_key_len_t key_len;      /**< Length distribution of the keys */
+  bench_key_len_t value_size;   /**< Size distribution of string and blob values */
+  uint64_t seed;                /**< Seed of the dataset */
+} gen_config_t;
+
+/**
+ * @brief Destination of the generated entries
+ */
+typedef struct _gen_writer_t {
+  FILE *file;   /**< Text file, NULL for directory formats */
+  FILE *stream; /**< Checksum stream writing to file */
+  db_t *db;     /**< Bitcask or LSM tree database, NULL for text */
+} gen_writer_t;
+
+static int64_t parse_types(uint8_t *list, gen_config_t *config) {
+  uint8_t *items[GEN_MAX_TYPES];
+  config->type_count = bench_split(list, items, GEN_MAX_TYPES);
+  config->total_weight = 0;
+  for (uint64_t idx = 0; idx < config->type_count; idx++) {
+    uint8_t *weight = strchr(items[idx], ':');
+    if (weight != NULL) {
+      *weight++ = '\0';
+    }
+    config->types[idx].name = items[idx];
+    config->types[idx].weight = weight != NULL ? strtoull(weight, NULL, 10) : 1;
+    if (map_datatype_from_str(items[idx]) < 0) {
+      fprintf(stderr, "Error: Unknown type %s\n", items[idx]);
+      return -1;
+    }
+    config->total_weight += config->types[idx].weight;
+  }
+  return config->total_weight > 0 ? 0 : -1;
+}
+
+static bool parse_range(uint8_t *arg, bench_key_len_t *range) {
+  int count = sscanf(arg, "%" SCNu64 "-%" SCNu64, &range->min, &range->max);
+  if (count == 1) {
+    range->max = range->min;
+  }
+  return count >= 1 && range->max >= range->min;
+}
+
+static uint8_t *pick_type(gen_config_t *config, bench_rng_t *rng) {
+  uint64_t choice = bench_rng_below(rng, config->total_weight);
+  for (uint64_t idx = 0; idx < config->type_count; idx++) {
+    if (choice < config->types[idx].weight) {
+      return config->types[idx].name;
+    }
+    choice -= config->types[idx].weight;
+  }
+  return config->types[config->type_count - 1].name;
+}
+
+static int64_t open_writer(gen_writer_t *writer, gen_config_t *config) {
+  memset(writer, 0, sizeof(gen_writer_t));
+  if (bench_remove_tree(config->output) < 0) {
+    fprintf(stderr, "Error: Failed to remove %s\n", config->output);
+    return -1;
+  }
+
+  if (strcmp(config->format, "text") == 0) {
+    writer->file = fopen(config->output, "w");
+    writer->stream = writer->file != NULL ? open_checksum_writer(writer->file, KV_CHECKSUM_BLOCK_LINES) : NULL;
+    if (writer->stream == NULL) {
+      if (writer->file != NULL) fclose(writer->file);
+      fprintf(stderr, "Error: Failed to open %s\n", config->output);
+      return -1;
+    }
+    return 0;
+  }
+
+  uint8_t *backend = strcmp(config->format, "bitcask") == 0 ? KV_STORAGE_STRUCTURE_BITCASK :
+                     strcmp(config->format, "lsm") == 0 ? KV_STORAGE_STRUCTURE_LSM : NULL;
+  if (backend == NULL) {
+    fprintf(stderr, "Error: Unknown format %s\n", config->format);
+    return -1;
+  }
+
+  /* Generated files are synced once at the end, not after every put */
+  writer->db = create_db(backend);
+  if (writer->db == NULL ||
+      set_db_durability(writer->db, DB_DURABILITY_RELAXED) < 0 ||
+      load_db(writer->db, config->output) < 0) {
+    free_db(writer->db);
+    fprintf(stderr, "Error: Failed to open %s\n", config->output);
+    return -1;
+  }
+  return 0;
+}
+
+static int64_t write_value(gen_writer_t *writer, uint8_t *key, bench_value_t *value, uint8_t *type) {
+  if (writer->db != NULL) {
+    return put_entry_span(writer->db, key, value->bytes, value->len, type);
+  }
+
+  db_entry_t *entry = create_entry_span(key, value->bytes, value->len, type);
+  if (entry == NULL) {
+    return -1;
+  }
+  int64_t result = write_entry(writer->stream, entry);
+  free_entry(entry);
+  return result;
+}
+
+static int64_t close_writer(gen_writer_t *writer) {
+  int64_t result = 0;
+  if (writer->db != NULL) {
+    free_db(writer->db);
+  }
+  if (writer->stream != NULL && fclose(writer->stream) == EOF) {
+    result = -1;
+  }
+  if (writer->file != NULL && fclose(writer->file) == EOF) {
+    result = -1;
+  }
+  return result;
+}
+
+static void print_usage(char *program) {
+  fprintf(stderr, "Usage: %s --output PATH [--format text|bitcask|lsm] [--entries 1000000]\n"
+                  "       [--types int32:4,double:2,string:3,blob:1] [--key-len 16|8-24]\n"
+                  "       [--value-size 64|16-256] [--seed 1]\n", program);
+}
+
+int main(int argc, char **argv) {
+  uint8_t types_arg[BG_BUFFER_SIZE] = "int32:4,double:2,string:3,blob:1";
+  gen_config_t config = {
+    .output = NULL,
+    .format = "text",
+    .entries = 1000000,
+    .key_len = { 16, 16 },
+    .value_size = { 64, 64 },
+    .seed = 1
+  };
+
+  struct option options[] = {
+    { "output", required_argument, NULL, 'o' },
+    { "format", required_argument, NULL, 'f' },
+    { "entries", required_argument, NULL, 'n' },
+    { "types", required_argument, NULL, 't' },
+    { "key-len", required_argument, NULL, 'l' },
+    { "value-size", required_argument, NULL, 'v' },
+    { "seed", required_argument, NULL, 's' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  int option;
+  bool valid = true;
+  while ((option = getopt_long(argc, argv, "o:f:n:t:l:v:s:", options, NULL)) != -1) {
+    switch (option) {
+    case 'o': config.output = optarg; break;
+    case 'f': config.format = optarg; break;
+    case 'n': config.entries = strtoull(optarg, NULL, 10); break;
+    case 't': snprintf(types_arg, BG_BUFFER_SIZE, "%s", optarg); break;
+    case 'l': valid &= parse_range(optarg, &config.key_len); break;
+    case 'v': valid &= parse_range(optarg, &config.value_size); break;
+    case 's': config.seed = strtoull(optarg, NULL, 10); break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (config.output == NULL || !valid || parse_types(types_arg, &config) < 0 ||
+      config.key_len.min == 0 || config.key_len.max > BENCH_MAX_KEY_LEN) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  gen_writer_t writer;
+  if (open_writer(&writer, &config) < 0) {
+    return 1;
+  }
+
+  bench_rng_t rng;
+  bench_rng_seed(&rng, config.seed);
+  uint64_t start = stats_now_ns();
+  int64_t result = 0;
+  for (uint64_t record = 0; record < config.entries && result == 0; record++) {
+    uint8_t key[SM_BUFFER_SIZE];
+    bench_make_key(key, 'k', record, config.key_len, &rng);
+
+    uint8_t *type = pick_type(&config, &rng);
+    uint64_t size = config.value_size.min;
+    if (config.value_size.max > config.value_size.min) {
+      size += bench_rng_below(&rng, config.value_size.max - config.value_size.min + 1);
+    }
+
+    bench_value_t value;
+    result = bench_make_value(&value, type, size, &rng);
+    if (result == 0) {
+      result = write_value(&writer, key, &value, type);
+      free(value.bytes);
+    }
+
+    if ((record + 1) % GEN_PROGRESS_ENTRIES == 0) {
+      fprintf(stderr, "%" PRIu64 " entries written\n", record + 1);
+    }
+  }
+
+  if (close_writer(&writer) < 0 || result != 0) {
+    fprintf(stderr, "Error: Failed to write %s\n", config.output);
+    return 1;
+  }
+
+  double seconds = (stats_now_ns() - start) / 1e9;
+  uint64_t bytes = bench_path_bytes(config.output);
+  fprintf(stderr, "Wrote %" PRIu64 " entries, %.1f MB, to %s in %.2f s\n",
+          config.entries, bytes / 1e6, config.output, seconds);
+  return 0;
+}
@@ -0,0 +1,285 @@
+/**
+ * @file kv_io_bench.c
+ * @brief Throughput benchmark of load_db() and save_db()
+ *
+ * Loads a database file or directory, typically written by kv_gen_dataset,
+ * several times with a cold and with a warm page cache, then saves it as a
+ * text file as many times. Cold runs evict the files from the page cache
+ * before each load, warm runs read them once beforehand. Results are written
+ * as a JSON array with the mean and best durations of each variant, in MB/s
+ * and entries/s computed from the mean.
+ *
+ * With --perf, the hardware counters of the loads and saves are added to
+ * their objects, summed over the runs, in total and per entry. When the PMU
+ * is not available "perf" is null.
+ *
+ * Usage:
+ *   kv_io_bench --input PATH [--format text|bitcask|lsm] [--backend H]
+ *               [--runs 3] [--cache cold,warm] [--save-path /tmp/kv_io_bench.db]
+ *               [--perf] [--output results.json]
+ */
+#include "bench_util.h"
+
+#include <getopt.h>
+
+
+/**
+ * @brief Options of the benchmark
+ */
+typedef struct _io_config_t {
+  uint8_t *input;     /**< File or directory to load */
+  uint8_t *format;    /**< "text", "bitcask" or "lsm" */
+  uint8_t *backend;   /**< Storage loading the text files */
+  uint64_t runs;      /**< Timed runs of each variant */
+  uint8_t *save_path; /**< Text file written by the save runs */
+} io_config_t;
+
+/**
+ * @brief Durations of the runs of one variant
+ */
+typedef struct _io_result_t {
+  uint64_t runs;      /**< Number of runs */
+  double seconds;     /**< Sum of the durations */
+  double min_seconds; /**< Best duration */
+  bench_perf_t perf;  /**< Hardware counters summed over the runs */
+} io_result_t;
+
+static bool first_result = true;
+static bool use_perf = false;
+static bench_perf_t perf;
+
+static void start_run() {
+  if (use_perf) bench_perf_start(&perf);
+}
+
+static void stop_run(io_result_t *result) {
+  if (!use_perf) return;
+
+  bench_perf_stop(&perf);
+  for (uint64_t counter = 0; counter < BENCH_PERF_COUNTERS; counter++) {
+    result->perf.fds[counter] = perf.fds[counter];
+    result->perf.values[counter] += perf.values[counter];
+  }
+  result->perf.available = perf.available;
+}
+
+static void add_run(io_result_t *result, double seconds) {
+  if (result->runs == 0 || seconds < result->min_seconds) {
+    result->min_seconds = seconds;
+  }
+  result->runs++;
+  result->seconds += seconds;
+}
+
+static void write_result(FILE *file, io_config_t *config, uint8_t *op, uint8_t *cache,
+                         uint64_t bytes, uint64_t entries, io_result_t *result) {
+  double mean = result->runs > 0 ? result->seconds / result->runs : 0;
+  fprintf(file, "%s  {\"input\": \"%s\", \"format\": \"%s\", \"backend\": \"%s\", \"op\": \"%s\", ",
+          first_result ? "" : ",\n", config->input, config->format, config->backend, op);
+  if (cache != NULL) {
+    fprintf(file, "\"cache\": \"%s\", ", cache);
+  }
+  else {
+    fprintf(file, "\"cache\": null, ");
+  }
+  fprintf(file, "\"runs\": %" PRIu64 ", \"bytes\": %" PRIu64 ", \"entries\": %" PRIu64 ", "
+                "\"mean_seconds\": %.6f, \"min_seconds\": %.6f, \"mb_per_sec\": %.1f, "
+                "\"entries_per_sec\": %.1f",
+          result->runs, bytes, entries, mean, result->min_seconds,
+          mean > 0 ? bytes / 1e6 / mean : 0, mean > 0 ? entries / mean : 0);
+  if (use_perf) {
+    fprintf(file, ", ");
+    bench_perf_write_json(file, &result->perf, entries * result->runs);
+  }
+  fprintf(file, "}");
+  first_result = false;
+}
+
+static int64_t count_saved_entries(uint8_t *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+
+  /* Checksum and comment lines start with '#' */
+  int64_t entries = 0;
+  bool line_start = true;
+  uint8_t buffer[1 << 16];
+  uint64_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    for (uint64_t idx = 0; idx < count; idx++) {
+      if (line_start && buffer[idx] != '#' && buffer[idx] != '\n') {
+        entries++;
+      }
+      line_start = buffer[idx] == '\n';
+    }
+  }
+  fclose(file);
+  return entries;
+}
+
+static db_t *timed_load(io_config_t *config, double *seconds, io_result_t *run_result) {
+  db_t *db = create_db(config->backend);
+  if (db == NULL) {
+    return NULL;
+  }
+
+  if (run_result != NULL) start_run();
+  uint64_t start = stats_now_ns();
+  int64_t result = load_db(db, config->input);
+  *seconds = (stats_now_ns() - start) / 1e9;
+  if (run_result != NULL) stop_run(run_result);
+  if (result < 0) {
+    fprintf(stderr, "Error: Failed to load %s\n", config->input);
+    free_db(db);
+    return NULL;
+  }
+  return db;
+}
+
+static void print_usage(char *program) {
+  fprintf(stderr, "Usage: %s --input PATH [--format text|bitcask|lsm] [--backend H]\n"
+                  "       [--runs 3] [--cache cold,warm] [--save-path /tmp/kv_io_bench.db]\n"
+                  "       [--perf] [--output results.json]\n", program);
+}
+
+int main(int argc, char **argv) {
+  uint8_t cache_arg[BG_BUFFER_SIZE] = "cold,warm";
+  io_config_t config = {
+    .input = NULL,
+    .format = "text",
+    .backend = KV_STORAGE_STRUCTURE_HASH,
+    .runs = 3,
+    .save_path = "/tmp/kv_io_bench.db"
+  };
+  uint8_t *output_path = NULL;
+
+  struct option options[] = {
+    { "input", required_argument, NULL, 'i' },
+    { "format", required_argument, NULL, 'f' },
+    { "backend", required_argument, NULL, 'b' },
+    { "runs", required_argument, NULL, 'r' },
+    { "cache", required_argument, NULL, 'c' },
+    { "save-path", required_argument, NULL, 'p' },
+    { "output", required_argument, NULL, 'o' },
+    { "perf", no_argument, NULL, 'P' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "i:f:b:r:c:p:o:P", options, NULL)) != -1) {
+    switch (option) {
+    case 'i': config.input = optarg; break;
+    case 'f': config.format = optarg; break;
+    case 'b': config.backend = optarg; break;
+    case 'r': config.runs = strtoull(optarg, NULL, 10); break;
+    case 'c': snprintf(cache_arg, BG_BUFFER_SIZE, "%s", optarg); break;
+    case 'p': config.save_path = optarg; break;
+    case 'o': output_path = optarg; break;
+    case 'P': use_perf = true; break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  /* Binary formats are directories opened by their own storage */
+  if (strcmp(config.format, "bitcask") == 0) {
+    config.backend = KV_STORAGE_STRUCTURE_BITCASK;
+  }
+  else if (strcmp(config.format, "lsm") == 0) {
+    config.backend = KV_STORAGE_STRUCTURE_LSM;
+  }
+  else if (strcmp(config.format, "text") != 0) {
+    fprintf(stderr, "Error: Unknown format %s\n", config.format);
+    return 1;
+  }
+
+  uint64_t input_bytes = config.input != NULL ? bench_path_bytes(config.input) : 0;
+  if (input_bytes == 0 || config.runs == 0) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  uint8_t *caches[2];
+  uint64_t cache_count = bench_split(cache_arg, caches, 2);
+
+  if (use_perf && bench_perf_open(&perf) == 0) {
+    fprintf(stderr, "Warning: Hardware counters are not available, perf is reported as null\n");
+  }
+
+  FILE *output = output_path != NULL ? fopen(output_path, "w") : stdout;
+  if (output == NULL) {
+    fprintf(stderr, "Error: Failed to open %s\n", output_path);
+    return 1;
+  }
+
+  /* The entries are counted on a first, untimed, save */
+  double seconds;
+  db_t *db = timed_load(&config, &seconds, NULL);
+  int64_t entries = db != NULL && save_db(db, config.save_path) == 0 ? count_saved_entries(config.save_path) : -1;
+  free_db(db);
+  if (entries < 0) {
+    fprintf(stderr, "Error: Failed to count the entries of %s\n", config.input);
+    return 1;
+  }
+
+  int64_t failures = 0;
+  fprintf(output, "[\n");
+  for (uint64_t cache_idx = 0; cache_idx < cache_count; cache_idx++) {
+    bool cold = strcmp(caches[cache_idx], "cold") == 0;
+    if (!cold && strcmp(caches[cache_idx], "warm") != 0) {
+      fprintf(stderr, "Error: Unknown cache variant %s\n", caches[cache_idx]);
+      failures++;
+      continue;
+    }
+
+    io_result_t result = { 0 };
+    for (uint64_t run = 0; run < config.runs; run++) {
+      if ((cold ? bench_drop_cache(config.input) : bench_warm_cache(config.input)) < 0) {
+        fprintf(stderr, "Warning: Failed to %s the page cache of %s\n",
+                cold ? "drop" : "warm", config.input);
+      }
+
+      db = timed_load(&config, &seconds, &result);
+      if (db == NULL) {
+        failures++;
+        break;
+      }
+      add_run(&result, seconds);
+      free_db(db);
+    }
+    write_result(output, &config, "load", caches[cache_idx], input_bytes, entries, &result);
+  }
+
+  /* Saves start from a loaded database, the page cache of the input does not matter */
+  io_result_t result = { 0 };
+  db = timed_load(&config, &seconds, NULL);
+  for (uint64_t run = 0; db != NULL && run < config.runs; run++) {
+    start_run();
+    uint64_t start = stats_now_ns();
+    int64_t saved = save_db(db, config.save_path);
+    double save_seconds = (stats_now_ns() - start) / 1e9;
+    stop_run(&result);
+    if (saved < 0) {
+      failures++;
+      break;
+    }
+    add_run(&result, save_seconds);
+  }
+  if (db == NULL) {
+    failures++;
+  }
+  free_db(db);
+  write_result(output, &config, "save", NULL, bench_path_bytes(config.save_path), entries, &result);
+  fprintf(output, "\n]\n");
+
+  remove(config.save_path);
+  if (use_perf) {
+    bench_perf_close(&perf);
+  }
+  if (output != stdout) {
+    fclose(output);
+  }
+  return failures == 0 ? 0 : 1;
+}
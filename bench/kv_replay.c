@@ -0,0 +1,218 @@
+/**
+ * @file kv_replay.c
+ * @brief Deterministic replay of operation traces
+ *
+ * Re-runs a trace recorded with start_db_trace() against fresh databases of
+ * any backend, either as fast as possible or at the original pace of the
+ * trace, optionally sped up. Results are written as a JSON array with the
+ * throughput and latency percentiles of the gets, puts and deletes of each
+ * backend, and one object with op "all". Operations whose status differs
+ * from the recorded one are counted as divergences, e.g. when the recorded
+ * database was loaded from a file before the trace started.
+ *
+ * Usage:
+ *   kv_replay --trace PATH [--backends L,H,C,B,T] [--timing fast|original]
+ *             [--speed 1.0] [--dir /tmp/kv_replay] [--output results.json]
+ */
+#include "bench_util.h"
+
+#include <getopt.h>
+
+
+#define REPLAY_MAX_BACKENDS 16
+
+static const char *op_names[KV_TRACE_OP_COUNT] = { "get", "put", "delete" };
+
+/**
+ * @brief Options of the replay
+ */
+typedef struct _replay_config_t {
+  uint8_t *trace;    /**< Path of the trace */
+  bool original;     /**< True to keep the timing of the trace */
+  double speed;      /**< Speed-up of the original timing */
+  uint8_t *dir;      /**< Directory of the bitcask and LSM tree databases */
+} replay_config_t;
+
+static bool first_result = true;
+
+static bool is_disk_backend(uint8_t *backend) {
+  return strcmp(backend, KV_STORAGE_STRUCTURE_BITCASK) == 0 ||
+         strcmp(backend, KV_STORAGE_STRUCTURE_LSM) == 0;
+}
+
+static void write_result(FILE *file, uint8_t *backend, replay_config_t *config, const char *op,
+                         uint64_t divergences, kv_histogram_t *histogram, double seconds) {
+  fprintf(file, "%s  {\"backend\": \"%s\", \"timing\": \"%s\", ",
+          first_result ? "" : ",\n", backend, config->original ? "original" : "fast");
+  if (config->original) {
+    fprintf(file, "\"speed\": %.3f, ", config->speed);
+  }
+  else {
+    fprintf(file, "\"speed\": null, ");
+  }
+  fprintf(file, "\"divergences\": %" PRIu64 ", \"op\": \"%s\", ", divergences, op);
+  bench_write_latency_json(file, histogram, seconds);
+  fprintf(file, "}");
+  first_result = false;
+}
+
+static void wait_until(uint64_t deadline_ns) {
+  struct timespec deadline = {
+    .tv_sec = deadline_ns / 1000000000ULL,
+    .tv_nsec = deadline_ns % 1000000000ULL
+  };
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
+
+static int64_t replay_record(db_t *db, kv_trace_record_t *record) {
+  uint8_t type[SM_BUFFER_SIZE] = "";
+  switch (record->op) {
+  case KV_TRACE_GET: {
+    kv_span_t value;
+    return get_entry_span(db, record->key, &value);
+  }
+  case KV_TRACE_PUT:
+    if (record->type >= 0) {
+      map_datatype_to_str(record->type, type, SM_BUFFER_SIZE);
+    }
+    return put_entry_span(db, record->key, record->value, record->value_len, type);
+  default:
+    return delete_entry(db, record->key);
+  }
+}
+
+static int64_t replay_backend(FILE *output, uint8_t *backend, replay_config_t *config) {
+  uint8_t db_dir[BG_BUFFER_SIZE];
+  snprintf(db_dir, BG_BUFFER_SIZE, "%s/%s", config->dir, backend);
+
+  kv_trace_reader_t *reader = open_trace_reader(config->trace);
+  kv_histogram_t *histograms = calloc(KV_TRACE_OP_COUNT + 1, sizeof(kv_histogram_t));
+  db_t *db = reader != NULL && histograms != NULL && bench_remove_tree(db_dir) == 0 ? create_db(backend) : NULL;
+  if (db == NULL || (is_disk_backend(backend) && load_db(db, db_dir) < 0)) {
+    fprintf(stderr, "Error: Failed to prepare the replay on backend %s\n", backend);
+    free_db(db);
+    free(histograms);
+    close_trace_reader(reader);
+    return -1;
+  }
+
+  uint64_t divergences[KV_TRACE_OP_COUNT] = { 0 };
+  kv_trace_record_t record;
+  int64_t result;
+  uint64_t replay_start = stats_now_ns();
+  while ((result = read_trace_record(reader, &record)) == 1) {
+    if (config->original) {
+      wait_until(replay_start + (uint64_t)(record.time_ns / config->speed));
+    }
+
+    uint64_t start = stats_now_ns();
+    int64_t status = replay_record(db, &record);
+    bench_record(&histograms[record.op], stats_now_ns() - start);
+    if (status != record.status) {
+      divergences[record.op]++;
+    }
+  }
+  double seconds = (stats_now_ns() - replay_start) / 1e9;
+
+  if (result == 0) {
+    kv_histogram_t *total = &histograms[KV_TRACE_OP_COUNT];
+    uint64_t total_divergences = 0;
+    for (int64_t op = 0; op < KV_TRACE_OP_COUNT; op++) {
+      if (histograms[op].count == 0) continue;
+      bench_merge(total, &histograms[op]);
+      total_divergences += divergences[op];
+      write_result(output, backend, config, op_names[op], divergences[op], &histograms[op], seconds);
+    }
+    write_result(output, backend, config, "all", total_divergences, total, seconds);
+  }
+  else {
+    fprintf(stderr, "Error: Replay of %s stopped at a damaged record\n", config->trace);
+  }
+
+  free_db(db);
+  bench_remove_tree(db_dir);
+  free(histograms);
+  close_trace_reader(reader);
+  return result;
+}
+
+static void print_usage(char *program) {
+  fprintf(stderr, "Usage: %s --trace PATH [--backends L,H,C,B,T] [--timing fast|original]\n"
+                  "       [--speed 1.0] [--dir /tmp/kv_replay] [--output results.json]\n", program);
+}
+
+int main(int argc, char **argv) {
+  uint8_t backends_arg[BG_BUFFER_SIZE] = "L,H,C,B,T";
+  replay_config_t config = {
+    .trace = NULL,
+    .original = false,
+    .speed = 1.0,
+    .dir = "/tmp/kv_replay"
+  };
+  uint8_t *output_path = NULL;
+
+  struct option options[] = {
+    { "trace", required_argument, NULL, 'i' },
+    { "backends", required_argument, NULL, 'b' },
+    { "timing", required_argument, NULL, 't' },
+    { "speed", required_argument, NULL, 'x' },
+    { "dir", required_argument, NULL, 'd' },
+    { "output", required_argument, NULL, 'o' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "i:b:t:x:d:o:", options, NULL)) != -1) {
+    switch (option) {
+    case 'i': config.trace = optarg; break;
+    case 'b': snprintf(backends_arg, BG_BUFFER_SIZE, "%s", optarg); break;
+    case 'x': config.speed = strtod(optarg, NULL); break;
+    case 'd': config.dir = optarg; break;
+    case 'o': output_path = optarg; break;
+    case 't':
+      if (strcmp(optarg, "original") != 0 && strcmp(optarg, "fast") != 0) {
+        fprintf(stderr, "Error: Unknown timing %s\n", optarg);
+        return 1;
+      }
+      config.original = strcmp(optarg, "original") == 0;
+      break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (config.trace == NULL || config.speed <= 0) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  uint8_t *backends[REPLAY_MAX_BACKENDS];
+  uint64_t backend_count = bench_split(backends_arg, backends, REPLAY_MAX_BACKENDS);
+
+  if (mkdir(config.dir, 0755) < 0 && errno != EEXIST) {
+    fprintf(stderr, "Error: Failed to create %s\n", config.dir);
+    return 1;
+  }
+
+  FILE *output = output_path != NULL ? fopen(output_path, "w") : stdout;
+  if (output == NULL) {
+    fprintf(stderr, "Error: Failed to open %s\n", output_path);
+    return 1;
+  }
+
+  int64_t failures = 0;
+  fprintf(output, "[\n");
+  for (uint64_t idx = 0; idx < backend_count; idx++) {
+    if (replay_backend(output, backends[idx], &config) < 0) {
+      failures++;
+    }
+    fflush(output);
+  }
+  fprintf(output, "\n]\n");
+
+  if (output != stdout) {
+    fclose(output);
+  }
+  return failures == 0 ? 0 : 1;
+}
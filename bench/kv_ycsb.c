@@ -0,0 +1,603 @@
+/**
+ * @file kv_ycsb.c
+ * @brief Driver of the YCSB core workloads
+ *
+ * Runs the core workloads of the Yahoo! Cloud Serving Benchmark through the
+ * public kv_controller.h API, so backends and locking modes can be compared
+ * on skewed access patterns:
+ *
+ *   A  50% reads, 50% updates             zipfian
+ *   B  95% reads, 5% updates              zipfian
+ *   C  100% reads                         zipfian
+ *   D  95% reads, 5% inserts              latest
+ *   E  95% scans, 5% inserts              zipfian, LSM tree only
+ *   F  50% reads, 50% read-modify-writes  zipfian
+ *
+ * Each run loads the records into a fresh database, lets every thread run a
+ * warmup whose latencies are dropped, then measures the operations of all
+ * threads together. Results are written as a JSON array with one object per
+ * operation type, and one with op "all" for the whole workload.
+ *
+ * The list and hash storages are not thread-safe, so their operations are
+ * serialized by a driver lock: "global" is a mutex, "rw" a read-write lock
+ * letting reads and scans run together. Cuckoo hash, bitcask and LSM tree
+ * databases synchronize internally and return entries owned by the calling
+ * thread, so they default to "none".
+ *
+ * Usage:
+ *   kv_ycsb [--workloads A,B,C,D,E,F] [--backends L,H,C,B,T] [--records 10000]
+ *           [--operations 100000] [--warmup 10000] [--threads 1]
+ *           [--distribution uniform|zipfian|latest] [--lock none|global|rw]
+ *           [--key-len 24] [--type string] [--value-size 100] [--max-scan 100]
+ *           [--dir /tmp/kv_ycsb] [--seed 1] [--output results.json]
+ */
+#include "bench_util.h"
+
+#include <getopt.h>
+#include <pthread.h>
+
+
+#define YCSB_MAX_ITEMS 16
+/** @brief Skew of the zipfian and latest distributions, as in YCSB */
+#define YCSB_ZIPF_THETA 0.99
+/** @brief Threads of a run, each with its own histograms */
+#define YCSB_MAX_THREADS 256
+
+/**
+ * @brief Operations of the core workloads
+ */
+enum YCSB_OP {
+  YCSB_READ,
+  YCSB_UPDATE,
+  YCSB_INSERT,
+  YCSB_SCAN,
+  YCSB_READ_MODIFY_WRITE,
+  YCSB_OP_COUNT
+};
+
+/**
+ * @brief Distributions of the records picked by the operations
+ */
+enum YCSB_DISTRIBUTION {
+  YCSB_UNIFORM,
+  YCSB_ZIPFIAN, /**< Popular records scattered over the key space */
+  YCSB_LATEST,  /**< Most recently inserted records are the most popular */
+  YCSB_DEFAULT  /**< Distribution of the workload */
+};
+
+/**
+ * @brief Locking of the database by the driver threads
+ */
+enum YCSB_LOCK {
+  YCSB_LOCK_NONE,
+  YCSB_LOCK_GLOBAL,
+  YCSB_LOCK_RW,
+  YCSB_LOCK_AUTO /**< none for thread-safe databases, rw for the others */
+};
+
+static const char *op_names[YCSB_OP_COUNT] = { "read", "update", "insert", "scan", "read_modify_write" };
+static const char *distribution_names[] = { "uniform", "zipfian", "latest" };
+static const char *lock_names[] = { "none", "global", "rw" };
+
+/**
+ * @brief Operation mix of a core workload
+ */
+typedef struct _ycsb_workload_t {
+  uint8_t name;                       /**< Letter of the workload */
+  double proportions[YCSB_OP_COUNT];  /**< Share of each YCSB_OP */
+  int64_t distribution;               /**< YCSB_DISTRIBUTION of the workload */
+} ycsb_workload_t;
+
+static const ycsb_workload_t workloads[] = {
+  { 'A', { 0.50, 0.50, 0.00, 0.00, 0.00 }, YCSB_ZIPFIAN },
+  { 'B', { 0.95, 0.05, 0.00, 0.00, 0.00 }, YCSB_ZIPFIAN },
+  { 'C', { 1.00, 0.00, 0.00, 0.00, 0.00 }, YCSB_ZIPFIAN },
+  { 'D', { 0.95, 0.00, 0.05, 0.00, 0.00 }, YCSB_LATEST },
+  { 'E', { 0.00, 0.00, 0.05, 0.95, 0.00 }, YCSB_ZIPFIAN },
+  { 'F', { 0.50, 0.00, 0.00, 0.00, 0.50 }, YCSB_ZIPFIAN },
+};
+
+/**
+ * @brief Options of the driver
+ */
+typedef struct _ycsb_config_t {
+  uint64_t records;        /**< Records loaded before the workload */
+  uint64_t operations;     /**< Measured operations, over all threads */
+  uint64_t warmup;         /**< Unmeasured operations, over all threads */
+  uint64_t threads;        /**< Number of client threads */
+  int64_t distribution;    /**< YCSB_DISTRIBUTION, YCSB_DEFAULT for the workload's */
+  int64_t lock;            /**< YCSB_LOCK */
+  bench_key_len_t key_len; /**< Length distribution of the keys */
+  uint8_t *type;           /**< Type of the values */
+  uint64_t value_size;     /**< Size of string and blob values */
+  uint64_t max_scan;       /**< Longest scan, lengths are uniform in [1, max_scan] */
+  uint8_t *dir;            /**< Directory of the bitcask and LSM tree databases */
+  uint64_t seed;           /**< Seed of the client threads */
+} ycsb_config_t;
+
+/**
+ * @brief State shared by the threads of a run
+ */
+typedef struct _ycsb_run_t {
+  db_t *db;                         /**< Database under test */
+  ycsb_config_t *config;            /**< Options of the driver */
+  const ycsb_workload_t *workload;  /**< Workload being run */
+  int64_t distribution;             /**< YCSB_DISTRIBUTION used */
+  int64_t lock;                     /**< YCSB_LOCK used */
+  pthread_mutex_t mutex;            /**< Lock of YCSB_LOCK_GLOBAL */
+  pthread_rwlock_t rwlock;          /**< Lock of YCSB_LOCK_RW */
+  pthread_barrier_t barrier;        /**< Separates the warmup from the measurement */
+  bench_zipf_t zipf;                /**< Popularity of the loaded records */
+  _Atomic uint64_t records;         /**< Next record number to insert */
+  _Atomic uint64_t not_found;       /**< Reads of records missing from the database */
+  _Atomic uint64_t failures;        /**< Operations that returned an error */
+} ycsb_run_t;
+
+/**
+ * @brief State of one client thread
+ */
+typedef struct _ycsb_thread_t {
+  ycsb_run_t *run;                            /**< Shared state */
+  pthread_t thread;                           /**< Client thread */
+  bench_rng_t rng;                            /**< Generator of the thread */
+  uint64_t warmup;                            /**< Unmeasured operations of the thread */
+  uint64_t operations;                        /**< Measured operations of the thread */
+  kv_histogram_t histograms[YCSB_OP_COUNT];   /**< Latencies of each YCSB_OP */
+} ycsb_thread_t;
+
+static bool first_result = true;
+
+static bool is_disk_backend(uint8_t *backend) {
+  return strcmp(backend, KV_STORAGE_STRUCTURE_BITCASK) == 0 ||
+         strcmp(backend, KV_STORAGE_STRUCTURE_LSM) == 0;
+}
+
+static bool is_thread_safe_backend(uint8_t *backend) {
+  return strcmp(backend, KV_STORAGE_STRUCTURE_CUCKOO) == 0 || is_disk_backend(backend);
+}
+
+static void record_key(uint8_t *dest, uint64_t record, bench_key_len_t key_len) {
+  /* Keys are derived from the record number only, so any thread can rebuild them */
+  bench_rng_t rng;
+  bench_rng_seed(&rng, record);
+  bench_make_key(dest, 'u', record, key_len, &rng);
+}
+
+static uint64_t next_record(ycsb_thread_t *thread) {
+  ycsb_run_t *run = thread->run;
+  uint64_t records = atomic_load_explicit(&run->records, memory_order_relaxed);
+  uint64_t item;
+  switch (run->distribution) {
+  case YCSB_UNIFORM:
+    return bench_rng_below(&thread->rng, records);
+  case YCSB_LATEST:
+    item = bench_zipf_next(&run->zipf, &thread->rng);
+    return item < records ? records - 1 - item : 0;
+  default:
+    return bench_fnv64(bench_zipf_next(&run->zipf, &thread->rng)) % records;
+  }
+}
+
+static void lock_db(ycsb_run_t *run, bool write) {
+  if (run->lock == YCSB_LOCK_GLOBAL) {
+    pthread_mutex_lock(&run->mutex);
+  }
+  else if (run->lock == YCSB_LOCK_RW) {
+    if (write) pthread_rwlock_wrlock(&run->rwlock);
+    else pthread_rwlock_rdlock(&run->rwlock);
+  }
+}
+
+static void unlock_db(ycsb_run_t *run) {
+  if (run->lock == YCSB_LOCK_GLOBAL) {
+    pthread_mutex_unlock(&run->mutex);
+  }
+  else if (run->lock == YCSB_LOCK_RW) {
+    pthread_rwlock_unlock(&run->rwlock);
+  }
+}
+
+static int64_t scan_callback(db_entry_t *entry, void *context) {
+  uint64_t *remaining = context;
+  return --(*remaining) > 0 ? 0 : -1;
+}
+
+static int64_t pick_op(ycsb_thread_t *thread) {
+  double choice = bench_rng_double(&thread->rng);
+  const double *proportions = thread->run->workload->proportions;
+  for (int64_t op = 0; op < YCSB_OP_COUNT; op++) {
+    if (choice < proportions[op]) return op;
+    choice -= proportions[op];
+  }
+  return YCSB_READ;
+}
+
+static void run_op(ycsb_thread_t *thread, bool measured) {
+  ycsb_run_t *run = thread->run;
+  ycsb_config_t *config = run->config;
+  int64_t op = pick_op(thread);
+
+  /* The key and the value are ready before the clock starts */
+  uint8_t key[SM_BUFFER_SIZE];
+  bench_value_t value = { NULL, 0 };
+  uint64_t scan_length = 0;
+  uint64_t record = op == YCSB_INSERT ?
+                    atomic_fetch_add_explicit(&run->records, 1, memory_order_relaxed) :
+                    next_record(thread);
+  record_key(key, record, config->key_len);
+  if (op == YCSB_UPDATE || op == YCSB_INSERT || op == YCSB_READ_MODIFY_WRITE) {
+    if (bench_make_value(&value, config->type, config->value_size, &thread->rng) < 0) {
+      atomic_fetch_add_explicit(&run->failures, 1, memory_order_relaxed);
+      return;
+    }
+  }
+  else if (op == YCSB_SCAN) {
+    scan_length = 1 + bench_rng_below(&thread->rng, config->max_scan);
+  }
+
+  int64_t result = 0;
+  bool found = true;
+  uint64_t start = stats_now_ns();
+  switch (op) {
+  case YCSB_READ:
+    lock_db(run, false);
+    found = get_entry(run->db, key) != NULL;
+    unlock_db(run);
+    break;
+  case YCSB_SCAN:
+    lock_db(run, false);
+    result = scan_db(run->db, key, NULL, scan_callback, &scan_length);
+    unlock_db(run);
+    break;
+  case YCSB_READ_MODIFY_WRITE:
+    lock_db(run, true);
+    found = get_entry(run->db, key) != NULL;
+    result = put_entry_span(run->db, key, value.bytes, value.len, config->type);
+    unlock_db(run);
+    break;
+  default:
+    lock_db(run, true);
+    result = put_entry_span(run->db, key, value.bytes, value.len, config->type);
+    unlock_db(run);
+    break;
+  }
+  uint64_t ns = stats_now_ns() - start;
+  free(value.bytes);
+
+  if (!measured) return;
+
+  bench_record(&thread->histograms[op], ns);
+  if (!found) {
+    atomic_fetch_add_explicit(&run->not_found, 1, memory_order_relaxed);
+  }
+  if (result < 0) {
+    atomic_fetch_add_explicit(&run->failures, 1, memory_order_relaxed);
+  }
+}
+
+static void *run_thread(void *arg) {
+  ycsb_thread_t *thread = arg;
+  for (uint64_t idx = 0; idx < thread->warmup; idx++) {
+    run_op(thread, false);
+  }
+
+  /* Twice: once when every warmup is done, once when the clock has started */
+  pthread_barrier_wait(&thread->run->barrier);
+  pthread_barrier_wait(&thread->run->barrier);
+  for (uint64_t idx = 0; idx < thread->operations; idx++) {
+    run_op(thread, true);
+  }
+  return NULL;
+}
+
+static void write_result(FILE *file, uint8_t *backend, ycsb_run_t *run, const char *op,
+                         kv_histogram_t *histogram, double seconds) {
+  fprintf(file, "%s  {\"backend\": \"%s\", \"workload\": \"%c\", \"distribution\": \"%s\", "
+                "\"lock\": \"%s\", \"threads\": %" PRIu64 ", \"records\": %" PRIu64 ", "
+                "\"not_found\": %" PRIu64 ", \"failures\": %" PRIu64 ", \"op\": \"%s\", ",
+          first_result ? "" : ",\n", backend, run->workload->name,
+          distribution_names[run->distribution], lock_names[run->lock], run->config->threads,
+          run->config->records, atomic_load(&run->not_found), atomic_load(&run->failures), op);
+  bench_write_latency_json(file, histogram, seconds);
+  fprintf(file, "}");
+  first_result = false;
+}
+
+static int64_t load_records(FILE *output, uint8_t *backend, ycsb_run_t *run) {
+  ycsb_config_t *config = run->config;
+  bench_rng_t rng;
+  bench_rng_seed(&rng, config->seed);
+
+  kv_histogram_t *histogram = calloc(1, sizeof(kv_histogram_t));
+  if (histogram == NULL) {
+    return -1;
+  }
+
+  uint64_t phase_start = stats_now_ns();
+  int64_t result = 0;
+  for (uint64_t record = 0; record < config->records && result == 0; record++) {
+    uint8_t key[SM_BUFFER_SIZE];
+    bench_value_t value;
+    record_key(key, record, config->key_len);
+    if (bench_make_value(&value, config->type, config->value_size, &rng) < 0) {
+      result = -1;
+      break;
+    }
+
+    uint64_t start = stats_now_ns();
+    result = put_entry_span(run->db, key, value.bytes, value.len, config->type);
+    bench_record(histogram, stats_now_ns() - start);
+    free(value.bytes);
+  }
+  write_result(output, backend, run, "load", histogram, (stats_now_ns() - phase_start) / 1e9);
+
+  free(histogram);
+  return result;
+}
+
+static int64_t run_workload(FILE *output, uint8_t *backend, const ycsb_workload_t *workload,
+                            ycsb_config_t *config) {
+  if (workload->proportions[YCSB_SCAN] > 0 && strcmp(backend, KV_STORAGE_STRUCTURE_LSM) != 0) {
+    fprintf(stderr, "Skipping workload %c on backend %s: scans need an LSM tree\n", workload->name, backend);
+    return 0;
+  }
+
+  int64_t lock = config->lock;
+  if (lock == YCSB_LOCK_AUTO) {
+    lock = is_thread_safe_backend(backend) ? YCSB_LOCK_NONE : YCSB_LOCK_RW;
+  }
+  if (lock == YCSB_LOCK_NONE && config->threads > 1 && !is_thread_safe_backend(backend)) {
+    fprintf(stderr, "Error: Backend %s is not thread-safe, use --lock global or rw\n", backend);
+    return -1;
+  }
+
+  ycsb_run_t *run = calloc(1, sizeof(ycsb_run_t));
+  ycsb_thread_t *threads = calloc(config->threads, sizeof(ycsb_thread_t));
+  if (run == NULL || threads == NULL) {
+    free(run);
+    free(threads);
+    return -1;
+  }
+  run->config = config;
+  run->workload = workload;
+  run->distribution = config->distribution == YCSB_DEFAULT ? workload->distribution : config->distribution;
+  run->lock = lock;
+  pthread_mutex_init(&run->mutex, NULL);
+  pthread_rwlock_init(&run->rwlock, NULL);
+  pthread_barrier_init(&run->barrier, NULL, config->threads + 1);
+  bench_zipf_init(&run->zipf, config->records, YCSB_ZIPF_THETA);
+  atomic_store(&run->records, config->records);
+
+  uint8_t db_dir[BG_BUFFER_SIZE];
+  snprintf(db_dir, BG_BUFFER_SIZE, "%s/%s_%c", config->dir, backend, workload->name);
+  int64_t result = bench_remove_tree(db_dir);
+  run->db = result == 0 ? create_db(backend) : NULL;
+  if (run->db == NULL || (is_disk_backend(backend) && load_db(run->db, db_dir) < 0)) {
+    fprintf(stderr, "Error: Failed to open a database of type %s\n", backend);
+    result = -1;
+  }
+
+  if (result == 0) {
+    result = load_records(output, backend, run);
+  }
+
+  uint64_t started = 0;
+  for (; result == 0 && started < config->threads; started++) {
+    ycsb_thread_t *thread = &threads[started];
+    thread->run = run;
+    bench_rng_seed(&thread->rng, config->seed + 1 + started);
+    thread->warmup = config->warmup / config->threads;
+    thread->operations = config->operations / config->threads;
+    if (started == 0) {
+      thread->warmup += config->warmup % config->threads;
+      thread->operations += config->operations % config->threads;
+    }
+    if (pthread_create(&thread->thread, NULL, run_thread, thread) != 0) {
+      fprintf(stderr, "Error: Failed to start client thread %" PRIu64 "\n", started);
+      result = -1;
+      break;
+    }
+  }
+
+  if (result == 0) {
+    pthread_barrier_wait(&run->barrier);
+    atomic_store(&run->not_found, 0);
+    atomic_store(&run->failures, 0);
+    uint64_t start = stats_now_ns();
+    pthread_barrier_wait(&run->barrier);
+    for (uint64_t idx = 0; idx < started; idx++) {
+      pthread_join(threads[idx].thread, NULL);
+    }
+    double seconds = (stats_now_ns() - start) / 1e9;
+
+    kv_histogram_t *total = calloc(1, sizeof(kv_histogram_t));
+    kv_histogram_t *op_total = calloc(1, sizeof(kv_histogram_t));
+    for (int64_t op = 0; total != NULL && op_total != NULL && op < YCSB_OP_COUNT; op++) {
+      if (workload->proportions[op] == 0) continue;
+
+      memset(op_total, 0, sizeof(kv_histogram_t));
+      for (uint64_t idx = 0; idx < started; idx++) {
+        bench_merge(op_total, &threads[idx].histograms[op]);
+      }
+      bench_merge(total, op_total);
+      write_result(output, backend, run, op_names[op], op_total, seconds);
+    }
+    if (total != NULL && op_total != NULL) {
+      write_result(output, backend, run, "all", total, seconds);
+    }
+    else {
+      result = -1;
+    }
+    free(total);
+    free(op_total);
+
+    if (atomic_load(&run->failures) > 0) {
+      fprintf(stderr, "Error: %" PRIu64 " operations of workload %c failed on backend %s\n",
+              atomic_load(&run->failures), workload->name, backend);
+      result = -1;
+    }
+  }
+  else if (started > 0) {
+    /* Threads already started are waiting on the barrier, which now never opens */
+    fprintf(stderr, "Error: Aborting after a partial start of the client threads\n");
+    exit(1);
+  }
+
+  free_db(run->db);
+  bench_remove_tree(db_dir);
+  pthread_barrier_destroy(&run->barrier);
+  pthread_rwlock_destroy(&run->rwlock);
+  pthread_mutex_destroy(&run->mutex);
+  free(threads);
+  free(run);
+  return result;
+}
+
+static int64_t parse_name(uint8_t *name, const char **names, int64_t count) {
+  for (int64_t idx = 0; idx < count; idx++) {
+    if (strcmp(name, names[idx]) == 0) return idx;
+  }
+  return -1;
+}
+
+static void print_usage(char *program) {
+  fprintf(stderr, "Usage: %s [--workloads A,B,C,D,E,F] [--backends L,H,C,B,T] [--records 10000]\n"
+                  "       [--operations 100000] [--warmup 10000] [--threads 1]\n"
+                  "       [--distribution uniform|zipfian|latest] [--lock none|global|rw]\n"
+                  "       [--key-len 24] [--type string] [--value-size 100] [--max-scan 100]\n"
+                  "       [--dir /tmp/kv_ycsb] [--seed 1] [--output results.json]\n", program);
+}
+
+int main(int argc, char **argv) {
+  uint8_t workloads_arg[BG_BUFFER_SIZE] = "A,B,C,D,E,F";
+  uint8_t backends_arg[BG_BUFFER_SIZE] = "L,H,C,B,T";
+  ycsb_config_t config = {
+    .records = 10000,
+    .operations = 100000,
+    .warmup = 10000,
+    .threads = 1,
+    .distribution = YCSB_DEFAULT,
+    .lock = YCSB_LOCK_AUTO,
+    .key_len = { 24, 24 },
+    .type = "string",
+    .value_size = 100,
+    .max_scan = 100,
+    .dir = "/tmp/kv_ycsb",
+    .seed = 1
+  };
+  uint8_t *output_path = NULL;
+
+  struct option options[] = {
+    { "workloads", required_argument, NULL, 'w' },
+    { "backends", required_argument, NULL, 'b' },
+    { "records", required_argument, NULL, 'r' },
+    { "operations", required_argument, NULL, 'n' },
+    { "warmup", required_argument, NULL, 'u' },
+    { "threads", required_argument, NULL, 'j' },
+    { "distribution", required_argument, NULL, 'D' },
+    { "lock", required_argument, NULL, 'L' },
+    { "key-len", required_argument, NULL, 'l' },
+    { "type", required_argument, NULL, 't' },
+    { "value-size", required_argument, NULL, 'v' },
+    { "max-scan", required_argument, NULL, 'S' },
+    { "dir", required_argument, NULL, 'd' },
+    { "seed", required_argument, NULL, 's' },
+    { "output", required_argument, NULL, 'o' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "w:b:r:n:u:j:D:L:l:t:v:S:d:s:o:", options, NULL)) != -1) {
+    switch (option) {
+    case 'w': snprintf(workloads_arg, BG_BUFFER_SIZE, "%s", optarg); break;
+    case 'b': snprintf(backends_arg, BG_BUFFER_SIZE, "%s", optarg); break;
+    case 'r': config.records = strtoull(optarg, NULL, 10); break;
+    case 'n': config.operations = strtoull(optarg, NULL, 10); break;
+    case 'u': config.warmup = strtoull(optarg, NULL, 10); break;
+    case 'j': config.threads = strtoull(optarg, NULL, 10); break;
+    case 't': config.type = optarg; break;
+    case 'v': config.value_size = strtoull(optarg, NULL, 10); break;
+    case 'S': config.max_scan = strtoull(optarg, NULL, 10); break;
+    case 'd': config.dir = optarg; break;
+    case 's': config.seed = strtoull(optarg, NULL, 10); break;
+    case 'o': output_path = optarg; break;
+    case 'D':
+      config.distribution = parse_name(optarg, distribution_names, 3);
+      if (config.distribution < 0) {
+        fprintf(stderr, "Error: Unknown distribution %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'L':
+      config.lock = parse_name(optarg, lock_names, 3);
+      if (config.lock < 0) {
+        fprintf(stderr, "Error: Unknown lock mode %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'l':
+      if (sscanf(optarg, "%" SCNu64 "-%" SCNu64, &config.key_len.min, &config.key_len.max) == 1) {
+        config.key_len.max = config.key_len.min;
+      }
+      break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (config.records < 2 || config.threads == 0 || config.threads > YCSB_MAX_THREADS ||
+      config.max_scan == 0 || config.key_len.min == 0 || config.key_len.max < config.key_len.min ||
+      config.key_len.max > BENCH_MAX_KEY_LEN) {
+    fprintf(stderr, "Error: Invalid options, records must be at least 2, threads between 1 and %d "
+                    "and key lengths between 1 and %d\n", YCSB_MAX_THREADS, BENCH_MAX_KEY_LEN);
+    return 1;
+  }
+
+  uint8_t *names[YCSB_MAX_ITEMS];
+  const ycsb_workload_t *selected[YCSB_MAX_ITEMS];
+  uint64_t workload_count = bench_split(workloads_arg, names, YCSB_MAX_ITEMS);
+  for (uint64_t idx = 0; idx < workload_count; idx++) {
+    selected[idx] = NULL;
+    for (uint64_t workload = 0; workload < sizeof(workloads) / sizeof(workloads[0]); workload++) {
+      if (strlen(names[idx]) == 1 && names[idx][0] == workloads[workload].name) {
+        selected[idx] = &workloads[workload];
+      }
+    }
+    if (selected[idx] == NULL) {
+      fprintf(stderr, "Error: Unknown workload %s\n", names[idx]);
+      return 1;
+    }
+  }
+
+  uint8_t *backends[YCSB_MAX_ITEMS];
+  uint64_t backend_count = bench_split(backends_arg, backends, YCSB_MAX_ITEMS);
+
+  if (mkdir(config.dir, 0755) < 0 && errno != EEXIST) {
+    fprintf(stderr, "Error: Failed to create %s\n", config.dir);
+    return 1;
+  }
+
+  FILE *output = output_path != NULL ? fopen(output_path, "w") : stdout;
+  if (output == NULL) {
+    fprintf(stderr, "Error: Failed to open %s\n", output_path);
+    return 1;
+  }
+
+  int64_t failures = 0;
+  fprintf(output, "[\n");
+  for (uint64_t backend_idx = 0; backend_idx < backend_count; backend_idx++) {
+    for (uint64_t workload_idx = 0; workload_idx < workload_count; workload_idx++) {
+      if (run_workload(output, backends[backend_idx], selected[workload_idx], &config) < 0) {
+        failures++;
+      }
+      fflush(output);
+    }
+  }
+  fprintf(output, "\n]\n");
+
+  if (output != stdout) {
+    fclose(output);
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,591 @@
+/**
+ * @file bitcask.h
+ * @brief Log-structured (Bitcask-style) persistent storage backend
+ *
+ * This module provides a persistent storage backend where every insert, put and
+ * delete appends a record to an active data file inside a directory. An
+ * in-memory key directory maps each key to the file and offset holding its
+ * latest value, so memory only holds keys and every read is a single pread.
+ * Merges rewrite the live records into compact files in the background and
+ * write hint files that make reopening the directory fast.
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#include "kv_parser.h"
+#include "kv_key.h"
+#include "checksum.h"
+#include "kv_log.h"
+
+
+/** @brief Type stored in the record header of a deletion marker */
+#define BITCASK_TOMBSTONE_TYPE -1
+
+/**
+ * @brief Header written in front of the key and value of every data record
+ *
+ * The checksum covers the rest of the header, the key and the value.
+ */
+typedef struct _bitcask_record_header_t {
+  uint32_t crc;        /**< CRC32C of the record after this field */
+  uint32_t value_size; /**< Size of the value bytes following the key */
+  uint8_t key_size;    /**< Size of the key bytes following the header */
+  int8_t type;         /**< ENTRY_VALUE_TYPE, or BITCASK_TOMBSTONE_TYPE */
+  uint16_t reserved;   /**< Padding, always zero */
+} bitcask_record_header_t;
+
+/**
+ * @brief Record of a hint file, followed by the key bytes
+ *
+ * Hint files are written next to merged data files and hold the location of
+ * every record, so the key directory is rebuilt without reading the values.
+ */
+typedef struct _bitcask_hint_t {
+  uint64_t offset;     /**< Offset of the value inside the data file */
+  uint32_t value_size; /**< Size of the value */
+  uint8_t key_size;    /**< Size of the key bytes following the hint */
+  int8_t type;         /**< ENTRY_VALUE_TYPE of the value */
+  uint16_t reserved;   /**< Padding, always zero */
+} bitcask_hint_t;
+
+/**
+ * @brief Key directory entry locating the latest value of a key
+ */
+typedef struct _bitcask_keydir_entry_t {
+  uint8_t key[SM_BUFFER_SIZE];          /**< Key string (null-terminated) */
+  int64_t type;                         /**< ENTRY_VALUE_TYPE of the value */
+  uint64_t file_id;                     /**< Data file holding the value */
+  uint64_t offset;                      /**< Offset of the value inside the data file */
+  uint32_t value_size;                  /**< Size of the value */
+  struct _bitcask_keydir_entry_t *next; /**< Next entry of the same bucket */
+} bitcask_keydir_entry_t;
+
+/**
+ * @brief Open data file of a bitcask directory
+ */
+typedef struct _bitcask_file_t {
+  uint64_t id;         /**< File id, data files are replayed in id order */
+  int32_t fd;          /**< Open descriptor of the data file */
+  uint64_t size;       /**< Bytes written to the file */
+  uint64_t dead_bytes; /**< Bytes of records superseded by later writes */
+} bitcask_file_t;
+
+/**
+ * @brief Location of a live record captured when a merge starts
+ */
+typedef struct _bitcask_merge_item_t {
+  uint8_t key[SM_BUFFER_SIZE]; /**< Key of the record */
+  int64_t type;                /**< ENTRY_VALUE_TYPE of the value */
+  uint64_t file_id;            /**< Data file holding the value */
+  int32_t fd;                  /**< Descriptor of that data file */
+  uint64_t offset;             /**< Offset of the value */
+  uint32_t value_size;         /**< Size of the value */
+} bitcask_merge_item_t;
+
+/**
+ * @brief Work of a background merge
+ */
+typedef struct _bitcask_merge_t {
+  struct _bitcask_t *bitcask;   /**< Bitcask being merged */
+  bitcask_merge_item_t *items;  /**< Live records to copy */
+  uint64_t item_count;          /**< Number of live records to copy */
+  uint64_t first_output_id;     /**< Id of the first merged file */
+  uint64_t last_output_id;      /**< Highest id reserved for merged files */
+} bitcask_merge_t;
+
+/**
+ * @brief Bitcask storage structure
+ *
+ * Every operation holds the lock, so the background merge thread can safely
+ * relocate values while the store is in use. Files are kept sorted by id and
+ * the last one is the active file receiving appends.
+ */
+typedef struct _bitcask_t {
+  uint8_t dir[BG_BUFFER_SIZE];      /**< Directory holding the data files */
+  bool attached;                    /**< True once a directory has been opened */
+  bitcask_keydir_entry_t **keydir;  /**< Buckets of the key directory */
+  uint64_t keydir_size;             /**< Number of buckets of the key directory */
+  _Atomic uint64_t count;           /**< Number of live keys, read without the lock */
+  bitcask_file_t *files;            /**< Open data files sorted by id */
+  uint64_t file_count;              /**< Number of open data files */
+  uint64_t file_capacity;           /**< Allocated length of the files array */
+  uint64_t next_file_id;            /**< Id given to the next data file */
+  uint64_t max_file_size;           /**< Size after which the active file is rotated */
+  bool merging;                     /**< True while a merge thread is running */
+  bool merge_joinable;              /**< True if the merge thread has to be joined */
+  pthread_t merge_thread;           /**< Background merge thread */
+  pthread_mutex_t lock;             /**< Guards the key directory and the files */
+} bitcask_t;
+
+/**
+ * @brief Entry returned to a thread by bitcask_get_entry(), with its value storage
+ *
+ * Each thread reads into its own, so gets from several threads do not share
+ * a buffer. It is freed when the thread exits.
+ */
+typedef struct _bitcask_reader_t {
+  db_entry_t entry;   /**< Entry returned by bitcask_get_entry() */
+  uint8_t *buffer;    /**< Value storage of entry */
+  uint64_t capacity;  /**< Allocated size of buffer */
+} bitcask_reader_t;
+
+/**
+ * @brief Hashes a key into a key directory bucket
+ *
+ * @param key Key string (null-terminated)
+ * @param size Number of buckets
+ * @return uint64_t Bucket index in the range [0, size-1]
+ *
+ * @note This is a static/internal function (FNV-1a)
+ */
+static uint64_t bitcask_hash(uint8_t *key, uint64_t size);
+
+/**
+ * @brief Computes the size of a data record
+ *
+ * @param key Key string (null-terminated)
+ * @param value_size Size of the value
+ * @return uint64_t Size of the header, key and value
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t record_size(uint8_t *key, uint32_t value_size);
+
+/**
+ * @brief Computes the checksum of a data record from its parts
+ *
+ * @param header Header of the record, its crc field is ignored
+ * @param key Key bytes, header->key_size of them
+ * @param value Value bytes, header->value_size of them
+ * @return uint32_t CRC32C of the record after its crc field
+ *
+ * @note This is a static/internal function
+ */
+static uint32_t record_crc(bitcask_record_header_t *header, uint8_t *key, void *value);
+
+/**
+ * @brief Writes a data record at an offset of a data file
+ *
+ * The header, key and value are written with a single pwritev(), so values
+ * are never copied into an intermediate buffer.
+ *
+ * @param fd Descriptor of the data file
+ * @param offset Offset of the record
+ * @param key Key string (null-terminated)
+ * @param type ENTRY_VALUE_TYPE of the value, or BITCASK_TOMBSTONE_TYPE
+ * @param value Pointer to the value bytes (NULL for tombstones)
+ * @param value_size Size of the value
+ * @return int64_t Size of the record on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t write_data_record(int32_t fd, uint64_t offset, uint8_t *key, int64_t type,
+                            void *value, uint32_t value_size);
+
+/**
+ * @brief Creates the thread key of the readers
+ *
+ * @note This is a static/internal function
+ */
+static void init_bitcask_reader_key();
+
+/**
+ * @brief Frees the reader of a thread when it exits
+ *
+ * @note This is a static/internal function
+ */
+static void free_bitcask_reader(void *arg);
+
+/**
+ * @brief Returns the reader of the calling thread, creating it on first use
+ *
+ * @return bitcask_reader_t* Reader of the thread, or NULL on failure
+ *
+ * @note This is a static/internal function
+ */
+static bitcask_reader_t *get_bitcask_reader();
+
+/**
+ * @brief Grows the buffer of a reader
+ *
+ * @param reader Reader of the calling thread
+ * @param size Size of the value to hold, a NUL byte is added after it
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t reserve_read_buffer(bitcask_reader_t *reader, uint64_t size);
+
+/**
+ * @brief Reads a whole data record and verifies its checksum
+ *
+ * @param fd Descriptor of the data file
+ * @param key_size Size of the key of the record
+ * @param value_size Size of the value
+ * @param value_offset Offset of the value inside the data file
+ * @param value Buffer receiving the value
+ * @return int64_t 0 on success, -1 if the record can not be read or is corrupt
+ *
+ * @note This is a static/internal function
+ */
+static int64_t read_record(int32_t fd, uint64_t key_size, uint32_t value_size,
+                           uint64_t value_offset, uint8_t *value);
+
+/**
+ * @brief Doubles the number of buckets of the key directory
+ *
+ * @param bitcask Pointer to the bitcask
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static int64_t keydir_grow(bitcask_t *bitcask);
+
+/**
+ * @brief Accounts superseded bytes to a data file
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param file_id Id of the data file holding the superseded record
+ * @param bytes Size of the superseded record
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static void mark_dead(bitcask_t *bitcask, uint64_t file_id, uint64_t bytes);
+
+/**
+ * @brief Finds the key directory entry of a key
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param key Key string (null-terminated)
+ * @return bitcask_keydir_entry_t* The entry, or NULL if the key does not exist
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static bitcask_keydir_entry_t *keydir_find(bitcask_t *bitcask, uint8_t *key);
+
+/**
+ * @brief Points a key at a new value location, creating the key if needed
+ *
+ * The record previously holding the key is accounted as dead bytes.
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param key Key string (null-terminated)
+ * @param type ENTRY_VALUE_TYPE of the value
+ * @param file_id Data file holding the value
+ * @param offset Offset of the value
+ * @param value_size Size of the value
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static int64_t keydir_set(bitcask_t *bitcask, uint8_t *key, int64_t type,
+                          uint64_t file_id, uint64_t offset, uint32_t value_size);
+
+/**
+ * @brief Removes a key from the key directory
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param key Key string (null-terminated)
+ * @return int64_t 0 on success, -1 if the key does not exist
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static int64_t keydir_remove(bitcask_t *bitcask, uint8_t *key);
+
+/**
+ * @brief Finds an open data file by id
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param file_id Id of the data file
+ * @return bitcask_file_t* The data file, or NULL if it is not open
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static bitcask_file_t *find_file(bitcask_t *bitcask, uint64_t file_id);
+
+/**
+ * @brief Builds the path of a file of the bitcask directory
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param file_id Id of the data file
+ * @param extension File extension ("data" or "hint")
+ * @param dest Buffer to store the path
+ * @param max_len Maximum length of the destination buffer
+ *
+ * @note This is a static/internal function
+ */
+static void build_file_path(bitcask_t *bitcask, uint64_t file_id, uint8_t *extension,
+                            uint8_t *dest, uint64_t max_len);
+
+/**
+ * @brief Opens or creates a data file and registers it in id order
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param file_id Id of the data file
+ * @param truncate True to discard the existing contents of the file
+ * @return bitcask_file_t* The registered data file, or NULL on failure
+ *
+ * @note This is a static/internal function, the lock must be held
+ * @note The returned pointer is invalidated by the next registration
+ */
+static bitcask_file_t *add_file(bitcask_t *bitcask, uint64_t file_id, bool truncate);
+
+/**
+ * @brief Closes a data file and deletes it along with its hint file
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param idx Index of the file in the files array
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static void remove_file(bitcask_t *bitcask, uint64_t idx);
+
+/**
+ * @brief Syncs the active data file and makes a new one active
+ *
+ * Starts a background merge when more than half of the stored bytes are dead.
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param file_id Id of the new active file
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static int64_t rotate_active_file(bitcask_t *bitcask, uint64_t file_id);
+
+/**
+ * @brief Appends a record to the active data file, rotating it when full
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param key Key string (null-terminated)
+ * @param type ENTRY_VALUE_TYPE of the value, or BITCASK_TOMBSTONE_TYPE
+ * @param value Pointer to the value bytes (NULL for tombstones)
+ * @param value_size Size of the value
+ * @param file_id Receives the id of the file the record was written to
+ * @param offset Receives the offset of the value
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static int64_t append_record(bitcask_t *bitcask, uint8_t *key, int64_t type, void *value,
+                             uint64_t value_size, uint64_t *file_id, uint64_t *offset);
+
+/**
+ * @brief Rebuilds the key directory from the records of a data file
+ *
+ * A truncated or malformed record ends the scan; the file is cut at the last
+ * valid record so that appends never follow garbage.
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param file Data file to scan
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static int64_t replay_data_file(bitcask_t *bitcask, bitcask_file_t *file);
+
+/**
+ * @brief Rebuilds the key directory from the hint file of a data file
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param file_id Id of the data file the hints belong to
+ * @param hint_path Path of the hint file
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static int64_t replay_hint_file(bitcask_t *bitcask, uint64_t file_id, uint8_t *hint_path);
+
+/**
+ * @brief Writes the hint file of a merged data file
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param file_id Id of the merged data file
+ * @param hints Buffer holding the hint records
+ * @param hints_size Size of the hint records
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t write_hint_file(bitcask_t *bitcask, uint64_t file_id, uint8_t *hints, uint64_t hints_size);
+
+/**
+ * @brief Syncs a merged data file and writes its hint file
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param file_id Id of the merged data file
+ * @param hints Buffer holding the hint records
+ * @param hints_size Size of the hint records
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t finish_merge_output(bitcask_t *bitcask, uint64_t file_id, uint8_t *hints, uint64_t hints_size);
+
+/**
+ * @brief Orders data file ids for qsort()
+ *
+ * @note This is a static/internal function
+ */
+static int compare_file_ids(const void *first, const void *second);
+
+/**
+ * @brief Rewrites the live records of the files older than the merge into new files
+ *
+ * @param arg Pointer to the bitcask being merged
+ * @return void* Always NULL
+ *
+ * @note This is a static/internal function run on the merge thread
+ */
+static void *merge_files(void *arg);
+
+/**
+ * @brief Starts a background merge, the lock must be held
+ *
+ * @param bitcask Pointer to the bitcask
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t start_merge(bitcask_t *bitcask);
+
+/**
+ * @brief Creates a new bitcask that is not attached to a directory yet
+ *
+ * @return bitcask_t* Pointer to the newly created bitcask, or NULL on failure
+ *
+ * @note The caller is responsible for freeing the bitcask using free_bitcask()
+ * @see bitcask_open(), free_bitcask()
+ */
+extern bitcask_t* create_bitcask();
+
+/**
+ * @brief Attaches a bitcask to a directory, creating it if needed
+ *
+ * Rebuilds the key directory from the hint files of merged data files and
+ * from the records of the other data files, replaying them in id order.
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param dir Path of the directory holding the data files
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note A bitcask can only be attached once
+ */
+extern int64_t bitcask_open(bitcask_t *bitcask, uint8_t *dir);
+
+/**
+ * @brief Inserts a database entry into the bitcask
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param entry Pointer to the database entry to insert
+ * @return int64_t KV_OK on success, KV_EXISTS if the key is already stored,
+ *                 or another negative kv_status_t on failure
+ *
+ * @note The bitcask takes ownership of the entry and frees it once written
+ * @see bitcask_put()
+ */
+extern int64_t bitcask_insert(bitcask_t *bitcask, db_entry_t *entry);
+
+/**
+ * @brief Creates or updates an entry with the given key, value, and type
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param key Key for the entry (null-terminated string)
+ * @param value Text of a number or bool, or bytes of a string or blob
+ * @param len Number of bytes of the value
+ * @param type Type identifier, can be empty to keep the type of an existing key
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if type is empty and the key
+ *                 does not exist, or another negative kv_status_t on failure
+ *
+ * @see bitcask_insert(), bitcask_get_entry()
+ */
+extern int64_t bitcask_put(bitcask_t *bitcask, uint8_t *key, uint8_t *value, uint64_t len, uint8_t *type);
+
+/**
+ * @brief Deletes an entry by appending a tombstone record
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param key Key of the entry to delete (null-terminated string)
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if the key does not exist,
+ *                 or another negative kv_status_t on failure
+ */
+extern int64_t bitcask_delete(bitcask_t *bitcask, uint8_t *key);
+
+/**
+ * @brief Reads the entry with the given key from its data file
+ *
+ * @param bitcask Pointer to the bitcask
+ * @param key Key of the entry to retrieve (null-terminated string)
+ * @return db_entry_t* Pointer to the entry, or NULL if not found
+ *
+ * @note The returned entry belongs to the calling thread and is only valid
+ *       until its next get from a bitcask
+ */
+extern db_entry_t *bitcask_get_entry(bitcask_t *bitcask, uint8_t *key);
+
+/**
+ * @brief Flushes the active data file to disk
+ *
+ * @param bitcask Pointer to the bitcask
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t bitcask_sync(bitcask_t *bitcask);
+
+/**
+ * @brief Starts merging the data files in the background
+ *
+ * The active file is rotated, then a thread copies the live records of every
+ * older file into new compact files with hint files and deletes the old files.
+ * Merges also start on their own when a rotation finds that more than half of
+ * the stored bytes are dead.
+ *
+ * @param bitcask Pointer to the bitcask
+ * @return int64_t 0 on success, -1 on failure (including a merge already running)
+ *
+ * @see bitcask_merge_wait()
+ */
+extern int64_t bitcask_merge(bitcask_t *bitcask);
+
+/**
+ * @brief Waits for a running merge to finish
+ *
+ * @param bitcask Pointer to the bitcask
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t bitcask_merge_wait(bitcask_t *bitcask);
+
+/**
+ * @brief Saves all entries in the bitcask to a file in the text format
+ *
+ * @param file Open file pointer for writing
+ * @param bitcask Pointer to the bitcask to save
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @see list_save(), hash_save()
+ */
+extern int64_t bitcask_save(FILE *file, bitcask_t *bitcask);
+
+/**
+ * @brief Closes the data files and frees the bitcask
+ *
+ * Waits for a running merge and syncs the active file first.
+ *
+ * @param bitcask Pointer to the bitcask to free (can be NULL)
+ */
+extern void free_bitcask(bitcask_t *bitcask);
+
+/**
+ * @brief Prints all entries in the bitcask to stdout
+ *
+ * @param bitcask Pointer to the bitcask to print
+ *
+ * @see print_entry()
+ */
+extern void bitcask_print(bitcask_t *bitcask);
@@ -0,0 +1,135 @@
+/**
+ * @file checksum.h
+ * @brief CRC32C checksums of the persisted database files
+ *
+ * This module computes CRC32C (Castagnoli) checksums, using the SSE4.2 crc32
+ * instruction when the CPU supports it and a slice-by-8 table otherwise. It
+ * also provides the stream wrapper that adds checksum lines to text database
+ * files as they are written.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "constants.h"
+#include "kv_log.h"
+
+
+/** @brief Prefix of the checksum lines of text database files */
+#define CHECKSUM_LINE_PREFIX "#crc32c:"
+/** @brief Reflected CRC32C (Castagnoli) polynomial */
+#define CHECKSUM_CRC32C_POLY 0x82F63B78
+
+/**
+ * @brief State of a text stream opened with open_checksum_writer()
+ */
+typedef struct _checksum_writer_t {
+  FILE *file;           /**< Stream receiving the lines and the checksum lines */
+  uint64_t block_lines; /**< Lines covered by each checksum line */
+  uint64_t lines;       /**< Lines written since the last checksum line */
+  uint32_t crc;         /**< CRC32C of the lines written since the last checksum line */
+  bool line_open;       /**< True if the last byte written was not a newline */
+} checksum_writer_t;
+
+/**
+ * @brief Builds the slice-by-8 tables and selects the CRC32C implementation
+ *
+ * @note This is a static/internal function run once through pthread_once()
+ */
+static void init_crc32c();
+
+/**
+ * @brief Computes a CRC32C with the slice-by-8 tables
+ *
+ * @param crc Inverted running checksum
+ * @param data Bytes to checksum
+ * @param size Number of bytes
+ * @return uint32_t Inverted running checksum
+ *
+ * @note This is a static/internal function
+ */
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *data, uint64_t size);
+
+/**
+ * @brief Computes a CRC32C with the SSE4.2 crc32 instruction
+ *
+ * @param crc Inverted running checksum
+ * @param data Bytes to checksum
+ * @param size Number of bytes
+ * @return uint32_t Inverted running checksum
+ *
+ * @note This is a static/internal function, only used when the CPU supports SSE4.2
+ */
+static uint32_t crc32c_hardware(uint32_t crc, const uint8_t *data, uint64_t size);
+
+/**
+ * @brief Writes the checksum line covering the lines written since the previous one
+ *
+ * @param writer Pointer to the writer state
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t write_checksum_line(checksum_writer_t *writer);
+
+/**
+ * @brief fopencookie() write function of the checksum writer
+ *
+ * @note This is a static/internal function
+ */
+static ssize_t checksum_writer_write(void *cookie, const char *buffer, size_t size);
+
+/**
+ * @brief fopencookie() close function of the checksum writer
+ *
+ * Writes the checksum line of the last, partial block.
+ *
+ * @note This is a static/internal function
+ */
+static int checksum_writer_close(void *cookie);
+
+/**
+ * @brief Computes the CRC32C of a buffer
+ *
+ * Passing the result of a previous call as crc continues the checksum, so
+ * crc32c(crc32c(0, a, n), b, m) is the checksum of a followed by b.
+ *
+ * @param crc 0, or the checksum of the preceding bytes
+ * @param data Bytes to checksum
+ * @param size Number of bytes
+ * @return uint32_t Checksum of the bytes
+ */
+extern uint32_t crc32c(uint32_t crc, const void *data, uint64_t size);
+
+/**
+ * @brief Opens a stream that adds checksum lines to the text written to file
+ *
+ * After every block_lines lines, and once more for the last partial block
+ * when the stream is closed, a line "#crc32c:<checksum>:<lines>" is written
+ * with the CRC32C of the bytes of those lines in hexadecimal.
+ *
+ * @param file Open file pointer receiving the text, not closed by the stream
+ * @param block_lines Number of lines covered by each checksum line
+ * @return FILE* Stream to write the text to, or NULL on failure
+ *
+ * @note The returned stream has to be closed with fclose() before file
+ */
+extern FILE *open_checksum_writer(FILE *file, uint64_t block_lines);
+
+/**
+ * @brief Parses a checksum line of a text database file
+ *
+ * @param line Start of the line
+ * @param len Length of the line, including the newline if any
+ * @param crc Pointer receiving the checksum of the block
+ * @param lines Pointer receiving the number of lines of the block
+ * @return int64_t 1 for a valid checksum line, 0 if the line is not a
+ *                 checksum line, -1 for a damaged checksum line
+ */
+extern int64_t parse_checksum_line(uint8_t *line, uint64_t len, uint32_t *crc, uint64_t *lines);
@@ -17,5 +17,30 @@
 
 #define KV_STORAGE_STRUCTURE_LIST "L"
 #define KV_STORAGE_STRUCTURE_HASH "H"
+#define KV_STORAGE_STRUCTURE_BITCASK "B"
+#define KV_STORAGE_STRUCTURE_LSM "T"
+#define KV_STORAGE_STRUCTURE_CUCKOO "C"
+#define KV_STORAGE_STRUCTURE_FROZEN "F"
 
 #define KV_STORAGE_HASH_SIZE 32
+#define KV_LIST_INDEX_THRESHOLD 16
+
+#define KV_CUCKOO_BUCKETS 64
+#define KV_CUCKOO_STASH_SIZE 8
+#define KV_CUCKOO_MAX_PATH 5
+
+#define KV_CHECKSUM_BLOCK_LINES 1024
+
+#define KV_READER_BUFFER_SIZE (64 * 1024)
+
+#define KV_BITCASK_KEYDIR_SIZE 1024
+#define KV_BITCASK_MAX_FILE_SIZE (64 * 1024 * 1024)
+
+#define KV_LSM_MAX_LEVELS 7
+#define KV_LSM_MEMTABLE_SIZE (4 * 1024 * 1024)
+#define KV_LSM_TABLE_SIZE (8 * 1024 * 1024)
+#define KV_LSM_BLOCK_SIZE 4096
+#define KV_LSM_LEVEL0_TABLES 4
+#define KV_LSM_LEVEL_BASE_SIZE (32 * 1024 * 1024)
+#define KV_LSM_LEVEL_MULTIPLIER 10
+#define KV_LSM_BLOOM_BITS_PER_KEY 10
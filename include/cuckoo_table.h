@@ -0,0 +1,461 @@
+/**
+ * @file cuckoo_table.h
+ * @brief Bucketized cuckoo hash table storage backend
+ *
+ * This module provides a cuckoo hash table for storing database entries with
+ * a bounded lookup cost. Every key has two candidate buckets of
+ * KV_CUCKOO_BUCKET_SLOTS slots, each bucket filling one cache line, so a
+ * lookup reads at most two buckets and compares the keys of the slots whose
+ * tag matches. The second bucket is derived from the first and the tag of
+ * the key, so entries can be moved without hashing their key again.
+ *
+ * When both buckets of a new key are full, a breadth-first search finds the
+ * shortest path of at most KV_CUCKOO_MAX_PATH displacements to a free slot.
+ * Keys that still find no room go to a small stash, also read by lookups
+ * while it is not empty, and the table doubles once the stash is full.
+ *
+ * Lookups take no lock. Writers are serialized by a mutex and bump a version
+ * counter around every change to a bucket, and readers retry when a version
+ * was odd or changed while they read, as in libcuckoo. Entries are moved by
+ * writing their new slot before clearing the old one, so a concurrent lookup
+ * never misses a key that is being displaced.
+ *
+ * Stored entries are never modified: an update publishes a new entry in the
+ * slot of the old one. Deleted and replaced entries and replaced bucket
+ * arrays are only freed once no lookup is running, and a lookup copies the
+ * entry it found before it ends, so the caller reads a copy that no writer
+ * can free.
+ */
+#pragma once
+
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "kv_parser.h"
+#include "kv_key.h"
+#include "kv_log.h"
+
+
+/** @brief Slots of a bucket, the tags and entry pointers fill one cache line */
+#define KV_CUCKOO_BUCKET_SLOTS 4
+
+/** @brief Version counters shared by the buckets, bucket i uses counter i % KV_CUCKOO_VERSION_STRIPES */
+#define KV_CUCKOO_VERSION_STRIPES 256
+
+/** @brief Buckets visited at most by the search for a displacement path */
+#define KV_CUCKOO_SEARCH_SIZE 256
+
+/**
+ * @brief Bucket of the table, aligned to a cache line
+ *
+ * A slot is empty when its entry is NULL. The tag holds the upper half of the
+ * key hash, so most slots are ruled out without reading their entry.
+ */
+typedef struct _cuckoo_bucket_t {
+  _Alignas(64) _Atomic uint32_t tags[KV_CUCKOO_BUCKET_SLOTS]; /**< Upper 32 bits of the kv_key_hash() of each key */
+  _Atomic(db_entry_t*) entries[KV_CUCKOO_BUCKET_SLOTS];        /**< Entries of the slots, NULL if empty */
+} cuckoo_bucket_t;
+
+/**
+ * @brief Array of buckets, replaced as a whole when the table grows
+ */
+typedef struct _cuckoo_array_t {
+  uint64_t mask;            /**< Number of buckets minus one, the number of buckets is a power of two */
+  uint64_t block_size;      /**< Bytes allocated for the array and its buckets */
+  cuckoo_bucket_t *buckets; /**< Buckets, allocated right after the array */
+} cuckoo_array_t;
+
+/**
+ * @brief Deleted entry or replaced bucket array waiting for the running lookups
+ */
+typedef struct _cuckoo_retired_t {
+  void *ptr;                       /**< Entry or array to free */
+  bool array;                      /**< True for a cuckoo_array_t, false for a db_entry_t */
+  struct _cuckoo_retired_t *next;  /**< Next retired block */
+} cuckoo_retired_t;
+
+/**
+ * @brief Position of an entry, in a bucket or in the stash
+ */
+typedef struct _cuckoo_position_t {
+  int64_t bucket; /**< Bucket of the entry, -1 for the stash */
+  int64_t slot;   /**< Slot in the bucket or in the stash */
+} cuckoo_position_t;
+
+/**
+ * @brief Bucket visited by the search for a displacement path
+ */
+typedef struct _cuckoo_search_node_t {
+  uint64_t bucket; /**< Bucket visited */
+  int64_t parent;  /**< Node whose entry would move into this bucket, -1 for the buckets of the new key */
+  uint64_t slot;   /**< Slot of that entry in the bucket of the parent */
+  uint64_t depth;  /**< Displacements needed to free a slot of this bucket */
+} cuckoo_search_node_t;
+
+/**
+ * @brief Copy of the last entry found by the lookups of a thread
+ */
+typedef struct _cuckoo_reader_t {
+  db_entry_t entry;  /**< Copy of the entry, its value points to the buffer */
+  uint8_t *buffer;   /**< Copy of the value */
+  uint64_t capacity; /**< Bytes of the buffer */
+} cuckoo_reader_t;
+
+/**
+ * @brief Cuckoo hash table structure for storing database entries
+ */
+typedef struct _cuckoo_table_t {
+  _Atomic(cuckoo_array_t*) array;                              /**< Current bucket array */
+  _Atomic uint64_t versions[KV_CUCKOO_VERSION_STRIPES];        /**< Odd while a writer changes one of their buckets */
+  _Atomic(db_entry_t*) stash[KV_CUCKOO_STASH_SIZE];            /**< Entries that found no slot in their buckets */
+  _Atomic uint64_t stash_version;                              /**< Odd while a writer changes the stash */
+  _Atomic uint64_t stash_count;                                /**< Entries in the stash */
+  _Atomic uint64_t readers;                                    /**< Lookups running, retired blocks wait for zero */
+  pthread_mutex_t writer;                                      /**< Serializes inserts, puts and deletes */
+  _Atomic uint64_t count;                                      /**< Number of entries, read without the writer lock */
+  uint64_t displacements;                                      /**< Entries moved to make room since creation */
+  uint64_t max_path;                                           /**< Longest displacement path taken */
+  uint64_t resizes;                                            /**< Times the bucket array doubled */
+  cuckoo_retired_t *retired;                                   /**< Blocks freed once no lookup is running */
+  kv_memory_t *memory;                                         /**< Memory of the table, its buckets and entries, NULL for kv_default_memory */
+} cuckoo_table_t;
+
+/**
+ * @brief Occupancy and displacement counters of a cuckoo hash table
+ */
+typedef struct _cuckoo_stats_t {
+  uint64_t entries;       /**< Number of entries */
+  uint64_t buckets;       /**< Number of buckets */
+  uint64_t slots;         /**< Slots of all the buckets */
+  double load_factor;     /**< Entries per slot */
+  uint64_t stash_entries; /**< Entries in the stash */
+  uint64_t displacements; /**< Entries moved to make room since creation */
+  uint64_t max_path;      /**< Longest displacement path taken */
+  uint64_t resizes;       /**< Times the bucket array doubled */
+} cuckoo_stats_t;
+
+/**
+ * @brief Computes the other candidate bucket of a key
+ *
+ * @param bucket One of the two buckets of the key
+ * @param tag Tag of the key
+ * @param mask Mask of the bucket array
+ * @return uint64_t The other bucket, applying it twice gives back bucket
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t alt_bucket(uint64_t bucket, uint32_t tag, uint64_t mask);
+
+/**
+ * @brief Allocates a bucket array with empty buckets
+ *
+ * @param memory Memory of the table
+ * @param bucket_count Number of buckets, a power of two
+ * @return cuckoo_array_t* The array, or NULL if it could not be allocated
+ *
+ * @note This is a static/internal function
+ */
+static cuckoo_array_t *create_bucket_array(kv_memory_t *memory, uint64_t bucket_count);
+
+/**
+ * @brief Marks the start of a change protected by a version counter
+ *
+ * @note This is a static/internal function, writers hold the writer mutex
+ */
+static void begin_version(_Atomic uint64_t *version);
+
+/**
+ * @brief Marks the end of a change protected by a version counter
+ *
+ * @note This is a static/internal function, writers hold the writer mutex
+ */
+static void end_version(_Atomic uint64_t *version);
+
+/**
+ * @brief Stores an entry in a slot of a bucket, or empties it with NULL
+ *
+ * @note This is a static/internal function
+ */
+static void write_bucket_slot(cuckoo_table_t *cuckoo, cuckoo_array_t *array, uint64_t bucket,
+                       uint64_t slot, uint32_t tag, db_entry_t *entry);
+
+/**
+ * @brief Stores an entry in a slot of the stash, or empties it with NULL
+ *
+ * @note This is a static/internal function
+ */
+static void write_stash(cuckoo_table_t *cuckoo, uint64_t slot, db_entry_t *entry);
+
+/**
+ * @brief Searches a bucket for a key
+ *
+ * @param bucket Bucket to search
+ * @param tag Tag of the key
+ * @param probe Key to look up
+ * @return int64_t Slot of the key, or -1 if it is not in the bucket
+ *
+ * @note This is a static/internal function
+ */
+static int64_t search_bucket(cuckoo_bucket_t *bucket, uint32_t tag, const kv_key_probe_t *probe);
+
+/**
+ * @brief Searches the stash for a key
+ *
+ * @return int64_t Slot of the key in the stash, or -1 if it is not there
+ *
+ * @note This is a static/internal function
+ */
+static int64_t search_stash(cuckoo_table_t *cuckoo, const kv_key_probe_t *probe);
+
+/**
+ * @brief Finds the position of a key, for writers
+ *
+ * @param cuckoo Pointer to the table, with the writer mutex held
+ * @param probe Key to look up
+ * @param position Pointer receiving the position of the key
+ * @return bool True if the key is stored
+ *
+ * @note This is a static/internal function
+ */
+static bool find_position(cuckoo_table_t *cuckoo, const kv_key_probe_t *probe, cuckoo_position_t *position);
+
+/**
+ * @brief Creates the key of the per-thread copies of the lookups
+ *
+ * @note This is a static/internal function run once through pthread_once()
+ */
+static void init_cuckoo_reader_key();
+
+/**
+ * @brief Frees the copy of a thread when it exits
+ *
+ * @note This is a static/internal function
+ */
+static void free_cuckoo_reader(void *arg);
+
+/**
+ * @brief Returns the copy of the calling thread, creating it on its first lookup
+ *
+ * @return cuckoo_reader_t* Copy of the thread, or NULL if it could not be allocated
+ *
+ * @note This is a static/internal function
+ */
+static cuckoo_reader_t *get_cuckoo_reader();
+
+/**
+ * @brief Copies an entry into the copy of a thread
+ *
+ * @param reader Copy of the calling thread
+ * @param entry Stored entry, which must not be freed during the call
+ * @return db_entry_t* The copy, or NULL if its buffer could not grow
+ *
+ * @note This is a static/internal function
+ */
+static db_entry_t *copy_to_reader(cuckoo_reader_t *reader, db_entry_t *entry);
+
+/**
+ * @brief Looks a key up without locking, retrying while writers change its buckets
+ *
+ * @param cuckoo Pointer to the table
+ * @param probe Key to look up
+ * @param reader Copy of the calling thread, receiving the entry found
+ * @return db_entry_t* Copy of the entry of the key, or NULL if it is not stored
+ *
+ * @note This is a static/internal function
+ */
+static db_entry_t *optimistic_lookup(cuckoo_table_t *cuckoo, const kv_key_probe_t *probe,
+                                     cuckoo_reader_t *reader);
+
+/**
+ * @brief Searches breadth-first for the shortest path of displacements to a free slot
+ *
+ * @param array Bucket array to search
+ * @param first First bucket of the new key
+ * @param second Second bucket of the new key
+ * @param queue Buckets visited, KV_CUCKOO_SEARCH_SIZE nodes
+ * @param free_slot Pointer receiving the free slot of the last bucket of the path
+ * @return int64_t Node of the last bucket of the path, or -1 if there is none
+ *
+ * @note This is a static/internal function
+ */
+static int64_t search_cuckoo_path(cuckoo_array_t *array, uint64_t first, uint64_t second,
+                           cuckoo_search_node_t *queue, uint64_t *free_slot);
+
+/**
+ * @brief Stores an entry in one of its buckets, displacing other entries if needed
+ *
+ * @param cuckoo Pointer to the table, with the writer mutex held
+ * @param array Bucket array to store the entry in
+ * @param entry Entry to store, with a padded key
+ * @param hash kv_key_hash() of the key of the entry
+ * @return bool False if no free slot is reachable
+ *
+ * @note This is a static/internal function
+ */
+static bool place_cuckoo_entry(cuckoo_table_t *cuckoo, cuckoo_array_t *array, db_entry_t *entry, uint64_t hash);
+
+/**
+ * @brief Moves the entries of the stash whose buckets have room back into them
+ *
+ * @note This is a static/internal function
+ */
+static void drain_stash(cuckoo_table_t *cuckoo);
+
+/**
+ * @brief Replaces the bucket array with one at least twice as large
+ *
+ * Every entry of the old array and of the stash is placed in the new array
+ * before it is published, the array doubles again until they all fit.
+ *
+ * @param cuckoo Pointer to the table, with the writer mutex held
+ * @return int64_t KV_OK on success, KV_OOM if the array could not be allocated
+ *
+ * @note This is a static/internal function
+ */
+static int64_t grow_cuckoo_table(cuckoo_table_t *cuckoo);
+
+/**
+ * @brief Frees an entry or array no longer reachable, or defers it while lookups run
+ *
+ * @note This is a static/internal function
+ */
+static void retire_block(cuckoo_table_t *cuckoo, void *ptr, bool array);
+
+/**
+ * @brief Frees the retired blocks if no lookup is running
+ *
+ * @param cuckoo Pointer to the table
+ * @param wait True to wait for the running lookups to finish
+ *
+ * @note This is a static/internal function
+ */
+static void reclaim_blocks(cuckoo_table_t *cuckoo, bool wait);
+
+/**
+ * @brief Inserts an entry with the writer mutex held
+ *
+ * @return int64_t KV_OK on success, KV_EXISTS if the key is already stored,
+ *                 KV_OOM if the table could not grow
+ *
+ * @note This is a static/internal function
+ */
+static int64_t cuckoo_insert_locked(cuckoo_table_t *cuckoo, db_entry_t *entry, const kv_key_probe_t *probe);
+
+/**
+ * @brief Creates a new empty cuckoo hash table of KV_CUCKOO_BUCKETS buckets
+ *
+ * @param memory Memory of the table, its buckets and the entries it creates,
+ *               NULL for kv_default_memory
+ * @return cuckoo_table_t* Pointer to the newly created table, or NULL on failure
+ *
+ * @note The caller is responsible for freeing the table using free_cuckoo_table()
+ * @see free_cuckoo_table()
+ */
+extern cuckoo_table_t *create_cuckoo_table(kv_memory_t *memory);
+
+/**
+ * @brief Inserts a database entry into the cuckoo hash table
+ *
+ * @param cuckoo Pointer to the table
+ * @param entry Pointer to the database entry to insert
+ * @return int64_t KV_OK on success, KV_EXISTS if the key is already stored,
+ *                 or another negative kv_status_t on failure
+ *
+ * @note The table takes ownership of the entry pointer
+ * @note Duplicate keys are left unchanged and the entry is not taken
+ * @note A lazy entry is parsed here, since stored entries are shared with
+ *       lookups and never modified
+ * @see cuckoo_put(), cuckoo_delete()
+ */
+extern int64_t cuckoo_insert(cuckoo_table_t *cuckoo, db_entry_t *entry);
+
+/**
+ * @brief Creates or updates the entry of a key
+ *
+ * @param cuckoo Pointer to the table
+ * @param key Key for the entry (null-terminated string)
+ * @param value Text of a number or bool, or bytes of a string or blob
+ * @param len Number of bytes of the value
+ * @param type Type identifier for the value (e.g., "int32", "float", "bool")
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if type is empty and the key
+ *                 does not exist, or another negative kv_status_t on failure
+ *
+ * @note An update replaces the entry of the key with a new one, the old entry
+ *       is freed like a deleted one
+ * @see cuckoo_insert(), cuckoo_get_entry()
+ */
+extern int64_t cuckoo_put(cuckoo_table_t *cuckoo, uint8_t *key, uint8_t *value, uint64_t len, uint8_t *type);
+
+/**
+ * @brief Deletes an entry from the cuckoo hash table by key
+ *
+ * @param cuckoo Pointer to the table
+ * @param key Key of the entry to delete (null-terminated string)
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if the key does not exist,
+ *                 or another negative kv_status_t on failure
+ *
+ * @note The entry is freed at once if no lookup is running, when the last
+ *       running lookup of a later write has finished otherwise
+ * @see cuckoo_get_entry(), cuckoo_insert()
+ */
+extern int64_t cuckoo_delete(cuckoo_table_t *cuckoo, uint8_t *key);
+
+/**
+ * @brief Retrieves an entry from the cuckoo hash table by key
+ *
+ * Reads at most the two buckets of the key, and the stash while it holds
+ * entries. Safe to call while another thread writes to the table.
+ *
+ * @param cuckoo Pointer to the table
+ * @param key Key of the entry to retrieve (null-terminated string)
+ * @return db_entry_t* Pointer to a copy of the found entry, or NULL if not found
+ *
+ * @note The copy belongs to the calling thread and is only valid until its
+ *       next lookup in a cuckoo hash table, writers never change it
+ * @see cuckoo_put(), cuckoo_delete()
+ */
+extern db_entry_t *cuckoo_get_entry(cuckoo_table_t *cuckoo, uint8_t *key);
+
+/**
+ * @brief Saves all entries in the cuckoo hash table to a file
+ *
+ * @param file Open file pointer for writing
+ * @param cuckoo Pointer to the table to save
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note The order of entries in the file is not guaranteed due to hashing
+ * @see cuckoo_insert(), parse_line()
+ */
+extern int64_t cuckoo_save(FILE *file, cuckoo_table_t *cuckoo);
+
+/**
+ * @brief Frees the table, its buckets and all its entries
+ *
+ * @param cuckoo Pointer to the table to free (can be NULL)
+ *
+ * @note No lookup may be running on the table
+ * @see create_cuckoo_table()
+ */
+extern void free_cuckoo_table(cuckoo_table_t *cuckoo);
+
+/**
+ * @brief Prints all entries in the cuckoo hash table to stdout
+ *
+ * @param cuckoo Pointer to the table to print
+ *
+ * @note Entries are printed in bucket order, not insertion order
+ * @see print_entry()
+ */
+extern void cuckoo_print(cuckoo_table_t *cuckoo);
+
+/**
+ * @brief Reads the occupancy and displacement counters of a cuckoo hash table
+ *
+ * @param cuckoo Pointer to the table
+ * @param out Pointer receiving the statistics
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @see cuckoo_stats_t
+ */
+extern int64_t cuckoo_stats(cuckoo_table_t *cuckoo, cuckoo_stats_t *out);
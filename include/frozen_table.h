@@ -0,0 +1,250 @@
+/**
+ * @file frozen_table.h
+ * @brief Read-only storage backend indexed by a minimal perfect hash
+ *
+ * A frozen table is built once from the entries of another storage and then
+ * only read. Its keys are spread over buckets of about KV_FROZEN_BUCKET_KEYS
+ * keys, and each bucket gets a 32-bit pilot chosen so that its keys land on
+ * free slots, as in CHD and PTHash. Buckets are placed from the largest to
+ * the smallest, so the last keys only need a single free slot. With as many
+ * slots as keys the hash is minimal: a lookup hashes the key once, reads the
+ * pilot of its bucket and compares the key of the one slot it maps to.
+ *
+ * The whole table is a single image: a header, the pilots, an array of
+ * fixed-size slots holding the padded key, type and size of every entry, and
+ * the values packed after them. The image is written as is by save_db() and
+ * mapped read-only by load_db(), so processes opening the same file share its
+ * pages and a lookup touches no other memory.
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "kv_parser.h"
+#include "kv_key.h"
+#include "checksum.h"
+#include "kv_log.h"
+
+
+/** @brief First bytes of a frozen image */
+#define KV_FROZEN_MAGIC "KVFROZEN"
+
+/** @brief Layout version of the frozen images written by frozen_write() */
+#define KV_FROZEN_VERSION 2
+
+/** @brief Average number of keys per bucket of the perfect hash */
+#define KV_FROZEN_BUCKET_KEYS 4
+
+/** @brief Hash seeds tried before building a frozen table fails */
+#define KV_FROZEN_SEEDS 16
+
+/**
+ * @brief Header at the start of a frozen image
+ */
+typedef struct _frozen_header_t {
+  uint8_t magic[8];   /**< KV_FROZEN_MAGIC, not null-terminated */
+  uint32_t version;   /**< KV_FROZEN_VERSION */
+  uint32_t crc;       /**< crc32c() of the image after the header */
+  uint64_t count;     /**< Number of entries, and of slots */
+  uint64_t buckets;   /**< Number of buckets, and of pilots */
+  uint64_t seed;      /**< Seed mixed into the hash of every key */
+  uint64_t size;      /**< Bytes of the whole image */
+} frozen_header_t;
+
+/**
+ * @brief Slot of a frozen table, holding one entry
+ */
+typedef struct _frozen_slot_t {
+  uint8_t key[SM_BUFFER_SIZE]; /**< Key, zero-padded to SM_BUFFER_SIZE bytes */
+  int64_t type;                /**< Type identifier from ENTRY_VALUE_TYPE enum */
+  uint64_t size;               /**< Size of the value, as in db_entry_t */
+  uint64_t offset;             /**< Offset of the value from the start of the image */
+} frozen_slot_t;
+
+/**
+ * @brief Frozen table structure
+ */
+typedef struct _frozen_table_t {
+  uint8_t *image;               /**< Image of the table, allocated or mapped */
+  uint64_t size;                /**< Bytes of the image */
+  bool mapped;                  /**< True if the image is a mapped file */
+  const uint32_t *pilots;       /**< Pilot of each bucket, inside the image */
+  const frozen_slot_t *slots;   /**< Slots, inside the image */
+  uint64_t count;               /**< Number of entries */
+  uint64_t buckets;             /**< Number of buckets */
+  uint64_t seed;                /**< Seed of the key hashes */
+  kv_memory_t *memory;          /**< Memory of the table and its built images, NULL for kv_default_memory */
+} frozen_table_t;
+
+/**
+ * @brief Mixes the bits of a 64-bit value
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t frozen_mix(uint64_t value);
+
+/**
+ * @brief Hashes a key for a seed
+ *
+ * @param key_hash kv_key_hash() of the padded key
+ * @param seed Seed of the table
+ * @return uint64_t Hash selecting the bucket and slot of the key
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t frozen_key_hash(uint64_t key_hash, uint64_t seed);
+
+/**
+ * @brief Maps the hash of a key to its bucket
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t frozen_bucket(uint64_t hash, uint64_t buckets);
+
+/**
+ * @brief Maps the hash of a key and the pilot of its bucket to a slot
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t frozen_position(uint64_t hash, uint32_t pilot, uint64_t count);
+
+/**
+ * @brief Rounds a size up to a multiple of eight bytes, the alignment of the slots and values
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t frozen_align(uint64_t size);
+
+/**
+ * @brief Bytes a value takes in the image, before alignment
+ *
+ * @return int64_t Size of the value block, or -1 for an unknown type
+ *
+ * @note This is a static/internal function
+ */
+static int64_t frozen_value_size(int64_t type, uint64_t size);
+
+/**
+ * @brief Chooses the pilot of every bucket and the slot of every key
+ *
+ * @param hashes kv_key_hash() of every key
+ * @param count Number of keys
+ * @param buckets Number of buckets
+ * @param seed Seed mixed into the hashes
+ * @param pilots Receives the pilot of each bucket
+ * @param positions Receives the slot of each key
+ * @param work Scratch space of 2 * count + 2 * buckets + 1 + (count + 63) / 64 words
+ * @return int64_t KV_OK on success, KV_EXISTS if two keys have the same
+ *                 hash, KV_ERROR if no pilot was found for a bucket
+ *
+ * @note This is a static/internal function
+ */
+static int64_t assign_pilots(const uint64_t *hashes, uint64_t count, uint64_t buckets, uint64_t seed,
+                             uint32_t *pilots, uint64_t *positions, uint64_t *work);
+
+/**
+ * @brief Points the table at an image and its sections
+ *
+ * @note This is a static/internal function
+ */
+static void attach_image(frozen_table_t *frozen, uint8_t *image, uint64_t size, bool mapped);
+
+/**
+ * @brief Frees or unmaps the image of a table
+ *
+ * @note This is a static/internal function
+ */
+static void release_image(frozen_table_t *frozen);
+
+/**
+ * @brief Checks that a mapped image is complete and not corrupt
+ *
+ * @param image Start of the image
+ * @param size Size of the file holding the image
+ * @return int64_t 0 if the image is valid, -1 otherwise
+ *
+ * @note This is a static/internal function
+ */
+static int64_t verify_image(const uint8_t *image, uint64_t size);
+
+/**
+ * @brief Fills an entry with the key and value of a slot
+ *
+ * @note This is a static/internal function
+ */
+static void fill_entry(frozen_table_t *frozen, const frozen_slot_t *slot, db_entry_t *entry);
+
+/**
+ * @brief Creates an empty frozen table
+ *
+ * @param memory Memory of the table, NULL for kv_default_memory
+ * @return frozen_table_t* Pointer to the new table, or NULL on failure
+ *
+ * @note The caller is responsible for freeing the returned table using free_frozen_table()
+ */
+extern frozen_table_t *create_frozen_table(kv_memory_t *memory);
+
+/**
+ * @brief Builds the image of a table from a set of entries
+ *
+ * Lazy entries are materialized first. The entries are copied into the image,
+ * so they stay owned by the caller.
+ *
+ * @param frozen Pointer to the table, its previous image is released
+ * @param entries Entries to freeze, with distinct keys
+ * @param count Number of entries
+ * @return int64_t KV_OK on success, KV_OOM, KV_TYPE_MISMATCH if a lazy value
+ *                 does not parse, or KV_ERROR if no perfect hash was found
+ */
+extern int64_t frozen_build(frozen_table_t *frozen, db_entry_t **entries, uint64_t count);
+
+/**
+ * @brief Maps a frozen image written by frozen_write()
+ *
+ * @param frozen Pointer to the table, its previous image is released on success
+ * @param file_path Path of the image
+ * @return int64_t KV_OK on success, KV_IO if the file can not be read or is corrupt
+ *
+ * @note The image stays mapped until the table is freed or another image is
+ *       opened, and is not counted in the memory of the table
+ */
+extern int64_t frozen_open(frozen_table_t *frozen, uint8_t *file_path);
+
+/**
+ * @brief Writes the image of a table to an open file
+ *
+ * @param file Open file pointer for writing
+ * @param frozen Pointer to the table
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t frozen_write(FILE *file, frozen_table_t *frozen);
+
+/**
+ * @brief Looks up an entry by key
+ *
+ * @param frozen Pointer to the table
+ * @param key Key to look up
+ * @return db_entry_t* Pointer to the entry, or NULL if the key does not exist
+ *
+ * @note The entry belongs to the calling thread and is only valid until its
+ *       next lookup in a frozen table. Its value points into the image and
+ *       must not be modified
+ */
+extern db_entry_t *frozen_get_entry(frozen_table_t *frozen, uint8_t *key);
+
+/**
+ * @brief Frees a table and releases its image
+ *
+ * @param frozen Pointer to the table
+ */
+extern void free_frozen_table(frozen_table_t *frozen);
+
+/**
+ * @brief Prints every entry of a table
+ *
+ * @param frozen Pointer to the table
+ */
+extern void frozen_print(frozen_table_t *frozen);
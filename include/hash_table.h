@@ -12,6 +12,9 @@
 #include "linked_list.h"
 
 
+/** @brief Chain lengths counted by hash_stats(), longer chains share the last slot */
+#define KV_HASH_STATS_CHAIN_SLOTS 16
+
 /**
  * @brief Hash table structure for storing database entries
  * 
@@ -21,8 +24,33 @@
 typedef struct _hash_table_t {
   list_t **content;         /**< Array of pointers to linked lists (buckets) */
   uint64_t size;           /**< Number of buckets in the hash table */
+  uint64_t count;          /**< Number of entries in the hash table */
+  kv_memory_t *memory;     /**< Memory of the table, its buckets and entries, NULL for kv_default_memory */
 } hash_table_t;
 
+/**
+ * @brief Distribution of the entries of a hash table over its buckets
+ * 
+ * The expected probe counts are the key comparisons of a lookup. A hit is
+ * averaged over the stored keys, and a miss walks the whole chain of a
+ * bucket picked as often as stored keys land in it, so missing keys are
+ * assumed to hash like the stored ones. Chains long enough to have an index
+ * count the slots of the index probed instead. With a uniform hash they
+ * approach 1 + load_factor / 2 and 1 + load_factor, larger values mean the
+ * keys are clustered.
+ */
+typedef struct _hash_stats_t {
+  uint64_t entries;                                  /**< Number of entries */
+  uint64_t buckets;                                  /**< Number of buckets */
+  double load_factor;                                /**< Entries per bucket */
+  uint64_t empty_buckets;                            /**< Buckets without entries */
+  uint64_t max_chain;                                /**< Length of the longest chain */
+  double mean_chain;                                 /**< Mean length of the non-empty chains */
+  double expected_hit_probes;                        /**< Mean comparisons to find a stored key */
+  double expected_miss_probes;                       /**< Mean comparisons to rule out a missing key */
+  uint64_t chain_lengths[KV_HASH_STATS_CHAIN_SLOTS]; /**< Buckets per chain length, the last slot counts longer chains too */
+} hash_stats_t;
+
 /**
  * @brief Calculates hash code for a given key
  * 
@@ -38,6 +66,21 @@ typedef struct _hash_table_t {
  */
 static int64_t calculate_hash_code(uint8_t *key, uint64_t size);
 
+/**
+ * @brief Counts the key comparisons of lookups in a chain with an index
+ * 
+ * Chains of KV_LIST_INDEX_THRESHOLD entries or more are searched through the
+ * open addressing index of their list, so a lookup compares the keys of the
+ * slots it probes instead of walking the chain.
+ * 
+ * @param list Chain with an index
+ * @param hit_probes Receives the comparisons of finding every key once
+ * @param miss_probes Receives the mean comparisons of a missing key
+ * 
+ * @note This is a static/internal function
+ */
+static void indexed_chain_probes(list_t *list, uint64_t *hit_probes, double *miss_probes);
+
 /**
  * @brief Creates a new hash table with the specified number of buckets
  * 
@@ -45,13 +88,15 @@ static int64_t calculate_hash_code(uint8_t *key, uint64_t size);
  * Each bucket is initialized as an empty linked list for collision handling.
  * 
  * @param size Number of buckets to create in the hash table
+ * @param memory Memory of the table, its buckets and the entries it creates,
+ *               NULL for kv_default_memory
  * @return hash_table_t* Pointer to the newly created hash table, or NULL on failure
  * 
  * @note The caller is responsible for freeing the hash table using free_hash_table()
  * @note Larger sizes generally provide better performance but use more memory
  * @see free_hash_table()
  */
-extern hash_table_t* create_hash_table(uint64_t size);
+extern hash_table_t* create_hash_table(uint64_t size, kv_memory_t *memory);
 
 /**
  * @brief Inserts a database entry into the hash table
@@ -62,10 +107,11 @@ extern hash_table_t* create_hash_table(uint64_t size);
  * 
  * @param hash Pointer to the hash table
  * @param entry Pointer to the database entry to insert
- * @return int64_t 0 on success, -1 on failure
+ * @return int64_t KV_OK on success, KV_EXISTS if the key is already stored,
+ *                 or another negative kv_status_t on failure
  * 
  * @note The hash table takes ownership of the entry pointer
- * @note Duplicate keys result in value updates, not multiple entries
+ * @note Duplicate keys are left unchanged and the entry is not taken
  * @note Average time complexity: O(1), worst case: O(n) with many collisions
  * @see hash_put(), hash_delete()
  */
@@ -80,15 +126,17 @@ extern int64_t hash_insert(hash_table_t *hash, db_entry_t *entry);
  * 
  * @param hash Pointer to the hash table
  * @param key Key for the entry (null-terminated string)
- * @param value Value for the entry (null-terminated string)
+ * @param value Text of a number or bool, or bytes of a string or blob
+ * @param len Number of bytes of the value
  * @param type Type identifier for the value (e.g., "int32", "float", "bool")
- * @return int64_t 0 on success, -1 on failure
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if type is empty and the key
+ *                 does not exist, or another negative kv_status_t on failure
  * 
  * @note All parameters must be non-NULL and non-empty strings
  * @note Average time complexity: O(1)
  * @see hash_insert(), hash_get_entry()
  */
-extern int64_t hash_put(hash_table_t *hash, uint8_t *key, uint8_t* value, uint8_t* type);
+extern int64_t hash_put(hash_table_t *hash, uint8_t *key, uint8_t* value, uint64_t len, uint8_t* type);
 
 /**
  * @brief Deletes an entry from the hash table by key
@@ -98,7 +146,8 @@ extern int64_t hash_put(hash_table_t *hash, uint8_t *key, uint8_t* value, uint8_
  * 
  * @param hash Pointer to the hash table
  * @param key Key of the entry to delete (null-terminated string)
- * @return int64_t 0 on success, -1 on failure (including if key not found)
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if the key does not exist,
+ *                 or another negative kv_status_t on failure
  * 
  * @note The key parameter must be non-NULL and non-empty
  * @note Average time complexity: O(1)
@@ -167,3 +216,15 @@ extern void free_hash_table(hash_table_t *hash);
  * @see print_entry(), list_print()
  */
 extern void hash_print(hash_table_t *hash);
+
+/**
+ * @brief Measures how the entries of a hash table are spread over its buckets
+ * 
+ * @param hash Pointer to the hash table
+ * @param out Pointer receiving the statistics
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note Walks every bucket once, O(size) time
+ * @see hash_stats_t
+ */
+extern int64_t hash_stats(hash_table_t *hash, hash_stats_t *out);
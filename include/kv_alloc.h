@@ -0,0 +1,171 @@
+/**
+ * @file kv_alloc.h
+ * @brief Pluggable allocator of the in-memory structures and its accounting
+ *
+ * The entries, values, list nodes, hash buckets and buffers of a database
+ * are allocated through the hooks of a kv_allocator_t, so an arena, a pool
+ * or an allocator such as jemalloc or mimalloc can be plugged in with
+ * create_db_with_allocator(). The hooks receive the size of every block they
+ * free or resize, as the callers always know it, so they do not need to keep
+ * it themselves.
+ *
+ * A kv_memory_t pairs the hooks with the bytes and number of blocks in use
+ * in each KV_ALLOC_CATEGORY, updated with relaxed atomics. A failed
+ * allocation sets errno to ENOMEM, so a hook refusing to go over a limit
+ * makes the operation fail with KV_OOM.
+ */
+#pragma once
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+
+#include "kv_log.h"
+
+
+/**
+ * @brief What an allocation is used for
+ */
+enum KV_ALLOC_CATEGORY {
+  KV_ALLOC_ENTRIES, /**< db_entry_t structures */
+  KV_ALLOC_NODES,   /**< Nodes of the linked lists */
+  KV_ALLOC_VALUES,  /**< Converted values of the entries */
+  KV_ALLOC_BUCKETS, /**< Bucket arrays and chains of the hash tables */
+  KV_ALLOC_BUFFERS, /**< Load blocks, tokenizers, snapshots and other bookkeeping */
+  KV_ALLOC_CATEGORY_COUNT
+};
+
+/**
+ * @brief Allocation hooks
+ *
+ * realloc may be NULL, resizes then allocate a new block, copy and free the
+ * old one.
+ */
+typedef struct _kv_allocator_t {
+  void *(*alloc)(void *context, uint64_t size);                                  /**< Returns a block of size bytes, or NULL */
+  void *(*realloc)(void *context, void *ptr, uint64_t old_size, uint64_t new_size); /**< Resizes a block, or returns NULL and keeps it */
+  void (*free)(void *context, void *ptr, uint64_t size);                         /**< Frees a block of size bytes */
+  void *context;                                                                 /**< User context passed to the hooks */
+} kv_allocator_t;
+
+/**
+ * @brief Allocator of a database and the blocks it has in use
+ */
+typedef struct _kv_memory_t {
+  kv_allocator_t allocator;                          /**< Hooks of the allocator */
+  _Atomic uint64_t bytes[KV_ALLOC_CATEGORY_COUNT];   /**< Bytes in use per KV_ALLOC_CATEGORY */
+  _Atomic uint64_t blocks[KV_ALLOC_CATEGORY_COUNT];  /**< Blocks in use per KV_ALLOC_CATEGORY */
+} kv_memory_t;
+
+/**
+ * @brief Memory in use, read by kv_memory_usage() and db_memory_usage()
+ */
+typedef struct _kv_memory_usage_t {
+  uint64_t bytes[KV_ALLOC_CATEGORY_COUNT];  /**< Bytes in use per KV_ALLOC_CATEGORY */
+  uint64_t blocks[KV_ALLOC_CATEGORY_COUNT]; /**< Blocks in use per KV_ALLOC_CATEGORY */
+  uint64_t total_bytes;                     /**< Bytes in use in all the categories */
+  uint64_t total_blocks;                    /**< Blocks in use in all the categories */
+} kv_memory_usage_t;
+
+/**
+ * @brief malloc() based memory of the structures created without a database
+ *
+ * Used by create_entry(), create_list() and the other functions given a NULL
+ * kv_memory_t. Its blocks are plain malloc() blocks that may be released
+ * with free().
+ */
+extern kv_memory_t kv_default_memory;
+
+/**
+ * @brief Allocation hook calling malloc()
+ *
+ * @note This is a static/internal function
+ */
+static void *libc_alloc(void *context, uint64_t size);
+
+/**
+ * @brief Resize hook calling realloc()
+ *
+ * @note This is a static/internal function
+ */
+static void *libc_realloc(void *context, void *ptr, uint64_t old_size, uint64_t new_size);
+
+/**
+ * @brief Free hook calling free()
+ *
+ * @note This is a static/internal function
+ */
+static void libc_free(void *context, void *ptr, uint64_t size);
+
+/**
+ * @brief Adds or removes a block from the accounting of a memory
+ *
+ * @param memory Pointer to the memory
+ * @param category KV_ALLOC_CATEGORY of the block
+ * @param size Size of the block
+ * @param added True for a new block, false for a freed one
+ *
+ * @note This is a static/internal function
+ */
+static void account_block(kv_memory_t *memory, int64_t category, uint64_t size, bool added);
+
+/**
+ * @brief Initializes a memory with zeroed accounting
+ *
+ * @param memory Pointer to the memory
+ * @param allocator Hooks to use, copied, or NULL for malloc()
+ * @return int64_t 0 on success, -1 if alloc or free is missing
+ */
+extern int64_t kv_memory_init(kv_memory_t *memory, const kv_allocator_t *allocator);
+
+/**
+ * @brief Allocates a block
+ *
+ * @param memory Pointer to the memory, NULL for kv_default_memory
+ * @param category KV_ALLOC_CATEGORY of the block
+ * @param size Size of the block
+ * @return void* Pointer to the block, or NULL with errno set to ENOMEM
+ */
+extern void *kv_alloc(kv_memory_t *memory, int64_t category, uint64_t size);
+
+/**
+ * @brief Allocates a zeroed block
+ *
+ * @see kv_alloc()
+ */
+extern void *kv_calloc(kv_memory_t *memory, int64_t category, uint64_t size);
+
+/**
+ * @brief Resizes a block, allocating it if ptr is NULL
+ *
+ * @param memory Pointer to the memory of the block, NULL for kv_default_memory
+ * @param category KV_ALLOC_CATEGORY of the block
+ * @param ptr Pointer to the block, or NULL
+ * @param old_size Current size of the block, 0 if ptr is NULL
+ * @param new_size Size to resize the block to
+ * @return void* Pointer to the resized block, or NULL with errno set to
+ *               ENOMEM, the block is then left unchanged
+ */
+extern void *kv_realloc(kv_memory_t *memory, int64_t category, void *ptr, uint64_t old_size, uint64_t new_size);
+
+/**
+ * @brief Frees a block
+ *
+ * @param memory Pointer to the memory of the block, NULL for kv_default_memory
+ * @param category KV_ALLOC_CATEGORY the block was allocated with
+ * @param ptr Pointer to the block, may be NULL
+ * @param size Size the block was allocated or last resized with
+ */
+extern void kv_free(kv_memory_t *memory, int64_t category, void *ptr, uint64_t size);
+
+/**
+ * @brief Reads the blocks in use of a memory
+ *
+ * @param memory Pointer to the memory
+ * @param out Pointer receiving the usage
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t kv_memory_usage(kv_memory_t *memory, kv_memory_usage_t *out);
@@ -7,47 +7,392 @@
  */
 #pragma once
 
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
 #include "kv_parser.h"
+#include "checksum.h"
 #include "linked_list.h"
 #include "hash_table.h"
+#include "cuckoo_table.h"
+#include "frozen_table.h"
+#include "bitcask.h"
+#include "lsm_tree.h"
+#include "kv_stats.h"
+#include "kv_trace.h"
+
+
+/**
+ * @brief Durability guarantees of the files written by save_db()
+ */
+enum DB_DURABILITY {
+  DB_DURABILITY_RELAXED, /**< Atomic rename only, no fsync (throwaway caches) */
+  DB_DURABILITY_SYNC     /**< fsync the file and its directory around the rename */
+};
+
+/**
+ * @brief How load_db() reads a text database file, DB_LOAD_RECOVER can be
+ *        combined with either of the other modes
+ */
+enum DB_LOAD_MODE {
+  DB_LOAD_EAGER = 0,  /**< Parse every value while loading */
+  DB_LOAD_LAZY = 1,   /**< Map the file and parse each value on its first get_entry() */
+  DB_LOAD_RECOVER = 2 /**< Skip and report corrupt blocks instead of failing */
+};
+
+/**
+ * @brief Outcome of the checksum verification of the last load_db()
+ */
+typedef struct _db_load_report_t {
+  uint64_t blocks_verified;    /**< Blocks whose checksum matched */
+  uint64_t corrupt_blocks;     /**< Blocks skipped by DB_LOAD_RECOVER */
+  uint64_t lines_skipped;      /**< Lines not loaded because they were corrupt */
+  uint64_t first_corrupt_line; /**< First line of the first corrupt block, 0 if none */
+} db_load_report_t;
+
+/**
+ * @brief Lines read by load_db() since the last checksum line
+ * 
+ * The entries of a block are only inserted once the checksum line closing
+ * the block has been verified.
+ */
+typedef struct _db_load_block_t {
+  db_entry_t **entries;     /**< Entries parsed from the lines of the block */
+  uint64_t entry_count;     /**< Number of parsed entries */
+  uint64_t capacity;        /**< Allocated size of the entries array */
+  uint64_t lines;           /**< Lines of the block, blank and comment lines included */
+  uint64_t malformed;       /**< Lines of the block that could not be parsed */
+  uint64_t first_malformed; /**< Line number of the first line that could not be parsed */
+  uint64_t first_line;      /**< Line number of the first line of the block */
+  uint64_t line_number;     /**< Line number of the next line of the file */
+  uint32_t crc;             /**< CRC32C of the lines of the block */
+  bool checksummed;         /**< True once a checksum line has been read */
+} db_load_block_t;
+
+/**
+ * @brief File mapped by a lazy load, kept until the database is freed
+ */
+typedef struct _db_mapping_t {
+  void *addr;                  /**< Start of the mapping */
+  uint64_t size;               /**< Size of the mapping */
+  struct _db_mapping_t *next;  /**< Next mapping of the database */
+} db_mapping_t;
 
+/**
+ * @brief Progress and completion report of a background snapshot
+ * 
+ * Passed to the snapshot callback every time the snapshot process reports
+ * progress, and one last time with done set once it has finished.
+ */
+typedef struct _db_snapshot_status_t {
+  bool done;                /**< True on the final report */
+  int64_t result;           /**< 0 on success, -1 on failure (valid when done) */
+  uint64_t entries_written; /**< Entries written to the snapshot so far */
+  uint64_t entries_total;   /**< Entries in the database when the snapshot started */
+  uint64_t elapsed_us;      /**< Microseconds since the snapshot started */
+} db_snapshot_status_t;
+
+/**
+ * @brief Callback invoked with the progress of a background snapshot
+ * 
+ * @note Runs on the snapshot watcher thread, not on the caller's thread
+ */
+typedef void (*db_snapshot_callback_t)(db_snapshot_status_t *status, void *context);
+
+/**
+ * @brief Callback receiving the entries of scan_db() in key order
+ * 
+ * @return int64_t 0 to continue the scan, a negative value to stop it
+ */
+typedef int64_t (*db_scan_callback_t)(db_entry_t *entry, void *context);
+
+/**
+ * @brief State of a background snapshot started by save_db_async()
+ */
+typedef struct _db_snapshot_t {
+  pid_t pid;                       /**< Process writing the snapshot */
+  int32_t progress_fd;             /**< Read end of the progress pipe */
+  pthread_t watcher;               /**< Thread relaying progress to the callback */
+  db_snapshot_callback_t callback; /**< User callback, can be NULL */
+  void *context;                   /**< User context passed to the callback */
+  struct timespec start;           /**< Monotonic time the snapshot started */
+  db_snapshot_status_t status;     /**< Last reported status */
+  _Atomic bool finished;           /**< Set once the final callback has returned */
+} db_snapshot_t;
 
 /**
  * @brief Database structure representing a key-value store
  * 
  * This structure contains the storage type and a pointer to the underlying
- * storage implementation (either linked list or hash table).
+ * storage implementation (linked list, hash table, bitcask or LSM tree).
  */
 typedef struct _db_t {
-  uint8_t storage_type[SM_BUFFER_SIZE]; /**< Storage type identifier ("L" for list, "H" for hash) */
+  uint8_t storage_type[SM_BUFFER_SIZE]; /**< Storage type identifier ("L" for list, "H" for hash, "C" for cuckoo hash, "F" for frozen, "B" for bitcask, "T" for LSM tree) */
   void *storage;                        /**< Pointer to the underlying storage structure */
+  db_snapshot_t *snapshot;              /**< Background snapshot in progress, or NULL */
+  int64_t durability;                   /**< DB_DURABILITY mode used when saving */
+  int64_t load_mode;                    /**< DB_LOAD_MODE flags used when loading */
+  db_mapping_t *mappings;               /**< Files mapped by lazy loads */
+  db_load_report_t load_report;         /**< Checksum report of the last load_db() */
+  kv_stats_t *stats;                    /**< Latency histograms and counters, see db_stats() */
+  kv_trace_t *trace;                    /**< Trace being recorded, or NULL, see start_db_trace() */
+  kv_memory_t memory;                   /**< Allocator of the database and its accounting, see db_memory_usage() */
 } db_t;
 
+/**
+ * @brief Adds one line of a text database file to the current block
+ * 
+ * Checksum lines close the block: it is verified and its entries inserted.
+ * 
+ * @param db Pointer to the database being loaded
+ * @param block Pointer to the current block
+ * @param tokens Spans of the line returned by the tokenizer
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note This is a static/internal function shared by both load modes
+ */
+static int64_t load_line(db_t *db, db_load_block_t *block, kv_tokens_t *tokens);
+
+/**
+ * @brief Inserts the entries of a verified block, or drops a corrupt one
+ * 
+ * @param db Pointer to the database being loaded
+ * @param block Pointer to the block to finish, reset for the next block
+ * @param intact True if the checksum of the block matched
+ * @return int64_t 0 on success, -1 on failure or on a corrupt block
+ *                 outside DB_LOAD_RECOVER mode
+ * 
+ * @note This is a static/internal function
+ */
+static int64_t finish_block(db_t *db, db_load_block_t *block, bool intact);
+
+/**
+ * @brief Finishes the last block at the end of a text database file
+ * 
+ * Files without any checksum line are accepted as they are. In a
+ * checksummed file, lines after the last checksum line are a torn write.
+ * 
+ * @param db Pointer to the database being loaded
+ * @param block Pointer to the current block, freed
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note This is a static/internal function
+ */
+static int64_t finish_load(db_t *db, db_load_block_t *block);
+
+/**
+ * @brief Frees the entries of a block that were not inserted
+ * 
+ * @param block Pointer to the block
+ * 
+ * @note This is a static/internal function
+ */
+static void free_block(db_t *db, db_load_block_t *block);
+
+/**
+ * @brief Maps a text database file and inserts the entries of its lines
+ * 
+ * The mapping is tokenized in place and kept until the database is freed,
+ * since the lazy entries point into it.
+ * 
+ * @param db Pointer to the database to load data into
+ * @param fd Open file descriptor of the database file
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note This is a static/internal function used by load_db_file() in DB_LOAD_LAZY mode
+ */
+static int64_t load_db_mapped(db_t *db, int32_t fd);
+
+/**
+ * @brief Reads a text database file in chunks and inserts the entries of its lines
+ * 
+ * Lines of any length are supported, the read buffer only grows to fit the
+ * longest one.
+ * 
+ * @param db Pointer to the database to load data into
+ * @param fd Open file descriptor of the database file
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note This is a static/internal function used by load_db_file() in eager mode
+ */
+static int64_t load_db_stream(db_t *db, int32_t fd);
+
+/**
+ * @brief Loads a text database file with the load mode of the database
+ * 
+ * @param db Pointer to the database to load data into
+ * @param file_path Path to the file containing the database data
+ * @return int64_t KV_OK on success, KV_IO if the file can not be read or is
+ *                 corrupt, KV_OOM, or another negative kv_status_t on failure
+ * 
+ * @note This is a static/internal function used by load_db() for list and hash databases
+ */
+static int64_t load_db_file(db_t *db, uint8_t *file_path);
+
+/**
+ * @brief Writes the database to a temporary file and moves it over file_path
+ * 
+ * The temporary file is renamed over the destination atomically, so a crash
+ * leaves either the old or the new file in place. With DB_DURABILITY_SYNC the
+ * temporary file is fsynced before the rename and the parent directory after it.
+ * 
+ * @param db Pointer to the database to save
+ * @param file_path Path where the database should be saved
+ * @param progress_fd Descriptor receiving the running entry count, or -1
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note This is a static/internal function shared by save_db() and save_db_async()
+ */
+static int64_t write_db_file(db_t *db, uint8_t *file_path, int32_t progress_fd);
+
+/**
+ * @brief Flushes the directory entry of a file to disk
+ * 
+ * @param file_path Path of a file whose parent directory should be synced
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note This is a static/internal function
+ */
+static int64_t sync_parent_dir(uint8_t *file_path);
+
+/**
+ * @brief Writes every entry of the database storage to an open file
+ * 
+ * @param file Open file pointer for writing
+ * @param db Pointer to the database to write
+ * @param progress_fd Descriptor receiving the running entry count, or -1
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note This is a static/internal function shared by save_db() and save_db_async()
+ */
+static int64_t save_storage(FILE *file, db_t *db, int32_t progress_fd);
+
+/**
+ * @brief Counts the entries held by the database storage
+ * 
+ * @param db Pointer to the database
+ * @return uint64_t Number of entries
+ * 
+ * @note This is a static/internal function
+ */
+static uint64_t count_entries(db_t *db);
+
+/**
+ * @brief Counts the entries of storages that keep their count
+ * 
+ * @param db Pointer to the database
+ * @return int64_t Number of entries, or -1 for an LSM tree
+ * 
+ * @note This is a static/internal function used to tell the inserts of
+ *       put_entry_span() from its updates
+ */
+static int64_t tracked_entries(db_t *db);
+
+/**
+ * @brief Computes the microseconds elapsed since a monotonic timestamp
+ * 
+ * @param start Monotonic timestamp taken with clock_gettime()
+ * @return uint64_t Elapsed microseconds
+ * 
+ * @note This is a static/internal function
+ */
+static uint64_t elapsed_us_since(struct timespec *start);
+
+/**
+ * @brief Relays snapshot progress to the user callback until the snapshot ends
+ * 
+ * @param arg Pointer to the snapshot being watched
+ * @return void* Always NULL
+ * 
+ * @note This is a static/internal function run on the watcher thread
+ */
+static void *watch_snapshot(void *arg);
+
 /**
  * @brief Creates a new database instance with the specified storage type
  * 
- * @param storage_type Storage type identifier ("L" for linked list, "H" for hash table)
+ * @param storage_type Storage type identifier ("L" for linked list, "H" for hash table,
+ *                     "C" for cuckoo hash table, "F" for frozen table, "B" for bitcask,
+ *                     "T" for LSM tree)
  * @return db_t* Pointer to the newly created database, or NULL on failure
  * 
  * @note The caller is responsible for freeing the returned database using free_db()
- * @see free_db()
+ * @note Bitcask and LSM tree databases have to be attached to their directory
+ *       with load_db() before they accept entries
+ * @see free_db(), create_db_with_allocator()
  */
 extern db_t* create_db(uint8_t *storage_type);
 
+/**
+ * @brief Creates a new database whose memory comes from the given allocator
+ * 
+ * The db_t and the entries, values, list nodes, hash buckets and load
+ * buffers of the database are allocated through the hooks of the allocator.
+ * All but the db_t are counted per KV_ALLOC_CATEGORY, see db_memory_usage().
+ * 
+ * @param storage_type Storage type identifier, see create_db()
+ * @param allocator Hooks to allocate with, copied, or NULL for malloc()
+ * @return db_t* Pointer to the newly created database, or NULL on failure
+ * 
+ * @note The caller is responsible for freeing the returned database using free_db()
+ * @note Entries given to insert_entry() keep the memory they were created
+ *       with, create them with create_entry_with_memory() and &db->memory to
+ *       count them in the database
+ * @note Bitcask and LSM tree databases only allocate their in-memory
+ *       structures, such as their key directory and memtable, with malloc()
+ * @see create_db(), kv_allocator_t
+ */
+extern db_t* create_db_with_allocator(uint8_t *storage_type, const kv_allocator_t *allocator);
+
 /**
  * @brief Loads database entries from a file
  * 
  * Reads key-value pairs from the specified file and populates the database.
+ * Bitcask and LSM tree databases are instead attached to the directory at
+ * file_path, which is created if it does not exist, and frozen databases map
+ * the image written by save_db() at file_path.
  * 
  * @param db Pointer to the database to load data into
  * @param file_path Path to the file containing the database data
- * @return int64_t 0 on success, -1 on failure
+ * @return int64_t KV_OK on success, KV_IO if the file can not be read or is
+ *                 corrupt, KV_OOM, or another negative kv_status_t on failure
  * 
  * @note The database should be created before calling this function
- * @see save_db()
+ * @note In DB_LOAD_LAZY mode only keys are indexed, see set_db_load_mode()
+ * @note The checksum lines written by save_db() are verified, entries are only
+ *       inserted once their block has been verified. The outcome is kept in
+ *       db->load_report
+ * @see save_db(), set_db_load_mode()
  */
 extern int64_t load_db(db_t *db, uint8_t *file_path);
 
+/**
+ * @brief Selects how load_db() reads the values of list and hash databases
+ * 
+ * DB_LOAD_EAGER (the default) parses every value while loading. DB_LOAD_LAZY
+ * maps the file and only indexes the keys; each value is parsed the first time
+ * get_entry() returns it and cached afterwards, so load time and memory follow
+ * the keys actually read instead of the size of the file.
+ * 
+ * load_db() fails on the first block whose checksum does not match. With
+ * DB_LOAD_RECOVER added to the mode, corrupt blocks are logged, counted in
+ * db->load_report and skipped, and the rest of the file is loaded.
+ * 
+ * @param db Pointer to the database
+ * @param load_mode DB_LOAD_MODE flags
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note The mapped files stay mapped until free_db()
+ * @see load_db()
+ */
+extern int64_t set_db_load_mode(db_t *db, int64_t load_mode);
+
 /**
  * @brief Saves database entries to a file
  * 
@@ -56,13 +401,135 @@ extern int64_t load_db(db_t *db, uint8_t *file_path);
  * 
  * @param db Pointer to the database to save
  * @param file_path Path where the database should be saved
- * @return int64_t 0 on success, -1 on failure
+ * @return int64_t KV_OK on success, KV_IO if the file can not be written,
+ *                 or another negative kv_status_t on failure
  * 
  * @note The original file is replaced only if the save operation succeeds
- * @see load_db()
+ * @note The durability of the replacement depends on set_db_durability()
+ * @note Saving a bitcask database to its own directory syncs the active data
+ *       file, and saving an LSM tree to its own directory syncs its write-ahead
+ *       log; any other path receives a copy in the text format
+ * @note Frozen databases are saved as their binary image, see freeze_db()
+ * @note Text files get a checksum line every KV_CHECKSUM_BLOCK_LINES lines
+ * @see load_db(), set_db_durability()
  */
 extern int64_t save_db(db_t *db, uint8_t *file_path);
 
+/**
+ * @brief Selects the durability guarantees of save_db() and save_db_async()
+ * 
+ * DB_DURABILITY_SYNC (the default) survives power loss at any point of a save.
+ * DB_DURABILITY_RELAXED keeps the atomic rename but skips the fsync calls,
+ * trading crash safety for latency.
+ * 
+ * @param db Pointer to the database
+ * @param durability DB_DURABILITY mode
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @see save_db()
+ */
+extern int64_t set_db_durability(db_t *db, int64_t durability);
+
+/**
+ * @brief Saves database entries to a file without blocking the caller
+ * 
+ * Forks a child process that writes a point-in-time snapshot of the database
+ * while the caller keeps reading and mutating it; the kernel's copy-on-write
+ * keeps the child's view consistent. A watcher thread reports the progress of
+ * the snapshot to the callback, and reports its result and duration once it
+ * has finished.
+ * 
+ * @param db Pointer to the database to save
+ * @param file_path Path where the database should be saved
+ * @param callback Function receiving progress and completion reports, can be NULL
+ * @param context User pointer passed to the callback
+ * @return int64_t 0 if the snapshot was started, -1 on failure
+ * 
+ * @note Only one snapshot can run at a time for a database; a snapshot whose
+ *       final callback has returned is reaped by the next call
+ * @note Progress is reported once per hash table bucket, or once for lists
+ * @see wait_db_snapshot(), save_db()
+ */
+extern int64_t save_db_async(db_t *db, uint8_t *file_path, db_snapshot_callback_t callback, void *context);
+
+/**
+ * @brief Waits for the background snapshot of a database to finish
+ * 
+ * @param db Pointer to the database
+ * @return int64_t Result of the snapshot (0 on success, -1 on failure),
+ *                 or 0 if no snapshot was running
+ * 
+ * @note The final callback has been invoked when this function returns
+ * @see save_db_async()
+ */
+extern int64_t wait_db_snapshot(db_t *db);
+
+/**
+ * @brief Reclaims the space of overwritten and deleted entries
+ * 
+ * Starts a background merge of the data files of a bitcask database, or
+ * flushes the memtable of an LSM tree and compacts its level 0 tables.
+ * 
+ * @param db Pointer to the database
+ * @return int64_t 0 on success, -1 on failure or if the storage has nothing to compact
+ * 
+ * @note free_db() waits for a running merge
+ */
+extern int64_t compact_db(db_t *db);
+
+/**
+ * @brief Calls a function for every entry in a key range, in key order
+ * 
+ * @param db Pointer to the database
+ * @param start_key Smallest key to return, or NULL for no lower bound
+ * @param end_key Key at which the scan stops (excluded), or NULL for no upper bound
+ * @param callback Function receiving the entries
+ * @param context User pointer passed to the callback
+ * @return int64_t Number of entries passed to the callback, or -1 on failure
+ * 
+ * @note Only LSM tree databases keep their entries ordered and support scans
+ * @note The entry passed to the callback is only valid during the call, and
+ *       the callback must not call into the database
+ */
+extern int64_t scan_db(db_t *db, uint8_t *start_key, uint8_t *end_key,
+                       db_scan_callback_t callback, void *context);
+
+/**
+ * @brief Gathers the entries of a list, hash or cuckoo hash storage
+ * 
+ * @param db Pointer to the database
+ * @param entries Array receiving at least count_entries() entries
+ * @return uint64_t Number of entries gathered
+ * 
+ * @note This is a static/internal function used by freeze_db()
+ */
+static uint64_t collect_entries(db_t *db, db_entry_t **entries);
+
+/**
+ * @brief Turns a database into a read-only table indexed by a minimal perfect hash
+ * 
+ * Builds a KV_STORAGE_STRUCTURE_FROZEN table from the current entries, copying
+ * their keys and values into one contiguous image, and frees the previous
+ * storage. A lookup then hashes the key once, reads one slot and compares its
+ * key; puts, inserts and deletes fail with KV_READ_ONLY.
+ * 
+ * save_db() writes the image as is, and load_db() on a database created with
+ * KV_STORAGE_STRUCTURE_FROZEN maps such a file read-only, so readers share it
+ * without loading or parsing it.
+ * 
+ * @param db Pointer to a list, hash or cuckoo hash database
+ * @return int64_t KV_OK on success or if the database is already frozen,
+ *                 KV_OOM, or another negative kv_status_t on failure, in which
+ *                 case the database is left as it was
+ * 
+ * @note No other operation may run on the database while it is frozen
+ * @note Entries returned by get_entry() from a frozen database belong to the
+ *       calling thread and are only valid until its next lookup in a frozen
+ *       database; their values must not be modified
+ * @see load_db(), save_db()
+ */
+extern int64_t freeze_db(db_t *db);
+
 /**
  * @brief Inserts a database entry into the storage
  * 
@@ -71,7 +538,8 @@ extern int64_t save_db(db_t *db, uint8_t *file_path);
  * 
  * @param db Pointer to the database
  * @param entry Pointer to the entry to insert
- * @return int64_t 0 on success, -1 on failure
+ * @return int64_t KV_OK on success, KV_EXISTS if the key is already stored,
+ *                 or another negative kv_status_t on failure
  * 
  * @note The entry should be properly initialized before insertion
  * @see put_entry(), create_entry()
@@ -89,13 +557,32 @@ extern int64_t insert_entry(db_t *db, db_entry_t *entry);
  * @param key Key for the entry (null-terminated string)
  * @param value Value for the entry (null-terminated string)
  * @param type Type identifier for the value (e.g., "int", "string", "float")
- * @return int64_t 0 on success, -1 on failure
+ * @return int64_t KV_OK on success, or a negative kv_status_t on failure
  * 
  * @note All parameters must be non-NULL and non-empty strings
  * @see insert_entry(), get_entry()
  */
 extern int64_t put_entry(db_t *db, uint8_t *key, uint8_t *value, uint8_t *type);
 
+/**
+ * @brief Creates or updates an entry from a span of bytes
+ * 
+ * Same as put_entry(), but the value need not be null-terminated, so string
+ * and blob values may hold NUL bytes and delimiters.
+ * 
+ * @param db Pointer to the database
+ * @param key Key for the entry (null-terminated string)
+ * @param value Text of a number or bool, or bytes of a string or blob
+ * @param len Number of bytes of the value (must be non-zero)
+ * @param type Type identifier for the value (e.g., "int32", "string", "blob")
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if type is empty and the key
+ *                 does not exist, KV_TYPE_MISMATCH if the value does not
+ *                 convert to the type, or another negative kv_status_t
+ * 
+ * @see put_entry(), get_entry_span()
+ */
+extern int64_t put_entry_span(db_t *db, uint8_t *key, uint8_t *value, uint64_t len, uint8_t *type);
+
 /**
  * @brief Deletes an entry from the database by key
  * 
@@ -103,7 +590,8 @@ extern int64_t put_entry(db_t *db, uint8_t *key, uint8_t *value, uint8_t *type);
  * 
  * @param db Pointer to the database
  * @param key Key of the entry to delete (null-terminated string)
- * @return int64_t 0 on success, -1 on failure (including if key not found)
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if the key does not exist,
+ *                 or another negative kv_status_t on failure
  * 
  * @note The key parameter must be non-NULL and non-empty
  * @see get_entry(), put_entry()
@@ -119,17 +607,82 @@ extern int64_t delete_entry(db_t *db, uint8_t *key);
  * @param key Key of the entry to retrieve (null-terminated string)
  * @return db_entry_t* Pointer to the found entry, or NULL if not found or on error
  * 
- * @note The returned pointer points to the actual entry in the database,
- *       not a copy. Do not free the returned pointer directly.
+ * @note For list and hash databases the returned pointer points to the
+ *       actual entry in the database, not a copy. Do not free the returned
+ *       pointer directly.
+ * @note A missing key is not logged, use get_entry_span() to tell it apart
+ *       from an error
+ * @note For cuckoo hash, frozen, bitcask and LSM tree databases the entry
+ *       belongs to the calling thread, even while other threads write the
+ *       key, and is valid until the thread's next get from a database of the
+ *       same storage type. Bitcask and LSM tree entries are read from disk,
+ *       and saving, printing or scanning such a database reuses the entry
  * @see put_entry(), delete_entry()
  */
 extern db_entry_t* get_entry(db_t *db, uint8_t *key);
 
+/**
+ * @brief Returns a view of the bytes of the value of a key
+ * 
+ * @param db Pointer to the database
+ * @param key Key of the entry to retrieve (null-terminated string)
+ * @param value Pointer receiving the address and size of the value
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if the key does not exist,
+ *                 or another negative kv_status_t on failure
+ * 
+ * @note The value is not copied; it stays valid as long as the entry returned
+ *       by get_entry() would
+ * @see get_entry(), put_entry_span()
+ */
+extern int64_t get_entry_span(db_t *db, uint8_t *key, kv_span_t *value);
+
+/**
+ * @brief Finds the entry of a key in the storage of a database
+ * 
+ * @param db Pointer to the database
+ * @param key Key of the entry to find
+ * @return db_entry_t* Pointer to the entry, or NULL if the key does not exist
+ * 
+ * @note This is a static/internal function. Misses are not logged
+ */
+static db_entry_t* lookup_entry(db_t *db, uint8_t *key);
+
+/**
+ * @brief Records the outcome and latency of a get
+ * 
+ * @param db Pointer to the database
+ * @param hit True if the key was found
+ * @param bytes Size of the value returned
+ * @param start_ns Value of kv_stats_clock() when the get started
+ * 
+ * @note This is a static/internal function
+ */
+static void record_get(db_t *db, bool hit, uint64_t bytes, uint64_t start_ns);
+
+/**
+ * @brief Appends an operation to the trace of a database, if one is recorded
+ * 
+ * @param db Pointer to the database
+ * @param op KV_TRACE_OP of the operation
+ * @param status kv_status_t returned by the operation
+ * @param key Key of the operation
+ * @param value Value of a put, NULL otherwise
+ * @param len Length of the value
+ * @param type Type name of a put, NULL otherwise
+ * @param start_ns Value of kv_stats_clock() when the operation started, 0 if
+ *                 statistics are compiled out
+ * 
+ * @note This is a static/internal function
+ */
+static void trace_op(db_t *db, int64_t op, int64_t status, uint8_t *key,
+                     uint8_t *value, uint64_t len, uint8_t *type, uint64_t start_ns);
+
 /**
  * @brief Frees all memory associated with the database
  * 
  * Properly deallocates the database structure and all its contained entries.
  * This function should be called when the database is no longer needed.
+ * Waits for a running background snapshot to finish first.
  * 
  * @param db Pointer to the database to free
  * 
@@ -138,6 +691,24 @@ extern db_entry_t* get_entry(db_t *db, uint8_t *key);
  */
 extern void free_db(db_t *db);
 
+/**
+ * @brief Returns a database to its allocator
+ * 
+ * @param db Pointer to the database, its storage already freed
+ * 
+ * @note This is a static/internal function
+ */
+static void free_db_struct(db_t *db);
+
+/**
+ * @brief Frees the storage structure of a database and its entries
+ * 
+ * @param db Pointer to the database, its storage is set to NULL
+ * 
+ * @note This is a static/internal function shared by free_db() and freeze_db()
+ */
+static void free_storage(db_t *db);
+
 /**
  * @brief Prints all entries in the database to stdout
  * 
@@ -149,3 +720,95 @@ extern void free_db(db_t *db);
  * @note Output format depends on the underlying storage implementation
  */
 extern void print_db(db_t *db);
+
+/**
+ * @brief Returns the statistics of a database
+ * 
+ * Merges the counters and latency histograms updated by every thread since
+ * the database was created or since reset_db_stats().
+ * 
+ * @param db Pointer to the database
+ * @param out Pointer receiving the statistics
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note Percentiles of the histograms are given by stats_percentile()
+ * @note Puts to an LSM tree do not read the previous value, so they are all
+ *       counted as updates
+ * @see write_db_stats(), reset_db_stats()
+ */
+extern int64_t db_stats(db_t *db, db_stats_t *out);
+
+/**
+ * @brief Writes the statistics of a database in the Prometheus text format
+ * 
+ * @param db Pointer to the database
+ * @param file Stream to write to
+ * @return int64_t KV_OK on success, or a negative kv_status_t on failure
+ * 
+ * @see db_stats(), write_stats_prometheus()
+ */
+extern int64_t write_db_stats(db_t *db, FILE *file);
+
+/**
+ * @brief Zeroes the statistics of a database
+ * 
+ * @param db Pointer to the database
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t reset_db_stats(db_t *db);
+
+/**
+ * @brief Starts recording the gets, puts and deletes of a database
+ * 
+ * Each operation is appended to a compact binary trace with its key, value,
+ * type, status and start time, see kv_trace.h. Traces are replayed against
+ * any backend by the kv_replay benchmark.
+ * 
+ * @param db Pointer to the database
+ * @param path Path of the trace file, replaced if it exists
+ * @return int64_t KV_OK on success, KV_EXISTS if a trace is already being
+ *                 recorded, or another negative kv_status_t on failure
+ * 
+ * @note Loads and saves, and the entries they insert, are not recorded
+ * @note Must not be called while other threads use the database
+ * @see stop_db_trace()
+ */
+extern int64_t start_db_trace(db_t *db, uint8_t *path);
+
+/**
+ * @brief Stops recording a trace and writes its last records
+ * 
+ * @param db Pointer to the database
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if no trace is being
+ *                 recorded, KV_IO if records could not be written
+ * 
+ * @note free_db() stops the trace of the database
+ * @note Must not be called while other threads use the database
+ */
+extern int64_t stop_db_trace(db_t *db);
+
+/**
+ * @brief Measures the distribution of the keys of a hash database
+ * 
+ * @param db Pointer to a database created with KV_STORAGE_STRUCTURE_HASH
+ * @param out Pointer receiving the statistics
+ * @return int64_t 0 on success, -1 on failure or for other storages
+ * 
+ * @see hash_stats()
+ */
+extern int64_t db_hash_stats(db_t *db, hash_stats_t *out);
+
+/**
+ * @brief Returns the memory in use by a database
+ * 
+ * Counts the blocks allocated through the allocator of the database, per
+ * KV_ALLOC_CATEGORY, such as its entries, values and list nodes.
+ * 
+ * @param db Pointer to the database
+ * @param out Pointer receiving the bytes and blocks in use
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note The db_t itself is not counted
+ * @see create_db_with_allocator(), kv_memory_usage()
+ */
+extern int64_t db_memory_usage(db_t *db, kv_memory_usage_t *out);
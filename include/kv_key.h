@@ -0,0 +1,99 @@
+/**
+ * @file kv_key.h
+ * @brief Fixed-width comparison of the keys of the in-memory structures
+ *
+ * Keys are stored in buffers of SM_BUFFER_SIZE bytes, zero-padded past
+ * their terminating NUL. Two padded keys are equal exactly when their
+ * buffers are, so lookups compare whole buffers with two SSE2 or one AVX2
+ * compare and a movemask instead of calling strcmp() byte by byte. The
+ * implementation is picked once for the CPU, like the tokenizer's.
+ *
+ * The key looked up is padded once into a kv_key_probe_t, which then
+ * compares against every stored key of a chain or list, and hashed once for
+ * the key indexes of the lists.
+ */
+#pragma once
+
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "constants.h"
+
+
+/**
+ * @brief Padded key being looked up
+ */
+typedef struct _kv_key_probe_t {
+  _Alignas(32) uint8_t key[SM_BUFFER_SIZE];          /**< Key, zero-padded to SM_BUFFER_SIZE bytes */
+  bool (*equal)(const uint8_t *probe, const uint8_t *key); /**< Comparison supported by the CPU */
+  uint64_t hash;                                     /**< kv_key_hash() of the padded key */
+} kv_key_probe_t;
+
+/**
+ * @brief Selects the comparison implementation supported by the CPU
+ *
+ * @note This is a static/internal function run once through pthread_once()
+ */
+static void init_key_compare();
+
+/**
+ * @brief Compares two padded keys eight bytes at a time
+ *
+ * @note This is a static/internal function
+ */
+static bool key_equal_scalar(const uint8_t *probe, const uint8_t *key);
+
+/**
+ * @brief Compares two padded keys with two 16-byte SSE2 compares
+ *
+ * @note This is a static/internal function
+ */
+static bool key_equal_sse2(const uint8_t *probe, const uint8_t *key);
+
+/**
+ * @brief Compares two padded keys with one 32-byte AVX2 compare
+ *
+ * @note This is a static/internal function, only used when the CPU supports AVX2
+ */
+static bool key_equal_avx2(const uint8_t *probe, const uint8_t *key);
+
+/**
+ * @brief Zero-pads a key in place or into another buffer
+ *
+ * @param dest Buffer of SM_BUFFER_SIZE bytes receiving the padded key, may be key
+ * @param key Null-terminated key, truncated to SM_BUFFER_SIZE - 1 bytes like
+ *            the keys of create_entry()
+ * @return uint64_t Length of the padded key
+ */
+extern uint64_t kv_key_pad(uint8_t *dest, const uint8_t *key);
+
+/**
+ * @brief Hashes a padded key eight bytes at a time
+ *
+ * @param key Key zero-padded to SM_BUFFER_SIZE bytes
+ * @return uint64_t Hash of the key
+ */
+extern uint64_t kv_key_hash(const uint8_t *key);
+
+/**
+ * @brief Prepares the lookup of a key
+ *
+ * @param probe Pointer to the probe to initialize
+ * @param key Null-terminated key to look up
+ * @return bool False if the key is empty or too long to be stored, no stored
+ *              key can then be equal to it
+ */
+extern bool kv_key_probe(kv_key_probe_t *probe, const uint8_t *key);
+
+/**
+ * @brief Compares a probe with a stored key
+ *
+ * @param probe Pointer to a probe prepared by kv_key_probe()
+ * @param key Stored key, zero-padded to SM_BUFFER_SIZE bytes
+ * @return bool True if the keys are equal
+ */
+static inline bool kv_key_matches(const kv_key_probe_t *probe, const uint8_t *key) {
+  return probe->equal(probe->key, key);
+}
@@ -0,0 +1,37 @@
+/**
+ * @file kv_log.h
+ * @brief Logging with levels removed at compile time
+ *
+ * The library logs through kv_log() instead of calling logger() directly.
+ * Messages less severe than KV_LOG_LEVEL are compiled out: their format
+ * strings and arguments are never evaluated, so failure paths cost nothing
+ * in builds that do not want them.
+ */
+#pragma once
+
+#include "logger.h"
+
+
+/**
+ * @brief Least severe logger level compiled into the library
+ *
+ * Levels follow logger(): 3 for errors and 4 for warnings and information.
+ * Configure with -DKV_LOG_LEVEL=<level> at build time, 2 silences the
+ * library entirely.
+ */
+#ifndef KV_LOG_LEVEL
+#define KV_LOG_LEVEL 4
+#endif
+
+/**
+ * @brief Calls logger() if level is at most KV_LOG_LEVEL
+ *
+ * The level must be a constant expression so that the compiler drops the
+ * disabled calls.
+ */
+#define kv_log(level, ...)                \
+  do {                                    \
+    if ((level) <= KV_LOG_LEVEL) {        \
+      logger((level), __VA_ARGS__);       \
+    }                                     \
+  } while (0)
@@ -8,7 +8,10 @@
 #pragma once
 
 #include "string_conversion.h"
-#include "logger.h"
+#include "tokenizer.h"
+#include "kv_log.h"
+#include "kv_status.h"
+#include "kv_alloc.h"
 #include "constants.h"
 
 /** @brief Delimiter used to separate type from key in serialized format */
@@ -23,73 +26,86 @@
  * 
  * This structure stores a key-value pair where the value can be of various types
  * (integers, floats, booleans, etc.) and is dynamically allocated based on the type.
+ * String and blob values are byte arrays of the given size that may hold NUL
+ * bytes; the copy made by the entry is followed by a NUL that size excludes.
+ * The entry and its value are allocated from its memory, a value of a fixed
+ * size type takes map_datatype_size() bytes and any other size + 1 bytes.
  */
 typedef struct _db_entry_t {
   int64_t type;                    /**< Type identifier from ENTRY_VALUE_TYPE enum */
   uint8_t key[SM_BUFFER_SIZE];     /**< Key string (null-terminated) */
   void *value;                     /**< Pointer to dynamically allocated typed value */
+  uint64_t size;                   /**< Size of the value in bytes */
+  uint8_t *raw_value;              /**< Unparsed value text of a lazily loaded entry, or NULL */
+  uint64_t raw_size;               /**< Length of raw_value */
+  kv_memory_t *memory;             /**< Allocator of the entry and its value, NULL for kv_default_memory */
 } db_entry_t;
 
 /**
  * @brief Sets an integer value in a database entry
  * 
  * @param dest Pointer to the database entry to modify
- * @param str_value String representation of the integer value
+ * @param str_value Text of the integer value, not null-terminated
+ * @param len Length of the text
  * @param type_size Size of the target integer type (1, 2, 4, or 8 bytes)
  * @return int64_t 0 on success, -1 on failure
  * 
  * @note This is a static/internal function for integer type conversion
- * @see set_entry_value()
+ * @see set_entry_span()
  */
-static int64_t set_integer_value(db_entry_t *dest, uint8_t *str_value, uint64_t type_size);
+static int64_t set_integer_value(db_entry_t *dest, uint8_t *str_value, uint64_t len, uint64_t type_size);
 
 /**
  * @brief Sets a float value in a database entry
  * 
  * @param dest Pointer to the database entry to modify
- * @param str_value String representation of the float value
+ * @param str_value Text of the float value, not null-terminated
+ * @param len Length of the text
  * @return int64_t 0 on success, -1 on failure
  * 
  * @note This is a static/internal function for float type conversion
- * @see set_entry_value()
+ * @see set_entry_span()
  */
-static int64_t set_float_value(db_entry_t *dest, uint8_t *str_value);
+static int64_t set_float_value(db_entry_t *dest, uint8_t *str_value, uint64_t len);
 
 /**
  * @brief Sets a double value in a database entry
  * 
  * @param dest Pointer to the database entry to modify
- * @param str_value String representation of the double value
+ * @param str_value Text of the double value, not null-terminated
+ * @param len Length of the text
  * @return int64_t 0 on success, -1 on failure
  * 
  * @note This is a static/internal function for double type conversion
- * @see set_entry_value()
+ * @see set_entry_span()
  */
-static int64_t set_double_value(db_entry_t *dest, uint8_t *str_value);
+static int64_t set_double_value(db_entry_t *dest, uint8_t *str_value, uint64_t len);
 
 /**
  * @brief Sets a boolean value in a database entry
  * 
  * @param dest Pointer to the database entry to modify
- * @param str_value String representation of the boolean value ("true"/"false")
+ * @param str_value Text of the boolean value ("true"/"false"), not null-terminated
+ * @param len Length of the text
  * @return int64_t 0 on success, -1 on failure
  * 
  * @note This is a static/internal function for boolean type conversion
- * @see set_entry_value()
+ * @see set_entry_span()
  */
-static int64_t set_bool_value(db_entry_t *dest, uint8_t *str_value);
+static int64_t set_bool_value(db_entry_t *dest, uint8_t *str_value, uint64_t len);
 
 /**
- * @brief Sets a string value in a database entry
+ * @brief Sets a string or blob value in a database entry
  * 
  * @param dest Pointer to the database entry to modify
- * @param str_value String value to store
+ * @param str_value Bytes to store, copied as is
+ * @param len Number of bytes
  * @return int64_t 0 on success, -1 on failure
  * 
  * @note This is a static/internal function for string type conversion
- * @see set_entry_value()
+ * @see set_entry_span()
  */
-static int64_t set_string_value(db_entry_t *dest, uint8_t *str_value);
+static int64_t set_string_value(db_entry_t *dest, uint8_t *str_value, uint64_t len);
 
 /**
  * @brief Sets the value of a database entry based on its type
@@ -102,12 +118,65 @@ static int64_t set_string_value(db_entry_t *dest, uint8_t *str_value);
  * @param str_value String representation of the value to set
  * @return int64_t 0 on success, -1 on failure
  * 
- * @note The entry's type field must be properly initialized before calling
- * @note Any existing value will be freed and replaced
+ * @note The entry's type and memory fields must be properly initialized before calling
+ * @note Any existing value will be freed and replaced, and a pending raw value
+ *       of a lazily loaded entry is dropped
  * @see create_entry(), update_entry()
  */
 extern int64_t set_entry_value(db_entry_t *dest, uint8_t *str_value);
 
+/**
+ * @brief Sets the value of a database entry from a span of text
+ * 
+ * @param dest Pointer to the database entry (type field must be set)
+ * @param str_value Text of the value, not null-terminated
+ * @param len Length of the text
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note Numbers are converted in place, without copying the text
+ * @see set_entry_value()
+ */
+extern int64_t set_entry_span(db_entry_t *dest, uint8_t *str_value, uint64_t len);
+
+/**
+ * @brief Sets a string or blob value from its escaped text in a file
+ * 
+ * @param dest Pointer to the database entry to modify
+ * @param text Escaped text of the value, see escape_bytes()
+ * @param len Length of the text
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note This is a static/internal function for lazily loaded entries
+ * @see materialize_entry()
+ */
+static int64_t set_escaped_value(db_entry_t *dest, uint8_t *text, uint64_t len);
+
+/**
+ * @brief Returns the size of the block holding a value
+ * 
+ * @param type ENTRY_VALUE_TYPE of the value
+ * @param size Size of the value in bytes
+ * @return uint64_t Size the value was allocated with
+ * 
+ * @note This is a static/internal function, frees pass it to the allocator
+ */
+static uint64_t value_block_size(int64_t type, uint64_t size);
+
+/**
+ * @brief Converts a value to a type and replaces the value and type of an entry
+ * 
+ * @param dest Pointer to the database entry
+ * @param type ENTRY_VALUE_TYPE to convert to
+ * @param str_value Text of the value, not null-terminated
+ * @param len Length of the text
+ * @return int64_t 0 on success, a negative kv_status_t on failure, the
+ *                 entry is then left unchanged
+ * 
+ * @note This is a static/internal function shared by set_entry_span() and
+ *       update_entry_span(), the old value is freed with its old type
+ */
+static int64_t convert_entry_value(db_entry_t *dest, int64_t type, uint8_t *str_value, uint64_t len);
+
 /**
  * @brief Updates an existing database entry with new value and optionally new type
  * 
@@ -117,13 +186,28 @@ extern int64_t set_entry_value(db_entry_t *dest, uint8_t *str_value);
  * @param entry Pointer to the database entry to update
  * @param value New string representation of the value
  * @param type New type string (can be empty to preserve current type)
- * @return int64_t 0 on success, -1 on failure
+ * @return int64_t KV_OK on success, KV_TYPE_MISMATCH if the value does not
+ *                 convert to the type, or another negative kv_status_t
  * 
  * @note If type conversion fails, the entry remains unchanged
  * @see set_entry_value(), create_entry()
  */
 extern int64_t update_entry(db_entry_t *entry, uint8_t* value, uint8_t* type);
 
+/**
+ * @brief Updates an existing database entry from a span of bytes
+ * 
+ * @param entry Pointer to the database entry to update
+ * @param value Text of a number or bool, or bytes of a string or blob
+ * @param len Number of bytes, may include NUL bytes for strings and blobs
+ * @param type New type string (can be empty to preserve current type)
+ * @return int64_t KV_OK on success, KV_TYPE_MISMATCH if the value does not
+ *                 convert to the type, or another negative kv_status_t
+ * 
+ * @see update_entry()
+ */
+extern int64_t update_entry_span(db_entry_t *entry, uint8_t *value, uint64_t len, uint8_t *type);
+
 /**
  * @brief Creates a new database entry with the specified key, value, and type
  * 
@@ -141,6 +225,101 @@ extern int64_t update_entry(db_entry_t *entry, uint8_t* value, uint8_t* type);
  */
 extern db_entry_t* create_entry(uint8_t *key, uint8_t *value, uint8_t *type);
 
+/**
+ * @brief Creates a new database entry from a span of bytes
+ * 
+ * Same as create_entry(), but the value need not be null-terminated, so
+ * string and blob values may hold NUL bytes.
+ * 
+ * @param key Key string for the entry (must be non-empty)
+ * @param value Text of a number or bool, or bytes of a string or blob
+ * @param len Number of bytes of the value (must be non-zero)
+ * @param type Type identifier string (e.g., "int32", "string", "blob")
+ * @return db_entry_t* Pointer to the newly created entry, or NULL on failure
+ * 
+ * @note The caller is responsible for freeing the returned entry using free_entry()
+ * @see create_entry()
+ */
+extern db_entry_t* create_entry_span(uint8_t *key, uint8_t *value, uint64_t len, uint8_t *type);
+
+/**
+ * @brief Creates a database entry allocated from a given memory
+ * 
+ * Same as create_entry_span(), the entry and all its later values are
+ * allocated from memory.
+ * 
+ * @param memory Memory of the entry, NULL for kv_default_memory
+ * @param key Key string for the entry (must be non-empty)
+ * @param value Text of a number or bool, or bytes of a string or blob
+ * @param len Number of bytes of the value (must be non-zero)
+ * @param type Type identifier string (e.g., "int32", "string", "blob")
+ * @return db_entry_t* Pointer to the newly created entry, or NULL on failure
+ * 
+ * @note The caller is responsible for freeing the returned entry using free_entry()
+ * @see create_entry_span(), create_db_with_allocator()
+ */
+extern db_entry_t* create_entry_with_memory(kv_memory_t *memory, uint8_t *key, uint8_t *value,
+                                            uint64_t len, uint8_t *type);
+
+/**
+ * @brief Creates a database entry whose value is parsed on first use
+ * 
+ * The entry keeps a pointer to the value text instead of converting it, so the
+ * text must stay valid and unmodified until materialize_entry() is called or
+ * the entry is freed.
+ * 
+ * @param key Key string for the entry (must be non-empty)
+ * @param raw_value Value text, not null-terminated
+ * @param raw_size Length of the value text
+ * @param type Type identifier string (e.g., "int32", "float", "bool")
+ * @return db_entry_t* Pointer to the newly created entry, or NULL on failure
+ * 
+ * @note The caller is responsible for freeing the returned entry using free_entry()
+ * @see materialize_entry(), parse_line_lazy()
+ */
+extern db_entry_t* create_lazy_entry(uint8_t *key, uint8_t *raw_value, uint64_t raw_size, uint8_t *type);
+
+/**
+ * @brief Allocates an entry with a pending raw value and a mapped type
+ *
+ * @param memory Memory of the entry, NULL for kv_default_memory
+ * @param key Key bytes, not null-terminated
+ * @param key_len Length of the key, less than SM_BUFFER_SIZE
+ * @param raw_value Value text, not null-terminated
+ * @param raw_size Length of the value text
+ * @param type ENTRY_VALUE_TYPE enum value
+ * @return db_entry_t* Pointer to the new entry, or NULL on failure
+ *
+ * @note This is a static/internal function shared by create_lazy_entry() and
+ *       parse_tokens(), which map the type from a string and a span
+ */
+static db_entry_t* new_lazy_entry(kv_memory_t *memory, uint8_t *key, uint64_t key_len,
+                                  uint8_t *raw_value, uint64_t raw_size, int64_t type);
+
+/**
+ * @brief Converts the pending raw value of a lazily loaded entry
+ * 
+ * @param entry Pointer to the database entry
+ * @return int64_t 0 on success or if the value was already converted, -1 on failure
+ * 
+ * @note The converted value replaces the raw one, later calls do nothing
+ * @see create_lazy_entry()
+ */
+extern int64_t materialize_entry(db_entry_t *entry);
+
+/**
+ * @brief Returns a view of the bytes of the value of an entry
+ * 
+ * @param entry Pointer to the database entry
+ * @param value Pointer receiving the address and size of the value
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note The value is not copied, the view is valid until the entry is
+ *       updated or freed
+ * @note A pending raw value is converted first, see materialize_entry()
+ */
+extern int64_t get_value_span(db_entry_t *entry, kv_span_t *value);
+
 /**
  * @brief Parses a text line into a database entry
  * 
@@ -148,15 +327,60 @@ extern db_entry_t* create_entry(uint8_t *key, uint8_t *value, uint8_t *type);
  * Lines starting with '#' are treated as comments and ignored.
  * Empty lines or lines containing only whitespace are also ignored.
  * 
- * @param line Input line to parse (will be modified by strtok)
+ * @param line Input line to parse (null-terminated, left untouched)
  * @return db_entry_t* Pointer to the parsed entry, or NULL if parsing fails or line is ignored
  * 
- * @note The input line is modified during parsing (uses strtok)
+ * @note The function is reentrant, lines can be parsed from several threads
  * @note The caller is responsible for freeing the returned entry using free_entry()
- * @see create_entry(), parse_entry()
+ * @see create_entry(), parse_entry(), parse_tokens()
  */
 extern db_entry_t* parse_line(uint8_t *line);
 
+/**
+ * @brief Creates a database entry from the spans of a tokenized line
+ * 
+ * @param tokens Pointer to the spans returned by tokenizer_next() or tokenize_line()
+ * @param lazy True to keep the value text unconverted, see create_lazy_entry()
+ * @param memory Memory of the entry, NULL for kv_default_memory
+ * @return db_entry_t* Pointer to the new entry, or NULL if the line is not a
+ *                     valid entry
+ * 
+ * @note A lazy entry points into the tokenized buffer until it is materialized
+ * @see parse_line(), parse_line_lazy()
+ */
+extern db_entry_t* parse_tokens(kv_tokens_t *tokens, bool lazy, kv_memory_t *memory);
+
+/**
+ * @brief Parses a text line into a database entry without converting its value
+ * 
+ * Same format as parse_line(), but the line is left untouched and need not be
+ * null-terminated, so it can point into a read-only mapped file.
+ * 
+ * @param line Start of the line
+ * @param len Length of the line, including the newline if any
+ * @return db_entry_t* Pointer to a lazy entry, or NULL if parsing fails or line is ignored
+ * 
+ * @note The returned entry points into the line until it is materialized
+ * @see create_lazy_entry(), parse_line()
+ */
+extern db_entry_t* parse_line_lazy(uint8_t *line, uint64_t len);
+
+/**
+ * @brief Returns the text of the value of an entry
+ * 
+ * @param entry Pointer to the database entry
+ * @param buffer Buffer of NUMBER_FORMAT_BUFFER_SIZE bytes for converted values
+ * @param value Pointer receiving the raw value of a lazily loaded entry, or
+ *              the value converted or escaped into buffer
+ * @param allocated Pointer receiving the buffer allocated from the memory of
+ *                  the entry for an escaped value longer than buffer, and its
+ *                  size, to be freed by the caller, or a NULL pointer
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note This is a static/internal function
+ */
+static int64_t map_entry_value(db_entry_t *entry, uint8_t *buffer, kv_span_t *value, kv_span_t *allocated);
+
 /**
  * @brief Serializes a database entry into a text format
  * 
@@ -168,12 +392,28 @@ extern db_entry_t* parse_line(uint8_t *line);
  * @param max_len Maximum length of the destination buffer
  * @return int64_t 0 on success, -1 on failure
  * 
- * @note The destination buffer must be large enough to hold the serialized entry
+ * @note Fails if the serialized entry does not fit in the destination buffer
  * @note The resulting string includes a newline character at the end
- * @see parse_line(), print_entry()
+ * @note The raw value of a lazily loaded entry is written as is, without converting it
+ * @see write_entry(), parse_line(), print_entry()
  */
 extern int64_t parse_entry(db_entry_t *entry, uint8_t *dest, uint64_t max_len);
 
+/**
+ * @brief Writes a database entry to a stream in the text format "type:key=value;"
+ * 
+ * Unlike parse_entry(), the value is written straight to the stream, so
+ * entries of any length are written without an intermediate buffer.
+ * 
+ * @param file Stream receiving the entry and a newline
+ * @param entry Pointer to the database entry to write
+ * @return int64_t 0 on success, -1 on failure
+ * 
+ * @note The raw value of a lazily loaded entry is written as is, without converting it
+ * @see parse_entry()
+ */
+extern int64_t write_entry(FILE *file, db_entry_t *entry);
+
 /**
  * @brief Frees all memory associated with a database entry
  * 
@@ -0,0 +1,243 @@
+/**
+ * @file kv_stats.h
+ * @brief Latency histograms and counters of the operations on a database
+ *
+ * Every database keeps HDR-style histograms of the latency of its gets,
+ * puts, deletes, loads and saves, and counters of hits, misses, inserts,
+ * updates and bytes read and written. Latencies are bucketed by their
+ * power of two, each power being split in KV_STATS_SUB_BUCKETS linear
+ * sub-buckets, so any latency is kept within 1/KV_STATS_SUB_BUCKETS of its
+ * value with a fixed number of buckets.
+ *
+ * Updates go to one of KV_STATS_SHARDS cache-aligned shards picked once per
+ * thread, so threads do not contend on the same cache lines. The shards are
+ * only merged when the statistics are read.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "constants.h"
+#include "kv_log.h"
+
+
+/**
+ * @brief Set to 0 at build time to compile out the statistics
+ *
+ * Configure with -DKV_STATS=OFF, kv_stats_clock() then returns 0 and the
+ * recording macros expand to nothing.
+ */
+#ifndef KV_STATS_ENABLED
+#define KV_STATS_ENABLED 1
+#endif
+
+/** @brief log2 of the number of linear sub-buckets of each power of two */
+#define KV_STATS_SUB_BUCKET_BITS 3
+/** @brief Number of linear sub-buckets of each power of two */
+#define KV_STATS_SUB_BUCKETS (1 << KV_STATS_SUB_BUCKET_BITS)
+/** @brief Highest power of two of a latency in nanoseconds, about 18 minutes */
+#define KV_STATS_MAX_EXPONENT 40
+/** @brief Number of buckets of a latency histogram */
+#define KV_STATS_BUCKETS ((KV_STATS_MAX_EXPONENT - KV_STATS_SUB_BUCKET_BITS + 2) << KV_STATS_SUB_BUCKET_BITS)
+/** @brief Number of shards updated by the threads of a database */
+#define KV_STATS_SHARDS 16
+
+/**
+ * @brief Operations whose latency is recorded
+ */
+enum DB_STATS_OP {
+  DB_STATS_GET,    /**< get_entry() and get_entry_span() */
+  DB_STATS_PUT,    /**< put_entry() and put_entry_span() */
+  DB_STATS_DELETE, /**< delete_entry() */
+  DB_STATS_LOAD,   /**< load_db() */
+  DB_STATS_SAVE,   /**< save_db() */
+  DB_STATS_OP_COUNT
+};
+
+/**
+ * @brief Counters of a database
+ */
+enum DB_STATS_COUNTER {
+  DB_STATS_HITS,          /**< Gets that found their key */
+  DB_STATS_MISSES,        /**< Gets of a missing key */
+  DB_STATS_INSERTS,       /**< Entries added by inserts and puts of new keys */
+  DB_STATS_UPDATES,       /**< Puts that replaced the value of a key */
+  DB_STATS_BYTES_READ,    /**< Value bytes returned by gets and bytes of loaded files */
+  DB_STATS_BYTES_WRITTEN, /**< Value bytes of puts and bytes of saved files */
+  DB_STATS_COUNTER_COUNT
+};
+
+/**
+ * @brief Latency histogram of one operation
+ */
+typedef struct _kv_histogram_t {
+  uint64_t count;                     /**< Number of recorded operations */
+  uint64_t sum_ns;                    /**< Sum of the latencies in nanoseconds */
+  uint64_t max_ns;                    /**< Highest latency in nanoseconds */
+  uint64_t buckets[KV_STATS_BUCKETS]; /**< Operations per latency bucket */
+} kv_histogram_t;
+
+/**
+ * @brief Statistics of a database, merged from all the shards by db_stats()
+ */
+typedef struct _db_stats_t {
+  uint64_t hits;                               /**< Gets that found their key */
+  uint64_t misses;                             /**< Gets of a missing key */
+  uint64_t inserts;                            /**< Entries added by inserts and puts of new keys */
+  uint64_t updates;                            /**< Puts that replaced the value of a key */
+  uint64_t bytes_read;                         /**< Value bytes returned by gets and bytes of loaded files */
+  uint64_t bytes_written;                      /**< Value bytes of puts and bytes of saved files */
+  kv_histogram_t latency[DB_STATS_OP_COUNT];   /**< Latency histogram of each DB_STATS_OP */
+} db_stats_t;
+
+/**
+ * @brief Histogram of one shard, updated with relaxed atomics
+ */
+typedef struct _kv_stats_histogram_t {
+  _Atomic uint64_t count;                     /**< Number of recorded operations */
+  _Atomic uint64_t sum_ns;                    /**< Sum of the latencies in nanoseconds */
+  _Atomic uint64_t max_ns;                    /**< Highest latency in nanoseconds */
+  _Atomic uint64_t buckets[KV_STATS_BUCKETS]; /**< Operations per latency bucket */
+} kv_stats_histogram_t;
+
+/**
+ * @brief Counters and histograms updated by the threads assigned to a shard
+ */
+typedef struct _kv_stats_shard_t {
+  _Alignas(64) _Atomic uint64_t counters[DB_STATS_COUNTER_COUNT]; /**< Value of each DB_STATS_COUNTER */
+  kv_stats_histogram_t latency[DB_STATS_OP_COUNT];                /**< Histogram of each DB_STATS_OP */
+} kv_stats_shard_t;
+
+/**
+ * @brief Sharded statistics of a database
+ */
+typedef struct _kv_stats_t {
+  kv_stats_shard_t shards[KV_STATS_SHARDS]; /**< Shards, one picked per thread */
+} kv_stats_t;
+
+/**
+ * @brief Returns the shard of the calling thread
+ *
+ * @param stats Pointer to the statistics
+ * @return kv_stats_shard_t* Shard assigned to the thread on its first update
+ *
+ * @note This is a static/internal function
+ */
+static kv_stats_shard_t *stats_shard(kv_stats_t *stats);
+
+/**
+ * @brief Allocates zeroed statistics
+ *
+ * @return kv_stats_t* Pointer to the statistics, or NULL on failure
+ *
+ * @note The caller is responsible for freeing the statistics using free_stats()
+ */
+extern kv_stats_t *create_stats();
+
+/**
+ * @brief Returns the monotonic time in nanoseconds
+ *
+ * @return uint64_t Nanoseconds since an arbitrary start
+ */
+extern uint64_t stats_now_ns();
+
+/**
+ * @brief Returns the bucket of a latency
+ *
+ * @param ns Latency in nanoseconds
+ * @return uint64_t Bucket index, latencies above 2^(KV_STATS_MAX_EXPONENT+1)
+ *                  nanoseconds go to the last bucket
+ */
+extern uint64_t stats_bucket(uint64_t ns);
+
+/**
+ * @brief Returns the exclusive upper bound of a bucket
+ *
+ * @param bucket Bucket index
+ * @return uint64_t Lowest latency in nanoseconds above the bucket
+ */
+extern uint64_t stats_bucket_limit(uint64_t bucket);
+
+/**
+ * @brief Records the latency of an operation started at start_ns
+ *
+ * @param stats Pointer to the statistics, may be NULL
+ * @param op DB_STATS_OP of the operation
+ * @param start_ns Value of stats_now_ns() when the operation started
+ */
+extern void stats_record_latency(kv_stats_t *stats, int64_t op, uint64_t start_ns);
+
+/**
+ * @brief Adds to a counter
+ *
+ * @param stats Pointer to the statistics, may be NULL
+ * @param counter DB_STATS_COUNTER to increase
+ * @param amount Amount to add
+ */
+extern void stats_add(kv_stats_t *stats, int64_t counter, uint64_t amount);
+
+/**
+ * @brief Merges the shards into a db_stats_t
+ *
+ * @param stats Pointer to the statistics
+ * @param out Pointer receiving the merged statistics
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note Updates running concurrently may be partially included
+ */
+extern int64_t stats_merge(kv_stats_t *stats, db_stats_t *out);
+
+/**
+ * @brief Zeroes every counter and histogram
+ *
+ * @param stats Pointer to the statistics, may be NULL
+ */
+extern void stats_reset(kv_stats_t *stats);
+
+/**
+ * @brief Returns a percentile of a histogram
+ *
+ * @param histogram Pointer to the histogram
+ * @param percentile Percentile between 0 and 100
+ * @return uint64_t Upper bound in nanoseconds of the bucket holding the
+ *                  percentile, capped to the highest latency, 0 if empty
+ */
+extern uint64_t stats_percentile(kv_histogram_t *histogram, double percentile);
+
+/**
+ * @brief Writes statistics in the Prometheus text exposition format
+ *
+ * Latencies are written as one histogram named kv_operation_duration_seconds
+ * with an op label and a bucket per power of two, counters as kv_*_total.
+ *
+ * @param file Stream to write to
+ * @param stats Pointer to the statistics
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t write_stats_prometheus(FILE *file, db_stats_t *stats);
+
+/**
+ * @brief Frees statistics
+ *
+ * @param stats Pointer to the statistics, may be NULL
+ */
+extern void free_stats(kv_stats_t *stats);
+
+/**
+ * @brief Time of the start of an operation, 0 if statistics are compiled out
+ */
+#if KV_STATS_ENABLED
+#define kv_stats_clock() stats_now_ns()
+#define kv_stats_latency(stats, op, start_ns) stats_record_latency((stats), (op), (start_ns))
+#define kv_stats_add(stats, counter, amount) stats_add((stats), (counter), (amount))
+#else
+#define kv_stats_clock() ((uint64_t)0)
+#define kv_stats_latency(stats, op, start_ns) ((void)(start_ns))
+#define kv_stats_add(stats, counter, amount) ((void)0)
+#endif
@@ -0,0 +1,25 @@
+/**
+ * @file kv_status.h
+ * @brief Status codes returned by the key-value store
+ *
+ * Functions returning int64_t statuses return KV_OK or one of the negative
+ * codes below, so "result < 0" still tests for any failure. Outcomes that
+ * are part of normal use, such as a missing or already existing key, are
+ * only reported through the status and never logged.
+ */
+#pragma once
+
+
+/**
+ * @brief Outcome of an operation on a database
+ */
+typedef enum _kv_status_t {
+  KV_OK = 0,               /**< Success */
+  KV_ERROR = -1,           /**< Invalid argument or unsupported operation */
+  KV_NOT_FOUND = -2,       /**< The key does not exist */
+  KV_EXISTS = -3,          /**< The key already exists */
+  KV_TYPE_MISMATCH = -4,   /**< Unknown type, or a value that does not convert to its type */
+  KV_OOM = -5,             /**< Memory allocation failed */
+  KV_IO = -6,              /**< Reading, writing or syncing a file failed, or its data is corrupt */
+  KV_READ_ONLY = -7        /**< The database is frozen and rejects writes */
+} kv_status_t;
@@ -0,0 +1,189 @@
+/**
+ * @file kv_trace.h
+ * @brief Binary traces of the operations on a database
+ *
+ * A trace starts with the KV_TRACE_MAGIC bytes, followed by one record per
+ * get, put and delete:
+ *
+ *   op (1 byte) | status (1 byte) | type (1 byte) | time delta (varint)
+ *   | key length (varint) | key | value length (varint) | value
+ *
+ * The status is the kv_status_t returned by the operation, the type the
+ * ENTRY_VALUE_TYPE of a put or KV_TRACE_NO_TYPE, and the time delta the
+ * zigzag-encoded difference in nanoseconds with the start of the previous
+ * record. Only puts carry a value. Varints are LEB128, so most records only
+ * take a few bytes more than their key and value.
+ *
+ * Records are appended to a buffer under a mutex and written when it fills
+ * up, so tracing costs a copy per operation and no system call.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "constants.h"
+#include "kv_log.h"
+#include "string_conversion.h"
+
+
+/** @brief First bytes of a trace file, the last one is the format version */
+#define KV_TRACE_MAGIC "KVTRACE1"
+/** @brief Length of KV_TRACE_MAGIC */
+#define KV_TRACE_MAGIC_SIZE 8
+/** @brief Size of the buffer of a trace, records are written when it is full */
+#define KV_TRACE_BUFFER_SIZE (1 << 16)
+/** @brief Longest encoding of a varint */
+#define KV_TRACE_VARINT_SIZE 10
+/** @brief Type byte of the records without a type */
+#define KV_TRACE_NO_TYPE 0xFF
+
+/**
+ * @brief Operations recorded in a trace
+ */
+enum KV_TRACE_OP {
+  KV_TRACE_GET,    /**< get_entry() and get_entry_span() */
+  KV_TRACE_PUT,    /**< put_entry() and put_entry_span() */
+  KV_TRACE_DELETE, /**< delete_entry() */
+  KV_TRACE_OP_COUNT
+};
+
+/**
+ * @brief Trace being recorded
+ */
+typedef struct _kv_trace_t {
+  FILE *file;                           /**< Trace file */
+  pthread_mutex_t lock;                 /**< Guards the buffer and the timestamps */
+  uint8_t buffer[KV_TRACE_BUFFER_SIZE]; /**< Records not written yet */
+  uint64_t used;                        /**< Bytes of the buffer in use */
+  uint64_t last_ns;                     /**< Start of the previous record */
+  uint64_t records;                     /**< Number of records */
+  bool failed;                          /**< True once a write has failed */
+} kv_trace_t;
+
+/**
+ * @brief Record read from a trace
+ */
+typedef struct _kv_trace_record_t {
+  int64_t op;                  /**< KV_TRACE_OP */
+  int64_t status;              /**< kv_status_t returned by the operation */
+  int64_t type;                /**< ENTRY_VALUE_TYPE of a put, -1 if none */
+  uint64_t time_ns;            /**< Start of the operation, from the start of the first */
+  uint8_t key[SM_BUFFER_SIZE]; /**< Null-terminated key */
+  uint8_t *value;              /**< Value of a put, NULL otherwise */
+  uint64_t value_len;          /**< Length of the value */
+} kv_trace_record_t;
+
+/**
+ * @brief Sequential reader of a trace
+ */
+typedef struct _kv_trace_reader_t {
+  FILE *file;              /**< Trace file */
+  int64_t last_ns;         /**< Start of the previous record */
+  bool started;            /**< True once the first record has been read */
+  uint8_t *value;          /**< Buffer of the values */
+  uint64_t value_capacity; /**< Allocated size of the value buffer */
+} kv_trace_reader_t;
+
+/**
+ * @brief Encodes a varint
+ *
+ * @param dest Buffer of at least KV_TRACE_VARINT_SIZE bytes
+ * @param value Value to encode
+ * @return uint64_t Number of bytes written
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t write_varint(uint8_t *dest, uint64_t value);
+
+/**
+ * @brief Decodes a varint from a stream
+ *
+ * @param file Stream to read from
+ * @param value Pointer receiving the value
+ * @return int64_t 1 on success, 0 at the end of the stream, -1 for a truncated
+ *                 or overlong varint
+ *
+ * @note This is a static/internal function
+ */
+static int64_t read_varint(FILE *file, uint64_t *value);
+
+/**
+ * @brief Writes the buffered records to the trace file
+ *
+ * @param trace Pointer to the trace, locked by the caller
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t flush_trace(kv_trace_t *trace);
+
+/**
+ * @brief Creates a trace file, replacing any existing file
+ *
+ * @param path Path of the trace file
+ * @return kv_trace_t* Pointer to the trace, or NULL on failure
+ *
+ * @note The caller is responsible for closing the trace using close_trace()
+ */
+extern kv_trace_t *open_trace(uint8_t *path);
+
+/**
+ * @brief Appends a record to a trace
+ *
+ * @param trace Pointer to the trace
+ * @param op KV_TRACE_OP of the operation
+ * @param status kv_status_t returned by the operation
+ * @param key Null-terminated key
+ * @param value Value of a put, NULL otherwise
+ * @param len Length of the value
+ * @param type Type name of a put, NULL otherwise
+ * @param start_ns Value of stats_now_ns() when the operation started
+ *
+ * @note Failures are logged once and stop the recording, the operations
+ *       themselves never fail because of the trace
+ */
+extern void trace_record(kv_trace_t *trace, int64_t op, int64_t status, uint8_t *key,
+                         uint8_t *value, uint64_t len, uint8_t *type, uint64_t start_ns);
+
+/**
+ * @brief Writes the remaining records and closes a trace
+ *
+ * @param trace Pointer to the trace, may be NULL
+ * @return int64_t 0 on success, -1 if any record could not be written
+ */
+extern int64_t close_trace(kv_trace_t *trace);
+
+/**
+ * @brief Opens a trace for reading
+ *
+ * @param path Path of the trace file
+ * @return kv_trace_reader_t* Pointer to the reader, or NULL on failure or if
+ *                            the file is not a trace
+ *
+ * @note The caller is responsible for closing the reader using close_trace_reader()
+ */
+extern kv_trace_reader_t *open_trace_reader(uint8_t *path);
+
+/**
+ * @brief Reads the next record of a trace
+ *
+ * @param reader Pointer to the reader
+ * @param record Pointer receiving the record
+ * @return int64_t 1 if a record was read, 0 at the end of the trace, -1 for a
+ *                 damaged trace
+ *
+ * @note The value of the record is only valid until the next read
+ */
+extern int64_t read_trace_record(kv_trace_reader_t *reader, kv_trace_record_t *record);
+
+/**
+ * @brief Closes a trace reader
+ *
+ * @param reader Pointer to the reader, may be NULL
+ */
+extern void close_trace_reader(kv_trace_reader_t *reader);
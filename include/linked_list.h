@@ -5,11 +5,17 @@
  * This module provides a linked list data structure for storing database entries.
  * It serves as one of the storage backends for the key-value database, offering
  * sequential access and dynamic sizing capabilities.
+ *
+ * Entries are appended at the tail and kept in insertion order. Once a list
+ * holds KV_LIST_INDEX_THRESHOLD entries it also keeps an open addressing
+ * index of its nodes by key, so inserts, lookups and deletes no longer walk
+ * the list. Shorter lists, such as most chains of a hash table, are scanned.
  */
 #pragma once
 
 #include "kv_parser.h"
-#include "logger.h"
+#include "kv_key.h"
+#include "kv_log.h"
 
 
 /**
@@ -21,6 +27,7 @@
 typedef struct _node_t {
   db_entry_t *entry; /**< Pointer to the database entry stored in this node */
   struct _node_t* next; /**< Pointer to the next node in the list */
+  struct _node_t* prev; /**< Pointer to the previous node in the list */
 } node_t;
 
 /**
@@ -32,33 +39,98 @@ typedef struct _node_t {
 typedef struct _list_t {
   uint64_t size;            /**< Number of entries currently in the list */
   node_t* head;             /**< Pointer to the first node in the list */
+  node_t* tail;             /**< Pointer to the last node in the list */
+  node_t** index;           /**< Open addressing index of the nodes by key, NULL below KV_LIST_INDEX_THRESHOLD entries */
+  uint64_t index_capacity;  /**< Number of slots of the index, a power of two */
+  kv_memory_t *memory;      /**< Memory of the list, its nodes and new entries, NULL for kv_default_memory */
+  int64_t category;         /**< KV_ALLOC_CATEGORY of the list_t itself */
 } list_t;
 
+/**
+ * @brief Finds the slot of a key in the index of a list
+ *
+ * @param list Pointer to a list with an index
+ * @param probe Key to look up
+ * @return node_t** Slot holding the node of the key, or the empty slot it
+ *                  would be stored in
+ *
+ * @note This is a static/internal function
+ */
+static node_t **index_slot(list_t *list, const kv_key_probe_t *probe);
+
+/**
+ * @brief Rebuilds the index of a list with a new number of slots
+ *
+ * @param list Pointer to the list
+ * @param capacity Number of slots, a power of two at least twice the size
+ * @return int64_t 0 on success, -1 if the slots could not be allocated, the
+ *                 old index is then kept
+ *
+ * @note This is a static/internal function
+ */
+static int64_t index_resize(list_t *list, uint64_t capacity);
+
+/**
+ * @brief Adds an appended node to the index, building or growing it first
+ *
+ * The index is dropped if it cannot grow, lookups then scan the list again.
+ *
+ * @param list Pointer to the list
+ * @param node Node just appended to the list
+ * @param probe Key of the node
+ *
+ * @note This is a static/internal function
+ */
+static void index_add(list_t *list, node_t *node, const kv_key_probe_t *probe);
+
+/**
+ * @brief Empties a slot of the index, shifting back the nodes probed past it
+ *
+ * @note This is a static/internal function
+ */
+static void index_remove(list_t *list, node_t **slot);
+
+/**
+ * @brief Finds the node of a key, through the index if the list has one
+ *
+ * @param list Pointer to the list
+ * @param probe Key to look up
+ * @return node_t* Node of the key, or NULL if it is not stored
+ *
+ * @note This is a static/internal function
+ */
+static node_t *find_node(list_t *list, const kv_key_probe_t *probe);
+
 /**
  * @brief Creates a new empty linked list
  * 
  * Allocates and initializes a new linked list structure with zero size
  * and NULL head pointer.
  * 
+ * @param memory Memory of the list, its nodes and the entries it creates,
+ *               NULL for kv_default_memory
+ * @param category KV_ALLOC_CATEGORY of the list_t, KV_ALLOC_BUCKETS for the
+ *                 chains of a hash table
  * @return list_t* Pointer to the newly created list, or NULL on failure
  * 
  * @note The caller is responsible for freeing the list using free_list()
  * @see free_list()
  */
-extern list_t* create_list();
+extern list_t* create_list(kv_memory_t *memory, int64_t category);
 
 /**
  * @brief Inserts a database entry into the linked list
  * 
- * Adds the given entry to the list. If an entry with the same key already exists,
- * it will be updated with the new entry's value and type.
+ * Appends the given entry to the tail of the list, in O(1) once the list is
+ * indexed. If an entry with the same key already exists the list is unchanged.
  * 
  * @param list Pointer to the linked list
  * @param entry Pointer to the database entry to insert
- * @return int64_t 0 on success, -1 on failure
+ * @return int64_t KV_OK on success, KV_EXISTS if the key is already stored,
+ *                 or another negative kv_status_t on failure
  * 
  * @note The list takes ownership of the entry pointer
- * @note Duplicate keys result in value updates, not multiple entries
+ * @note Duplicate keys are left unchanged and the entry is not taken
  * @see list_put(), list_delete()
  */
 extern int64_t list_insert(list_t *list, db_entry_t *entry);
@@ -72,14 +144,16 @@ extern int64_t list_insert(list_t *list, db_entry_t *entry);
  * 
  * @param list Pointer to the linked list
  * @param key Key for the entry (null-terminated string)
- * @param value Value for the entry (null-terminated string)
+ * @param value Text of a number or bool, or bytes of a string or blob
+ * @param len Number of bytes of the value
  * @param type Type identifier for the value (e.g., "int32", "float", "bool")
- * @return int64_t 0 on success, -1 on failure
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if type is empty and the key
+ *                 does not exist, or another negative kv_status_t on failure
  * 
  * @note All parameters must be non-NULL and non-empty strings
  * @see list_insert(), list_get_entry_by_key()
  */
-extern int64_t list_put(list_t *list, uint8_t *key, uint8_t* value, uint8_t* type);
+extern int64_t list_put(list_t *list, uint8_t *key, uint8_t* value, uint64_t len, uint8_t* type);
 
 /**
  * @brief Deletes an entry from the linked list by key
@@ -89,7 +163,8 @@ extern int64_t list_put(list_t *list, uint8_t *key, uint8_t* value, uint8_t* typ
  * 
  * @param list Pointer to the linked list
  * @param key Key of the entry to delete (null-terminated string)
- * @return int64_t 0 on success, -1 on failure (including if key not found)
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if the key does not exist,
+ *                 or another negative kv_status_t on failure
  * 
  * @note The key parameter must be non-NULL and non-empty
  * @see list_get_entry_by_key(), list_insert()
@@ -99,8 +174,9 @@ extern int64_t list_delete(list_t *list, uint8_t *key);
 /**
  * @brief Retrieves an entry from the linked list by index
  * 
- * Returns the entry at the specified zero-based index position in the list.
- * Provides O(n) access time due to the sequential nature of linked lists.
+ * Returns the entry at the specified zero-based index position in the list,
+ * in insertion order. Provides O(n) access time due to the sequential nature
+ * of linked lists.
  * 
  * @param list Pointer to the linked list
  * @param idx Zero-based index of the entry to retrieve
@@ -116,7 +192,8 @@ extern db_entry_t *list_get_entry_by_idx(list_t *list, uint64_t idx);
  * @brief Retrieves an entry from the linked list by key
  * 
  * Searches the list for an entry with the specified key and returns it.
- * Provides O(n) access time due to linear search.
+ * Provides O(1) access time through the index of the list, O(n) on lists too
+ * short to be indexed.
  * 
  * @param list Pointer to the linked list
  * @param key Key of the entry to retrieve (null-terminated string)
@@ -149,13 +226,14 @@ extern int64_t list_save(FILE *file, list_t *list);
  * Deallocates the memory for a node and its contained database entry.
  * This is typically used internally by other list management functions.
  * 
+ * @param list Pointer to the list the node was allocated for
  * @param node Pointer to the node to free (can be NULL)
  * 
  * @note Safe to call with NULL pointer
  * @note Also frees the database entry contained in the node
  * @see free_list(), free_entry()
  */
-extern void free_node(node_t *node);
+extern void free_node(list_t *list, node_t *node);
 
 /**
  * @brief Frees all memory associated with the linked list
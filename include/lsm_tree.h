@@ -0,0 +1,924 @@
+/**
+ * @file lsm_tree.h
+ * @brief Log-structured merge tree storage backend
+ *
+ * This module provides a persistent, ordered storage backend. Writes go to a
+ * write-ahead log and to a sorted in-memory memtable. Full memtables are
+ * flushed by a background thread to immutable sorted table files, each with a
+ * block index and a Bloom filter, and the tables are merged level by level
+ * (leveled compaction) by the same thread. Entries can be scanned in key order.
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#include "kv_parser.h"
+#include "checksum.h"
+#include "kv_log.h"
+
+
+/** @brief Type stored in the record header of a deletion marker */
+#define LSM_TOMBSTONE_TYPE -1
+/** @brief Maximum height of the memtable skip list */
+#define LSM_MAX_HEIGHT 12
+/** @brief Magic number closing every table file */
+#define LSM_TABLE_MAGIC 0x31424154534d4c4bULL
+
+/**
+ * @brief Header written in front of the key and value of every record
+ *
+ * Used by the write-ahead log and by the data blocks of table files. In the
+ * write-ahead log every record is preceded by the CRC32C of its header, key
+ * and value; the data blocks are checksummed as a whole in the block index.
+ */
+typedef struct _lsm_record_header_t {
+  uint32_t value_size; /**< Size of the value bytes following the key */
+  uint8_t key_size;    /**< Size of the key bytes following the header */
+  int8_t type;         /**< ENTRY_VALUE_TYPE, or LSM_TOMBSTONE_TYPE */
+  uint16_t reserved;   /**< Padding, always zero */
+} lsm_record_header_t;
+
+/**
+ * @brief Skip list node of a memtable
+ */
+typedef struct _lsm_memtable_node_t {
+  db_entry_t entry;                      /**< Entry, its value points to value_buffer or to an allocated copy */
+  uint8_t value_buffer[sizeof(int64_t)]; /**< Storage of values of up to 8 bytes */
+  uint8_t height;                        /**< Number of forward pointers */
+  struct _lsm_memtable_node_t *next[];   /**< Forward pointers, one per level */
+} lsm_memtable_node_t;
+
+/**
+ * @brief Sorted in-memory table receiving the writes
+ */
+typedef struct _lsm_memtable_t {
+  lsm_memtable_node_t *head; /**< Sentinel node of the skip list */
+  uint64_t size;             /**< Approximate bytes held */
+  uint64_t count;            /**< Number of records, tombstones included */
+  uint64_t wal_id;           /**< Id of the write-ahead log of the memtable */
+  int32_t wal_fd;            /**< Descriptor of the write-ahead log */
+} lsm_memtable_t;
+
+/**
+ * @brief Index entry locating a data block of a table file
+ */
+typedef struct _lsm_block_handle_t {
+  uint8_t last_key[SM_BUFFER_SIZE]; /**< Largest key stored in the block */
+  uint64_t offset;                  /**< Offset of the block in the file */
+  uint64_t size;                    /**< Size of the block */
+  uint32_t crc;                     /**< CRC32C of the block */
+  uint32_t reserved;                /**< Padding, always zero */
+} lsm_block_handle_t;
+
+/**
+ * @brief Footer closing every table file
+ */
+typedef struct _lsm_table_footer_t {
+  uint64_t index_offset; /**< Offset of the block index */
+  uint64_t index_count;  /**< Number of block handles in the index */
+  uint64_t bloom_offset; /**< Offset of the Bloom filter bits */
+  uint64_t bloom_bits;   /**< Number of bits of the Bloom filter */
+  uint64_t bloom_hashes; /**< Number of hash functions of the Bloom filter */
+  uint64_t entry_count;  /**< Number of records, tombstones included */
+  uint32_t meta_crc;     /**< CRC32C of the block index followed by the Bloom filter */
+  uint32_t reserved;     /**< Padding, always zero */
+  uint64_t magic;        /**< LSM_TABLE_MAGIC */
+} lsm_table_footer_t;
+
+/**
+ * @brief Open immutable table file
+ */
+typedef struct _lsm_table_t {
+  uint64_t id;                      /**< File id */
+  int32_t fd;                       /**< Open descriptor of the file */
+  uint64_t file_size;               /**< Size of the file */
+  uint64_t entry_count;             /**< Number of records, tombstones included */
+  lsm_block_handle_t *index;        /**< Block index */
+  uint64_t index_count;             /**< Number of blocks */
+  uint8_t *bloom;                   /**< Bloom filter bits */
+  uint64_t bloom_bits;              /**< Number of bits of the Bloom filter */
+  uint64_t bloom_hashes;            /**< Number of hash functions of the Bloom filter */
+  uint8_t smallest[SM_BUFFER_SIZE]; /**< Smallest key of the table */
+  uint8_t largest[SM_BUFFER_SIZE];  /**< Largest key of the table */
+} lsm_table_t;
+
+/**
+ * @brief Tables of one level of the tree
+ *
+ * Level 0 tables may overlap and are ordered newest first. Tables of deeper
+ * levels never overlap and are ordered by key.
+ */
+typedef struct _lsm_level_t {
+  lsm_table_t **tables; /**< Tables of the level */
+  uint64_t count;       /**< Number of tables */
+  uint64_t capacity;    /**< Allocated length of the tables array */
+  uint64_t size;        /**< Bytes held by the tables */
+} lsm_level_t;
+
+/**
+ * @brief Table file being written
+ */
+typedef struct _lsm_table_writer_t {
+  uint64_t id;                 /**< File id */
+  int32_t fd;                  /**< Descriptor of the file */
+  uint64_t offset;             /**< Bytes written so far */
+  uint8_t *block;              /**< Data block being filled */
+  uint64_t block_size;         /**< Bytes in the data block */
+  uint64_t block_capacity;     /**< Allocated bytes of the data block */
+  lsm_block_handle_t *index;   /**< Handles of the written blocks */
+  uint64_t index_count;        /**< Number of written blocks */
+  uint64_t index_capacity;     /**< Allocated length of the index */
+  uint64_t *hashes;            /**< Key hashes feeding the Bloom filter */
+  uint64_t entry_count;        /**< Records written */
+  uint64_t hash_capacity;      /**< Allocated length of the hashes */
+  uint8_t last_key[SM_BUFFER_SIZE]; /**< Last key added */
+} lsm_table_writer_t;
+
+/**
+ * @brief Cursor over the records of a memtable or a table, in key order
+ */
+typedef struct _lsm_iterator_t {
+  lsm_memtable_node_t *node;    /**< Current node when iterating a memtable */
+  lsm_table_t *table;           /**< Table being iterated, or NULL for memtables */
+  uint64_t block_idx;           /**< Index of the loaded block */
+  uint8_t *block;               /**< Loaded block */
+  uint64_t block_size;          /**< Size of the loaded block */
+  uint64_t block_pos;           /**< Offset of the next record in the block */
+  bool valid;                   /**< False once the iterator is exhausted */
+  uint8_t key[SM_BUFFER_SIZE];  /**< Key of the current record */
+  int64_t type;                 /**< Type of the current record */
+  uint8_t *value;               /**< Value of the current record, inside the block or the node */
+  uint32_t value_size;          /**< Size of the current value */
+  uint64_t block_capacity;      /**< Allocated size of the block buffer */
+  bool failed;                  /**< True if a block could not be read */
+} lsm_iterator_t;
+
+/**
+ * @brief Callback receiving the entries of a range scan in key order
+ *
+ * @return int64_t 0 to continue the scan, a negative value to stop it
+ */
+typedef int64_t (*lsm_scan_callback_t)(db_entry_t *entry, void *context);
+
+/**
+ * @brief LSM tree storage structure
+ *
+ * The lock guards the memtables and the levels. Reads hold it for their whole
+ * duration; the background worker only releases it while writing files.
+ */
+typedef struct _lsm_tree_t {
+  uint8_t dir[BG_BUFFER_SIZE];          /**< Directory holding the files */
+  bool attached;                        /**< True once a directory has been opened */
+  lsm_memtable_t *memtable;             /**< Memtable receiving writes */
+  lsm_memtable_t *immutable;            /**< Full memtable waiting to be flushed, or NULL */
+  lsm_level_t levels[KV_LSM_MAX_LEVELS]; /**< Levels of tables */
+  uint64_t compact_pointer[KV_LSM_MAX_LEVELS]; /**< Next table to compact per level */
+  uint64_t next_id;                     /**< Id given to the next file */
+  uint64_t memtable_size;               /**< Memtable size that triggers a flush */
+  uint64_t table_size;                  /**< Size after which a compaction output is split */
+  uint64_t block_size;                  /**< Target size of data blocks */
+  uint64_t level0_tables;               /**< Level 0 table count that triggers a compaction */
+  uint64_t level_base_size;             /**< Size limit of level 1, multiplied per level */
+  uint64_t random_state;                /**< State of the skip list height generator */
+  bool force_compaction;                /**< Compact level 0 even below its limit */
+  bool working;                         /**< True while the worker writes files */
+  bool background_error;                /**< Set once a flush or compaction failed */
+  bool shutdown;                        /**< Asks the worker to stop */
+  pthread_t worker;                     /**< Background flush and compaction thread */
+  pthread_mutex_t lock;                 /**< Guards memtables and levels */
+  pthread_cond_t work_cond;             /**< Wakes the worker */
+  pthread_cond_t done_cond;             /**< Signals finished background work */
+  uint8_t *block_buffer;                /**< Block read by point lookups */
+  uint64_t block_capacity;              /**< Allocated size of block_buffer */
+} lsm_tree_t;
+
+/**
+ * @brief Entry returned to a thread by lookups and scans, with its value storage
+ *
+ * Each thread copies values into its own, so gets from several threads do
+ * not share a buffer. It is freed when the thread exits.
+ */
+typedef struct _lsm_reader_t {
+  db_entry_t entry;   /**< Entry returned by lookups and scans */
+  uint8_t *buffer;    /**< Value storage of entry */
+  uint64_t capacity;  /**< Allocated size of buffer */
+} lsm_reader_t;
+
+/**
+ * @brief State of lsm_save() passed through lsm_scan()
+ */
+typedef struct _lsm_save_context_t {
+  FILE *file;     /**< File receiving the entries */
+  int64_t result; /**< 0 on success, -1 once a write failed */
+} lsm_save_context_t;
+
+/**
+ * @brief Hashes a key for Bloom filters (FNV-1a)
+ *
+ * @param key Key string (null-terminated)
+ * @return uint64_t 64-bit hash of the key
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t lsm_hash(uint8_t *key);
+
+/**
+ * @brief Builds the path of a file of the tree directory
+ *
+ * @param lsm Pointer to the tree
+ * @param file_id Id of the file
+ * @param extension File extension ("sst" or "wal")
+ * @param dest Buffer to store the path
+ * @param max_len Maximum length of the destination buffer
+ *
+ * @note This is a static/internal function
+ */
+static void build_lsm_path(lsm_tree_t *lsm, uint64_t file_id, uint8_t *extension,
+                            uint8_t *dest, uint64_t max_len);
+
+/**
+ * @brief Draws the height of a new skip list node
+ *
+ * @param lsm Pointer to the tree
+ * @return uint8_t Height between 1 and LSM_MAX_HEIGHT
+ *
+ * @note This is a static/internal function
+ */
+static uint8_t random_height(lsm_tree_t *lsm);
+
+/**
+ * @brief Creates an empty memtable
+ *
+ * @param lsm Pointer to the tree
+ * @param with_wal True to create a new write-ahead log for the memtable
+ * @return lsm_memtable_t* The memtable, or NULL on failure
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static lsm_memtable_t *create_memtable(lsm_tree_t *lsm, bool with_wal);
+
+/**
+ * @brief Frees a memtable, optionally deleting its write-ahead log
+ *
+ * @param lsm Pointer to the tree
+ * @param memtable Memtable to free (can be NULL)
+ * @param delete_wal True to delete the write-ahead log
+ *
+ * @note This is a static/internal function
+ */
+static void free_memtable(lsm_tree_t *lsm, lsm_memtable_t *memtable, bool delete_wal);
+
+/**
+ * @brief Finds the memtable node of a key
+ *
+ * @param memtable Memtable to search
+ * @param key Key string (null-terminated)
+ * @return lsm_memtable_node_t* The node, or NULL if the key is not in the memtable
+ *
+ * @note This is a static/internal function
+ */
+static lsm_memtable_node_t *memtable_find(lsm_memtable_t *memtable, uint8_t *key);
+
+/**
+ * @brief Inserts or replaces a record in a memtable
+ *
+ * @param lsm Pointer to the tree
+ * @param memtable Memtable to modify
+ * @param key Key string (null-terminated)
+ * @param type ENTRY_VALUE_TYPE of the value, or LSM_TOMBSTONE_TYPE
+ * @param value Pointer to the value bytes (NULL for tombstones)
+ * @param value_size Size of the value
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t memtable_put(lsm_tree_t *lsm, lsm_memtable_t *memtable, uint8_t *key,
+                            int64_t type, void *value, uint32_t value_size);
+
+/**
+ * @brief Encodes a record into a buffer
+ *
+ * @param dest Buffer of at least sizeof(lsm_record_header_t) + SM_BUFFER_SIZE + value_size bytes
+ * @param key Key string (null-terminated)
+ * @param type ENTRY_VALUE_TYPE of the value, or LSM_TOMBSTONE_TYPE
+ * @param value Pointer to the value bytes (NULL for tombstones)
+ * @param value_size Size of the value
+ * @return uint64_t Size of the encoded record
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t encode_record(uint8_t *dest, uint8_t *key, int64_t type, void *value, uint32_t value_size);
+
+/**
+ * @brief Decodes the record at the start of a buffer
+ *
+ * @param src Buffer holding the record
+ * @param max_len Bytes available in the buffer
+ * @param key Receives the key (null-terminated)
+ * @param type Receives the type
+ * @param value Receives a pointer to the value bytes inside src
+ * @param value_size Receives the size of the value
+ * @return int64_t Size of the record, or -1 if it is truncated or malformed
+ *
+ * @note This is a static/internal function
+ */
+static int64_t decode_record(uint8_t *src, uint64_t max_len, uint8_t *key, int64_t *type,
+                             uint8_t **value, uint32_t *value_size);
+
+/**
+ * @brief Writes a record to a write-ahead log and the memtable
+ *
+ * Moves a full memtable to the immutable slot first, waiting if the previous
+ * one is still being flushed.
+ *
+ * @param lsm Pointer to the tree
+ * @param key Key string (null-terminated)
+ * @param type ENTRY_VALUE_TYPE of the value, or LSM_TOMBSTONE_TYPE
+ * @param value Pointer to the value bytes (NULL for tombstones)
+ * @param value_size Size of the value
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static int64_t write_record(lsm_tree_t *lsm, uint8_t *key, int64_t type, void *value, uint32_t value_size);
+
+/**
+ * @brief Replays a write-ahead log into a memtable
+ *
+ * @param lsm Pointer to the tree
+ * @param memtable Memtable receiving the records
+ * @param wal_path Path of the write-ahead log
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t replay_wal(lsm_tree_t *lsm, lsm_memtable_t *memtable, uint8_t *wal_path);
+
+/**
+ * @brief Opens a table file and loads its index and Bloom filter
+ *
+ * @param lsm Pointer to the tree
+ * @param file_id Id of the table file
+ * @return lsm_table_t* The table, or NULL on failure
+ *
+ * @note This is a static/internal function
+ */
+static lsm_table_t *open_table(lsm_tree_t *lsm, uint64_t file_id);
+
+/**
+ * @brief Closes a table, optionally deleting its file
+ *
+ * @param lsm Pointer to the tree
+ * @param table Table to close (can be NULL)
+ * @param delete_file True to delete the file
+ *
+ * @note This is a static/internal function
+ */
+static void close_table(lsm_tree_t *lsm, lsm_table_t *table, bool delete_file);
+
+/**
+ * @brief Tests the Bloom filter of a table
+ *
+ * @param table Table to test
+ * @param hash Hash of the key from lsm_hash()
+ * @return bool False if the key is certainly not in the table
+ *
+ * @note This is a static/internal function
+ */
+static bool table_may_contain(lsm_table_t *table, uint64_t hash);
+
+/**
+ * @brief Reads a data block of a table
+ *
+ * @param table Table to read
+ * @param block_idx Index of the block
+ * @param dest Receives a buffer holding the block, reallocated as needed
+ * @param capacity Allocated size of *dest, updated on reallocation
+ * @return int64_t Size of the block, or -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t read_block(lsm_table_t *table, uint64_t block_idx, uint8_t **dest, uint64_t *capacity);
+
+/**
+ * @brief Finds the first block of a table that may hold keys not below key
+ *
+ * @param table Table to search
+ * @param key Key string (null-terminated)
+ * @return uint64_t Index of the block, or index_count if key is past the table
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t find_block(lsm_table_t *table, uint8_t *key);
+
+/**
+ * @brief Looks a key up in a table
+ *
+ * @param lsm Pointer to the tree
+ * @param table Table to search
+ * @param key Key string (null-terminated)
+ * @param hash Hash of the key from lsm_hash()
+ * @param type Receives the type of the record
+ * @param value Receives a pointer to the value bytes inside lsm->block_buffer
+ * @param value_size Receives the size of the value
+ * @return int64_t 1 if the key was found, 0 if not, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t table_get(lsm_tree_t *lsm, lsm_table_t *table, uint8_t *key, uint64_t hash,
+                         int64_t *type, uint8_t **value, uint32_t *value_size);
+
+/**
+ * @brief Looks a key up in the memtables, then level by level
+ *
+ * @param lsm Pointer to the tree
+ * @param key Key string (null-terminated)
+ * @param type Receives the type of the newest record
+ * @param value Receives a pointer to the value bytes of the newest record
+ * @param value_size Receives the size of the value
+ * @return int64_t 1 if the key is live, 0 if missing or deleted, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held. The value
+ *       is not copied and is only valid until the lock is released
+ */
+static int64_t lookup(lsm_tree_t *lsm, uint8_t *key, int64_t *type, uint8_t **value, uint32_t *value_size);
+
+/**
+ * @brief Creates the thread key of the readers
+ *
+ * @note This is a static/internal function
+ */
+static void init_lsm_reader_key();
+
+/**
+ * @brief Frees the reader of a thread when it exits
+ *
+ * @note This is a static/internal function
+ */
+static void free_lsm_reader(void *arg);
+
+/**
+ * @brief Returns the reader of the calling thread, creating it on first use
+ *
+ * @return lsm_reader_t* Reader of the thread, or NULL on failure
+ *
+ * @note This is a static/internal function
+ */
+static lsm_reader_t *get_lsm_reader();
+
+/**
+ * @brief Copies a value into the entry of a reader
+ *
+ * @param reader Reader of the calling thread
+ * @param value Value bytes
+ * @param value_size Size of the value, a NUL byte is added after it
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held while
+ *       value points into the tree
+ */
+static int64_t set_read_value(lsm_reader_t *reader, uint8_t *value, uint32_t value_size);
+
+/**
+ * @brief Starts writing a new table file
+ *
+ * @param lsm Pointer to the tree
+ * @param writer Writer to initialize
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, takes the lock to allocate the file id
+ */
+static int64_t writer_open(lsm_tree_t *lsm, lsm_table_writer_t *writer);
+
+/**
+ * @brief Appends a record to a table file, keys must be added in order
+ *
+ * @param lsm Pointer to the tree
+ * @param writer Writer of the table
+ * @param key Key string (null-terminated)
+ * @param type ENTRY_VALUE_TYPE of the value, or LSM_TOMBSTONE_TYPE
+ * @param value Pointer to the value bytes
+ * @param value_size Size of the value
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t writer_add(lsm_tree_t *lsm, lsm_table_writer_t *writer, uint8_t *key,
+                          int64_t type, void *value, uint32_t value_size);
+
+/**
+ * @brief Writes the pending data block of a table file
+ *
+ * @param writer Writer of the table
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t writer_flush_block(lsm_table_writer_t *writer);
+
+/**
+ * @brief Writes the index, Bloom filter and footer, then syncs the table file
+ *
+ * @param lsm Pointer to the tree
+ * @param writer Writer of the table
+ * @return lsm_table_t* The finished table opened for reading, or NULL on failure
+ *
+ * @note This is a static/internal function
+ */
+static lsm_table_t *writer_finish(lsm_tree_t *lsm, lsm_table_writer_t *writer);
+
+/**
+ * @brief Frees a table writer, deleting its file if it was not finished
+ *
+ * @param lsm Pointer to the tree
+ * @param writer Writer to free
+ *
+ * @note This is a static/internal function
+ */
+static void writer_abort(lsm_tree_t *lsm, lsm_table_writer_t *writer);
+
+/**
+ * @brief Copies the memtable node of an iterator into its current record
+ *
+ * @param iterator Iterator over a memtable
+ *
+ * @note This is a static/internal function
+ */
+static void iterator_load_node(lsm_iterator_t *iterator);
+
+/**
+ * @brief Decodes the next record of a table iterator, loading blocks as needed
+ *
+ * @param iterator Iterator over a table
+ *
+ * @note This is a static/internal function
+ */
+static void iterator_read_record(lsm_iterator_t *iterator);
+
+/**
+ * @brief Positions an iterator on the first memtable record not below start_key
+ *
+ * @param iterator Iterator to initialize
+ * @param memtable Memtable to iterate
+ * @param start_key Smallest key to return, or NULL
+ *
+ * @note This is a static/internal function
+ */
+static void iterator_init_memtable(lsm_iterator_t *iterator, lsm_memtable_t *memtable, uint8_t *start_key);
+
+/**
+ * @brief Positions an iterator on the first table record not below start_key
+ *
+ * @param iterator Iterator to initialize
+ * @param table Table to iterate
+ * @param start_key Smallest key to return, or NULL
+ *
+ * @note This is a static/internal function
+ */
+static void iterator_init_table(lsm_iterator_t *iterator, lsm_table_t *table, uint8_t *start_key);
+
+/**
+ * @brief Moves an iterator to the next record
+ *
+ * @param iterator Iterator to advance
+ *
+ * @note This is a static/internal function
+ */
+static void iterator_next(lsm_iterator_t *iterator);
+
+/**
+ * @brief Frees the block buffer of an iterator
+ *
+ * @param iterator Iterator to release
+ *
+ * @note This is a static/internal function
+ */
+static void iterator_free(lsm_iterator_t *iterator);
+
+/**
+ * @brief Selects the iterator holding the smallest key
+ *
+ * @param iterators Iterators ordered newest first
+ * @param iterator_count Number of iterators
+ * @return int64_t Index of the newest iterator holding the smallest key, or -1 if all are exhausted
+ *
+ * @note This is a static/internal function
+ */
+static int64_t iterator_pick(lsm_iterator_t *iterators, uint64_t iterator_count);
+
+/**
+ * @brief Advances every iterator positioned on a key
+ *
+ * @param iterators Iterators to advance
+ * @param iterator_count Number of iterators
+ * @param key Key to move past
+ *
+ * @note This is a static/internal function
+ */
+static void iterator_skip(lsm_iterator_t *iterators, uint64_t iterator_count, uint8_t *key);
+
+/**
+ * @brief Merges iterators ordered newest first into table files of a level
+ *
+ * @param lsm Pointer to the tree
+ * @param iterators Input iterators, newest first
+ * @param iterator_count Number of input iterators
+ * @param drop_tombstones True if no older data can be shadowed by tombstones
+ * @param split True to split the output into tables of table_size bytes
+ * @param outputs Receives the new tables, allocated by the function
+ * @param output_count Receives the number of new tables
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t merge_iterators(lsm_tree_t *lsm, lsm_iterator_t *iterators, uint64_t iterator_count,
+                               bool drop_tombstones, bool split,
+                               lsm_table_t ***outputs, uint64_t *output_count);
+
+/**
+ * @brief Adds a table to a level, keeping the level ordering
+ *
+ * @param level Level receiving the table
+ * @param table Table to add
+ * @param level_idx Index of the level
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static int64_t level_add(lsm_level_t *level, lsm_table_t *table, uint64_t level_idx);
+
+/**
+ * @brief Removes a table from a level
+ *
+ * @param level Level holding the table
+ * @param table Table to remove
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static void level_remove(lsm_level_t *level, lsm_table_t *table);
+
+/**
+ * @brief Atomically rewrites the manifest listing the tables of every level
+ *
+ * @param lsm Pointer to the tree
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static int64_t write_manifest(lsm_tree_t *lsm);
+
+/**
+ * @brief Checks whether a level and all deeper levels hold no tables
+ *
+ * @param lsm Pointer to the tree
+ * @param first_level Index of the first level to check
+ * @return bool True if no table is stored from first_level down
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static bool levels_empty(lsm_tree_t *lsm, uint64_t first_level);
+
+/**
+ * @brief Writes the immutable memtable to a level 0 table
+ *
+ * @param lsm Pointer to the tree
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held and is
+ *       released while the table is written
+ */
+static int64_t flush_immutable(lsm_tree_t *lsm);
+
+/**
+ * @brief Returns the level most in need of a compaction
+ *
+ * @param lsm Pointer to the tree
+ * @return int64_t Index of the level to compact, or -1 if none needs it
+ *
+ * @note This is a static/internal function, the lock must be held
+ */
+static int64_t pick_compaction(lsm_tree_t *lsm);
+
+/**
+ * @brief Merges tables of a level into the overlapping tables of the next level
+ *
+ * @param lsm Pointer to the tree
+ * @param level_idx Index of the level to compact
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function, the lock must be held and is
+ *       released while the tables are merged
+ */
+static int64_t compact_level(lsm_tree_t *lsm, uint64_t level_idx);
+
+/**
+ * @brief Flushes memtables and compacts levels until asked to stop
+ *
+ * @param arg Pointer to the tree
+ * @return void* Always NULL
+ *
+ * @note This is a static/internal function run on the worker thread
+ */
+static void *lsm_worker(void *arg);
+
+/**
+ * @brief Checks whether the manifest lists a table
+ *
+ * @param lsm Pointer to the tree
+ * @param file_id Id of the table file
+ * @return bool True if a level holds the table
+ *
+ * @note This is a static/internal function
+ */
+static bool table_listed(lsm_tree_t *lsm, uint64_t file_id);
+
+/**
+ * @brief Comparison function used to sort file ids
+ *
+ * @note This is a static/internal function
+ */
+static int compare_lsm_ids(const void *first, const void *second);
+
+/**
+ * @brief Opens the tables listed in the manifest of the tree directory
+ *
+ * @param lsm Pointer to the tree
+ * @return int64_t 0 on success or if there is no manifest yet, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t load_manifest(lsm_tree_t *lsm);
+
+/**
+ * @brief Scan callbacks counting, saving and printing entries
+ *
+ * @note These are static/internal functions
+ */
+static int64_t count_callback(db_entry_t *entry, void *context);
+static int64_t save_callback(db_entry_t *entry, void *context);
+static int64_t print_callback(db_entry_t *entry, void *context);
+
+/**
+ * @brief Creates a new LSM tree that is not attached to a directory yet
+ *
+ * @return lsm_tree_t* Pointer to the newly created tree, or NULL on failure
+ *
+ * @note The caller is responsible for freeing the tree using free_lsm_tree()
+ * @see lsm_open(), free_lsm_tree()
+ */
+extern lsm_tree_t* create_lsm_tree();
+
+/**
+ * @brief Attaches an LSM tree to a directory, creating it if needed
+ *
+ * Opens the tables listed in the manifest, replays leftover write-ahead logs
+ * and starts the background worker.
+ *
+ * @param lsm Pointer to the tree
+ * @param dir Path of the directory holding the files
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note A tree can only be attached once
+ */
+extern int64_t lsm_open(lsm_tree_t *lsm, uint8_t *dir);
+
+/**
+ * @brief Inserts a database entry into the tree
+ *
+ * @param lsm Pointer to the tree
+ * @param entry Pointer to the database entry to insert
+ * @return int64_t KV_OK on success, KV_EXISTS if the key is already stored,
+ *                 or another negative kv_status_t on failure
+ *
+ * @note The tree takes ownership of the entry and frees it once written
+ * @see lsm_put()
+ */
+extern int64_t lsm_insert(lsm_tree_t *lsm, db_entry_t *entry);
+
+/**
+ * @brief Creates or updates an entry with the given key, value, and type
+ *
+ * @param lsm Pointer to the tree
+ * @param key Key for the entry (null-terminated string)
+ * @param value Text of a number or bool, or bytes of a string or blob
+ * @param len Number of bytes of the value
+ * @param type Type identifier, can be empty to keep the type of an existing key
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if type is empty and the key
+ *                 does not exist, or another negative kv_status_t on failure
+ *
+ * @see lsm_insert(), lsm_get_entry()
+ */
+extern int64_t lsm_put(lsm_tree_t *lsm, uint8_t *key, uint8_t *value, uint64_t len, uint8_t *type);
+
+/**
+ * @brief Deletes an entry by writing a tombstone
+ *
+ * @param lsm Pointer to the tree
+ * @param key Key of the entry to delete (null-terminated string)
+ * @return int64_t KV_OK on success, KV_NOT_FOUND if the key does not exist,
+ *                 or another negative kv_status_t on failure
+ */
+extern int64_t lsm_delete(lsm_tree_t *lsm, uint8_t *key);
+
+/**
+ * @brief Retrieves the entry with the given key
+ *
+ * Searches the memtables, then the level 0 tables newest first, then one
+ * table per deeper level, skipping tables whose Bloom filter rules the key out.
+ *
+ * @param lsm Pointer to the tree
+ * @param key Key of the entry to retrieve (null-terminated string)
+ * @return db_entry_t* Pointer to the entry, or NULL if not found
+ *
+ * @note The returned entry belongs to the calling thread and is only valid
+ *       until its next get or scan of an LSM tree
+ */
+extern db_entry_t *lsm_get_entry(lsm_tree_t *lsm, uint8_t *key);
+
+/**
+ * @brief Calls a function for every entry in a key range, in key order
+ *
+ * @param lsm Pointer to the tree
+ * @param start_key Smallest key to return, or NULL for no lower bound
+ * @param end_key Key at which the scan stops (excluded), or NULL for no upper bound
+ * @param callback Function receiving the entries
+ * @param context User pointer passed to the callback
+ * @return int64_t Number of entries passed to the callback, or -1 on failure
+ *
+ * @note The callback runs with the tree locked and must not call into the database
+ * @note The entry passed to the callback belongs to the calling thread and is
+ *       only valid during the call
+ */
+extern int64_t lsm_scan(lsm_tree_t *lsm, uint8_t *start_key, uint8_t *end_key,
+                        lsm_scan_callback_t callback, void *context);
+
+/**
+ * @brief Counts the live entries of the tree
+ *
+ * @param lsm Pointer to the tree
+ * @return uint64_t Number of live entries
+ *
+ * @note Requires a full scan of the tree
+ */
+extern uint64_t lsm_count(lsm_tree_t *lsm);
+
+/**
+ * @brief Flushes the write-ahead log of the memtable to disk
+ *
+ * @param lsm Pointer to the tree
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t lsm_sync(lsm_tree_t *lsm);
+
+/**
+ * @brief Flushes the memtable and compacts level 0 in the background
+ *
+ * @param lsm Pointer to the tree
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @see lsm_wait_idle()
+ */
+extern int64_t lsm_compact(lsm_tree_t *lsm);
+
+/**
+ * @brief Waits until the background worker has no pending flush or compaction
+ *
+ * @param lsm Pointer to the tree
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t lsm_wait_idle(lsm_tree_t *lsm);
+
+/**
+ * @brief Saves all entries in the tree to a file in the text format
+ *
+ * @param file Open file pointer for writing
+ * @param lsm Pointer to the tree to save
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note Entries are written in key order
+ * @see list_save(), hash_save()
+ */
+extern int64_t lsm_save(FILE *file, lsm_tree_t *lsm);
+
+/**
+ * @brief Stops the background worker, closes the files and frees the tree
+ *
+ * The memtable stays in its write-ahead log and is replayed on the next open.
+ *
+ * @param lsm Pointer to the tree to free (can be NULL)
+ */
+extern void free_lsm_tree(lsm_tree_t *lsm);
+
+/**
+ * @brief Prints all entries in the tree to stdout in key order
+ *
+ * @param lsm Pointer to the tree to print
+ *
+ * @see print_entry()
+ */
+extern void lsm_print(lsm_tree_t *lsm);
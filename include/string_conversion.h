@@ -11,33 +11,74 @@
 #include <string.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <stdbool.h>
 
-#include "logger.h"
+#include "constants.h"
+#include "value_types.h"
+#include "kv_log.h"
 
 
-#define INT8_TYPE_STR "int8"
-#define INT16_TYPE_STR "int16"
-#define INT32_TYPE_STR "int32"
-#define INT64_TYPE_STR "int64"
-#define FLOAT_TYPE_STR "float"
-#define DOUBLE_TYPE_STR "double"
-#define BOOL_TYPE_STR "bool"
+/** @brief Most significant decimal digits parsed exactly into a uint64_t */
+#define NUMBER_MAX_DIGITS 19
+/** @brief Buffer size fitting any number written by the format_* functions */
+#define NUMBER_FORMAT_BUFFER_SIZE 32
+/** @brief Smallest power of ten of the power_of_five_128 table */
+#define NUMBER_SMALLEST_POWER_OF_FIVE -342
+/** @brief Largest power of ten of the power_of_five_128 table */
+#define NUMBER_LARGEST_POWER_OF_FIVE 308
 
 /**
- * @brief Enumeration of supported value types in the database
- * 
- * These type identifiers are used internally to track the data type
- * of values stored in database entries.
+ * @brief Name of a value type, not null-terminated
+ */
+typedef struct _type_name_t {
+  const uint8_t *ptr; /**< First byte of the name */
+  uint64_t len;       /**< Length of the name */
+} type_name_t;
+
+/**
+ * @brief Decimal number split into its significant digits and power of ten
+ */
+typedef struct _decimal_number_t {
+  uint64_t mantissa; /**< Significant digits, only exact if truncated is false */
+  int64_t exponent;  /**< Power of ten applied to the mantissa */
+  bool negative;     /**< True if the number had a minus sign */
+  bool truncated;    /**< True if there were more than NUMBER_MAX_DIGITS significant digits */
+} decimal_number_t;
+
+/**
+ * @brief Layout of an IEEE 754 binary floating point format
+ *
+ * Holds the limits used by the Eisel-Lemire conversion, so the same code
+ * rounds to both float and double.
+ */
+typedef struct _binary_format_t {
+  uint8_t mantissa_bits;        /**< Explicit mantissa bits */
+  uint8_t sign_shift;           /**< Position of the sign bit */
+  int32_t minimum_exponent;     /**< Negated exponent bias */
+  int32_t infinite_power;       /**< Biased exponent of infinity */
+  int32_t smallest_power;       /**< Powers of ten below this always round to zero */
+  int32_t largest_power;        /**< Powers of ten above this always round to infinity */
+  int32_t min_round_to_even;    /**< Smallest power of ten of an exact halfway case */
+  int32_t max_round_to_even;    /**< Largest power of ten of an exact halfway case */
+  int32_t max_exact_power;      /**< Largest power of ten exact in the format */
+  uint64_t max_exact_mantissa;  /**< Largest integer exact in the format */
+} binary_format_t;
+
+/**
+ * @brief Floating point number with a 64-bit significand, f * 2^e
+ */
+typedef struct _diy_fp_t {
+  uint64_t f; /**< Significand */
+  int32_t e;  /**< Binary exponent */
+} diy_fp_t;
+
+/**
+ * @brief 128-bit approximations of the powers of five
+ *
+ * Two words per power, most significant first, for the powers
+ * NUMBER_SMALLEST_POWER_OF_FIVE to NUMBER_LARGEST_POWER_OF_FIVE.
  */
-enum ENTRY_VALUE_TYPE {
-  INT8_TYPE,
-  INT16_TYPE,
-  INT32_TYPE,
-  INT64_TYPE,
-  FLOAT_TYPE,
-  DOUBLE_TYPE,
-  BOOL_TYPE
-};
+extern const uint64_t power_of_five_128[];
 
 /**
  * @brief Maps a type string to its corresponding enum value
@@ -48,11 +89,38 @@ enum ENTRY_VALUE_TYPE {
  * @param type String representation of the type (null-terminated)
  * @return int64_t The corresponding ENTRY_VALUE_TYPE enum value, or -1 if invalid
  * 
- * @note Supported type strings: "int8", "int16", "int32", "int64", "float", "double", "bool"
- * @see map_datatype_to_str()
+ * @note Supported type strings: "int8", "int16", "int32", "int64", "float", "double", "bool",
+ *       "string", "blob"
+ * @see map_datatype_from_span(), map_datatype_to_str()
  */
 extern int64_t map_datatype_from_str(uint8_t *type);
 
+/**
+ * @brief Maps the bytes of a type name to its enum value
+ *
+ * The name is looked up in a perfect hash of its length and one of its
+ * characters, generated at build time from KV_VALUE_TYPES, and confirmed with
+ * a single comparison.
+ *
+ * @param type Type name, not null-terminated
+ * @param len Length of the name
+ * @return int64_t The corresponding ENTRY_VALUE_TYPE enum value, or -1 if invalid
+ *
+ * @note Unknown names are not logged, the caller reports them
+ */
+extern int64_t map_datatype_from_span(uint8_t *type, uint64_t len);
+
+/**
+ * @brief Returns the name of a type without copying it
+ *
+ * @param type ENTRY_VALUE_TYPE enum value
+ * @return type_name_t Constant name of the type, with a NULL pointer if the
+ *                     type is invalid
+ *
+ * @see map_datatype_to_str()
+ */
+extern type_name_t map_datatype_name(int64_t type);
+
 /**
  * @brief Maps an enum type value to its string representation
  * 
@@ -65,10 +133,21 @@ extern int64_t map_datatype_from_str(uint8_t *type);
  * @return int64_t 0 on success, -1 on failure
  * 
  * @note The destination buffer must be large enough to hold the type string
- * @see map_datatype_from_str()
+ * @see map_datatype_from_str(), map_datatype_name()
  */
 extern int64_t map_datatype_to_str(uint64_t type, uint8_t *dest, uint64_t max_len);
 
+/**
+ * @brief Returns the size in bytes of the values of a type
+ * 
+ * @param type ENTRY_VALUE_TYPE enum value
+ * @return int64_t Size of a value of the given type, 0 for the variable-length
+ *                 string and blob types, or -1 if invalid
+ * 
+ * @see map_datatype_from_str()
+ */
+extern int64_t map_datatype_size(int64_t type);
+
 /**
  * @brief Converts a typed value to its string representation
  * 
@@ -82,71 +161,398 @@ extern int64_t map_datatype_to_str(uint64_t type, uint8_t *dest, uint64_t max_le
  * @return int64_t 0 on success, -1 on failure
  * 
  * @note The value pointer must point to data of the specified type
- * @note Different types are formatted with appropriate precision and format
- * @see str_to_int64(), str_to_float(), str_to_double(), str_to_bool()
+ * @note Only fixed-size types are supported, strings and blobs are written
+ *       with escape_bytes()
+ * @note Floats and doubles are written with the shortest digits that parse
+ *       back to the same value
+ * @note Fails instead of truncating when the value does not fit
+ * @see format_int64(), format_float(), format_double()
  */
 extern int64_t map_value_to_str(uint64_t type, void *value, uint8_t *dest, uint64_t max_len);
 
+/**
+ * @brief Writes the decimal digits of an unsigned integer, two at a time
+ *
+ * @param value Integer to write
+ * @param dest Buffer receiving the digits, at least NUMBER_MAX_DIGITS + 1 bytes
+ * @return uint64_t Number of digits written, without a null terminator
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t write_uint64(uint64_t value, uint8_t *dest);
+
+/**
+ * @brief Shifts a number until the top bit of its significand is set
+ *
+ * @note This is a static/internal function
+ */
+static diy_fp_t diy_fp_normalize(diy_fp_t value);
+
+/**
+ * @brief Multiplies two numbers, keeping the rounded upper 64 bits of the significand
+ *
+ * @note This is a static/internal function
+ */
+static diy_fp_t diy_fp_multiply(diy_fp_t left, diy_fp_t right);
+
+/**
+ * @brief Finds the cached power of ten that scales a number to [2^-60, 2^-32) units
+ *
+ * @param exponent Binary exponent of the normalized number
+ * @param decimal_exponent Pointer receiving the negated decimal exponent of the power
+ * @return diy_fp_t The power of ten
+ *
+ * @note This is a static/internal function
+ */
+static diy_fp_t cached_power(int32_t exponent, int32_t *decimal_exponent);
+
+/**
+ * @brief Moves the last generated digit closer to the exact value
+ *
+ * @note This is a static/internal function
+ */
+static void grisu_round(uint8_t *digits, uint64_t len, uint64_t delta, uint64_t rest,
+                        uint64_t ten_kappa, uint64_t distance);
+
+/**
+ * @brief Generates the shortest digits of a number with the Grisu2 algorithm
+ *
+ * The boundaries halfway to the neighbouring floating point numbers are
+ * scaled by a cached power of ten, and digits are generated until the
+ * number is uniquely identified inside them. The digits always parse back
+ * to the same number, and are the shortest ones in nearly every case.
+ *
+ * @param mantissa Significand of the number, including its hidden bit
+ * @param exponent Binary exponent of the number
+ * @param lower_boundary_closer True for powers of two, whose lower neighbour is closer
+ * @param digits Buffer receiving the digits, at least NUMBER_MAX_DIGITS bytes
+ * @param decimal_exponent Pointer receiving the power of ten of the last digit
+ * @return uint64_t Number of digits
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t grisu2(uint64_t mantissa, int32_t exponent, bool lower_boundary_closer,
+                       uint8_t *digits, int32_t *decimal_exponent);
+
+/**
+ * @brief Writes digits and their power of ten in fixed or scientific notation
+ *
+ * @param digits Digits of the number
+ * @param len Number of digits
+ * @param decimal_exponent Power of ten of the last digit
+ * @param dest Buffer receiving the text, without a null terminator
+ * @return uint64_t Number of bytes written
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t write_shortest(uint8_t *digits, uint64_t len, int32_t decimal_exponent, uint8_t *dest);
+
+/**
+ * @brief Writes the shortest representation of a float or a double
+ *
+ * @param bits Bits of the number
+ * @param format Floating point format of the number
+ * @param dest Buffer receiving the null-terminated text
+ * @param max_len Size of the buffer
+ * @return int64_t Length of the text on success, -1 if it does not fit
+ *
+ * @note This is a static/internal function
+ */
+static int64_t format_binary_float(uint64_t bits, const binary_format_t *format, uint8_t *dest, uint64_t max_len);
+
+/**
+ * @brief Writes a 64-bit signed integer in decimal
+ *
+ * @param value Integer to write
+ * @param dest Buffer receiving the null-terminated text
+ * @param max_len Size of the buffer
+ * @return int64_t Length of the text on success, -1 if it does not fit
+ *
+ * @see span_to_int64()
+ */
+extern int64_t format_int64(int64_t value, uint8_t *dest, uint64_t max_len);
+
+/**
+ * @brief Writes the shortest text that parses back to the same float
+ *
+ * @param value Float to write
+ * @param dest Buffer receiving the null-terminated text
+ * @param max_len Size of the buffer
+ * @return int64_t Length of the text on success, -1 if it does not fit
+ *
+ * @note Integral values keep a ".0", large and small magnitudes use
+ *       scientific notation, e.g. "1.5e-7"
+ * @see span_to_float(), format_double()
+ */
+extern int64_t format_float(float value, uint8_t *dest, uint64_t max_len);
+
+/**
+ * @brief Writes the shortest text that parses back to the same double
+ *
+ * @param value Double to write
+ * @param dest Buffer receiving the null-terminated text
+ * @param max_len Size of the buffer
+ * @return int64_t Length of the text on success, -1 if it does not fit
+ *
+ * @see span_to_double(), format_float()
+ */
+extern int64_t format_double(double value, uint8_t *dest, uint64_t max_len);
+
+/**
+ * @brief Returns the escape letter of a byte of a string or blob value
+ *
+ * @param byte Byte of the value
+ * @return uint8_t Letter following the backslash, 'x' for a hexadecimal
+ *                 escape, or 0 if the byte is written as is
+ *
+ * @note This is a static/internal function
+ */
+static uint8_t escape_code(uint8_t byte);
+
+/**
+ * @brief Returns the value of a hexadecimal digit
+ *
+ * @param character Digit, in either case
+ * @return int64_t Value of the digit, or -1 if it is not a hexadecimal digit
+ *
+ * @note This is a static/internal function
+ */
+static int64_t hex_digit_value(uint8_t character);
+
+/**
+ * @brief Returns the length of the text of a string or blob value
+ *
+ * Bytes that would end a line or a value of a text database file are written
+ * as C-style escapes: backslash, newline, carriage return, tab and NUL as
+ * "\\\\", "\\n", "\\r", "\\t" and "\\0", the value delimiter and the other control
+ * bytes as "\\xHH". Every other byte is written as is.
+ *
+ * @param src Bytes of the value
+ * @param len Number of bytes
+ * @return uint64_t Length of the escaped text
+ *
+ * @see escape_bytes()
+ */
+extern uint64_t escaped_length(const uint8_t *src, uint64_t len);
+
+/**
+ * @brief Writes the text of a string or blob value
+ *
+ * @param src Bytes of the value
+ * @param len Number of bytes
+ * @param dest Buffer receiving the escaped text, not null-terminated
+ * @param max_len Size of the buffer
+ * @return int64_t Length of the text on success, -1 if it does not fit
+ *
+ * @see escaped_length(), unescape_bytes()
+ */
+extern int64_t escape_bytes(const uint8_t *src, uint64_t len, uint8_t *dest, uint64_t max_len);
+
+/**
+ * @brief Converts the escaped text of a string or blob value back to its bytes
+ *
+ * @param src Escaped text
+ * @param len Length of the text
+ * @param dest Buffer of at least len bytes receiving the value
+ * @return int64_t Number of bytes of the value, or -1 for a malformed escape
+ *
+ * @see escape_bytes()
+ */
+extern int64_t unescape_bytes(const uint8_t *src, uint64_t len, uint8_t *dest);
+
+/**
+ * @brief Loads 8 bytes of a span as a little-endian word
+ *
+ * @note This is a static/internal function
+ */
+static uint64_t load_eight_bytes(const uint8_t *data);
+
+/**
+ * @brief Checks if the 8 bytes of a word are all ASCII digits
+ *
+ * @note This is a static/internal function
+ */
+static bool is_eight_digits(uint64_t word);
+
+/**
+ * @brief Converts 8 ASCII digits packed in a word with SWAR multiplications
+ *
+ * @param word 8 digits loaded with load_eight_bytes()
+ * @return uint32_t Value of the digits, the first one being the most significant
+ *
+ * @note This is a static/internal function
+ */
+static uint32_t parse_eight_digits(uint64_t word);
+
+/**
+ * @brief Accumulates a run of digits into a number, 8 digits at a time
+ *
+ * @param str Start of the digits
+ * @param len Bytes available from str
+ * @param value Pointer to the running value, multiplied by 10 for each digit
+ * @return uint64_t Number of digits consumed
+ *
+ * @note This is a static/internal function. The value wraps around past 19
+ *       digits, callers check the count
+ */
+static uint64_t parse_digits(uint8_t *str, uint64_t len, uint64_t *value);
+
+/**
+ * @brief Splits a decimal number into its significant digits and power of ten
+ *
+ * @param str Start of the number
+ * @param len Length of the number, the whole span has to be consumed
+ * @param number Pointer receiving the parsed number
+ * @return int64_t 0 on success, -1 if the span is not a decimal number
+ *
+ * @note This is a static/internal function
+ */
+static int64_t parse_decimal(uint8_t *str, uint64_t len, decimal_number_t *number);
+
+/**
+ * @brief Rounds a decimal number to a binary floating point format
+ *
+ * Eisel-Lemire algorithm: the normalized mantissa is multiplied by a 128-bit
+ * approximation of the power of five, which gives the correctly rounded
+ * result unless the product is too close to a halfway point.
+ *
+ * @param number Parsed decimal number with at most NUMBER_MAX_DIGITS digits
+ * @param format Target floating point format
+ * @param bits Pointer receiving the bits of the result
+ * @return bool True on success, false if the slow path is needed
+ *
+ * @note This is a static/internal function
+ */
+static bool compute_binary_float(decimal_number_t *number, const binary_format_t *format, uint64_t *bits);
+
+/**
+ * @brief Converts a span with strtod(), the slow path of the float parsers
+ *
+ * Used for numbers with more than NUMBER_MAX_DIGITS significant digits,
+ * the rare products Eisel-Lemire cannot round, and infinities, NaNs and
+ * hexadecimal floats.
+ *
+ * @param str Start of the number
+ * @param len Length of the number, the whole span has to be consumed
+ * @param dest Pointer receiving the value
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t parse_double_fallback(uint8_t *str, uint64_t len, double *dest);
+
+/**
+ * @brief Converts a span with strtof(), the slow path of span_to_float()
+ *
+ * @note This is a static/internal function
+ * @see parse_double_fallback()
+ */
+static int64_t parse_float_fallback(uint8_t *str, uint64_t len, float *dest);
+
+/**
+ * @brief Converts a span of text to a 64-bit signed integer
+ *
+ * Digits are converted 8 at a time with SWAR multiplications on a 64-bit
+ * word, without locale lookups or errno.
+ *
+ * @param str Start of the text, not null-terminated
+ * @param len Length of the text
+ * @param dest Pointer to store the converted integer value
+ * @return int64_t 0 on success, -1 on failure (invalid format, overflow, etc.)
+ *
+ * @note Accepts decimal integers with an optional sign, the whole span has
+ *       to be a number
+ * @see span_to_float(), span_to_double(), span_to_bool()
+ */
+extern int64_t span_to_int64(uint8_t *str, uint64_t len, int64_t *dest);
+
+/**
+ * @brief Converts a span of text to a single-precision floating point number
+ *
+ * @param str Start of the text, not null-terminated
+ * @param len Length of the text
+ * @param dest Pointer to store the converted float value
+ * @return int64_t 0 on success, -1 on failure (invalid format, overflow, etc.)
+ *
+ * @note The result is correctly rounded, like strtof() in the C locale
+ * @see span_to_double()
+ */
+extern int64_t span_to_float(uint8_t *str, uint64_t len, float *dest);
+
+/**
+ * @brief Converts a span of text to a double-precision floating point number
+ *
+ * Mantissas and powers of ten that are both exact in a double are combined
+ * with a single multiplication or division (Clinger's fast path), the other
+ * numbers of up to 19 significant digits go through compute_binary_float()
+ * and only longer numbers fall back to strtod().
+ *
+ * @param str Start of the text, not null-terminated
+ * @param len Length of the text
+ * @param dest Pointer to store the converted double value
+ * @return int64_t 0 on success, -1 on failure (invalid format, overflow, etc.)
+ *
+ * @note The result is correctly rounded, like strtod() in the C locale
+ * @see span_to_float(), compute_binary_float()
+ */
+extern int64_t span_to_double(uint8_t *str, uint64_t len, double *dest);
+
+/**
+ * @brief Converts a span of text to a boolean value
+ *
+ * @param str Start of the text, not null-terminated
+ * @param len Length of the text
+ * @param dest Pointer to store the converted boolean value
+ * @return int64_t 0 on success, -1 on failure (unrecognized format)
+ *
+ * @note Only "true" and "false" are accepted
+ */
+extern int64_t span_to_bool(uint8_t *str, uint64_t len, bool *dest);
+
 /**
  * @brief Converts a string to a 64-bit signed integer
  * 
- * Parses a string representation of an integer and stores the result
- * in the provided destination. Handles error checking and validation.
- * 
  * @param str_value String representation of the integer (null-terminated)
  * @param dest Pointer to store the converted integer value
  * @return int64_t 0 on success, -1 on failure (invalid format, overflow, etc.)
  * 
- * @note Uses standard library functions with proper error handling
- * @note Supports decimal integers with optional sign
- * @see str_to_float(), str_to_double(), str_to_bool()
+ * @see span_to_int64()
  */
 extern int64_t str_to_int64(uint8_t *str_value, int64_t *dest);
 
 /**
  * @brief Converts a string to a single-precision floating point number
  * 
- * Parses a string representation of a float and stores the result
- * in the provided destination. Handles scientific notation and special values.
- * 
  * @param str_value String representation of the float (null-terminated)
  * @param dest Pointer to store the converted float value
  * @return int64_t 0 on success, -1 on failure (invalid format, overflow, etc.)
  * 
  * @note Supports decimal notation, scientific notation (e.g., "1.23e-4")
  * @note Handles special values like infinity and NaN
- * @see str_to_int64(), str_to_double(), str_to_bool()
+ * @see span_to_float()
  */
 extern int64_t str_to_float(uint8_t *str_value, float *dest);
 
 /**
  * @brief Converts a string to a double-precision floating point number
  * 
- * Parses a string representation of a double and stores the result
- * in the provided destination. Provides higher precision than str_to_float().
- * 
  * @param str_value String representation of the double (null-terminated)
  * @param dest Pointer to store the converted double value
  * @return int64_t 0 on success, -1 on failure (invalid format, overflow, etc.)
  * 
  * @note Supports decimal notation, scientific notation with extended precision
  * @note Handles special values like infinity and NaN
- * @see str_to_int64(), str_to_float(), str_to_bool()
+ * @see span_to_double()
  */
 extern int64_t str_to_double(uint8_t *str_value, double *dest);
 
 /**
  * @brief Converts a string to a boolean value
  * 
- * Parses string representations of boolean values and converts them
- * to C boolean type. Supports multiple string formats for true/false.
- * 
  * @param str_value String representation of the boolean (null-terminated)
  * @param dest Pointer to store the converted boolean value
  * @return int64_t 0 on success, -1 on failure (unrecognized format)
  * 
- * @note Typical supported formats: "true"/"false", "1"/"0", "yes"/"no"
- * @note Case sensitivity depends on implementation
- * @see str_to_int64(), str_to_float(), str_to_double()
+ * @see span_to_bool()
  */
 extern int64_t str_to_bool(uint8_t *str_value, bool *dest);
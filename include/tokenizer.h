@@ -0,0 +1,213 @@
+/**
+ * @file tokenizer.h
+ * @brief Reentrant tokenizer of the lines of text database files
+ *
+ * This module splits a buffer holding database lines into (type, key, value)
+ * spans pointing into the buffer, without copying or modifying it. The
+ * positions of every delimiter and newline of a window of the buffer are
+ * found at once with SSE2/AVX2 compares and movemasks, and the lines are then
+ * assembled by walking those positions.
+ *
+ * Files that are not mapped are tokenized through a reader, which reads them
+ * in large chunks into a buffer that only grows when a single line does not
+ * fit in it.
+ */
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "constants.h"
+#include "kv_log.h"
+#include "kv_alloc.h"
+
+
+/** @brief Bytes of the buffer indexed at once by the tokenizer */
+#define TOKENIZER_WINDOW_SIZE 4096
+
+/**
+ * @brief Bytes of a buffer, not null-terminated
+ */
+typedef struct _kv_span_t {
+  uint8_t *ptr; /**< First byte of the span */
+  uint64_t len; /**< Number of bytes */
+} kv_span_t;
+
+/**
+ * @brief Spans of one line of a database file
+ *
+ * The type, key and value spans are only set when valid is true. Comment,
+ * blank and malformed lines are returned with valid set to false. The value
+ * may be empty, an empty string or blob.
+ */
+typedef struct _kv_tokens_t {
+  kv_span_t line;  /**< Whole line, including its newline if any */
+  kv_span_t type;  /**< Text before the type delimiter */
+  kv_span_t key;   /**< Text between the type and key delimiters */
+  kv_span_t value; /**< Text between the key and value delimiters */
+  bool valid;      /**< True if the line holds a complete entry */
+} kv_tokens_t;
+
+/**
+ * @brief Tokenizer state over a buffer of database lines
+ *
+ * The structural positions (delimiters and newlines) are indexed one window
+ * at a time, so the state has a fixed size whatever the size of the buffer.
+ */
+typedef struct _kv_tokenizer_t {
+  uint8_t *buffer;                                  /**< Buffer being tokenized */
+  uint64_t len;                                     /**< Size of the buffer */
+  uint64_t position;                                /**< Start of the next line */
+  uint64_t indexed;                                 /**< Bytes of the buffer already indexed */
+  uint64_t window_start;                            /**< Offset of the current window */
+  uint32_t structurals[TOKENIZER_WINDOW_SIZE];      /**< Structural offsets inside the window */
+  uint64_t structural_count;                        /**< Number of structural offsets */
+  uint64_t cursor;                                  /**< Next structural offset to consume */
+} kv_tokenizer_t;
+
+/**
+ * @brief Reader tokenizing the lines of a file descriptor chunk by chunk
+ *
+ * The buffer holds complete lines being tokenized followed by the start of
+ * the next, partial line. It grows by doubling when a line fills it, so
+ * its size follows the longest line rather than the file.
+ */
+typedef struct _kv_reader_t {
+  int32_t fd;                 /**< File descriptor being read, not owned */
+  uint8_t *buffer;            /**< Bytes read and not returned yet */
+  uint64_t capacity;          /**< Size of the buffer */
+  uint64_t len;               /**< Bytes held in the buffer */
+  uint64_t consumed;          /**< Bytes of complete lines handed to the tokenizer */
+  bool eof;                   /**< True once the end of the file was read */
+  kv_tokenizer_t tokenizer;   /**< Tokenizer over the complete lines of the buffer */
+  kv_memory_t *memory;        /**< Memory of the reader and its buffer, NULL for kv_default_memory */
+} kv_reader_t;
+
+/**
+ * @brief Selects the structural indexing implementation supported by the CPU
+ *
+ * @note This is a static/internal function run once through pthread_once()
+ */
+static void init_tokenizer();
+
+/**
+ * @brief Finds the structural bytes of a window one byte at a time
+ *
+ * @param data Start of the window
+ * @param len Size of the window
+ * @param dest Array receiving the offsets of the structural bytes
+ * @return uint64_t Number of structural bytes
+ *
+ * @note This is a static/internal function, also used for the tail of the
+ *       SIMD implementations
+ */
+static uint64_t index_structurals_scalar(const uint8_t *data, uint64_t len, uint32_t *dest);
+
+/**
+ * @brief Finds the structural bytes of a window 16 bytes at a time with SSE2
+ *
+ * @note This is a static/internal function
+ * @see index_structurals_scalar()
+ */
+static uint64_t index_structurals_sse2(const uint8_t *data, uint64_t len, uint32_t *dest);
+
+/**
+ * @brief Finds the structural bytes of a window 32 bytes at a time with AVX2
+ *
+ * @note This is a static/internal function, only used when the CPU supports AVX2
+ * @see index_structurals_scalar()
+ */
+static uint64_t index_structurals_avx2(const uint8_t *data, uint64_t len, uint32_t *dest);
+
+/**
+ * @brief Indexes the next window of the buffer
+ *
+ * @param tokenizer Pointer to the tokenizer
+ * @return bool False if the whole buffer has been indexed
+ *
+ * @note This is a static/internal function
+ */
+static bool index_next_window(kv_tokenizer_t *tokenizer);
+
+/**
+ * @brief Starts tokenizing a buffer
+ *
+ * @param tokenizer Pointer to the tokenizer state to initialize
+ * @param buffer Buffer of database lines, left untouched
+ * @param len Size of the buffer
+ * @return int64_t 0 on success, -1 on failure
+ */
+extern int64_t tokenizer_init(kv_tokenizer_t *tokenizer, uint8_t *buffer, uint64_t len);
+
+/**
+ * @brief Returns the spans of the next line of the buffer
+ *
+ * @param tokenizer Pointer to the tokenizer
+ * @param tokens Pointer receiving the spans of the line
+ * @return int64_t 1 if a line was returned, 0 at the end of the buffer,
+ *                 -1 on failure
+ *
+ * @note The last line of the buffer does not need a newline
+ */
+extern int64_t tokenizer_next(kv_tokenizer_t *tokenizer, kv_tokens_t *tokens);
+
+/**
+ * @brief Tokenizes a single line
+ *
+ * @param line Start of the line, left untouched
+ * @param len Length of the line
+ * @param tokens Pointer receiving the spans of the line
+ * @return int64_t 0 if the line holds a complete entry, -1 otherwise
+ */
+extern int64_t tokenize_line(uint8_t *line, uint64_t len, kv_tokens_t *tokens);
+
+/**
+ * @brief Reads the next chunk of the file into the buffer of a reader
+ *
+ * Moves the partial line left by the previous chunk to the start of the
+ * buffer and reads until the buffer holds at least one complete line or
+ * the file ends, growing the buffer if a line does not fit in it.
+ *
+ * @param reader Pointer to the reader
+ * @return int64_t 0 on success, -1 on failure
+ *
+ * @note This is a static/internal function
+ */
+static int64_t fill_reader(kv_reader_t *reader);
+
+/**
+ * @brief Creates a reader over an open file descriptor
+ *
+ * @param fd File descriptor to read, left open by free_reader()
+ * @param capacity Initial size of the buffer
+ * @param memory Memory of the reader and its buffer, NULL for kv_default_memory
+ * @return kv_reader_t* Pointer to the reader, or NULL on failure
+ *
+ * @note The caller is responsible for freeing the reader using free_reader()
+ */
+extern kv_reader_t *create_reader(int32_t fd, uint64_t capacity, kv_memory_t *memory);
+
+/**
+ * @brief Returns the spans of the next line of the file
+ *
+ * @param reader Pointer to the reader
+ * @param tokens Pointer receiving the spans of the line
+ * @return int64_t 1 if a line was returned, 0 at the end of the file,
+ *                 -1 on failure
+ *
+ * @note The spans are only valid until the next call
+ * @see tokenizer_next()
+ */
+extern int64_t reader_next(kv_reader_t *reader, kv_tokens_t *tokens);
+
+/**
+ * @brief Frees a reader and its buffer
+ *
+ * @param reader Pointer to the reader, may be NULL
+ */
+extern void free_reader(kv_reader_t *reader);
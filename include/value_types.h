@@ -0,0 +1,56 @@
+/**
+ * @file value_types.h
+ * @brief List of the value types supported by the key-value store
+ *
+ * Every table indexed by type is expanded from KV_VALUE_TYPES: the
+ * ENTRY_VALUE_TYPE enum, the name and size tables of string_conversion.c and
+ * the perfect hash of the type names, which tools/gen_type_hash.c generates
+ * at build time. A new type only has to be added here.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define INT8_TYPE_STR "int8"
+#define INT16_TYPE_STR "int16"
+#define INT32_TYPE_STR "int32"
+#define INT64_TYPE_STR "int64"
+#define FLOAT_TYPE_STR "float"
+#define DOUBLE_TYPE_STR "double"
+#define BOOL_TYPE_STR "bool"
+#define STRING_TYPE_STR "string"
+#define BLOB_TYPE_STR "blob"
+
+/**
+ * @brief Expands X(enum_value, name, size) once per value type
+ *
+ * The size is the size of a value in bytes, 0 for variable-length types.
+ * Types are listed in the order of their enum values.
+ */
+#define KV_VALUE_TYPES(X)                         \
+  X(INT8_TYPE, INT8_TYPE_STR, sizeof(int8_t))     \
+  X(INT16_TYPE, INT16_TYPE_STR, sizeof(int16_t))  \
+  X(INT32_TYPE, INT32_TYPE_STR, sizeof(int32_t))  \
+  X(INT64_TYPE, INT64_TYPE_STR, sizeof(int64_t))  \
+  X(FLOAT_TYPE, FLOAT_TYPE_STR, sizeof(float))    \
+  X(DOUBLE_TYPE, DOUBLE_TYPE_STR, sizeof(double)) \
+  X(BOOL_TYPE, BOOL_TYPE_STR, sizeof(bool))       \
+  X(STRING_TYPE, STRING_TYPE_STR, 0)              \
+  X(BLOB_TYPE, BLOB_TYPE_STR, 0)
+
+#define KV_VALUE_TYPE_ENUM(enum_value, name, size) enum_value,
+
+/**
+ * @brief Enumeration of supported value types in the database
+ *
+ * These type identifiers are used internally to track the data type
+ * of values stored in database entries.
+ */
+enum ENTRY_VALUE_TYPE {
+  KV_VALUE_TYPES(KV_VALUE_TYPE_ENUM)
+  VALUE_TYPE_COUNT /**< Number of value types, not a type */
+};
+
+#undef KV_VALUE_TYPE_ENUM
@@ -0,0 +1,1103 @@
+#include "bitcask.h"
+
+static pthread_once_t bitcask_reader_once = PTHREAD_ONCE_INIT;
+static pthread_key_t bitcask_reader_key;
+
+static uint64_t bitcask_hash(uint8_t *key, uint64_t size) {
+  uint64_t hash_code = 14695981039346656037ULL;
+
+  uint8_t character;
+  while ((character = *key++) != '\0') {
+    hash_code ^= character;
+    hash_code *= 1099511628211ULL;
+  }
+
+  return hash_code % size;
+}
+
+static uint64_t record_size(uint8_t *key, uint32_t value_size) {
+  return sizeof(bitcask_record_header_t) + strlen(key) + value_size;
+}
+
+static uint32_t record_crc(bitcask_record_header_t *header, uint8_t *key, void *value) {
+  uint64_t skip = offsetof(bitcask_record_header_t, value_size);
+  uint32_t crc = crc32c(0, (uint8_t*)header + skip, sizeof(bitcask_record_header_t) - skip);
+  crc = crc32c(crc, key, header->key_size);
+  return crc32c(crc, value, header->value_size);
+}
+
+static int64_t write_data_record(int32_t fd, uint64_t offset, uint8_t *key, int64_t type,
+                            void *value, uint32_t value_size) {
+  bitcask_record_header_t header = {
+    .crc = 0,
+    .value_size = value_size,
+    .key_size = strlen(key),
+    .type = type,
+    .reserved = 0
+  };
+  header.crc = record_crc(&header, key, value);
+
+  struct iovec parts[3] = {
+    { .iov_base = &header, .iov_len = sizeof(bitcask_record_header_t) },
+    { .iov_base = key, .iov_len = header.key_size },
+    { .iov_base = value, .iov_len = value_size }
+  };
+  int64_t size = sizeof(bitcask_record_header_t) + header.key_size + value_size;
+  if (pwritev(fd, parts, value_size > 0 ? 3 : 2, offset) != size) {
+    return -1;
+  }
+  return size;
+}
+
+static int64_t read_record(int32_t fd, uint64_t key_size, uint32_t value_size,
+                           uint64_t value_offset, uint8_t *value) {
+  uint8_t prefix[sizeof(bitcask_record_header_t) + SM_BUFFER_SIZE];
+  uint64_t prefix_size = sizeof(bitcask_record_header_t) + key_size;
+  uint64_t offset = value_offset - prefix_size;
+  struct iovec parts[2] = {
+    { .iov_base = prefix, .iov_len = prefix_size },
+    { .iov_base = value, .iov_len = value_size }
+  };
+  if (preadv(fd, parts, 2, offset) != (ssize_t)(prefix_size + value_size)) {
+    return -1;
+  }
+
+  bitcask_record_header_t header;
+  memcpy(&header, prefix, sizeof(bitcask_record_header_t));
+  if (header.key_size != key_size || header.value_size != value_size ||
+      header.crc != record_crc(&header, prefix + sizeof(bitcask_record_header_t), value)) {
+    kv_log(3, "Error: Checksum mismatch in the record at offset %" PRIu64 "\n", offset);
+    return -1;
+  }
+  return 0;
+}
+
+static void init_bitcask_reader_key() {
+  pthread_key_create(&bitcask_reader_key, free_bitcask_reader);
+}
+
+static void free_bitcask_reader(void *arg) {
+  bitcask_reader_t *reader = (bitcask_reader_t*)arg;
+  free(reader->buffer);
+  free(reader);
+}
+
+static bitcask_reader_t *get_bitcask_reader() {
+  pthread_once(&bitcask_reader_once, init_bitcask_reader_key);
+  bitcask_reader_t *reader = pthread_getspecific(bitcask_reader_key);
+  if (reader != NULL) {
+    return reader;
+  }
+
+  reader = calloc(1, sizeof(bitcask_reader_t));
+  if (reader == NULL || pthread_setspecific(bitcask_reader_key, reader) != 0) {
+    kv_log(3, "Error: Failed to allocate the read buffer of a thread\n");
+    free(reader);
+    return NULL;
+  }
+  return reader;
+}
+
+static int64_t reserve_read_buffer(bitcask_reader_t *reader, uint64_t size) {
+  if (size < reader->capacity) return 0;
+
+  uint64_t capacity = reader->capacity > 0 ? reader->capacity : sizeof(int64_t) + 1;
+  while (capacity <= size) capacity *= 2;
+
+  uint8_t *buffer = realloc(reader->buffer, capacity);
+  if (buffer == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for a bitcask value\n");
+    return -1;
+  }
+  reader->buffer = buffer;
+  reader->capacity = capacity;
+  return 0;
+}
+
+static bitcask_keydir_entry_t *keydir_find(bitcask_t *bitcask, uint8_t *key) {
+  kv_key_probe_t probe;
+  if (!kv_key_probe(&probe, key)) {
+    return NULL;
+  }
+
+  bitcask_keydir_entry_t *current = bitcask->keydir[bitcask_hash(key, bitcask->keydir_size)];
+  while (current != NULL) {
+    if (kv_key_matches(&probe, current->key)) {
+      return current;
+    }
+    current = current->next;
+  }
+  return NULL;
+}
+
+static int64_t keydir_grow(bitcask_t *bitcask) {
+  uint64_t new_size = bitcask->keydir_size * 2;
+  bitcask_keydir_entry_t **new_keydir = calloc(new_size, sizeof(bitcask_keydir_entry_t*));
+  if (new_keydir == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for the bitcask key directory\n");
+    return -1;
+  }
+
+  for (uint64_t idx = 0; idx < bitcask->keydir_size; idx++) {
+    bitcask_keydir_entry_t *current = bitcask->keydir[idx];
+    while (current != NULL) {
+      bitcask_keydir_entry_t *next = current->next;
+      uint64_t bucket = bitcask_hash(current->key, new_size);
+      current->next = new_keydir[bucket];
+      new_keydir[bucket] = current;
+      current = next;
+    }
+  }
+
+  free(bitcask->keydir);
+  bitcask->keydir = new_keydir;
+  bitcask->keydir_size = new_size;
+  return 0;
+}
+
+static void mark_dead(bitcask_t *bitcask, uint64_t file_id, uint64_t bytes) {
+  bitcask_file_t *file = find_file(bitcask, file_id);
+  if (file != NULL) {
+    file->dead_bytes += bytes;
+  }
+}
+
+static int64_t keydir_set(bitcask_t *bitcask, uint8_t *key, int64_t type,
+                          uint64_t file_id, uint64_t offset, uint32_t value_size) {
+  bitcask_keydir_entry_t *entry = keydir_find(bitcask, key);
+  if (entry != NULL) {
+    mark_dead(bitcask, entry->file_id, record_size(key, entry->value_size));
+  }
+  else {
+    if (bitcask->count >= bitcask->keydir_size && keydir_grow(bitcask) < 0) {
+      return KV_OOM;
+    }
+
+    entry = malloc(sizeof(bitcask_keydir_entry_t));
+    if (entry == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for a key directory entry\n");
+      return KV_OOM;
+    }
+    strncpy(entry->key, key, SM_BUFFER_SIZE);
+    entry->key[SM_BUFFER_SIZE-1] = '\0';
+
+    uint64_t bucket = bitcask_hash(entry->key, bitcask->keydir_size);
+    entry->next = bitcask->keydir[bucket];
+    bitcask->keydir[bucket] = entry;
+    bitcask->count++;
+  }
+
+  entry->type = type;
+  entry->file_id = file_id;
+  entry->offset = offset;
+  entry->value_size = value_size;
+  return 0;
+}
+
+static int64_t keydir_remove(bitcask_t *bitcask, uint8_t *key) {
+  kv_key_probe_t probe;
+  if (!kv_key_probe(&probe, key)) {
+    return KV_NOT_FOUND;
+  }
+
+  uint64_t bucket = bitcask_hash(key, bitcask->keydir_size);
+  bitcask_keydir_entry_t *previous = NULL;
+  bitcask_keydir_entry_t *current = bitcask->keydir[bucket];
+  while (current != NULL) {
+    if (kv_key_matches(&probe, current->key)) {
+      if (previous == NULL) {
+        bitcask->keydir[bucket] = current->next;
+      }
+      else {
+        previous->next = current->next;
+      }
+      mark_dead(bitcask, current->file_id, record_size(current->key, current->value_size));
+      free(current);
+      bitcask->count--;
+      return 0;
+    }
+    previous = current;
+    current = current->next;
+  }
+  return KV_NOT_FOUND;
+}
+
+static bitcask_file_t *find_file(bitcask_t *bitcask, uint64_t file_id) {
+  uint64_t low = 0;
+  uint64_t high = bitcask->file_count;
+  while (low < high) {
+    uint64_t middle = (low + high) / 2;
+    if (bitcask->files[middle].id == file_id) {
+      return &bitcask->files[middle];
+    }
+    if (bitcask->files[middle].id < file_id) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return NULL;
+}
+
+static void build_file_path(bitcask_t *bitcask, uint64_t file_id, uint8_t *extension,
+                            uint8_t *dest, uint64_t max_len) {
+  snprintf(dest, max_len, "%s/%09" PRIu64 ".%s", bitcask->dir, file_id, extension);
+  dest[max_len-1] = '\0';
+}
+
+static bitcask_file_t *add_file(bitcask_t *bitcask, uint64_t file_id, bool truncate) {
+  if (bitcask->file_count == bitcask->file_capacity) {
+    uint64_t new_capacity = bitcask->file_capacity == 0 ? 8 : bitcask->file_capacity * 2;
+    bitcask_file_t *new_files = realloc(bitcask->files, new_capacity * sizeof(bitcask_file_t));
+    if (new_files == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for bitcask files\n");
+      return NULL;
+    }
+    bitcask->files = new_files;
+    bitcask->file_capacity = new_capacity;
+  }
+
+  uint8_t path[BG_BUFFER_SIZE];
+  build_file_path(bitcask, file_id, "data", path, BG_BUFFER_SIZE);
+  int32_t fd = open(path, O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+  if (fd < 0) {
+    kv_log(3, "Error: Failed to open bitcask data file %s\n", path);
+    return NULL;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0) {
+    kv_log(3, "Error: Failed to stat bitcask data file %s\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  uint64_t idx = bitcask->file_count;
+  while (idx > 0 && bitcask->files[idx-1].id > file_id) {
+    bitcask->files[idx] = bitcask->files[idx-1];
+    idx--;
+  }
+
+  bitcask->files[idx].id = file_id;
+  bitcask->files[idx].fd = fd;
+  bitcask->files[idx].size = file_stat.st_size;
+  bitcask->files[idx].dead_bytes = 0;
+  bitcask->file_count++;
+
+  if (file_id >= bitcask->next_file_id) {
+    bitcask->next_file_id = file_id + 1;
+  }
+
+  return &bitcask->files[idx];
+}
+
+static void remove_file(bitcask_t *bitcask, uint64_t idx) {
+  bitcask_file_t *file = &bitcask->files[idx];
+
+  uint8_t path[BG_BUFFER_SIZE];
+  close(file->fd);
+  build_file_path(bitcask, file->id, "data", path, BG_BUFFER_SIZE);
+  unlink(path);
+  build_file_path(bitcask, file->id, "hint", path, BG_BUFFER_SIZE);
+  unlink(path);
+
+  memmove(&bitcask->files[idx], &bitcask->files[idx+1],
+          (bitcask->file_count - idx - 1) * sizeof(bitcask_file_t));
+  bitcask->file_count--;
+}
+
+static int64_t rotate_active_file(bitcask_t *bitcask, uint64_t file_id) {
+  if (bitcask->file_count > 0) {
+    bitcask_file_t *active = &bitcask->files[bitcask->file_count-1];
+    if (fsync(active->fd) < 0) {
+      kv_log(3, "Error: Failed to sync bitcask data file %" PRIu64 "\n", active->id);
+      return -1;
+    }
+  }
+
+  if (add_file(bitcask, file_id, true) == NULL) {
+    return -1;
+  }
+
+  uint64_t total_bytes = 0;
+  uint64_t dead_bytes = 0;
+  for (uint64_t idx = 0; idx < bitcask->file_count; idx++) {
+    total_bytes += bitcask->files[idx].size;
+    dead_bytes += bitcask->files[idx].dead_bytes;
+  }
+  if (!bitcask->merging && dead_bytes * 2 > total_bytes) {
+    start_merge(bitcask);
+  }
+
+  return 0;
+}
+
+static int64_t append_record(bitcask_t *bitcask, uint8_t *key, int64_t type, void *value,
+                             uint64_t value_size, uint64_t *file_id, uint64_t *offset) {
+  uint64_t key_size = strlen(key);
+  uint64_t size = sizeof(bitcask_record_header_t) + key_size + value_size;
+  if (key_size >= SM_BUFFER_SIZE || value_size > UINT32_MAX) {
+    kv_log(3, "Error: Record for key \"%s\" is too large\n", key);
+    return -1;
+  }
+
+  bitcask_file_t *active = &bitcask->files[bitcask->file_count-1];
+  if (active->size > 0 && active->size + size > bitcask->max_file_size) {
+    if (rotate_active_file(bitcask, bitcask->next_file_id) < 0) {
+      return -1;
+    }
+    active = &bitcask->files[bitcask->file_count-1];
+  }
+
+  if (write_data_record(active->fd, active->size, key, type, value, value_size) < 0) {
+    kv_log(3, "Error: Failed to append a record to bitcask data file %" PRIu64 "\n", active->id);
+    return -1;
+  }
+
+  *file_id = active->id;
+  *offset = active->size + sizeof(bitcask_record_header_t) + key_size;
+  active->size += size;
+  return 0;
+}
+
+static int64_t replay_data_file(bitcask_t *bitcask, bitcask_file_t *file) {
+  FILE *data_file = fdopen(dup(file->fd), "r");
+  if (data_file == NULL) {
+    kv_log(3, "Error: Failed to read bitcask data file %" PRIu64 "\n", file->id);
+    return -1;
+  }
+
+  uint64_t offset = 0;
+  uint8_t *value = NULL;
+  uint64_t value_capacity = 0;
+  bitcask_record_header_t header;
+  while (fread(&header, sizeof(bitcask_record_header_t), 1, data_file) == 1) {
+    bool is_tombstone = header.type == BITCASK_TOMBSTONE_TYPE;
+    int64_t fixed_size = map_datatype_size(header.type);
+
+    /* A header is checked before its sizes are trusted, a torn one could ask for gigabytes */
+    uint8_t key[SM_BUFFER_SIZE];
+    if (offset + sizeof(bitcask_record_header_t) > file->size ||
+        header.key_size == 0 || header.key_size >= SM_BUFFER_SIZE ||
+        (is_tombstone && header.value_size != 0) ||
+        (!is_tombstone && (fixed_size < 0 || (fixed_size > 0 && fixed_size != header.value_size))) ||
+        (uint64_t)header.key_size + header.value_size > file->size - offset - sizeof(bitcask_record_header_t) ||
+        fread(key, header.key_size, 1, data_file) != 1) {
+      kv_log(3, "Error: Bitcask data file %" PRIu64 " is truncated at offset %" PRIu64 "\n",
+             file->id, offset);
+      break;
+    }
+
+    if (header.value_size > value_capacity) {
+      uint8_t *new_value = realloc(value, header.value_size);
+      if (new_value == NULL) {
+        kv_log(3, "Error: Failed to allocate memory for a bitcask value\n");
+        free(value);
+        fclose(data_file);
+        return -1;
+      }
+      value = new_value;
+      value_capacity = header.value_size;
+    }
+
+    if (header.value_size > 0 && fread(value, header.value_size, 1, data_file) != 1) {
+      kv_log(3, "Error: Bitcask data file %" PRIu64 " is truncated at offset %" PRIu64 "\n",
+             file->id, offset);
+      break;
+    }
+
+    /* A torn or damaged record ends the file like a truncated one */
+    if (header.crc != record_crc(&header, key, value)) {
+      kv_log(3, "Error: Checksum mismatch in bitcask data file %" PRIu64 " at offset %" PRIu64 "\n",
+             file->id, offset);
+      break;
+    }
+    key[header.key_size] = '\0';
+
+    uint64_t value_offset = offset + sizeof(bitcask_record_header_t) + header.key_size;
+    uint64_t size = value_offset + header.value_size - offset;
+    if (is_tombstone) {
+      keydir_remove(bitcask, key);
+      file->dead_bytes += size;
+    }
+    else if (keydir_set(bitcask, key, header.type, file->id, value_offset, header.value_size) < 0) {
+      free(value);
+      fclose(data_file);
+      return -1;
+    }
+    offset += size;
+  }
+  free(value);
+  fclose(data_file);
+
+  if (offset < file->size) {
+    if (ftruncate(file->fd, offset) < 0) {
+      kv_log(3, "Error: Failed to truncate bitcask data file %" PRIu64 "\n", file->id);
+      return -1;
+    }
+    file->size = offset;
+  }
+
+  return 0;
+}
+
+static int64_t replay_hint_file(bitcask_t *bitcask, uint64_t file_id, uint8_t *hint_path) {
+  FILE *hint_file = fopen(hint_path, "r");
+  if (hint_file == NULL) {
+    kv_log(3, "Error: Failed to read bitcask hint file %s\n", hint_path);
+    return -1;
+  }
+
+  int64_t result = 0;
+  bitcask_hint_t hint;
+  while (fread(&hint, sizeof(bitcask_hint_t), 1, hint_file) == 1) {
+    uint8_t key[SM_BUFFER_SIZE];
+    if (hint.key_size == 0 || hint.key_size >= SM_BUFFER_SIZE ||
+        fread(key, hint.key_size, 1, hint_file) != 1) {
+      kv_log(3, "Error: Bitcask hint file %s is corrupted\n", hint_path);
+      result = -1;
+      break;
+    }
+    key[hint.key_size] = '\0';
+
+    if (keydir_set(bitcask, key, hint.type, file_id, hint.offset, hint.value_size) < 0) {
+      result = -1;
+      break;
+    }
+  }
+
+  fclose(hint_file);
+  return result;
+}
+
+static int64_t write_hint_file(bitcask_t *bitcask, uint64_t file_id, uint8_t *hints, uint64_t hints_size) {
+  uint8_t hint_path[BG_BUFFER_SIZE];
+  uint8_t tmp_path[BG_BUFFER_SIZE];
+  build_file_path(bitcask, file_id, "hint", hint_path, BG_BUFFER_SIZE);
+  build_file_path(bitcask, file_id, "hint.tmp", tmp_path, BG_BUFFER_SIZE);
+
+  int32_t fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    kv_log(3, "Error: Failed to create bitcask hint file %s\n", tmp_path);
+    return -1;
+  }
+
+  int64_t result = 0;
+  if (write(fd, hints, hints_size) != (ssize_t)hints_size || fsync(fd) < 0) {
+    kv_log(3, "Error: Failed to write bitcask hint file %s\n", tmp_path);
+    result = -1;
+  }
+  close(fd);
+
+  if (result == 0 && rename(tmp_path, hint_path) < 0) {
+    kv_log(3, "Error: Failed to rename bitcask hint file %s\n", tmp_path);
+    result = -1;
+  }
+  if (result < 0) {
+    unlink(tmp_path);
+  }
+
+  return result;
+}
+
+static int64_t finish_merge_output(bitcask_t *bitcask, uint64_t file_id, uint8_t *hints, uint64_t hints_size) {
+  pthread_mutex_lock(&bitcask->lock);
+  bitcask_file_t *file = find_file(bitcask, file_id);
+  int32_t fd = file != NULL ? file->fd : -1;
+  pthread_mutex_unlock(&bitcask->lock);
+
+  if (fd < 0 || fsync(fd) < 0) {
+    kv_log(3, "Error: Failed to sync merged bitcask data file %" PRIu64 "\n", file_id);
+    return -1;
+  }
+  return write_hint_file(bitcask, file_id, hints, hints_size);
+}
+
+static void *merge_files(void *arg) {
+  bitcask_merge_t *merge = (bitcask_merge_t*)arg;
+  bitcask_t *bitcask = merge->bitcask;
+
+  uint64_t output_id = merge->first_output_id;
+  uint64_t output_size = 0;
+  uint64_t hints_size = 0;
+  uint64_t hints_capacity = BG_BUFFER_SIZE;
+  uint8_t *hints = malloc(hints_capacity);
+  uint8_t *value = NULL;
+  uint64_t value_capacity = 0;
+  bool failed = hints == NULL;
+
+  pthread_mutex_lock(&bitcask->lock);
+  failed = failed || add_file(bitcask, output_id, true) == NULL;
+  pthread_mutex_unlock(&bitcask->lock);
+
+  for (uint64_t idx = 0; idx < merge->item_count && !failed; idx++) {
+    bitcask_merge_item_t *item = &merge->items[idx];
+    if (item->value_size > value_capacity) {
+      uint8_t *new_value = realloc(value, item->value_size);
+      if (new_value == NULL) {
+        kv_log(3, "Error: Failed to allocate memory for a bitcask value\n");
+        failed = true;
+        break;
+      }
+      value = new_value;
+      value_capacity = item->value_size;
+    }
+
+    if (read_record(item->fd, strlen(item->key), item->value_size, item->offset, value) < 0) {
+      kv_log(3, "Error: Failed to read a value to merge for key \"%s\"\n", item->key);
+      failed = true;
+      break;
+    }
+
+    uint64_t key_size = strlen(item->key);
+    uint64_t size = sizeof(bitcask_record_header_t) + key_size + item->value_size;
+    if (output_size > 0 && output_size + size > bitcask->max_file_size) {
+      if (output_id == merge->last_output_id ||
+          finish_merge_output(bitcask, output_id, hints, hints_size) < 0) {
+        failed = true;
+        break;
+      }
+      output_id++;
+      output_size = 0;
+      hints_size = 0;
+
+      pthread_mutex_lock(&bitcask->lock);
+      failed = add_file(bitcask, output_id, true) == NULL;
+      pthread_mutex_unlock(&bitcask->lock);
+      if (failed) break;
+    }
+
+    if (hints_size + sizeof(bitcask_hint_t) + key_size > hints_capacity) {
+      hints_capacity *= 2;
+      uint8_t *new_hints = realloc(hints, hints_capacity);
+      if (new_hints == NULL) {
+        kv_log(3, "Error: Failed to allocate memory for bitcask hints\n");
+        failed = true;
+        break;
+      }
+      hints = new_hints;
+    }
+
+    pthread_mutex_lock(&bitcask->lock);
+    bitcask_file_t *output = find_file(bitcask, output_id);
+    if (write_data_record(output->fd, output->size, item->key, item->type, value, item->value_size) < 0) {
+      kv_log(3, "Error: Failed to write merged bitcask data file %" PRIu64 "\n", output_id);
+      pthread_mutex_unlock(&bitcask->lock);
+      failed = true;
+      break;
+    }
+    uint64_t value_offset = output->size + sizeof(bitcask_record_header_t) + key_size;
+    output->size += size;
+
+    bitcask_keydir_entry_t *entry = keydir_find(bitcask, item->key);
+    if (entry != NULL && entry->file_id == item->file_id && entry->offset == item->offset) {
+      entry->file_id = output_id;
+      entry->offset = value_offset;
+    }
+    else {
+      output->dead_bytes += size;
+    }
+    pthread_mutex_unlock(&bitcask->lock);
+
+    bitcask_hint_t hint = {
+      .offset = value_offset,
+      .value_size = item->value_size,
+      .key_size = key_size,
+      .type = item->type,
+      .reserved = 0
+    };
+    memcpy(hints + hints_size, &hint, sizeof(bitcask_hint_t));
+    memcpy(hints + hints_size + sizeof(bitcask_hint_t), item->key, key_size);
+    hints_size += sizeof(bitcask_hint_t) + key_size;
+    output_size += size;
+  }
+
+  if (!failed && finish_merge_output(bitcask, output_id, hints, hints_size) < 0) {
+    failed = true;
+  }
+
+  pthread_mutex_lock(&bitcask->lock);
+  if (failed) {
+    kv_log(3, "Error: Bitcask merge failed, keeping the original data files\n");
+  }
+  else {
+    uint64_t idx = 0;
+    while (idx < bitcask->file_count) {
+      if (bitcask->files[idx].id < merge->first_output_id) {
+        remove_file(bitcask, idx);
+      }
+      else {
+        idx++;
+      }
+    }
+  }
+  bitcask->merging = false;
+  pthread_mutex_unlock(&bitcask->lock);
+
+  free(hints);
+  free(value);
+  free(merge->items);
+  free(merge);
+  return NULL;
+}
+
+static int64_t start_merge(bitcask_t *bitcask) {
+  if (bitcask->merging) {
+    kv_log(3, "Error: A bitcask merge is already running\n");
+    return -1;
+  }
+
+  if (bitcask->merge_joinable) {
+    pthread_join(bitcask->merge_thread, NULL);
+    bitcask->merge_joinable = false;
+  }
+
+  bitcask_merge_t *merge = calloc(1, sizeof(bitcask_merge_t));
+  if (merge == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for a bitcask merge\n");
+    return -1;
+  }
+  merge->bitcask = bitcask;
+  merge->items = malloc((bitcask->count + 1) * sizeof(bitcask_merge_item_t));
+  if (merge->items == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for a bitcask merge\n");
+    free(merge);
+    return -1;
+  }
+
+  /* Merged files take ids above every existing file and below the new
+   * active file, so replaying in id order always lets newer writes win. */
+  uint64_t merged_file_count = bitcask->file_count;
+  merge->first_output_id = bitcask->next_file_id;
+  merge->last_output_id = merge->first_output_id + merged_file_count - 1;
+  if (add_file(bitcask, merge->last_output_id + 1, true) == NULL) {
+    free(merge->items);
+    free(merge);
+    return -1;
+  }
+
+  for (uint64_t idx = 0; idx < bitcask->keydir_size; idx++) {
+    bitcask_keydir_entry_t *current = bitcask->keydir[idx];
+    while (current != NULL) {
+      if (current->file_id < merge->first_output_id) {
+        bitcask_merge_item_t *item = &merge->items[merge->item_count++];
+        memcpy(item->key, current->key, SM_BUFFER_SIZE);
+        item->type = current->type;
+        item->file_id = current->file_id;
+        item->fd = find_file(bitcask, current->file_id)->fd;
+        item->offset = current->offset;
+        item->value_size = current->value_size;
+      }
+      current = current->next;
+    }
+  }
+
+  bitcask->merging = true;
+  if (pthread_create(&bitcask->merge_thread, NULL, merge_files, merge) != 0) {
+    kv_log(3, "Error: Failed to start the bitcask merge thread\n");
+    bitcask->merging = false;
+    free(merge->items);
+    free(merge);
+    return -1;
+  }
+  bitcask->merge_joinable = true;
+
+  return 0;
+}
+
+extern bitcask_t* create_bitcask() {
+  bitcask_t *bitcask = calloc(1, sizeof(bitcask_t));
+  if (bitcask == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for bitcask\n");
+    return NULL;
+  }
+
+  bitcask->keydir_size = KV_BITCASK_KEYDIR_SIZE;
+  bitcask->keydir = calloc(bitcask->keydir_size, sizeof(bitcask_keydir_entry_t*));
+  if (bitcask->keydir == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for the bitcask key directory\n");
+    free(bitcask);
+    return NULL;
+  }
+
+  bitcask->max_file_size = KV_BITCASK_MAX_FILE_SIZE;
+  pthread_mutex_init(&bitcask->lock, NULL);
+
+  return bitcask;
+}
+
+static int compare_file_ids(const void *first, const void *second) {
+  uint64_t first_id = *(uint64_t*)first;
+  uint64_t second_id = *(uint64_t*)second;
+  return (first_id > second_id) - (first_id < second_id);
+}
+
+extern int64_t bitcask_open(bitcask_t *bitcask, uint8_t *dir) {
+  if (bitcask == NULL || dir == NULL) {
+    kv_log(3, "Error: NULL pointer passed to bitcask_open\n");
+    return -1;
+  }
+
+  if (strlen(dir) == 0 || strlen(dir) >= BG_BUFFER_SIZE - SM_BUFFER_SIZE) {
+    kv_log(3, "Error: Invalid directory passed to bitcask_open\n");
+    return -1;
+  }
+
+  if (bitcask->attached) {
+    kv_log(3, "Error: Bitcask is already attached to %s\n", bitcask->dir);
+    return -1;
+  }
+
+  if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+    kv_log(3, "Error: Failed to create bitcask directory %s\n", dir);
+    return -1;
+  }
+
+  DIR *data_dir = opendir(dir);
+  if (data_dir == NULL) {
+    kv_log(3, "Error: Failed to open bitcask directory %s\n", dir);
+    return -1;
+  }
+
+  strncpy(bitcask->dir, dir, BG_BUFFER_SIZE);
+  bitcask->dir[BG_BUFFER_SIZE-1] = '\0';
+
+  uint64_t id_count = 0;
+  uint64_t id_capacity = SM_BUFFER_SIZE;
+  uint64_t *ids = malloc(id_capacity * sizeof(uint64_t));
+  if (ids == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for bitcask file ids\n");
+    closedir(data_dir);
+    return -1;
+  }
+
+  struct dirent *dir_entry;
+  while ((dir_entry = readdir(data_dir)) != NULL) {
+    uint8_t *end;
+    uint64_t file_id = strtoull(dir_entry->d_name, (char**)&end, 10);
+    if (end == (uint8_t*)dir_entry->d_name || strcmp(end, ".data") != 0) continue;
+
+    if (id_count == id_capacity) {
+      id_capacity *= 2;
+      uint64_t *new_ids = realloc(ids, id_capacity * sizeof(uint64_t));
+      if (new_ids == NULL) {
+        kv_log(3, "Error: Failed to allocate memory for bitcask file ids\n");
+        free(ids);
+        closedir(data_dir);
+        return -1;
+      }
+      ids = new_ids;
+    }
+    ids[id_count++] = file_id;
+  }
+  closedir(data_dir);
+  qsort(ids, id_count, sizeof(uint64_t), compare_file_ids);
+
+  pthread_mutex_lock(&bitcask->lock);
+  int64_t result = 0;
+  for (uint64_t idx = 0; idx < id_count && result == 0; idx++) {
+    bitcask_file_t *file = add_file(bitcask, ids[idx], false);
+    if (file == NULL) {
+      result = -1;
+      break;
+    }
+
+    uint8_t hint_path[BG_BUFFER_SIZE];
+    build_file_path(bitcask, ids[idx], "hint", hint_path, BG_BUFFER_SIZE);
+    if (access(hint_path, R_OK) == 0) {
+      result = replay_hint_file(bitcask, ids[idx], hint_path);
+    }
+    else {
+      result = replay_data_file(bitcask, file);
+    }
+  }
+  free(ids);
+
+  if (result == 0 &&
+      (bitcask->file_count == 0 ||
+       bitcask->files[bitcask->file_count-1].size >= bitcask->max_file_size) &&
+      add_file(bitcask, bitcask->next_file_id, true) == NULL) {
+    result = -1;
+  }
+
+  if (result == 0) {
+    bitcask->attached = true;
+  }
+  pthread_mutex_unlock(&bitcask->lock);
+
+  return result;
+}
+
+extern int64_t bitcask_insert(bitcask_t *bitcask, db_entry_t *entry) {
+  if (bitcask == NULL || entry == NULL) {
+    kv_log(3, "Error: NULL pointer passed to bitcask_insert\n");
+    return -1;
+  }
+
+  if (!bitcask->attached) {
+    kv_log(3, "Error: Bitcask is not attached to a directory, call load_db first\n");
+    return -1;
+  }
+
+  if (map_datatype_size(entry->type) < 0) {
+    kv_log(3, "Error: data type %ld is not a valid datatype.\n", entry->type);
+    return -1;
+  }
+
+  pthread_mutex_lock(&bitcask->lock);
+  int64_t result = KV_IO;
+  uint64_t file_id, offset;
+  if (keydir_find(bitcask, entry->key) != NULL) {
+    result = KV_EXISTS;
+  }
+  else if (append_record(bitcask, entry->key, entry->type, entry->value,
+                         entry->size, &file_id, &offset) == 0) {
+    result = keydir_set(bitcask, entry->key, entry->type, file_id, offset, entry->size);
+  }
+  pthread_mutex_unlock(&bitcask->lock);
+
+  if (result == KV_OK) {
+    free_entry(entry);
+  }
+  return result;
+}
+
+extern int64_t bitcask_put(bitcask_t *bitcask, uint8_t *key, uint8_t *value, uint64_t len, uint8_t *type) {
+  if (bitcask == NULL || key == NULL || value == NULL || type == NULL) {
+    kv_log(3, "Error: NULL pointer passed to bitcask_put\n");
+    return -1;
+  }
+
+  if (strlen(key) == 0) {
+    kv_log(3, "Error: Empty string passed to bitcask_put\n");
+    return -1;
+  }
+
+  if (!bitcask->attached) {
+    kv_log(3, "Error: Bitcask is not attached to a directory, call load_db first\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&bitcask->lock);
+
+  uint8_t current_type[SM_BUFFER_SIZE];
+  if (strlen(type) == 0) {
+    bitcask_keydir_entry_t *current = keydir_find(bitcask, key);
+    if (current == NULL || map_datatype_to_str(current->type, current_type, SM_BUFFER_SIZE) < 0) {
+      pthread_mutex_unlock(&bitcask->lock);
+      return KV_NOT_FOUND;
+    }
+    type = current_type;
+  }
+
+  errno = 0;
+  db_entry_t *entry = create_entry_span(key, value, len, type);
+  if (entry == NULL) {
+    pthread_mutex_unlock(&bitcask->lock);
+    return errno == ENOMEM ? KV_OOM : KV_TYPE_MISMATCH;
+  }
+
+  int64_t result = KV_IO;
+  uint64_t file_id, offset;
+  if (append_record(bitcask, entry->key, entry->type, entry->value,
+                    entry->size, &file_id, &offset) == 0) {
+    result = keydir_set(bitcask, entry->key, entry->type, file_id, offset, entry->size);
+  }
+  pthread_mutex_unlock(&bitcask->lock);
+
+  free_entry(entry);
+  return result;
+}
+
+extern int64_t bitcask_delete(bitcask_t *bitcask, uint8_t *key) {
+  if (bitcask == NULL || key == NULL) {
+    kv_log(3, "Error: NULL pointer passed to bitcask_delete\n");
+    return -1;
+  }
+
+  if (strlen(key) == 0) {
+    kv_log(3, "Error: Empty string passed to bitcask_delete\n");
+    return -1;
+  }
+
+  if (!bitcask->attached) {
+    kv_log(3, "Error: Bitcask is not attached to a directory, call load_db first\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&bitcask->lock);
+  int64_t result;
+  uint64_t file_id, offset;
+  if (keydir_find(bitcask, key) == NULL) {
+    result = KV_NOT_FOUND;
+  }
+  else if (append_record(bitcask, key, BITCASK_TOMBSTONE_TYPE, NULL, 0, &file_id, &offset) == 0) {
+    mark_dead(bitcask, file_id, record_size(key, 0));
+    result = keydir_remove(bitcask, key);
+  }
+  else {
+    result = KV_IO;
+  }
+  pthread_mutex_unlock(&bitcask->lock);
+
+  return result;
+}
+
+extern db_entry_t *bitcask_get_entry(bitcask_t *bitcask, uint8_t *key) {
+  if (bitcask == NULL || key == NULL) {
+    kv_log(3, "Error: NULL pointer passed to bitcask_get_entry\n");
+    return NULL;
+  }
+
+  if (strlen(key) == 0) {
+    kv_log(3, "Error: Empty string passed to bitcask_get_entry\n");
+    return NULL;
+  }
+
+  bitcask_reader_t *reader = get_bitcask_reader();
+  if (reader == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&bitcask->lock);
+  db_entry_t *entry = NULL;
+  bitcask_keydir_entry_t *location = keydir_find(bitcask, key);
+  if (location != NULL) {
+    bitcask_file_t *file = find_file(bitcask, location->file_id);
+    if (file != NULL &&
+        reserve_read_buffer(reader, location->value_size) == 0 &&
+        read_record(file->fd, strlen(location->key), location->value_size,
+                    location->offset, reader->buffer) == 0) {
+      reader->buffer[location->value_size] = '\0';
+      memcpy(reader->entry.key, location->key, SM_BUFFER_SIZE);
+      reader->entry.type = location->type;
+      reader->entry.value = reader->buffer;
+      reader->entry.size = location->value_size;
+      entry = &reader->entry;
+    }
+    else {
+      kv_log(3, "Error: Failed to read the value of key \"%s\"\n", key);
+    }
+  }
+  pthread_mutex_unlock(&bitcask->lock);
+
+  return entry;
+}
+
+extern int64_t bitcask_sync(bitcask_t *bitcask) {
+  if (bitcask == NULL) {
+    kv_log(3, "Error: NULL pointer passed to bitcask_sync\n");
+    return -1;
+  }
+
+  if (!bitcask->attached) return 0;
+
+  pthread_mutex_lock(&bitcask->lock);
+  int64_t result = 0;
+  if (fsync(bitcask->files[bitcask->file_count-1].fd) < 0) {
+    kv_log(3, "Error: Failed to sync the active bitcask data file\n");
+    result = -1;
+  }
+  pthread_mutex_unlock(&bitcask->lock);
+
+  return result;
+}
+
+extern int64_t bitcask_merge(bitcask_t *bitcask) {
+  if (bitcask == NULL) {
+    kv_log(3, "Error: NULL pointer passed to bitcask_merge\n");
+    return -1;
+  }
+
+  if (!bitcask->attached) {
+    kv_log(3, "Error: Bitcask is not attached to a directory, call load_db first\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&bitcask->lock);
+  int64_t result = start_merge(bitcask);
+  pthread_mutex_unlock(&bitcask->lock);
+
+  return result;
+}
+
+extern int64_t bitcask_merge_wait(bitcask_t *bitcask) {
+  if (bitcask == NULL) {
+    kv_log(3, "Error: NULL pointer passed to bitcask_merge_wait\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&bitcask->lock);
+  bool joinable = bitcask->merge_joinable;
+  bitcask->merge_joinable = false;
+  pthread_mutex_unlock(&bitcask->lock);
+
+  if (joinable) {
+    pthread_join(bitcask->merge_thread, NULL);
+  }
+  return 0;
+}
+
+extern int64_t bitcask_save(FILE *file, bitcask_t *bitcask) {
+  if (file == NULL || bitcask == NULL) {
+    kv_log(3, "Error: NULL pointer passed to bitcask_save\n");
+    return -1;
+  }
+
+  for (uint64_t idx = 0; idx < bitcask->keydir_size; idx++) {
+    bitcask_keydir_entry_t *current = bitcask->keydir[idx];
+    while (current != NULL) {
+      db_entry_t *entry = bitcask_get_entry(bitcask, current->key);
+      if (entry == NULL || write_entry(file, entry) < 0) {
+        kv_log(3, "Error: Failed to write entry to file\n");
+        return -1;
+      }
+      current = current->next;
+    }
+  }
+  return 0;
+}
+
+extern void free_bitcask(bitcask_t *bitcask) {
+  if (bitcask == NULL) return;
+
+  bitcask_merge_wait(bitcask);
+  bitcask_sync(bitcask);
+
+  for (uint64_t idx = 0; idx < bitcask->file_count; idx++) {
+    close(bitcask->files[idx].fd);
+  }
+  free(bitcask->files);
+
+  for (uint64_t idx = 0; idx < bitcask->keydir_size; idx++) {
+    bitcask_keydir_entry_t *current = bitcask->keydir[idx];
+    while (current != NULL) {
+      bitcask_keydir_entry_t *next = current->next;
+      free(current);
+      current = next;
+    }
+  }
+  free(bitcask->keydir);
+
+  pthread_mutex_destroy(&bitcask->lock);
+  free(bitcask);
+}
+
+extern void bitcask_print(bitcask_t *bitcask) {
+  if (bitcask == NULL) {
+    kv_log(3, "Error: NULL pointer passed to bitcask_print\n");
+    return;
+  }
+
+  for (uint64_t idx = 0; idx < bitcask->keydir_size; idx++) {
+    bitcask_keydir_entry_t *current = bitcask->keydir[idx];
+    while (current != NULL) {
+      db_entry_t *entry = bitcask_get_entry(bitcask, current->key);
+      if (entry != NULL) {
+        print_entry(entry);
+      }
+      current = current->next;
+    }
+  }
+}
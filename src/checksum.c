@@ -0,0 +1,239 @@
+#define _GNU_SOURCE
+#include "checksum.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+static uint32_t crc32c_tables[8][256];
+static uint32_t (*crc32c_impl)(uint32_t crc, const uint8_t *data, uint64_t size);
+
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *data, uint64_t size) {
+  while (size > 0 && ((uintptr_t)data & 7) != 0) {
+    crc = crc32c_tables[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    size--;
+  }
+
+  while (size >= 8) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(uint64_t));
+    word ^= crc;
+    crc = crc32c_tables[7][word & 0xFF] ^
+          crc32c_tables[6][(word >> 8) & 0xFF] ^
+          crc32c_tables[5][(word >> 16) & 0xFF] ^
+          crc32c_tables[4][(word >> 24) & 0xFF] ^
+          crc32c_tables[3][(word >> 32) & 0xFF] ^
+          crc32c_tables[2][(word >> 40) & 0xFF] ^
+          crc32c_tables[1][(word >> 48) & 0xFF] ^
+          crc32c_tables[0][word >> 56];
+    data += 8;
+    size -= 8;
+  }
+
+  while (size > 0) {
+    crc = crc32c_tables[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    size--;
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hardware(uint32_t crc, const uint8_t *data, uint64_t size) {
+  while (size > 0 && ((uintptr_t)data & 7) != 0) {
+    crc = _mm_crc32_u8(crc, *data++);
+    size--;
+  }
+
+  uint64_t crc64 = crc;
+  while (size >= 8) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(uint64_t));
+    crc64 = _mm_crc32_u64(crc64, word);
+    data += 8;
+    size -= 8;
+  }
+  crc = (uint32_t)crc64;
+
+  while (size > 0) {
+    crc = _mm_crc32_u8(crc, *data++);
+    size--;
+  }
+  return crc;
+}
+#endif
+
+static void init_crc32c() {
+  for (uint32_t idx = 0; idx < 256; idx++) {
+    uint32_t crc = idx;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ CHECKSUM_CRC32C_POLY : crc >> 1;
+    }
+    crc32c_tables[0][idx] = crc;
+  }
+
+  for (uint32_t idx = 0; idx < 256; idx++) {
+    for (uint8_t slice = 1; slice < 8; slice++) {
+      uint32_t previous = crc32c_tables[slice-1][idx];
+      crc32c_tables[slice][idx] = crc32c_tables[0][previous & 0xFF] ^ (previous >> 8);
+    }
+  }
+
+  crc32c_impl = crc32c_table;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2")) {
+    crc32c_impl = crc32c_hardware;
+  }
+#endif
+}
+
+extern uint32_t crc32c(uint32_t crc, const void *data, uint64_t size) {
+  pthread_once(&crc32c_once, init_crc32c);
+  if (data == NULL || size == 0) {
+    return crc;
+  }
+  return ~crc32c_impl(~crc, data, size);
+}
+
+static int64_t write_checksum_line(checksum_writer_t *writer) {
+  if (fprintf(writer->file, CHECKSUM_LINE_PREFIX "%08" PRIx32 ":%" PRIu64 "\n",
+              writer->crc, writer->lines) < 0) {
+    kv_log(3, "Error: Failed to write a checksum line\n");
+    return -1;
+  }
+
+  writer->crc = 0;
+  writer->lines = 0;
+  return 0;
+}
+
+static ssize_t checksum_writer_write(void *cookie, const char *buffer, size_t size) {
+  checksum_writer_t *writer = (checksum_writer_t*)cookie;
+
+  const char *start = buffer;
+  const char *end = buffer + size;
+  while (start < end) {
+    /* Find the end of the current block, checksumming it in one pass */
+    const char *position = start;
+    const char *block_end = end;
+    while (position < end) {
+      const char *newline = memchr(position, '\n', end - position);
+      if (newline == NULL) break;
+      position = newline + 1;
+      if (++writer->lines == writer->block_lines) {
+        block_end = position;
+        break;
+      }
+    }
+
+    uint64_t len = block_end - start;
+    writer->crc = crc32c(writer->crc, start, len);
+    if (fwrite(start, 1, len, writer->file) != len) {
+      kv_log(3, "Error: Failed to write a checksummed block\n");
+      return -1;
+    }
+    writer->line_open = block_end[-1] != '\n';
+
+    if (writer->lines == writer->block_lines && write_checksum_line(writer) < 0) {
+      return -1;
+    }
+    start = block_end;
+  }
+
+  return size;
+}
+
+static int checksum_writer_close(void *cookie) {
+  checksum_writer_t *writer = (checksum_writer_t*)cookie;
+
+  int result = 0;
+  if (writer->line_open) {
+    writer->crc = crc32c(writer->crc, "\n", 1);
+    writer->lines++;
+    if (fputc('\n', writer->file) == EOF) {
+      result = EOF;
+    }
+  }
+
+  if (result == 0 && writer->lines > 0 && write_checksum_line(writer) < 0) {
+    result = EOF;
+  }
+
+  free(writer);
+  return result;
+}
+
+extern FILE *open_checksum_writer(FILE *file, uint64_t block_lines) {
+  if (file == NULL) {
+    kv_log(3, "Error: NULL pointer passed to open_checksum_writer\n");
+    return NULL;
+  }
+
+  if (block_lines == 0) {
+    kv_log(3, "Error: Checksum blocks need at least one line\n");
+    return NULL;
+  }
+
+  checksum_writer_t *writer = calloc(1, sizeof(checksum_writer_t));
+  if (writer == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for checksum_writer_t\n");
+    return NULL;
+  }
+  writer->file = file;
+  writer->block_lines = block_lines;
+
+  cookie_io_functions_t functions = {
+    .read = NULL,
+    .write = checksum_writer_write,
+    .seek = NULL,
+    .close = checksum_writer_close
+  };
+  FILE *stream = fopencookie(writer, "w", functions);
+  if (stream == NULL) {
+    kv_log(3, "Error: Failed to open a checksummed stream\n");
+    free(writer);
+    return NULL;
+  }
+
+  return stream;
+}
+
+extern int64_t parse_checksum_line(uint8_t *line, uint64_t len, uint32_t *crc, uint64_t *lines) {
+  if (line == NULL || crc == NULL || lines == NULL) {
+    kv_log(3, "Error: NULL pointer passed to parse_checksum_line\n");
+    return -1;
+  }
+
+  uint64_t prefix_len = strlen(CHECKSUM_LINE_PREFIX);
+  if (len < prefix_len || memcmp(line, CHECKSUM_LINE_PREFIX, prefix_len) != 0) {
+    return 0;
+  }
+
+  uint64_t position = prefix_len;
+  uint32_t value = 0;
+  for (uint8_t digit = 0; digit < 8; digit++, position++) {
+    if (position >= len) return -1;
+
+    uint8_t character = line[position];
+    if (character >= '0' && character <= '9') value = (value << 4) | (character - '0');
+    else if (character >= 'a' && character <= 'f') value = (value << 4) | (character - 'a' + 10);
+    else return -1;
+  }
+
+  if (position >= len || line[position++] != ':') return -1;
+
+  uint64_t count = 0;
+  uint64_t digits = 0;
+  while (position < len && line[position] >= '0' && line[position] <= '9' && digits < 19) {
+    count = count * 10 + (line[position++] - '0');
+    digits++;
+  }
+
+  if (digits == 0) return -1;
+  if (position < len && !(line[position] == '\n' && position + 1 == len)) return -1;
+
+  *crc = value;
+  *lines = count;
+  return 1;
+}
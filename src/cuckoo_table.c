@@ -0,0 +1,672 @@
+#include "cuckoo_table.h"
+
+static pthread_once_t cuckoo_reader_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cuckoo_reader_key;
+
+static uint64_t alt_bucket(uint64_t bucket, uint32_t tag, uint64_t mask) {
+  return (bucket ^ (tag * 0x5BD1E995ULL)) & mask;
+}
+
+static cuckoo_array_t *create_bucket_array(kv_memory_t *memory, uint64_t bucket_count) {
+  /* The buckets follow the array, aligned up to a cache line */
+  uint64_t block_size = sizeof(cuckoo_array_t) + bucket_count * sizeof(cuckoo_bucket_t) + 64;
+  cuckoo_array_t *array = kv_calloc(memory, KV_ALLOC_BUCKETS, block_size);
+  if (array == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for the buckets of a cuckoo hash table\n");
+    return NULL;
+  }
+
+  uintptr_t buckets = ((uintptr_t)(array + 1) + 63) & ~(uintptr_t)63;
+  array->mask = bucket_count - 1;
+  array->block_size = block_size;
+  array->buckets = (cuckoo_bucket_t*)buckets;
+  return array;
+}
+
+static void begin_version(_Atomic uint64_t *version) {
+  atomic_store_explicit(version, atomic_load_explicit(version, memory_order_relaxed) + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+
+static void end_version(_Atomic uint64_t *version) {
+  atomic_store_explicit(version, atomic_load_explicit(version, memory_order_relaxed) + 1, memory_order_release);
+}
+
+static void write_bucket_slot(cuckoo_table_t *cuckoo, cuckoo_array_t *array, uint64_t bucket,
+                       uint64_t slot, uint32_t tag, db_entry_t *entry) {
+  _Atomic uint64_t *version = &cuckoo->versions[bucket % KV_CUCKOO_VERSION_STRIPES];
+  begin_version(version);
+  atomic_store_explicit(&array->buckets[bucket].tags[slot], tag, memory_order_relaxed);
+  atomic_store_explicit(&array->buckets[bucket].entries[slot], entry, memory_order_release);
+  end_version(version);
+}
+
+static void write_stash(cuckoo_table_t *cuckoo, uint64_t slot, db_entry_t *entry) {
+  db_entry_t *previous = atomic_load_explicit(&cuckoo->stash[slot], memory_order_relaxed);
+  begin_version(&cuckoo->stash_version);
+  if (previous == NULL && entry != NULL) {
+    atomic_fetch_add_explicit(&cuckoo->stash_count, 1, memory_order_relaxed);
+  }
+  else if (previous != NULL && entry == NULL) {
+    atomic_fetch_sub_explicit(&cuckoo->stash_count, 1, memory_order_relaxed);
+  }
+  atomic_store_explicit(&cuckoo->stash[slot], entry, memory_order_release);
+  end_version(&cuckoo->stash_version);
+}
+
+static int64_t search_bucket(cuckoo_bucket_t *bucket, uint32_t tag, const kv_key_probe_t *probe) {
+  for (int64_t slot = 0; slot < KV_CUCKOO_BUCKET_SLOTS; slot++) {
+    if (atomic_load_explicit(&bucket->tags[slot], memory_order_relaxed) != tag) continue;
+
+    db_entry_t *entry = atomic_load_explicit(&bucket->entries[slot], memory_order_acquire);
+    if (entry != NULL && kv_key_matches(probe, entry->key)) {
+      return slot;
+    }
+  }
+  return -1;
+}
+
+static int64_t search_stash(cuckoo_table_t *cuckoo, const kv_key_probe_t *probe) {
+  for (int64_t slot = 0; slot < KV_CUCKOO_STASH_SIZE; slot++) {
+    db_entry_t *entry = atomic_load_explicit(&cuckoo->stash[slot], memory_order_acquire);
+    if (entry != NULL && kv_key_matches(probe, entry->key)) {
+      return slot;
+    }
+  }
+  return -1;
+}
+
+static bool find_position(cuckoo_table_t *cuckoo, const kv_key_probe_t *probe, cuckoo_position_t *position) {
+  cuckoo_array_t *array = atomic_load_explicit(&cuckoo->array, memory_order_relaxed);
+  uint32_t tag = (uint32_t)(probe->hash >> 32);
+  uint64_t first = probe->hash & array->mask;
+  uint64_t second = alt_bucket(first, tag, array->mask);
+
+  position->bucket = first;
+  position->slot = search_bucket(&array->buckets[first], tag, probe);
+  if (position->slot < 0 && second != first) {
+    position->bucket = second;
+    position->slot = search_bucket(&array->buckets[second], tag, probe);
+  }
+  if (position->slot < 0 && atomic_load_explicit(&cuckoo->stash_count, memory_order_relaxed) > 0) {
+    position->bucket = -1;
+    position->slot = search_stash(cuckoo, probe);
+  }
+  return position->slot >= 0;
+}
+
+static void init_cuckoo_reader_key() {
+  pthread_key_create(&cuckoo_reader_key, free_cuckoo_reader);
+}
+
+static void free_cuckoo_reader(void *arg) {
+  cuckoo_reader_t *reader = (cuckoo_reader_t*)arg;
+  kv_free(NULL, KV_ALLOC_BUFFERS, reader->buffer, reader->capacity);
+  kv_free(NULL, KV_ALLOC_BUFFERS, reader, sizeof(cuckoo_reader_t));
+}
+
+static cuckoo_reader_t *get_cuckoo_reader() {
+  pthread_once(&cuckoo_reader_once, init_cuckoo_reader_key);
+  cuckoo_reader_t *reader = pthread_getspecific(cuckoo_reader_key);
+  if (reader != NULL) {
+    return reader;
+  }
+
+  reader = kv_calloc(NULL, KV_ALLOC_BUFFERS, sizeof(cuckoo_reader_t));
+  if (reader == NULL || pthread_setspecific(cuckoo_reader_key, reader) != 0) {
+    kv_log(3, "Error: Failed to allocate the lookup buffer of a thread\n");
+    kv_free(NULL, KV_ALLOC_BUFFERS, reader, sizeof(cuckoo_reader_t));
+    return NULL;
+  }
+  return reader;
+}
+
+static db_entry_t *copy_to_reader(cuckoo_reader_t *reader, db_entry_t *entry) {
+  int64_t type_size = map_datatype_size(entry->type);
+  uint64_t value_size = type_size > 0 ? (uint64_t)type_size : entry->size + 1;
+  if (value_size > reader->capacity) {
+    uint8_t *buffer = kv_alloc(NULL, KV_ALLOC_BUFFERS, value_size);
+    if (buffer == NULL) {
+      kv_log(3, "Error: Failed to allocate the lookup buffer of a thread\n");
+      return NULL;
+    }
+    kv_free(NULL, KV_ALLOC_BUFFERS, reader->buffer, reader->capacity);
+    reader->buffer = buffer;
+    reader->capacity = value_size;
+  }
+
+  memcpy(reader->buffer, entry->value, value_size);
+  memcpy(reader->entry.key, entry->key, SM_BUFFER_SIZE);
+  reader->entry.type = entry->type;
+  reader->entry.value = reader->buffer;
+  reader->entry.size = entry->size;
+  reader->entry.raw_value = NULL;
+  reader->entry.raw_size = 0;
+  reader->entry.memory = NULL;
+  return &reader->entry;
+}
+
+static db_entry_t *optimistic_lookup(cuckoo_table_t *cuckoo, const kv_key_probe_t *probe,
+                                     cuckoo_reader_t *reader) {
+  /* Retired blocks are kept while the count is not zero, see retire_block() */
+  atomic_fetch_add(&cuckoo->readers, 1);
+  atomic_thread_fence(memory_order_seq_cst);
+
+  uint32_t tag = (uint32_t)(probe->hash >> 32);
+  db_entry_t *entry;
+  while (true) {
+    cuckoo_array_t *array = atomic_load(&cuckoo->array);
+    uint64_t first = probe->hash & array->mask;
+    uint64_t second = alt_bucket(first, tag, array->mask);
+    _Atomic uint64_t *first_version = &cuckoo->versions[first % KV_CUCKOO_VERSION_STRIPES];
+    _Atomic uint64_t *second_version = &cuckoo->versions[second % KV_CUCKOO_VERSION_STRIPES];
+
+    uint64_t versions[3];
+    versions[0] = atomic_load_explicit(first_version, memory_order_acquire);
+    versions[1] = atomic_load_explicit(second_version, memory_order_acquire);
+    versions[2] = atomic_load_explicit(&cuckoo->stash_version, memory_order_acquire);
+    if ((versions[0] | versions[1] | versions[2]) & 1) continue;
+
+    entry = NULL;
+    int64_t slot = search_bucket(&array->buckets[first], tag, probe);
+    if (slot >= 0) {
+      entry = atomic_load_explicit(&array->buckets[first].entries[slot], memory_order_acquire);
+    }
+    else if ((slot = search_bucket(&array->buckets[second], tag, probe)) >= 0) {
+      entry = atomic_load_explicit(&array->buckets[second].entries[slot], memory_order_acquire);
+    }
+    else if (atomic_load_explicit(&cuckoo->stash_count, memory_order_relaxed) > 0 &&
+             (slot = search_stash(cuckoo, probe)) >= 0) {
+      entry = atomic_load_explicit(&cuckoo->stash[slot], memory_order_acquire);
+    }
+
+    /* A writer changed the buckets while they were read */
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(first_version, memory_order_relaxed) == versions[0] &&
+        atomic_load_explicit(second_version, memory_order_relaxed) == versions[1] &&
+        atomic_load_explicit(&cuckoo->stash_version, memory_order_relaxed) == versions[2]) {
+      break;
+    }
+  }
+
+  /* The entry may be retired from now on, it is copied before the count drops */
+  if (entry != NULL) {
+    entry = copy_to_reader(reader, entry);
+  }
+  atomic_fetch_sub(&cuckoo->readers, 1);
+  return entry;
+}
+
+static int64_t search_cuckoo_path(cuckoo_array_t *array, uint64_t first, uint64_t second,
+                           cuckoo_search_node_t *queue, uint64_t *free_slot) {
+  uint64_t tail = 0;
+  queue[tail++] = (cuckoo_search_node_t){ first, -1, 0, 0 };
+  if (second != first) {
+    queue[tail++] = (cuckoo_search_node_t){ second, -1, 0, 0 };
+  }
+
+  for (uint64_t head = 0; head < tail; head++) {
+    cuckoo_bucket_t *bucket = &array->buckets[queue[head].bucket];
+    for (uint64_t slot = 0; slot < KV_CUCKOO_BUCKET_SLOTS; slot++) {
+      if (atomic_load_explicit(&bucket->entries[slot], memory_order_relaxed) == NULL) {
+        *free_slot = slot;
+        return head;
+      }
+    }
+
+    if (queue[head].depth >= KV_CUCKOO_MAX_PATH) continue;
+
+    for (uint64_t slot = 0; slot < KV_CUCKOO_BUCKET_SLOTS && tail < KV_CUCKOO_SEARCH_SIZE; slot++) {
+      uint32_t tag = atomic_load_explicit(&bucket->tags[slot], memory_order_relaxed);
+      uint64_t alt = alt_bucket(queue[head].bucket, tag, array->mask);
+
+      /* A bucket visited twice on a path would move an entry it just received */
+      bool on_path = false;
+      for (int64_t node = head; node >= 0 && !on_path; node = queue[node].parent) {
+        on_path = queue[node].bucket == alt;
+      }
+      if (!on_path) {
+        queue[tail++] = (cuckoo_search_node_t){ alt, (int64_t)head, slot, queue[head].depth + 1 };
+      }
+    }
+  }
+  return -1;
+}
+
+static bool place_cuckoo_entry(cuckoo_table_t *cuckoo, cuckoo_array_t *array, db_entry_t *entry, uint64_t hash) {
+  uint32_t tag = (uint32_t)(hash >> 32);
+  uint64_t first = hash & array->mask;
+  uint64_t second = alt_bucket(first, tag, array->mask);
+
+  cuckoo_search_node_t queue[KV_CUCKOO_SEARCH_SIZE];
+  uint64_t free_slot;
+  int64_t node = search_cuckoo_path(array, first, second, queue, &free_slot);
+  if (node < 0) {
+    return false;
+  }
+
+  /* The last entry of the path moves first, each move frees the slot of the next one */
+  uint64_t path = 0;
+  while (queue[node].parent >= 0) {
+    cuckoo_bucket_t *from = &array->buckets[queue[queue[node].parent].bucket];
+    uint64_t from_slot = queue[node].slot;
+    db_entry_t *moved = atomic_load_explicit(&from->entries[from_slot], memory_order_relaxed);
+    uint32_t moved_tag = atomic_load_explicit(&from->tags[from_slot], memory_order_relaxed);
+
+    write_bucket_slot(cuckoo, array, queue[node].bucket, free_slot, moved_tag, moved);
+    write_bucket_slot(cuckoo, array, queue[queue[node].parent].bucket, from_slot, 0, NULL);
+    free_slot = from_slot;
+    node = queue[node].parent;
+    path++;
+  }
+
+  write_bucket_slot(cuckoo, array, queue[node].bucket, free_slot, tag, entry);
+  cuckoo->displacements += path;
+  if (path > cuckoo->max_path) {
+    cuckoo->max_path = path;
+  }
+  return true;
+}
+
+static void drain_stash(cuckoo_table_t *cuckoo) {
+  cuckoo_array_t *array = atomic_load_explicit(&cuckoo->array, memory_order_relaxed);
+  for (uint64_t slot = 0; slot < KV_CUCKOO_STASH_SIZE; slot++) {
+    db_entry_t *entry = atomic_load_explicit(&cuckoo->stash[slot], memory_order_relaxed);
+    if (entry != NULL && place_cuckoo_entry(cuckoo, array, entry, kv_key_hash(entry->key))) {
+      write_stash(cuckoo, slot, NULL);
+    }
+  }
+}
+
+static int64_t grow_cuckoo_table(cuckoo_table_t *cuckoo) {
+  cuckoo_array_t *old_array = atomic_load_explicit(&cuckoo->array, memory_order_relaxed);
+  uint64_t bucket_count = (old_array->mask + 1) * 2;
+
+  while (true) {
+    cuckoo_array_t *array = create_bucket_array(cuckoo->memory, bucket_count);
+    if (array == NULL) {
+      return KV_OOM;
+    }
+
+    /* Lookups keep reading the old array until the new one holds every entry */
+    bool placed = true;
+    for (uint64_t bucket = 0; bucket <= old_array->mask && placed; bucket++) {
+      for (uint64_t slot = 0; slot < KV_CUCKOO_BUCKET_SLOTS && placed; slot++) {
+        db_entry_t *entry = atomic_load_explicit(&old_array->buckets[bucket].entries[slot], memory_order_relaxed);
+        if (entry != NULL) {
+          placed = place_cuckoo_entry(cuckoo, array, entry, kv_key_hash(entry->key));
+        }
+      }
+    }
+    for (uint64_t slot = 0; slot < KV_CUCKOO_STASH_SIZE && placed; slot++) {
+      db_entry_t *entry = atomic_load_explicit(&cuckoo->stash[slot], memory_order_relaxed);
+      if (entry != NULL) {
+        placed = place_cuckoo_entry(cuckoo, array, entry, kv_key_hash(entry->key));
+      }
+    }
+
+    if (placed) {
+      atomic_store(&cuckoo->array, array);
+      for (uint64_t slot = 0; slot < KV_CUCKOO_STASH_SIZE; slot++) {
+        if (atomic_load_explicit(&cuckoo->stash[slot], memory_order_relaxed) != NULL) {
+          write_stash(cuckoo, slot, NULL);
+        }
+      }
+      retire_block(cuckoo, old_array, true);
+      cuckoo->resizes++;
+      return KV_OK;
+    }
+
+    kv_free(cuckoo->memory, KV_ALLOC_BUCKETS, array, array->block_size);
+    bucket_count *= 2;
+  }
+}
+
+static void retire_block(cuckoo_table_t *cuckoo, void *ptr, bool array) {
+  /* Pairs with the fence of optimistic_lookup(), a lookup not counted yet cannot reach ptr */
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(&cuckoo->readers) != 0) {
+    cuckoo_retired_t *retired = kv_alloc(cuckoo->memory, KV_ALLOC_BUFFERS, sizeof(cuckoo_retired_t));
+    if (retired != NULL) {
+      retired->ptr = ptr;
+      retired->array = array;
+      retired->next = cuckoo->retired;
+      cuckoo->retired = retired;
+      return;
+    }
+    while (atomic_load(&cuckoo->readers) != 0) {
+      sched_yield();
+    }
+  }
+
+  if (array) {
+    kv_free(cuckoo->memory, KV_ALLOC_BUCKETS, ptr, ((cuckoo_array_t*)ptr)->block_size);
+  }
+  else {
+    free_entry((db_entry_t*)ptr);
+  }
+}
+
+static void reclaim_blocks(cuckoo_table_t *cuckoo, bool wait) {
+  if (cuckoo->retired == NULL) return;
+
+  while (atomic_load(&cuckoo->readers) != 0) {
+    if (!wait) return;
+    sched_yield();
+  }
+
+  cuckoo_retired_t *retired = cuckoo->retired;
+  while (retired != NULL) {
+    cuckoo_retired_t *next = retired->next;
+    if (retired->array) {
+      kv_free(cuckoo->memory, KV_ALLOC_BUCKETS, retired->ptr, ((cuckoo_array_t*)retired->ptr)->block_size);
+    }
+    else {
+      free_entry((db_entry_t*)retired->ptr);
+    }
+    kv_free(cuckoo->memory, KV_ALLOC_BUFFERS, retired, sizeof(cuckoo_retired_t));
+    retired = next;
+  }
+  cuckoo->retired = NULL;
+}
+
+static int64_t cuckoo_insert_locked(cuckoo_table_t *cuckoo, db_entry_t *entry, const kv_key_probe_t *probe) {
+  cuckoo_position_t position;
+  if (find_position(cuckoo, probe, &position)) {
+    return KV_EXISTS;
+  }
+
+  while (true) {
+    cuckoo_array_t *array = atomic_load_explicit(&cuckoo->array, memory_order_relaxed);
+    if (place_cuckoo_entry(cuckoo, array, entry, probe->hash)) {
+      break;
+    }
+
+    if (atomic_load_explicit(&cuckoo->stash_count, memory_order_relaxed) < KV_CUCKOO_STASH_SIZE) {
+      uint64_t slot = 0;
+      while (atomic_load_explicit(&cuckoo->stash[slot], memory_order_relaxed) != NULL) slot++;
+      write_stash(cuckoo, slot, entry);
+      break;
+    }
+
+    int64_t result = grow_cuckoo_table(cuckoo);
+    if (result < 0) {
+      kv_log(3, "Error: Failed to grow a cuckoo hash table\n");
+      return result;
+    }
+  }
+
+  cuckoo->count++;
+  return KV_OK;
+}
+
+extern cuckoo_table_t *create_cuckoo_table(kv_memory_t *memory) {
+  cuckoo_table_t *cuckoo = kv_calloc(memory, KV_ALLOC_BUFFERS, sizeof(cuckoo_table_t));
+  if (cuckoo == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for a cuckoo hash table\n");
+    return NULL;
+  }
+  cuckoo->memory = memory;
+
+  cuckoo_array_t *array = create_bucket_array(memory, KV_CUCKOO_BUCKETS);
+  if (array == NULL) {
+    kv_free(memory, KV_ALLOC_BUFFERS, cuckoo, sizeof(cuckoo_table_t));
+    return NULL;
+  }
+  atomic_init(&cuckoo->array, array);
+  pthread_mutex_init(&cuckoo->writer, NULL);
+  return cuckoo;
+}
+
+extern int64_t cuckoo_insert(cuckoo_table_t *cuckoo, db_entry_t *entry) {
+  if (cuckoo == NULL || entry == NULL) {
+    kv_log(3, "Error: NULL pointer passed to cuckoo_insert\n");
+    return -1;
+  }
+
+  /* Lookups read stored entries concurrently, so they are never parsed later */
+  if (materialize_entry(entry) < 0) {
+    kv_log(3, "Error: Failed to parse the value of key \"%s\"\n", entry->key);
+    return KV_TYPE_MISMATCH;
+  }
+
+  /* Stored keys are compared as whole zero-padded buffers */
+  kv_key_pad(entry->key, entry->key);
+  kv_key_probe_t probe;
+  kv_key_probe(&probe, entry->key);
+
+  pthread_mutex_lock(&cuckoo->writer);
+  reclaim_blocks(cuckoo, false);
+  int64_t result = cuckoo_insert_locked(cuckoo, entry, &probe);
+  pthread_mutex_unlock(&cuckoo->writer);
+  return result;
+}
+
+extern int64_t cuckoo_put(cuckoo_table_t *cuckoo, uint8_t *key, uint8_t *value, uint64_t len, uint8_t *type) {
+  if (cuckoo == NULL || key == NULL || value == NULL || type == NULL) {
+    kv_log(3, "Error: NULL pointer passed to cuckoo_put\n");
+    return -1;
+  }
+
+  if (key[0] == '\0') {
+    kv_log(3, "Error: Empty string passed to cuckoo_put\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&cuckoo->writer);
+  reclaim_blocks(cuckoo, false);
+
+  int64_t result;
+  kv_key_probe_t probe;
+  cuckoo_position_t position;
+  if (kv_key_probe(&probe, key) && find_position(cuckoo, &probe, &position)) {
+    cuckoo_array_t *array = atomic_load_explicit(&cuckoo->array, memory_order_relaxed);
+    db_entry_t *entry = position.bucket >= 0 ?
+                        atomic_load_explicit(&array->buckets[position.bucket].entries[position.slot], memory_order_relaxed) :
+                        atomic_load_explicit(&cuckoo->stash[position.slot], memory_order_relaxed);
+
+    /* Lookups may be reading the entry, the new value goes into a new one */
+    uint8_t type_name[SM_BUFFER_SIZE];
+    if (type[0] == '\0') {
+      map_datatype_to_str(entry->type, type_name, SM_BUFFER_SIZE);
+      type = type_name;
+    }
+    errno = 0;
+    db_entry_t *updated = create_entry_with_memory(cuckoo->memory, entry->key, value, len, type);
+    if (updated == NULL) {
+      kv_log(3, "Error: Failed to update an entry\n");
+      result = errno == ENOMEM ? KV_OOM : KV_TYPE_MISMATCH;
+    }
+    else {
+      if (position.bucket >= 0) {
+        write_bucket_slot(cuckoo, array, position.bucket, position.slot, (uint32_t)(probe.hash >> 32), updated);
+      }
+      else {
+        write_stash(cuckoo, position.slot, updated);
+      }
+      retire_block(cuckoo, entry, false);
+      result = KV_OK;
+    }
+  }
+  /* A new key needs a type, there is no previous one to keep */
+  else if (type[0] == '\0') {
+    result = KV_NOT_FOUND;
+  }
+  else {
+    errno = 0;
+    db_entry_t *entry = create_entry_with_memory(cuckoo->memory, key, value, len, type);
+    if (entry == NULL) {
+      kv_log(3, "Error: Failed to create entry.\n");
+      result = errno == ENOMEM ? KV_OOM : KV_TYPE_MISMATCH;
+    }
+    else {
+      kv_key_probe(&probe, entry->key);
+      result = cuckoo_insert_locked(cuckoo, entry, &probe);
+      if (result < 0) {
+        free_entry(entry);
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&cuckoo->writer);
+  return result;
+}
+
+extern int64_t cuckoo_delete(cuckoo_table_t *cuckoo, uint8_t *key) {
+  if (cuckoo == NULL || key == NULL) {
+    kv_log(3, "Error: NULL pointer passed to cuckoo_delete\n");
+    return -1;
+  }
+
+  if (key[0] == '\0') {
+    kv_log(3, "Error: Empty string passed to cuckoo_delete\n");
+    return -1;
+  }
+
+  kv_key_probe_t probe;
+  if (!kv_key_probe(&probe, key)) {
+    return KV_NOT_FOUND;
+  }
+
+  pthread_mutex_lock(&cuckoo->writer);
+  reclaim_blocks(cuckoo, false);
+
+  cuckoo_position_t position;
+  if (!find_position(cuckoo, &probe, &position)) {
+    pthread_mutex_unlock(&cuckoo->writer);
+    return KV_NOT_FOUND;
+  }
+
+  db_entry_t *entry;
+  if (position.bucket >= 0) {
+    cuckoo_array_t *array = atomic_load_explicit(&cuckoo->array, memory_order_relaxed);
+    entry = atomic_load_explicit(&array->buckets[position.bucket].entries[position.slot], memory_order_relaxed);
+    write_bucket_slot(cuckoo, array, position.bucket, position.slot, 0, NULL);
+    if (atomic_load_explicit(&cuckoo->stash_count, memory_order_relaxed) > 0) {
+      drain_stash(cuckoo);
+    }
+  }
+  else {
+    entry = atomic_load_explicit(&cuckoo->stash[position.slot], memory_order_relaxed);
+    write_stash(cuckoo, position.slot, NULL);
+  }
+  cuckoo->count--;
+  retire_block(cuckoo, entry, false);
+
+  pthread_mutex_unlock(&cuckoo->writer);
+  return KV_OK;
+}
+
+extern db_entry_t *cuckoo_get_entry(cuckoo_table_t *cuckoo, uint8_t *key) {
+  if (cuckoo == NULL || key == NULL) {
+    kv_log(3, "Error: NULL pointer passed to cuckoo_get_entry\n");
+    return NULL;
+  }
+
+  if (key[0] == '\0') {
+    kv_log(3, "Error: Empty string passed to cuckoo_get_entry\n");
+    return NULL;
+  }
+
+  kv_key_probe_t probe;
+  if (!kv_key_probe(&probe, key)) {
+    return NULL;
+  }
+
+  cuckoo_reader_t *reader = get_cuckoo_reader();
+  if (reader == NULL) {
+    return NULL;
+  }
+  return optimistic_lookup(cuckoo, &probe, reader);
+}
+
+extern int64_t cuckoo_save(FILE *file, cuckoo_table_t *cuckoo) {
+  if (file == NULL || cuckoo == NULL) {
+    kv_log(3, "Error: NULL pointer passed to cuckoo_save\n");
+    return -1;
+  }
+
+  cuckoo_array_t *array = atomic_load(&cuckoo->array);
+  for (uint64_t bucket = 0; bucket <= array->mask; bucket++) {
+    for (uint64_t slot = 0; slot < KV_CUCKOO_BUCKET_SLOTS; slot++) {
+      db_entry_t *entry = atomic_load_explicit(&array->buckets[bucket].entries[slot], memory_order_acquire);
+      if (entry != NULL && write_entry(file, entry) < 0) {
+        kv_log(3, "Error: Failed to save cuckoo hash table entry\n");
+        return -1;
+      }
+    }
+  }
+
+  for (uint64_t slot = 0; slot < KV_CUCKOO_STASH_SIZE; slot++) {
+    db_entry_t *entry = atomic_load_explicit(&cuckoo->stash[slot], memory_order_acquire);
+    if (entry != NULL && write_entry(file, entry) < 0) {
+      kv_log(3, "Error: Failed to save cuckoo hash table entry\n");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+extern void free_cuckoo_table(cuckoo_table_t *cuckoo) {
+  if (cuckoo == NULL) return;
+
+  reclaim_blocks(cuckoo, true);
+
+  cuckoo_array_t *array = atomic_load(&cuckoo->array);
+  for (uint64_t bucket = 0; bucket <= array->mask; bucket++) {
+    for (uint64_t slot = 0; slot < KV_CUCKOO_BUCKET_SLOTS; slot++) {
+      free_entry(atomic_load_explicit(&array->buckets[bucket].entries[slot], memory_order_relaxed));
+    }
+  }
+  for (uint64_t slot = 0; slot < KV_CUCKOO_STASH_SIZE; slot++) {
+    free_entry(atomic_load_explicit(&cuckoo->stash[slot], memory_order_relaxed));
+  }
+
+  pthread_mutex_destroy(&cuckoo->writer);
+  kv_free(cuckoo->memory, KV_ALLOC_BUCKETS, array, array->block_size);
+  kv_free(cuckoo->memory, KV_ALLOC_BUFFERS, cuckoo, sizeof(cuckoo_table_t));
+}
+
+extern void cuckoo_print(cuckoo_table_t *cuckoo) {
+  if (cuckoo == NULL) {
+    kv_log(3, "Error: NULL pointer passed to cuckoo_print\n");
+    return;
+  }
+
+  cuckoo_array_t *array = atomic_load(&cuckoo->array);
+  for (uint64_t bucket = 0; bucket <= array->mask; bucket++) {
+    for (uint64_t slot = 0; slot < KV_CUCKOO_BUCKET_SLOTS; slot++) {
+      db_entry_t *entry = atomic_load_explicit(&array->buckets[bucket].entries[slot], memory_order_acquire);
+      if (entry != NULL) {
+        print_entry(entry);
+      }
+    }
+  }
+  for (uint64_t slot = 0; slot < KV_CUCKOO_STASH_SIZE; slot++) {
+    db_entry_t *entry = atomic_load_explicit(&cuckoo->stash[slot], memory_order_acquire);
+    if (entry != NULL) {
+      print_entry(entry);
+    }
+  }
+}
+
+extern int64_t cuckoo_stats(cuckoo_table_t *cuckoo, cuckoo_stats_t *out) {
+  if (cuckoo == NULL || out == NULL) {
+    kv_log(3, "Error: NULL pointer passed to cuckoo_stats\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&cuckoo->writer);
+  cuckoo_array_t *array = atomic_load_explicit(&cuckoo->array, memory_order_relaxed);
+  memset(out, 0, sizeof(cuckoo_stats_t));
+  out->entries = cuckoo->count;
+  out->buckets = array->mask + 1;
+  out->slots = out->buckets * KV_CUCKOO_BUCKET_SLOTS;
+  out->load_factor = (double)out->entries / out->slots;
+  out->stash_entries = atomic_load_explicit(&cuckoo->stash_count, memory_order_relaxed);
+  out->displacements = cuckoo->displacements;
+  out->max_path = cuckoo->max_path;
+  out->resizes = cuckoo->resizes;
+  pthread_mutex_unlock(&cuckoo->writer);
+  return 0;
+}
@@ -0,0 +1,389 @@
+#include "frozen_table.h"
+
+static _Thread_local db_entry_t frozen_entry;
+
+static uint64_t frozen_mix(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+  return value ^ (value >> 31);
+}
+
+static uint64_t frozen_key_hash(uint64_t key_hash, uint64_t seed) {
+  return frozen_mix(key_hash ^ seed);
+}
+
+static uint64_t frozen_bucket(uint64_t hash, uint64_t buckets) {
+  return (uint64_t)(((unsigned __int128)hash * buckets) >> 64);
+}
+
+static uint64_t frozen_position(uint64_t hash, uint32_t pilot, uint64_t count) {
+  /* The pilot is mixed in before reducing, an XOR alone keeps the low bits
+     two keys share, and with a power of two count no pilot separates them */
+  return (uint64_t)(((unsigned __int128)frozen_mix(hash ^ frozen_mix(pilot)) * count) >> 64);
+}
+
+static uint64_t frozen_align(uint64_t size) {
+  return (size + 7) & ~(uint64_t)7;
+}
+
+static int64_t frozen_value_size(int64_t type, uint64_t size) {
+  int64_t type_size = map_datatype_size(type);
+  if (type_size < 0) return -1;
+  return type_size > 0 ? type_size : (int64_t)size + 1;
+}
+
+static int64_t assign_pilots(const uint64_t *hashes, uint64_t count, uint64_t buckets, uint64_t seed,
+                             uint32_t *pilots, uint64_t *positions, uint64_t *work) {
+  uint64_t *seeded = work;
+  uint64_t *order = seeded + count;
+  uint64_t *starts = order + count;
+  uint64_t *bucket_order = starts + buckets + 1;
+  uint64_t *taken = bucket_order + buckets;
+  memset(starts, 0, (buckets + 1) * sizeof(uint64_t));
+  memset(taken, 0, ((count + 63) / 64) * sizeof(uint64_t));
+  memset(pilots, 0, buckets * sizeof(uint32_t));
+
+  /* Keys are grouped by bucket with a counting sort */
+  for (uint64_t idx = 0; idx < count; idx++) {
+    seeded[idx] = frozen_key_hash(hashes[idx], seed);
+    starts[frozen_bucket(seeded[idx], buckets) + 1]++;
+  }
+  uint64_t max_size = 0;
+  for (uint64_t bucket = 0; bucket < buckets; bucket++) {
+    uint64_t size = starts[bucket + 1];
+    max_size = size > max_size ? size : max_size;
+    starts[bucket + 1] += starts[bucket];
+    bucket_order[bucket] = starts[bucket];
+  }
+  for (uint64_t idx = 0; idx < count; idx++) {
+    uint64_t bucket = frozen_bucket(seeded[idx], buckets);
+    order[bucket_order[bucket]++] = idx;
+  }
+
+  /* The largest buckets are placed first, while most slots are still free */
+  uint64_t placed = 0;
+  for (uint64_t size = max_size; size > 0; size--) {
+    for (uint64_t bucket = 0; bucket < buckets; bucket++) {
+      if (starts[bucket + 1] - starts[bucket] == size) {
+        bucket_order[placed++] = bucket;
+      }
+    }
+  }
+
+  uint64_t max_pilot = 64 * count + 1024;
+  max_pilot = max_pilot < UINT32_MAX ? max_pilot : UINT32_MAX;
+  for (uint64_t rank = 0; rank < placed; rank++) {
+    uint64_t bucket = bucket_order[rank];
+    uint64_t *keys = order + starts[bucket];
+    uint64_t size = starts[bucket + 1] - starts[bucket];
+
+    /* Keys with the same hash share every slot, no pilot can separate them */
+    for (uint64_t key = 1; key < size; key++) {
+      for (uint64_t other = 0; other < key; other++) {
+        if (seeded[keys[key]] == seeded[keys[other]]) {
+          return KV_EXISTS;
+        }
+      }
+    }
+
+    bool found = false;
+    for (uint64_t pilot = 0; pilot < max_pilot && !found; pilot++) {
+      found = true;
+      for (uint64_t key = 0; key < size && found; key++) {
+        uint64_t position = frozen_position(seeded[keys[key]], pilot, count);
+        found = (taken[position / 64] & (1ULL << (position % 64))) == 0;
+        for (uint64_t other = 0; other < key && found; other++) {
+          found = positions[keys[other]] != position;
+        }
+        positions[keys[key]] = position;
+      }
+
+      if (found) {
+        pilots[bucket] = pilot;
+        for (uint64_t key = 0; key < size; key++) {
+          taken[positions[keys[key]] / 64] |= 1ULL << (positions[keys[key]] % 64);
+        }
+      }
+    }
+
+    if (!found) {
+      return KV_ERROR;
+    }
+  }
+
+  return KV_OK;
+}
+
+static void attach_image(frozen_table_t *frozen, uint8_t *image, uint64_t size, bool mapped) {
+  const frozen_header_t *header = (const frozen_header_t*)image;
+  frozen->image = image;
+  frozen->size = size;
+  frozen->mapped = mapped;
+  frozen->count = header->count;
+  frozen->buckets = header->buckets;
+  frozen->seed = header->seed;
+  frozen->pilots = (const uint32_t*)(image + sizeof(frozen_header_t));
+  frozen->slots = (const frozen_slot_t*)(image + sizeof(frozen_header_t) +
+                                         frozen_align(header->buckets * sizeof(uint32_t)));
+}
+
+static void release_image(frozen_table_t *frozen) {
+  if (frozen->image == NULL) return;
+
+  if (frozen->mapped) {
+    munmap(frozen->image, frozen->size);
+  }
+  else {
+    kv_free(frozen->memory, KV_ALLOC_BUCKETS, frozen->image, frozen->size);
+  }
+  frozen->image = NULL;
+  frozen->size = 0;
+  frozen->count = 0;
+}
+
+static int64_t verify_image(const uint8_t *image, uint64_t size) {
+  const frozen_header_t *header = (const frozen_header_t*)image;
+  if (memcmp(header->magic, KV_FROZEN_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != KV_FROZEN_VERSION) {
+    kv_log(3, "Error: Not a frozen image of version %d\n", KV_FROZEN_VERSION);
+    return -1;
+  }
+
+  uint64_t max_count = (size - sizeof(frozen_header_t)) / sizeof(frozen_slot_t);
+  uint64_t buckets = (header->count + KV_FROZEN_BUCKET_KEYS - 1) / KV_FROZEN_BUCKET_KEYS;
+  if (header->size != size || header->count > max_count || header->buckets != buckets) {
+    kv_log(3, "Error: The frozen image is truncated or its header is damaged\n");
+    return -1;
+  }
+
+  uint64_t values_start = sizeof(frozen_header_t) + frozen_align(buckets * sizeof(uint32_t)) +
+                          header->count * sizeof(frozen_slot_t);
+  if (values_start > size) {
+    kv_log(3, "Error: The frozen image is truncated\n");
+    return -1;
+  }
+
+  if (crc32c(0, image + sizeof(frozen_header_t), size - sizeof(frozen_header_t)) != header->crc) {
+    kv_log(3, "Error: Checksum mismatch in the frozen image\n");
+    return -1;
+  }
+
+  const frozen_slot_t *slots = (const frozen_slot_t*)(image + values_start -
+                                                      header->count * sizeof(frozen_slot_t));
+  for (uint64_t idx = 0; idx < header->count; idx++) {
+    int64_t value_size = frozen_value_size(slots[idx].type, slots[idx].size);
+    if (value_size < 0 || slots[idx].key[SM_BUFFER_SIZE - 1] != '\0' ||
+        slots[idx].offset < values_start || slots[idx].offset > size ||
+        (uint64_t)value_size > size - slots[idx].offset) {
+      kv_log(3, "Error: Damaged slot %lu in the frozen image\n", idx);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void fill_entry(frozen_table_t *frozen, const frozen_slot_t *slot, db_entry_t *entry) {
+  memcpy(entry->key, slot->key, SM_BUFFER_SIZE);
+  entry->type = slot->type;
+  entry->value = frozen->image + slot->offset;
+  entry->size = slot->size;
+  entry->raw_value = NULL;
+  entry->raw_size = 0;
+  entry->memory = NULL;
+}
+
+extern frozen_table_t *create_frozen_table(kv_memory_t *memory) {
+  frozen_table_t *frozen = kv_calloc(memory, KV_ALLOC_BUFFERS, sizeof(frozen_table_t));
+  if (frozen == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for a frozen table\n");
+    return NULL;
+  }
+  frozen->memory = memory;
+
+  if (frozen_build(frozen, NULL, 0) < 0) {
+    kv_free(memory, KV_ALLOC_BUFFERS, frozen, sizeof(frozen_table_t));
+    return NULL;
+  }
+  return frozen;
+}
+
+extern int64_t frozen_build(frozen_table_t *frozen, db_entry_t **entries, uint64_t count) {
+  if (frozen == NULL || (entries == NULL && count > 0)) {
+    kv_log(3, "Error: NULL pointer passed to frozen_build\n");
+    return KV_ERROR;
+  }
+
+  uint64_t buckets = (count + KV_FROZEN_BUCKET_KEYS - 1) / KV_FROZEN_BUCKET_KEYS;
+  uint64_t values_start = sizeof(frozen_header_t) + frozen_align(buckets * sizeof(uint32_t)) +
+                          count * sizeof(frozen_slot_t);
+  uint64_t size = values_start;
+  for (uint64_t idx = 0; idx < count; idx++) {
+    int64_t value_size = -1;
+    if (materialize_entry(entries[idx]) == 0) {
+      value_size = frozen_value_size(entries[idx]->type, entries[idx]->size);
+    }
+    if (value_size < 0) {
+      kv_log(3, "Error: Failed to read the value of key \"%s\"\n", entries[idx]->key);
+      return KV_TYPE_MISMATCH;
+    }
+    size += frozen_align(value_size);
+  }
+
+  /* Hashes, slots of the keys and the scratch space of assign_pilots() */
+  uint64_t work_size = (4 * count + 2 * buckets + 1 + (count + 63) / 64) * sizeof(uint64_t);
+  uint64_t *hashes = kv_alloc(frozen->memory, KV_ALLOC_BUFFERS, work_size);
+  uint8_t *image = kv_calloc(frozen->memory, KV_ALLOC_BUCKETS, size);
+  if (hashes == NULL || image == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for a frozen table\n");
+    kv_free(frozen->memory, KV_ALLOC_BUFFERS, hashes, work_size);
+    kv_free(frozen->memory, KV_ALLOC_BUCKETS, image, size);
+    return KV_OOM;
+  }
+  uint64_t *positions = hashes + count;
+
+  for (uint64_t idx = 0; idx < count; idx++) {
+    uint8_t key[SM_BUFFER_SIZE];
+    kv_key_pad(key, entries[idx]->key);
+    hashes[idx] = kv_key_hash(key);
+  }
+
+  frozen_header_t *header = (frozen_header_t*)image;
+  uint32_t *pilots = (uint32_t*)(image + sizeof(frozen_header_t));
+  int64_t result = KV_ERROR;
+  uint64_t seed = 0;
+  for (uint64_t attempt = 0; attempt < KV_FROZEN_SEEDS && result == KV_ERROR; attempt++) {
+    seed = frozen_mix(attempt + 1);
+    result = assign_pilots(hashes, count, buckets, seed, pilots, positions, positions + count);
+  }
+
+  if (result != KV_OK) {
+    kv_log(3, result == KV_EXISTS ? "Error: Two keys to freeze have the same hash\n" :
+                                    "Error: Failed to find a perfect hash for the keys\n");
+    kv_free(frozen->memory, KV_ALLOC_BUFFERS, hashes, work_size);
+    kv_free(frozen->memory, KV_ALLOC_BUCKETS, image, size);
+    return KV_ERROR;
+  }
+
+  frozen_slot_t *slots = (frozen_slot_t*)(image + values_start - count * sizeof(frozen_slot_t));
+  uint64_t offset = values_start;
+  for (uint64_t idx = 0; idx < count; idx++) {
+    db_entry_t *entry = entries[idx];
+    frozen_slot_t *slot = &slots[positions[idx]];
+    kv_key_pad(slot->key, entry->key);
+    slot->type = entry->type;
+    slot->size = entry->size;
+    slot->offset = offset;
+
+    uint64_t value_size = frozen_value_size(entry->type, entry->size);
+    memcpy(image + offset, entry->value, value_size);
+    offset += frozen_align(value_size);
+  }
+
+  memcpy(header->magic, KV_FROZEN_MAGIC, sizeof(header->magic));
+  header->version = KV_FROZEN_VERSION;
+  header->count = count;
+  header->buckets = buckets;
+  header->seed = seed;
+  header->size = size;
+  header->crc = crc32c(0, image + sizeof(frozen_header_t), size - sizeof(frozen_header_t));
+  kv_free(frozen->memory, KV_ALLOC_BUFFERS, hashes, work_size);
+
+  release_image(frozen);
+  attach_image(frozen, image, size, false);
+  return KV_OK;
+}
+
+extern int64_t frozen_open(frozen_table_t *frozen, uint8_t *file_path) {
+  if (frozen == NULL || file_path == NULL) {
+    kv_log(3, "Error: NULL pointer passed to frozen_open\n");
+    return KV_ERROR;
+  }
+
+  int32_t fd = open(file_path, O_RDONLY);
+  if (fd < 0) {
+    kv_log(3, "Error: Failed to open the frozen image %s\n", file_path);
+    return KV_IO;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0 || (uint64_t)file_stat.st_size < sizeof(frozen_header_t)) {
+    kv_log(3, "Error: %s is too short to be a frozen image\n", file_path);
+    close(fd);
+    return KV_IO;
+  }
+
+  /* Shared, so every process mapping the file reads the same pages */
+  uint64_t size = file_stat.st_size;
+  uint8_t *image = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    kv_log(3, "Error: Failed to map the frozen image %s\n", file_path);
+    return KV_IO;
+  }
+
+  if (verify_image(image, size) < 0) {
+    kv_log(3, "Error: %s is not a valid frozen image\n", file_path);
+    munmap(image, size);
+    return KV_IO;
+  }
+
+  release_image(frozen);
+  attach_image(frozen, image, size, true);
+  return KV_OK;
+}
+
+extern int64_t frozen_write(FILE *file, frozen_table_t *frozen) {
+  if (file == NULL || frozen == NULL) {
+    kv_log(3, "Error: NULL pointer passed to frozen_write\n");
+    return -1;
+  }
+
+  if (fwrite(frozen->image, 1, frozen->size, file) != frozen->size) {
+    kv_log(3, "Error: Failed to write the frozen image\n");
+    return -1;
+  }
+  return 0;
+}
+
+extern db_entry_t *frozen_get_entry(frozen_table_t *frozen, uint8_t *key) {
+  if (frozen == NULL || key == NULL) {
+    kv_log(3, "Error: NULL pointer passed to frozen_get_entry\n");
+    return NULL;
+  }
+
+  kv_key_probe_t probe;
+  if (frozen->count == 0 || !kv_key_probe(&probe, key)) {
+    return NULL;
+  }
+
+  uint64_t hash = frozen_key_hash(probe.hash, frozen->seed);
+  uint32_t pilot = frozen->pilots[frozen_bucket(hash, frozen->buckets)];
+  const frozen_slot_t *slot = &frozen->slots[frozen_position(hash, pilot, frozen->count)];
+  if (!kv_key_matches(&probe, slot->key)) {
+    return NULL;
+  }
+
+  fill_entry(frozen, slot, &frozen_entry);
+  return &frozen_entry;
+}
+
+extern void free_frozen_table(frozen_table_t *frozen) {
+  if (frozen == NULL) return;
+
+  release_image(frozen);
+  kv_free(frozen->memory, KV_ALLOC_BUFFERS, frozen, sizeof(frozen_table_t));
+}
+
+extern void frozen_print(frozen_table_t *frozen) {
+  if (frozen == NULL) {
+    kv_log(3, "Error: NULL pointer passed to frozen_print\n");
+    return;
+  }
+
+  for (uint64_t idx = 0; idx < frozen->count; idx++) {
+    db_entry_t entry;
+    fill_entry(frozen, &frozen->slots[idx], &entry);
+    print_entry(&entry);
+  }
+}
@@ -2,12 +2,12 @@
 
 static int64_t calculate_hash_code(uint8_t *key, uint64_t size) {
   if (key == NULL) {
-    logger(3, "Error: key parameter is NULL\n");
+    kv_log(3, "Error: key parameter is NULL\n");
     return -1;
   }
 
   if (strlen(key) == 0) {
-    logger(3, "Error: key parameter is empty\n");
+    kv_log(3, "Error: key parameter is empty\n");
     return -1;
   }
 
@@ -23,27 +23,55 @@ static int64_t calculate_hash_code(uint8_t *key, uint64_t size) {
   return hash_code;
 }
 
-extern hash_table_t* create_hash_table(uint64_t len) {
-  hash_table_t *hash = malloc(sizeof(hash_table_t));
+static void indexed_chain_probes(list_t *list, uint64_t *hit_probes, double *miss_probes) {
+  uint64_t mask = list->index_capacity - 1;
+  *hit_probes = 0;
+  for (uint64_t slot = 0; slot < list->index_capacity; slot++) {
+    if (list->index[slot] != NULL) {
+      uint64_t home = kv_key_hash(list->index[slot]->entry->key) & mask;
+      *hit_probes += ((slot - home) & mask) + 1;
+    }
+  }
+
+  /* A miss compares every key from its slot to the next empty one. At most
+     half of the slots are used, so there is an empty slot to walk back from */
+  uint64_t empty = 0;
+  while (list->index[empty] != NULL) empty++;
+  uint64_t run = 0;
+  uint64_t total = 0;
+  for (uint64_t step = 1; step <= list->index_capacity; step++) {
+    uint64_t slot = (empty - step) & mask;
+    run = list->index[slot] != NULL ? run + 1 : 0;
+    total += run;
+  }
+  *miss_probes = (double)total / list->index_capacity;
+}
+
+extern hash_table_t* create_hash_table(uint64_t len, kv_memory_t *memory) {
+  hash_table_t *hash = kv_alloc(memory, KV_ALLOC_BUFFERS, sizeof(hash_table_t));
   if (hash == NULL) {
-    logger(3, "Failed to allocate memory for hash table.");
+    kv_log(3, "Failed to allocate memory for hash table.");
     return NULL;
   }
+  hash->memory = memory;
+  hash->content = NULL;
+  hash->size = 0;
   
-  list_t **content = malloc(sizeof(list_t*)*len);
+  list_t **content = kv_calloc(memory, KV_ALLOC_BUCKETS, sizeof(list_t*)*len);
   if (content == NULL) {
-    logger(3, "Failed to allocate memory for hash table contents.");
+    kv_log(3, "Failed to allocate memory for hash table contents.");
     free_hash_table(hash);
     return NULL;
   }
   
   hash->content = content;
   hash->size = len;
+  hash->count = 0;
 
   for (uint64_t idx = 0; idx < hash->size; idx++) {
-    hash->content[idx] = create_list();
+    hash->content[idx] = create_list(memory, KV_ALLOC_BUCKETS);
     if (hash->content[idx] == NULL) {
-      logger(3, "Failed to create list for index %d\n", idx);
+      kv_log(3, "Failed to create list for index %d\n", idx);
       free_hash_table(hash);
       return NULL;
     }
@@ -54,7 +82,7 @@ extern hash_table_t* create_hash_table(uint64_t len) {
 
 extern int64_t hash_insert(hash_table_t *hash, db_entry_t *entry) {
   if (hash == NULL || entry == NULL) {
-    logger(3, "Error: NULL pointer passed to hash_insert\n");
+    kv_log(3, "Error: NULL pointer passed to hash_insert\n");
     return -1;
   }
   
@@ -66,17 +94,22 @@ extern int64_t hash_insert(hash_table_t *hash, db_entry_t *entry) {
   if (list == NULL) {
     return -1;
   }
-  return list_insert(list, entry);
+
+  int64_t result = list_insert(list, entry);
+  if (result == KV_OK) {
+    hash->count++;
+  }
+  return result;
 }
 
-extern int64_t hash_put(hash_table_t *hash, uint8_t *key, uint8_t* value, uint8_t* type) {
+extern int64_t hash_put(hash_table_t *hash, uint8_t *key, uint8_t* value, uint64_t len, uint8_t* type) {
   if (hash == NULL || key == NULL || value == NULL || type == NULL) {
-    logger(3, "Error: NULL pointer passed to hash_put\n");
+    kv_log(3, "Error: NULL pointer passed to hash_put\n");
     return -1;
   }
 
   if (strlen(key) == 0) {
-    logger(3, "Error: Empty string passed to hash_put\n");
+    kv_log(3, "Error: Empty string passed to hash_put\n");
     return -1;
   }
   
@@ -85,36 +118,20 @@ extern int64_t hash_put(hash_table_t *hash, uint8_t *key, uint8_t* value, uint8_
     return -1;
   }
   list_t *list = hash->content[hash_code];
-  db_entry_t *entry = list_get_entry_by_key(list, key);
-  if (entry != NULL) {
-    if (update_entry(entry, value, type)) {
-      logger(3, "Error: Failed to update an entry\n");
-      return -1;
-    }
-  }
-  else {
-    entry = create_entry(key, value, type);
-    if (entry == NULL) {
-      logger(3, "Error: Failed to create entry.\n");
-      return -1;
-    }
-    
-    if (hash_insert(hash, entry) < 0) {      
-      logger(3, "Error: Failed to insert entry into list.\n");
-      return -1;
-    }
-  }
-  return 0;
+  uint64_t previous_size = list->size;
+  int64_t result = list_put(list, key, value, len, type);
+  hash->count += list->size - previous_size;
+  return result;
 }
 
 extern int64_t hash_delete(hash_table_t *hash, uint8_t *key) {
   if (hash == NULL || key == NULL) {
-    logger(3, "Error: NULL pointer passed to hash_delete\n");
+    kv_log(3, "Error: NULL pointer passed to hash_delete\n");
     return -1;
   }
 
   if (strlen(key) == 0) {
-    logger(3, "Error: Empty string passed to hash_delete\n");
+    kv_log(3, "Error: Empty string passed to hash_delete\n");
     return -1;
   }
   
@@ -123,17 +140,21 @@ extern int64_t hash_delete(hash_table_t *hash, uint8_t *key) {
     return -1;
   }
   list_t *list = hash->content[hash_code];
-  return list_delete(list, key);
+  int64_t result = list_delete(list, key);
+  if (result == KV_OK) {
+    hash->count--;
+  }
+  return result;
 }
 
 extern db_entry_t *hash_get_entry(hash_table_t *hash, uint8_t *key) {
   if (hash == NULL || key == NULL) {
-    logger(3, "Error: NULL pointer passed to hash_get_entry\n");
+    kv_log(3, "Error: NULL pointer passed to hash_get_entry\n");
     return NULL;
   }
 
   if (strlen(key) == 0) {
-    logger(3, "Error: Empty string passed to hash_get_entry\n");
+    kv_log(3, "Error: Empty string passed to hash_get_entry\n");
     return NULL;
   }
   
@@ -148,14 +169,14 @@ extern db_entry_t *hash_get_entry(hash_table_t *hash, uint8_t *key) {
 
 extern int64_t hash_save(FILE *file, hash_table_t *hash) {
   if (file == NULL || hash == NULL) {
-    logger(3, "Error: NULL pointer passed to hash_save\n");
+    kv_log(3, "Error: NULL pointer passed to hash_save\n");
     return -1;
   }
   
   for (uint64_t idx = 0; idx < hash->size; idx++) {
     list_t *list = hash->content[idx];
     if (list_save(file, list) < 0) {
-      logger(3, "Error: Failed to save hash table entry\n");
+      kv_log(3, "Error: Failed to save hash table entry\n");
       return -1;
     }
   }
@@ -171,13 +192,13 @@ extern void free_hash_table(hash_table_t *hash) {
     free_list(list);
   }
 
-  free(hash->content);
-  free(hash);
+  kv_free(hash->memory, KV_ALLOC_BUCKETS, hash->content, sizeof(list_t*)*hash->size);
+  kv_free(hash->memory, KV_ALLOC_BUFFERS, hash, sizeof(hash_table_t));
 }
 
 extern void hash_print(hash_table_t *hash) {
   if (hash == NULL) {
-    logger(3, "Error: NULL pointer passed to hash_print\n");
+    kv_log(3, "Error: NULL pointer passed to hash_print\n");
     return;
   }
   
@@ -188,3 +209,53 @@ extern void hash_print(hash_table_t *hash) {
     }
   }
 }
+
+extern int64_t hash_stats(hash_table_t *hash, hash_stats_t *out) {
+  if (hash == NULL || out == NULL) {
+    kv_log(3, "Error: NULL pointer passed to hash_stats\n");
+    return -1;
+  }
+
+  memset(out, 0, sizeof(hash_stats_t));
+  out->buckets = hash->size;
+
+  /* A hit on the i-th key of a chain takes i comparisons, a miss all of them
+     in a bucket chosen with the weight of its keys */
+  uint64_t hit_probes = 0;
+  double miss_probes = 0;
+  for (uint64_t idx = 0; idx < hash->size; idx++) {
+    list_t *chain = hash->content[idx];
+    uint64_t length = chain->size;
+    out->entries += length;
+    if (chain->index != NULL) {
+      uint64_t chain_hits;
+      double chain_misses;
+      indexed_chain_probes(chain, &chain_hits, &chain_misses);
+      hit_probes += chain_hits;
+      miss_probes += length * chain_misses;
+    }
+    else {
+      hit_probes += length * (length + 1) / 2;
+      miss_probes += length * length;
+    }
+    if (length == 0) {
+      out->empty_buckets++;
+    }
+    if (length > out->max_chain) {
+      out->max_chain = length;
+    }
+    out->chain_lengths[length < KV_HASH_STATS_CHAIN_SLOTS ? length : KV_HASH_STATS_CHAIN_SLOTS - 1]++;
+  }
+
+  if (out->buckets > 0) {
+    out->load_factor = (double)out->entries / out->buckets;
+  }
+  if (out->buckets > out->empty_buckets) {
+    out->mean_chain = (double)out->entries / (out->buckets - out->empty_buckets);
+  }
+  if (out->entries > 0) {
+    out->expected_hit_probes = (double)hit_probes / out->entries;
+    out->expected_miss_probes = miss_probes / out->entries;
+  }
+  return 0;
+}
@@ -0,0 +1,128 @@
+#include "kv_alloc.h"
+
+static void *libc_alloc(void *context, uint64_t size) {
+  (void)context;
+  return malloc(size);
+}
+
+static void *libc_realloc(void *context, void *ptr, uint64_t old_size, uint64_t new_size) {
+  (void)context;
+  (void)old_size;
+  return realloc(ptr, new_size);
+}
+
+static void libc_free(void *context, void *ptr, uint64_t size) {
+  (void)context;
+  (void)size;
+  free(ptr);
+}
+
+kv_memory_t kv_default_memory = {
+  .allocator = { libc_alloc, libc_realloc, libc_free, NULL }
+};
+
+static void account_block(kv_memory_t *memory, int64_t category, uint64_t size, bool added) {
+  if (category < 0 || category >= KV_ALLOC_CATEGORY_COUNT) {
+    category = KV_ALLOC_BUFFERS;
+  }
+
+  if (added) {
+    atomic_fetch_add_explicit(&memory->bytes[category], size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&memory->blocks[category], 1, memory_order_relaxed);
+  }
+  else {
+    atomic_fetch_sub_explicit(&memory->bytes[category], size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&memory->blocks[category], 1, memory_order_relaxed);
+  }
+}
+
+extern int64_t kv_memory_init(kv_memory_t *memory, const kv_allocator_t *allocator) {
+  if (memory == NULL) {
+    kv_log(3, "Error: NULL pointer passed to kv_memory_init\n");
+    return -1;
+  }
+
+  if (allocator != NULL && (allocator->alloc == NULL || allocator->free == NULL)) {
+    kv_log(3, "Error: An allocator needs both an alloc and a free hook\n");
+    return -1;
+  }
+
+  memory->allocator = allocator != NULL ? *allocator : kv_default_memory.allocator;
+  for (int64_t category = 0; category < KV_ALLOC_CATEGORY_COUNT; category++) {
+    atomic_init(&memory->bytes[category], 0);
+    atomic_init(&memory->blocks[category], 0);
+  }
+  return 0;
+}
+
+extern void *kv_alloc(kv_memory_t *memory, int64_t category, uint64_t size) {
+  memory = memory != NULL ? memory : &kv_default_memory;
+
+  void *ptr = memory->allocator.alloc(memory->allocator.context, size);
+  if (ptr == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  account_block(memory, category, size, true);
+  return ptr;
+}
+
+extern void *kv_calloc(kv_memory_t *memory, int64_t category, uint64_t size) {
+  void *ptr = kv_alloc(memory, category, size);
+  if (ptr != NULL) {
+    memset(ptr, 0, size);
+  }
+  return ptr;
+}
+
+extern void *kv_realloc(kv_memory_t *memory, int64_t category, void *ptr, uint64_t old_size, uint64_t new_size) {
+  memory = memory != NULL ? memory : &kv_default_memory;
+  if (ptr == NULL) {
+    return kv_alloc(memory, category, new_size);
+  }
+
+  kv_allocator_t *allocator = &memory->allocator;
+  void *resized;
+  if (allocator->realloc != NULL) {
+    resized = allocator->realloc(allocator->context, ptr, old_size, new_size);
+  }
+  else {
+    resized = allocator->alloc(allocator->context, new_size);
+    if (resized != NULL) {
+      memcpy(resized, ptr, old_size < new_size ? old_size : new_size);
+      allocator->free(allocator->context, ptr, old_size);
+    }
+  }
+
+  if (resized == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  account_block(memory, category, old_size, false);
+  account_block(memory, category, new_size, true);
+  return resized;
+}
+
+extern void kv_free(kv_memory_t *memory, int64_t category, void *ptr, uint64_t size) {
+  if (ptr == NULL) return;
+
+  memory = memory != NULL ? memory : &kv_default_memory;
+  memory->allocator.free(memory->allocator.context, ptr, size);
+  account_block(memory, category, size, false);
+}
+
+extern int64_t kv_memory_usage(kv_memory_t *memory, kv_memory_usage_t *out) {
+  if (memory == NULL || out == NULL) {
+    kv_log(3, "Error: NULL pointer passed to kv_memory_usage\n");
+    return -1;
+  }
+
+  memset(out, 0, sizeof(kv_memory_usage_t));
+  for (int64_t category = 0; category < KV_ALLOC_CATEGORY_COUNT; category++) {
+    out->bytes[category] = atomic_load_explicit(&memory->bytes[category], memory_order_relaxed);
+    out->blocks[category] = atomic_load_explicit(&memory->blocks[category], memory_order_relaxed);
+    out->total_bytes += out->bytes[category];
+    out->total_blocks += out->blocks[category];
+  }
+  return 0;
+}
@@ -1,36 +1,339 @@
 #include "kv_controller.h"
 
+static int64_t save_storage(FILE *file, db_t *db, int32_t progress_fd) {
+  if (file == NULL || db == NULL) {
+    kv_log(3, "Error: NULL pointer passed to save_storage\n");
+    return -1;
+  }
+
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LIST) == 0) {
+    list_t *list = (list_t*)db->storage;
+    if (list_save(file, list) < 0) {
+      return -1;
+    }
+    if (progress_fd >= 0) {
+      uint64_t written = list->size;
+      write(progress_fd, &written, sizeof(uint64_t));
+    }
+    return 0;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) == 0) {
+    if (progress_fd < 0) {
+      return hash_save(file, (hash_table_t*)db->storage);
+    }
+
+    hash_table_t *hash = (hash_table_t*)db->storage;
+    uint64_t written = 0;
+    for (uint64_t idx = 0; idx < hash->size; idx++) {
+      list_t *list = hash->content[idx];
+      if (list_save(file, list) < 0) {
+        kv_log(3, "Error: Failed to save hash table entry\n");
+        return -1;
+      }
+      if (list->size > 0) {
+        written += list->size;
+        write(progress_fd, &written, sizeof(uint64_t));
+      }
+    }
+    return 0;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_CUCKOO) == 0) {
+    cuckoo_table_t *cuckoo = (cuckoo_table_t*)db->storage;
+    if (cuckoo_save(file, cuckoo) < 0) {
+      return -1;
+    }
+    if (progress_fd >= 0) {
+      uint64_t written = cuckoo->count;
+      write(progress_fd, &written, sizeof(uint64_t));
+    }
+    return 0;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    bitcask_t *bitcask = (bitcask_t*)db->storage;
+    if (bitcask_save(file, bitcask) < 0) {
+      return -1;
+    }
+    if (progress_fd >= 0) {
+      uint64_t written = bitcask->count;
+      write(progress_fd, &written, sizeof(uint64_t));
+    }
+    return 0;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    lsm_tree_t *lsm = (lsm_tree_t*)db->storage;
+    if (lsm_save(file, lsm) < 0) {
+      return -1;
+    }
+    if (progress_fd >= 0) {
+      uint64_t written = lsm_count(lsm);
+      write(progress_fd, &written, sizeof(uint64_t));
+    }
+    return 0;
+  }
+
+  kv_log(3, "Error: Invalid storage structure\n");
+  return -1;
+}
+
+static int64_t sync_parent_dir(uint8_t *file_path) {
+  if (file_path == NULL) {
+    kv_log(3, "Error: NULL pointer passed to sync_parent_dir\n");
+    return -1;
+  }
+
+  uint8_t dir_path[BG_BUFFER_SIZE];
+  uint8_t *separator = strrchr(file_path, '/');
+  if (separator == NULL) {
+    strcpy(dir_path, ".");
+  }
+  else if (separator == file_path) {
+    strcpy(dir_path, "/");
+  }
+  else {
+    uint64_t dir_len = separator - file_path;
+    if (dir_len >= BG_BUFFER_SIZE) {
+      kv_log(3, "Error: Directory path is too long\n");
+      return -1;
+    }
+    memcpy(dir_path, file_path, dir_len);
+    dir_path[dir_len] = '\0';
+  }
+
+  int32_t dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY);
+  if (dir_fd < 0) {
+    kv_log(3, "Error: Failed to open directory %s\n", dir_path);
+    return -1;
+  }
+
+  int64_t result = 0;
+  if (fsync(dir_fd) < 0) {
+    kv_log(3, "Error: Failed to sync directory %s\n", dir_path);
+    result = -1;
+  }
+  close(dir_fd);
+
+  return result;
+}
+
+static int64_t write_db_file(db_t *db, uint8_t *file_path, int32_t progress_fd) {
+  if (db == NULL || file_path == NULL) {
+    kv_log(3, "Error: NULL pointer passed to write_db_file\n");
+    return -1;
+  }
+
+  uint8_t tmp_path[BG_BUFFER_SIZE];
+  snprintf(tmp_path, BG_BUFFER_SIZE, "%s.tmp", file_path);
+  tmp_path[BG_BUFFER_SIZE - 1] = '\0';
+
+  FILE *new_file = fopen(tmp_path, "w");
+  if (new_file == NULL) {
+    kv_log(3, "Error: Failed to create temporary database file.\n");
+    return KV_IO;
+  }
+
+  int64_t result = KV_IO;
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_FROZEN) == 0) {
+    /* Frozen images are binary and carry their own checksum */
+    frozen_table_t *frozen = (frozen_table_t*)db->storage;
+    result = frozen_write(new_file, frozen) == 0 ? 0 : KV_IO;
+    if (result == 0 && progress_fd >= 0) {
+      uint64_t written = frozen->count;
+      write(progress_fd, &written, sizeof(uint64_t));
+    }
+  }
+  else {
+    FILE *stream = open_checksum_writer(new_file, KV_CHECKSUM_BLOCK_LINES);
+    if (stream != NULL) {
+      result = save_storage(stream, db, progress_fd);
+      if (fclose(stream) == EOF && result == 0) {
+        kv_log(3, "Error: Failed to write the checksums of the temporary database file\n");
+        result = KV_IO;
+      }
+    }
+  }
+
+  if (result == 0 && fflush(new_file) == EOF) {
+    kv_log(3, "Error: Failed to flush the temporary database file\n");
+    result = KV_IO;
+  }
+
+  int64_t written = result == 0 ? ftell(new_file) : -1;
+
+  if (result == 0 &&
+      db->durability == DB_DURABILITY_SYNC &&
+      fsync(fileno(new_file)) < 0) {
+    kv_log(3, "Error: Failed to sync the temporary database file\n");
+    result = KV_IO;
+  }
+
+  if (fclose(new_file) == EOF && result == 0) {
+    kv_log(3, "Error: Failed to close the temporary database file\n");
+    result = KV_IO;
+  }
+
+  if (result < 0) {
+    kv_log(3, "Error: Failed to save database to a file\n");
+    remove(tmp_path);
+    return result;
+  }
+
+  if (rename(tmp_path, file_path) < 0) {
+    kv_log(3, "Error: Failed to replace %s with the saved database\n", file_path);
+    remove(tmp_path);
+    return KV_IO;
+  }
+
+  if (db->durability == DB_DURABILITY_SYNC && sync_parent_dir(file_path) < 0) {
+    return KV_IO;
+  }
+
+  if (written > 0) {
+    kv_stats_add(db->stats, DB_STATS_BYTES_WRITTEN, written);
+  }
+  return 0;
+}
+
+static uint64_t count_entries(db_t *db) {
+  if (db == NULL) return 0;
+
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LIST) == 0) {
+    return ((list_t*)db->storage)->size;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) == 0) {
+    return ((hash_table_t*)db->storage)->count;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_CUCKOO) == 0) {
+    return ((cuckoo_table_t*)db->storage)->count;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_FROZEN) == 0) {
+    return ((frozen_table_t*)db->storage)->count;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    return ((bitcask_t*)db->storage)->count;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    return lsm_count((lsm_tree_t*)db->storage);
+  }
+  return 0;
+}
+
+static int64_t tracked_entries(db_t *db) {
+  /* Counting the entries of an LSM tree takes a full scan */
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    return -1;
+  }
+  return count_entries(db);
+}
+
+static uint64_t elapsed_us_since(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000 +
+         (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void *watch_snapshot(void *arg) {
+  db_snapshot_t *snapshot = (db_snapshot_t*)arg;
+
+  uint64_t written;
+  while (read(snapshot->progress_fd, &written, sizeof(uint64_t)) == sizeof(uint64_t)) {
+    snapshot->status.entries_written = written;
+    snapshot->status.elapsed_us = elapsed_us_since(&snapshot->start);
+    if (snapshot->callback != NULL) {
+      snapshot->callback(&snapshot->status, snapshot->context);
+    }
+  }
+  close(snapshot->progress_fd);
+
+  int32_t exit_status;
+  pid_t pid;
+  do {
+    pid = waitpid(snapshot->pid, &exit_status, 0);
+  } while (pid < 0 && errno == EINTR);
+
+  if (pid < 0 || !WIFEXITED(exit_status) || WEXITSTATUS(exit_status) != 0) {
+    kv_log(3, "Error: Background snapshot process failed\n");
+    snapshot->status.result = -1;
+  }
+  else {
+    snapshot->status.result = 0;
+  }
+  snapshot->status.done = true;
+  snapshot->status.elapsed_us = elapsed_us_since(&snapshot->start);
+  if (snapshot->callback != NULL) {
+    snapshot->callback(&snapshot->status, snapshot->context);
+  }
+  snapshot->finished = true;
+
+  return NULL;
+}
+
 extern db_t *create_db(uint8_t *storage_type) {
+  return create_db_with_allocator(storage_type, NULL);
+}
+
+extern db_t *create_db_with_allocator(uint8_t *storage_type, const kv_allocator_t *allocator) {
   if (storage_type == NULL) {
-    logger(3, "Error: storage_type parameter is NULL\n");
+    kv_log(3, "Error: storage_type parameter is NULL\n");
     return NULL;
   }
 
   if (strlen(storage_type) == 0) {
-    logger(3, "Error: storage_type parameter is empty\n");
+    kv_log(3, "Error: storage_type parameter is empty\n");
     return NULL;
   }
   
-  db_t *db = malloc(sizeof(db_t));
+  /* The db_t holds the accounting, so it is not counted in it */
+  kv_memory_t memory;
+  if (kv_memory_init(&memory, allocator) < 0) {
+    return NULL;
+  }
+
+  db_t *db = kv_alloc(&memory, KV_ALLOC_BUFFERS, sizeof(db_t));
   if (db == NULL) {
-    logger(3, "Error: Failed to allocate memory for db_t\n");
+    kv_log(3, "Error: Failed to allocate memory for db_t\n");
     return NULL;
   }
+  kv_memory_init(&db->memory, allocator);
   strncpy(db->storage_type, storage_type, SM_BUFFER_SIZE);
   db->storage_type[SM_BUFFER_SIZE-1] = '\0';
+  db->snapshot = NULL;
+  db->durability = DB_DURABILITY_SYNC;
+  db->load_mode = DB_LOAD_EAGER;
+  db->mappings = NULL;
+  memset(&db->load_report, 0, sizeof(db_load_report_t));
+  db->trace = NULL;
+
+  db->stats = create_stats();
+  if (db->stats == NULL) {
+    free_db_struct(db);
+    return NULL;
+  }
 
   if(strcmp(storage_type, KV_STORAGE_STRUCTURE_LIST) == 0) {
-    db->storage = create_list();
+    db->storage = create_list(&db->memory, KV_ALLOC_BUFFERS);
   }
   else if(strcmp(storage_type, KV_STORAGE_STRUCTURE_HASH) == 0) {
-    db->storage = create_hash_table(KV_STORAGE_HASH_SIZE);
+    db->storage = create_hash_table(KV_STORAGE_HASH_SIZE, &db->memory);
+  }
+  else if(strcmp(storage_type, KV_STORAGE_STRUCTURE_CUCKOO) == 0) {
+    db->storage = create_cuckoo_table(&db->memory);
+  }
+  else if(strcmp(storage_type, KV_STORAGE_STRUCTURE_FROZEN) == 0) {
+    db->storage = create_frozen_table(&db->memory);
+  }
+  else if(strcmp(storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    db->storage = create_bitcask();
+  }
+  else if(strcmp(storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    db->storage = create_lsm_tree();
   }
   else {
     db->storage = NULL;
   }
 
   if (db->storage == NULL) {
-    logger(3, "Error: Failed to create storage structure\n");
+    kv_log(3, "Error: Failed to create storage structure\n");
     free_db(db);
     return NULL;
   }
@@ -38,95 +341,559 @@ extern db_t *create_db(uint8_t *storage_type) {
   return db;
 }
 
+static void free_block(db_t *db, db_load_block_t *block) {
+  for (uint64_t idx = 0; idx < block->entry_count; idx++) {
+    free_entry(block->entries[idx]);
+  }
+  block->entry_count = 0;
+  kv_free(&db->memory, KV_ALLOC_BUFFERS, block->entries, block->capacity * sizeof(db_entry_t*));
+  block->entries = NULL;
+  block->capacity = 0;
+}
+
+static int64_t finish_block(db_t *db, db_load_block_t *block, bool intact) {
+  bool recover = (db->load_mode & DB_LOAD_RECOVER) != 0;
+  uint64_t last_line = block->line_number - 1;
+  db_load_report_t *report = &db->load_report;
+  int64_t result = 0;
+
+  if (!intact) {
+    if (recover) {
+      kv_log(4, "Warning: Skipping corrupt block at lines %lu-%lu\n", block->first_line, last_line);
+    }
+    else {
+      kv_log(3, "Error: Checksum mismatch in the block at lines %lu-%lu\n", block->first_line, last_line);
+      result = KV_IO;
+    }
+    report->corrupt_blocks++;
+    report->lines_skipped += block->lines;
+    if (report->first_corrupt_line == 0) {
+      report->first_corrupt_line = block->first_line;
+    }
+  }
+  else if (block->malformed > 0) {
+    if (recover) {
+      kv_log(4, "Warning: Skipping %lu malformed lines at lines %lu-%lu\n",
+             block->malformed, block->first_line, last_line);
+    }
+    else {
+      kv_log(3, "Error: Malformed line %lu\n", block->first_malformed);
+      result = KV_IO;
+    }
+    report->lines_skipped += block->malformed;
+    if (report->first_corrupt_line == 0) {
+      report->first_corrupt_line = block->first_malformed;
+    }
+  }
+
+  if (intact && block->checksummed) {
+    report->blocks_verified++;
+  }
+
+  uint64_t idx = 0;
+  for (; idx < block->entry_count && result == 0 && intact; idx++) {
+    result = insert_entry(db, block->entries[idx]);
+    if (result < 0) {
+      kv_log(3, "Error: Failed to insert entry into storage\n");
+      break;
+    }
+  }
+  for (; idx < block->entry_count; idx++) {
+    free_entry(block->entries[idx]);
+  }
+
+  block->entry_count = 0;
+  block->lines = 0;
+  block->malformed = 0;
+  block->crc = 0;
+  block->first_line = block->line_number;
+  return result;
+}
+
+static int64_t load_line(db_t *db, db_load_block_t *block, kv_tokens_t *tokens) {
+  uint64_t line_number = block->line_number++;
+  uint8_t *line = tokens->line.ptr;
+  uint64_t len = tokens->line.len;
+
+  uint32_t crc;
+  uint64_t lines;
+  int64_t checksum = parse_checksum_line(line, len, &crc, &lines);
+  if (checksum != 0) {
+    if (checksum < 0) {
+      kv_log(3, "Error: Damaged checksum line %lu\n", line_number);
+    }
+    block->checksummed = true;
+    return finish_block(db, block, checksum > 0 && crc == block->crc && lines == block->lines);
+  }
+
+  block->crc = crc32c(block->crc, line, len);
+  block->lines++;
+  if (line[0] == '\n' || line[0] == '#') {
+    return 0;
+  }
+
+  db_entry_t *entry = parse_tokens(tokens, (db->load_mode & DB_LOAD_LAZY) != 0, &db->memory);
+  if (entry == NULL) {
+    kv_log(3, "Error: Failed to parse line %lu\n", line_number);
+    if (block->malformed++ == 0) {
+      block->first_malformed = line_number;
+    }
+    return 0;
+  }
+
+  if (block->entry_count == block->capacity) {
+    uint64_t capacity = block->capacity == 0 ? KV_CHECKSUM_BLOCK_LINES : block->capacity * 2;
+    db_entry_t **entries = kv_realloc(&db->memory, KV_ALLOC_BUFFERS, block->entries,
+                                      block->capacity * sizeof(db_entry_t*), capacity * sizeof(db_entry_t*));
+    if (entries == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for the entries of a block\n");
+      free_entry(entry);
+      return KV_OOM;
+    }
+    block->entries = entries;
+    block->capacity = capacity;
+  }
+  block->entries[block->entry_count++] = entry;
+  return 0;
+}
+
+static int64_t finish_load(db_t *db, db_load_block_t *block) {
+  int64_t result = 0;
+  if (block->lines > 0) {
+    if (block->checksummed) {
+      /* A checksummed file ends with a checksum line, the tail is a torn write */
+      kv_log(3, "Error: Lines %lu-%lu are not covered by a checksum\n",
+             block->first_line, block->line_number - 1);
+    }
+    result = finish_block(db, block, !block->checksummed);
+  }
+
+  free_block(db, block);
+  return result;
+}
+
+static int64_t load_db_mapped(db_t *db, int32_t fd) {
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0) {
+    kv_log(3, "Error: Failed to stat the database file\n");
+    return KV_IO;
+  }
+
+  if (file_stat.st_size == 0) {
+    return 0;
+  }
+
+  uint8_t *addr = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) {
+    kv_log(3, "Error: Failed to map the database file\n");
+    return KV_IO;
+  }
+
+  /* Lazy entries point into the mapping until they are materialized */
+  db_mapping_t *mapping = kv_alloc(&db->memory, KV_ALLOC_BUFFERS, sizeof(db_mapping_t));
+  if (mapping == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for db_mapping_t\n");
+    munmap(addr, file_stat.st_size);
+    return KV_OOM;
+  }
+  mapping->addr = addr;
+  mapping->size = file_stat.st_size;
+  mapping->next = db->mappings;
+  db->mappings = mapping;
+  madvise(addr, file_stat.st_size, MADV_SEQUENTIAL);
+
+  kv_tokenizer_t *tokenizer = kv_alloc(&db->memory, KV_ALLOC_BUFFERS, sizeof(kv_tokenizer_t));
+  if (tokenizer == NULL || tokenizer_init(tokenizer, addr, file_stat.st_size) < 0) {
+    kv_log(3, "Error: Failed to allocate memory for kv_tokenizer_t\n");
+    kv_free(&db->memory, KV_ALLOC_BUFFERS, tokenizer, sizeof(kv_tokenizer_t));
+    return KV_OOM;
+  }
+
+  db_load_block_t block = { .first_line = 1, .line_number = 1 };
+  kv_tokens_t tokens;
+  int64_t result = 0;
+  while (result == 0 && tokenizer_next(tokenizer, &tokens) == 1) {
+    result = load_line(db, &block, &tokens);
+    if (result < 0) {
+      free_block(db, &block);
+    }
+  }
+  kv_free(&db->memory, KV_ALLOC_BUFFERS, tokenizer, sizeof(kv_tokenizer_t));
+
+  if (result == 0) {
+    result = finish_load(db, &block);
+  }
+
+  /* Values are now read in key order of use, not file order */
+  madvise(addr, file_stat.st_size, MADV_RANDOM);
+  return result;
+}
+
+static int64_t load_db_stream(db_t *db, int32_t fd) {
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  kv_reader_t *reader = create_reader(fd, KV_READER_BUFFER_SIZE, &db->memory);
+  if (reader == NULL) {
+    kv_log(3, "Error: Failed to create a reader for the database file\n");
+    return KV_OOM;
+  }
+
+  db_load_block_t block = { .first_line = 1, .line_number = 1 };
+  kv_tokens_t tokens;
+  int64_t result = 0;
+  int64_t next = 0;
+  while (result == 0 && (next = reader_next(reader, &tokens)) == 1) {
+    result = load_line(db, &block, &tokens);
+    if (result < 0) {
+      free_block(db, &block);
+    }
+  }
+  free_reader(reader);
+
+  if (result == 0 && next < 0) {
+    free_block(db, &block);
+    result = KV_IO;
+  }
+
+  if (result == 0) {
+    result = finish_load(db, &block);
+  }
+  return result;
+}
+
+static int64_t load_db_file(db_t *db, uint8_t *file_path) {
+  if (db == NULL || file_path == NULL) {
+    kv_log(3, "Error: NULL pointer passed to load_db_file\n");
+    return -1;
+  }
+
+  int32_t fd = open(file_path, O_RDONLY);
+  if (fd < 0) {
+    kv_log(3, "Error: Failed to read the database file.\n");
+    return KV_IO;
+  }
+
+  int64_t result = (db->load_mode & DB_LOAD_LAZY) != 0 ?
+                   load_db_mapped(db, fd) :
+                   load_db_stream(db, fd);
+
+  struct stat file_stat;
+  if (result == 0 && fstat(fd, &file_stat) == 0) {
+    kv_stats_add(db->stats, DB_STATS_BYTES_READ, file_stat.st_size);
+  }
+  close(fd);
+  return result;
+}
+
 extern int64_t load_db(db_t *db, uint8_t *file_path) {
   if (db == NULL || file_path == NULL) {
-    logger(3, "Error: NULL pointer passed to load_db\n");
+    kv_log(3, "Error: NULL pointer passed to load_db\n");
     return -1;
   }
 
   if (strlen(file_path) == 0) {
-    logger(3, "Error: Empty string passed to load_db\n");
+    kv_log(3, "Error: Empty string passed to load_db\n");
+    return -1;
+  }
+  
+  uint64_t start = kv_stats_clock();
+  int64_t result;
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    result = bitcask_open((bitcask_t*)db->storage, file_path);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    result = lsm_open((lsm_tree_t*)db->storage, file_path);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_FROZEN) == 0) {
+    frozen_table_t *frozen = (frozen_table_t*)db->storage;
+    result = frozen_open(frozen, file_path);
+    if (result == KV_OK) {
+      kv_stats_add(db->stats, DB_STATS_BYTES_READ, frozen->size);
+    }
+  }
+  else {
+    memset(&db->load_report, 0, sizeof(db_load_report_t));
+    result = load_db_file(db, file_path);
+  }
+
+  kv_stats_latency(db->stats, DB_STATS_LOAD, start);
+  return result;
+}
+
+extern int64_t save_db(db_t *db, uint8_t *file_path) {
+  if (db == NULL || file_path == NULL) {
+    kv_log(3, "Error: NULL pointer passed to save_db\n");
     return -1;
   }
   
-  FILE *db_file = fopen(file_path, "r");
-  if (db_file == NULL) {
-    logger(3, "Error: Failed to read the database file.\n");
+  if (strlen(file_path) == 0) {
+    kv_log(3, "Error: Empty string passed to save_db\n");
     return -1;
   }
 
-  uint8_t line_buffer[BG_BUFFER_SIZE];
-  while (fgets(line_buffer, BG_BUFFER_SIZE, db_file) != NULL) {
-    db_entry_t *entry = parse_line(line_buffer);
-    if (entry == NULL) {
-      logger(3, "Error: Failed to create entry object\n");
-      return -1;
-    }
+  uint64_t start = kv_stats_clock();
+  int64_t result;
+  bitcask_t *bitcask = (bitcask_t*)db->storage;
+  lsm_tree_t *lsm = (lsm_tree_t*)db->storage;
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0 &&
+      bitcask->attached && strcmp(bitcask->dir, file_path) == 0) {
+    result = bitcask_sync(bitcask);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0 &&
+           lsm->attached && strcmp(lsm->dir, file_path) == 0) {
+    result = lsm_sync(lsm);
+  }
+  else {
+    result = write_db_file(db, file_path, -1);
+  }
 
-    if (insert_entry(db, entry) < 0) {
-      logger(3, "Error: Failed to insert entry into storage\n");
-      return -1;
-    }
+  kv_stats_latency(db->stats, DB_STATS_SAVE, start);
+  return result;
+}
+
+extern int64_t set_db_durability(db_t *db, int64_t durability) {
+  if (db == NULL) {
+    kv_log(3, "Error: NULL pointer passed to set_db_durability\n");
+    return -1;
   }
 
-  if (fclose(db_file) == EOF) {
-    logger(3, "Error: Failed to close the database file\n");
+  if (durability != DB_DURABILITY_RELAXED && durability != DB_DURABILITY_SYNC) {
+    kv_log(3, "Error: Invalid durability mode %ld\n", durability);
     return -1;
   }
 
+  db->durability = durability;
   return 0;
 }
 
-extern int64_t save_db(db_t *db, uint8_t *file_path) {
+extern int64_t set_db_load_mode(db_t *db, int64_t load_mode) {
+  if (db == NULL) {
+    kv_log(3, "Error: NULL pointer passed to set_db_load_mode\n");
+    return -1;
+  }
+
+  if ((load_mode & ~(DB_LOAD_LAZY | DB_LOAD_RECOVER)) != 0) {
+    kv_log(3, "Error: Invalid load mode %ld\n", load_mode);
+    return -1;
+  }
+
+  db->load_mode = load_mode;
+  return 0;
+}
+
+extern int64_t save_db_async(db_t *db, uint8_t *file_path, db_snapshot_callback_t callback, void *context) {
   if (db == NULL || file_path == NULL) {
-    logger(3, "Error: NULL pointer passed to save_db\n");
+    kv_log(3, "Error: NULL pointer passed to save_db_async\n");
     return -1;
   }
-  
+
   if (strlen(file_path) == 0) {
-    logger(3, "Error: Empty string passed to save_db\n");
+    kv_log(3, "Error: Empty string passed to save_db_async\n");
     return -1;
   }
 
-  uint8_t tmp_path[BG_BUFFER_SIZE];
-  snprintf(tmp_path, BG_BUFFER_SIZE, "%s.tmp", file_path);
-  tmp_path[BG_BUFFER_SIZE - 1] = '\0';
-  
-  FILE *new_file = fopen(tmp_path, "w");
-  if (new_file == NULL) {
-    logger(3, "Error: Failed to create temporary database file.\n");
-    fclose(new_file);
+  if (db->snapshot != NULL && db->snapshot->finished) {
+    wait_db_snapshot(db);
+  }
+
+  if (db->snapshot != NULL) {
+    kv_log(3, "Error: A snapshot of this database is already running\n");
     return -1;
   }
 
-  int64_t result;
+  db_snapshot_t *snapshot = kv_calloc(&db->memory, KV_ALLOC_BUFFERS, sizeof(db_snapshot_t));
+  if (snapshot == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for snapshot\n");
+    return -1;
+  }
+  snapshot->callback = callback;
+  snapshot->context = context;
+  snapshot->status.entries_total = count_entries(db);
+  clock_gettime(CLOCK_MONOTONIC, &snapshot->start);
+
+  int32_t progress_pipe[2];
+  if (pipe(progress_pipe) < 0) {
+    kv_log(3, "Error: Failed to create snapshot progress pipe\n");
+    kv_free(&db->memory, KV_ALLOC_BUFFERS, snapshot, sizeof(db_snapshot_t));
+    return -1;
+  }
+
+  /* The child must not inherit a storage lock held by a background thread */
+  pthread_mutex_t *storage_lock = NULL;
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    storage_lock = &((bitcask_t*)db->storage)->lock;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    storage_lock = &((lsm_tree_t*)db->storage)->lock;
+  }
+  if (storage_lock != NULL) {
+    pthread_mutex_lock(storage_lock);
+  }
+
+  fflush(NULL);
+  pid_t pid = fork();
+  if (storage_lock != NULL) {
+    pthread_mutex_unlock(storage_lock);
+  }
+  if (pid < 0) {
+    kv_log(3, "Error: Failed to fork snapshot process\n");
+    close(progress_pipe[0]);
+    close(progress_pipe[1]);
+    kv_free(&db->memory, KV_ALLOC_BUFFERS, snapshot, sizeof(db_snapshot_t));
+    return -1;
+  }
+
+  if (pid == 0) {
+    close(progress_pipe[0]);
+    _exit(write_db_file(db, file_path, progress_pipe[1]) < 0 ? 1 : 0);
+  }
+
+  close(progress_pipe[1]);
+  snapshot->pid = pid;
+  snapshot->progress_fd = progress_pipe[0];
+
+  if (pthread_create(&snapshot->watcher, NULL, watch_snapshot, snapshot) != 0) {
+    kv_log(3, "Error: Failed to start snapshot watcher thread\n");
+    close(snapshot->progress_fd);
+    waitpid(pid, NULL, 0);
+    kv_free(&db->memory, KV_ALLOC_BUFFERS, snapshot, sizeof(db_snapshot_t));
+    return -1;
+  }
+
+  db->snapshot = snapshot;
+  return 0;
+}
+
+extern int64_t wait_db_snapshot(db_t *db) {
+  if (db == NULL) {
+    kv_log(3, "Error: NULL pointer passed to wait_db_snapshot\n");
+    return -1;
+  }
+
+  if (db->snapshot == NULL) return 0;
+
+  pthread_join(db->snapshot->watcher, NULL);
+  int64_t result = db->snapshot->status.result;
+  kv_free(&db->memory, KV_ALLOC_BUFFERS, db->snapshot, sizeof(db_snapshot_t));
+  db->snapshot = NULL;
+
+  return result;
+}
+
+extern int64_t compact_db(db_t *db) {
+  if (db == NULL) {
+    kv_log(3, "Error: NULL pointer passed to compact_db\n");
+    return -1;
+  }
+
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    return bitcask_merge((bitcask_t*)db->storage);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    return lsm_compact((lsm_tree_t*)db->storage);
+  }
+
+  kv_log(3, "Error: Storage structure %s does not support compaction\n", db->storage_type);
+  return -1;
+}
+
+extern int64_t scan_db(db_t *db, uint8_t *start_key, uint8_t *end_key,
+                       db_scan_callback_t callback, void *context) {
+  if (db == NULL || callback == NULL) {
+    kv_log(3, "Error: NULL pointer passed to scan_db\n");
+    return -1;
+  }
+
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    return lsm_scan((lsm_tree_t*)db->storage, start_key, end_key, callback, context);
+  }
+
+  kv_log(3, "Error: Storage structure %s does not support ordered scans\n", db->storage_type);
+  return -1;
+}
+
+static uint64_t collect_entries(db_t *db, db_entry_t **entries) {
+  uint64_t count = 0;
   if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LIST) == 0) {
-    result = list_save(new_file, (list_t*)db->storage);
+    for (node_t *node = ((list_t*)db->storage)->head; node != NULL; node = node->next) {
+      entries[count++] = node->entry;
+    }
   }
   else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) == 0) {
-    result = hash_save(new_file, (hash_table_t*)db->storage);
+    hash_table_t *hash = (hash_table_t*)db->storage;
+    for (uint64_t idx = 0; idx < hash->size; idx++) {
+      for (node_t *node = hash->content[idx]->head; node != NULL; node = node->next) {
+        entries[count++] = node->entry;
+      }
+    }
   }
-  else {
-    logger(3, "Error: Invalid storage structure\n");
-    result = -1;
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_CUCKOO) == 0) {
+    cuckoo_table_t *cuckoo = (cuckoo_table_t*)db->storage;
+    cuckoo_array_t *array = atomic_load(&cuckoo->array);
+    for (uint64_t bucket = 0; bucket <= array->mask; bucket++) {
+      for (uint64_t slot = 0; slot < KV_CUCKOO_BUCKET_SLOTS; slot++) {
+        db_entry_t *entry = atomic_load_explicit(&array->buckets[bucket].entries[slot], memory_order_acquire);
+        if (entry != NULL) {
+          entries[count++] = entry;
+        }
+      }
+    }
+    for (uint64_t slot = 0; slot < KV_CUCKOO_STASH_SIZE; slot++) {
+      db_entry_t *entry = atomic_load_explicit(&cuckoo->stash[slot], memory_order_acquire);
+      if (entry != NULL) {
+        entries[count++] = entry;
+      }
+    }
   }
+  return count;
+}
 
-  fclose(new_file);
-  
-  if (result < 0) {
-    logger(3, "Error: Failed to save database to a file");
+extern int64_t freeze_db(db_t *db) {
+  if (db == NULL) {
+    kv_log(3, "Error: NULL pointer passed to freeze_db\n");
+    return KV_ERROR;
   }
-  else {
-    remove(file_path);
-    rename(tmp_path, file_path);
+
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_FROZEN) == 0) {
+    return KV_OK;
   }
-  
-  return result;
+
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LIST) != 0 &&
+      strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) != 0 &&
+      strcmp(db->storage_type, KV_STORAGE_STRUCTURE_CUCKOO) != 0) {
+    kv_log(3, "Error: Storage structure %s can not be frozen\n", db->storage_type);
+    return KV_ERROR;
+  }
+
+  uint64_t count = count_entries(db);
+  uint64_t entries_size = (count > 0 ? count : 1) * sizeof(db_entry_t*);
+  db_entry_t **entries = kv_alloc(&db->memory, KV_ALLOC_BUFFERS, entries_size);
+  frozen_table_t *frozen = create_frozen_table(&db->memory);
+  if (entries == NULL || frozen == NULL) {
+    kv_log(3, "Error: Failed to allocate memory to freeze the database\n");
+    kv_free(&db->memory, KV_ALLOC_BUFFERS, entries, entries_size);
+    free_frozen_table(frozen);
+    return KV_OOM;
+  }
+
+  int64_t result = frozen_build(frozen, entries, collect_entries(db, entries));
+  kv_free(&db->memory, KV_ALLOC_BUFFERS, entries, entries_size);
+  if (result < 0) {
+    kv_log(3, "Error: Failed to freeze the database\n");
+    free_frozen_table(frozen);
+    return result;
+  }
+
+  /* The values were copied into the frozen image, the old storage goes */
+  free_storage(db);
+  db->storage = frozen;
+  strcpy(db->storage_type, KV_STORAGE_STRUCTURE_FROZEN);
+  return KV_OK;
 }
 
 extern int64_t insert_entry(db_t *db, db_entry_t *entry) {
   if (db == NULL || entry == NULL) {
-    logger(3, "Error: NULL pointer passed to insert_entry\n");
+    kv_log(3, "Error: NULL pointer passed to insert_entry\n");
     return -1;
   }
   
@@ -137,13 +904,29 @@ extern int64_t insert_entry(db_t *db, db_entry_t *entry) {
   else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) == 0) {
     result = hash_insert((hash_table_t*)db->storage, entry);
   }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_CUCKOO) == 0) {
+    result = cuckoo_insert((cuckoo_table_t*)db->storage, entry);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_FROZEN) == 0) {
+    kv_log(3, "Error: Frozen databases are read-only\n");
+    result = KV_READ_ONLY;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    result = bitcask_insert((bitcask_t*)db->storage, entry);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    result = lsm_insert((lsm_tree_t*)db->storage, entry);
+  }
   else {
-    logger(3, "Error: Invalid storage structure\n");
-    result = -1;
+    kv_log(3, "Error: Invalid storage structure\n");
+    result = KV_ERROR;
   }
 
-  if (result < 0) {
-    logger(3, "Error: Failed to insert entry to storage\n");
+  if (result == KV_OK) {
+    kv_stats_add(db->stats, DB_STATS_INSERTS, 1);
+  }
+  else if (result != KV_EXISTS) {
+    kv_log(3, "Error: Failed to insert entry to storage\n");
   }
 
   return result;
@@ -151,118 +934,264 @@ extern int64_t insert_entry(db_t *db, db_entry_t *entry) {
 
 extern int64_t put_entry(db_t *db, uint8_t *key, uint8_t *value, uint8_t *type) {
   if (db == NULL || key == NULL || value == NULL || type == NULL) {
-    logger(3, "Error: NULL pointer passed to put_entry\n");
+    kv_log(3, "Error: NULL pointer passed to put_entry\n");
+    return -1;
+  }
+
+  return put_entry_span(db, key, value, strlen(value), type);
+}
+
+extern int64_t put_entry_span(db_t *db, uint8_t *key, uint8_t *value, uint64_t len, uint8_t *type) {
+  if (db == NULL || key == NULL || value == NULL || type == NULL) {
+    kv_log(3, "Error: NULL pointer passed to put_entry_span\n");
     return -1;
   }
 
-  if (strlen(key) == 0 || strlen(value) == 0) {
-    logger(3, "Error: Empty string passed to put_entry\n");
+  if (strlen(key) == 0) {
+    kv_log(3, "Error: Empty string passed to put_entry_span\n");
     return -1;
   }
   
-  uint64_t result;
+  uint64_t start = kv_stats_clock();
+  int64_t previous_count = KV_STATS_ENABLED ? tracked_entries(db) : -1;
+  int64_t result;
   if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LIST) == 0) {
-    result = list_put((list_t*)db->storage, key, value, type);
+    result = list_put((list_t*)db->storage, key, value, len, type);
   }
   else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) == 0) {
-    result = hash_put((hash_table_t*)db->storage, key, value, type);
+    result = hash_put((hash_table_t*)db->storage, key, value, len, type);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_CUCKOO) == 0) {
+    result = cuckoo_put((cuckoo_table_t*)db->storage, key, value, len, type);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_FROZEN) == 0) {
+    kv_log(3, "Error: Frozen databases are read-only\n");
+    result = KV_READ_ONLY;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    result = bitcask_put((bitcask_t*)db->storage, key, value, len, type);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    result = lsm_put((lsm_tree_t*)db->storage, key, value, len, type);
   }
   else {
-    logger(3, "Error: Invalid storage structure\n");
-    result = -1;
+    kv_log(3, "Error: Invalid storage structure\n");
+    result = KV_ERROR;
   }
 
-  if (result < 0) {
-    logger(3, "Error: Failed to put entry into storage\n");
+  if (result == KV_OK) {
+    /* Puts to an LSM tree are blind writes, they are counted as updates */
+    bool created = previous_count >= 0 && tracked_entries(db) > previous_count;
+    kv_stats_add(db->stats, created ? DB_STATS_INSERTS : DB_STATS_UPDATES, 1);
+    kv_stats_add(db->stats, DB_STATS_BYTES_WRITTEN, len);
+  }
+  else if (result != KV_NOT_FOUND) {
+    kv_log(3, "Error: Failed to put entry into storage\n");
   }
 
+  kv_stats_latency(db->stats, DB_STATS_PUT, start);
+  trace_op(db, KV_TRACE_PUT, result, key, value, len, type, start);
   return result;
 }
 
 extern int64_t delete_entry(db_t *db, uint8_t *key) {
   if (db == NULL || key == NULL) {
-    logger(3, "Error: NULL pointer passed to delete_entry\n");
+    kv_log(3, "Error: NULL pointer passed to delete_entry\n");
     return -1;
   }
 
   if (strlen(key) == 0) {
-    logger(3, "Error: Empty string passed to delete_entry\n");
+    kv_log(3, "Error: Empty string passed to delete_entry\n");
     return -1;
   }
   
-  uint64_t result;
+  uint64_t start = kv_stats_clock();
+  int64_t result;
   if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LIST) == 0) {
     result = list_delete((list_t*)db->storage, key);
   }
   else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) == 0) {
     result = hash_delete((hash_table_t*)db->storage, key);
   }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_CUCKOO) == 0) {
+    result = cuckoo_delete((cuckoo_table_t*)db->storage, key);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_FROZEN) == 0) {
+    kv_log(3, "Error: Frozen databases are read-only\n");
+    result = KV_READ_ONLY;
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    result = bitcask_delete((bitcask_t*)db->storage, key);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    result = lsm_delete((lsm_tree_t*)db->storage, key);
+  }
   else {
-    logger(3, "Error: Invalid storage structure\n");
-    result = -1;
+    kv_log(3, "Error: Invalid storage structure\n");
+    result = KV_ERROR;
   }
 
-  if (result < 0) {
-    logger(3, "Error: Failed to delete an entry from storage\n");
+  if (result < 0 && result != KV_NOT_FOUND) {
+    kv_log(3, "Error: Failed to delete an entry from storage\n");
   }
 
+  kv_stats_latency(db->stats, DB_STATS_DELETE, start);
+  trace_op(db, KV_TRACE_DELETE, result, key, NULL, 0, NULL, start);
   return result;
 }
 
+static db_entry_t* lookup_entry(db_t *db, uint8_t *key) {
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LIST) == 0) {
+    return list_get_entry_by_key((list_t*)db->storage, key);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) == 0) {
+    return hash_get_entry((hash_table_t*)db->storage, key);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_CUCKOO) == 0) {
+    return cuckoo_get_entry((cuckoo_table_t*)db->storage, key);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_FROZEN) == 0) {
+    return frozen_get_entry((frozen_table_t*)db->storage, key);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    return bitcask_get_entry((bitcask_t*)db->storage, key);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    return lsm_get_entry((lsm_tree_t*)db->storage, key);
+  }
+
+  kv_log(3, "Error: Invalid storage structure\n");
+  return NULL;
+}
+
+static void record_get(db_t *db, bool hit, uint64_t bytes, uint64_t start_ns) {
+  kv_stats_add(db->stats, hit ? DB_STATS_HITS : DB_STATS_MISSES, 1);
+  kv_stats_add(db->stats, DB_STATS_BYTES_READ, bytes);
+  kv_stats_latency(db->stats, DB_STATS_GET, start_ns);
+}
+
+static void trace_op(db_t *db, int64_t op, int64_t status, uint8_t *key,
+                     uint8_t *value, uint64_t len, uint8_t *type, uint64_t start_ns) {
+  if (db->trace == NULL) return;
+
+  /* Without statistics the operation was not timed, its end is recorded instead */
+  trace_record(db->trace, op, status, key, value, len, type, start_ns != 0 ? start_ns : stats_now_ns());
+}
+
 extern db_entry_t* get_entry(db_t *db, uint8_t *key) {
   if (db == NULL || key == NULL) {
-    logger(3, "Error: NULL pointer passed to get_entry\n");
+    kv_log(3, "Error: NULL pointer passed to get_entry\n");
     return NULL;
   }
 
   if (strlen(key) == 0) {
-    logger(3, "Error: Empty string passed to get_entry\n");
+    kv_log(3, "Error: Empty string passed to get_entry\n");
     return NULL;
   }
   
-  db_entry_t *entry;
-  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LIST) == 0) {
-    entry = list_get_entry_by_key((list_t*)db->storage, key);
+  /* A missing key is a normal outcome, it is not logged */
+  uint64_t start = kv_stats_clock();
+  db_entry_t *entry = lookup_entry(db, key);
+  if (entry != NULL && materialize_entry(entry) < 0) {
+    kv_log(3, "Error: Failed to parse the value of key \"%s\"\n", key);
+    entry = NULL;
   }
-  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) == 0) {
-    entry = hash_get_entry((hash_table_t*)db->storage, key);
+
+  record_get(db, entry != NULL, entry != NULL ? entry->size : 0, start);
+  trace_op(db, KV_TRACE_GET, entry != NULL ? KV_OK : KV_NOT_FOUND, key, NULL, 0, NULL, start);
+  return entry;
+}
+
+extern int64_t get_entry_span(db_t *db, uint8_t *key, kv_span_t *value) {
+  if (db == NULL || key == NULL || value == NULL) {
+    kv_log(3, "Error: NULL pointer passed to get_entry_span\n");
+    return KV_ERROR;
   }
-  else {
-    logger(3, "Error: Invalid storage structure\n");
-    entry = NULL;
+
+  if (strlen(key) == 0) {
+    kv_log(3, "Error: Empty string passed to get_entry_span\n");
+    return KV_ERROR;
   }
 
+  uint64_t start = kv_stats_clock();
+  db_entry_t *entry = lookup_entry(db, key);
   if (entry == NULL) {
-    logger(3, "Error: Failed to get entry from storage\n");
+    record_get(db, false, 0, start);
+    trace_op(db, KV_TRACE_GET, KV_NOT_FOUND, key, NULL, 0, NULL, start);
+    return KV_NOT_FOUND;
   }
 
-  return entry;
+  if (get_value_span(entry, value) < 0) {
+    kv_log(3, "Error: Failed to parse the value of key \"%s\"\n", key);
+    trace_op(db, KV_TRACE_GET, KV_TYPE_MISMATCH, key, NULL, 0, NULL, start);
+    return KV_TYPE_MISMATCH;
+  }
+
+  record_get(db, true, value->len, start);
+  trace_op(db, KV_TRACE_GET, KV_OK, key, NULL, 0, NULL, start);
+  return KV_OK;
 }
 
 extern void free_db(db_t *db) {
   if (db == NULL) return;
 
+  wait_db_snapshot(db);
+  close_trace(db->trace);
+
   if (db->storage == NULL) {
-    free(db);
+    free_stats(db->stats);
+    free_db_struct(db);
     return;
   };
 
+  free_storage(db);
+
+  /* Lazy entries point into the mappings, so they go after the storage */
+  db_mapping_t *mapping = db->mappings;
+  while (mapping != NULL) {
+    db_mapping_t *next = mapping->next;
+    munmap(mapping->addr, mapping->size);
+    kv_free(&db->memory, KV_ALLOC_BUFFERS, mapping, sizeof(db_mapping_t));
+    mapping = next;
+  }
+
+  free_stats(db->stats);
+  free_db_struct(db);
+}
+
+static void free_storage(db_t *db) {
   if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LIST) == 0) {
     free_list((list_t*)db->storage);
   }
   else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) == 0) {
     free_hash_table((hash_table_t*)db->storage);
   }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_CUCKOO) == 0) {
+    free_cuckoo_table((cuckoo_table_t*)db->storage);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_FROZEN) == 0) {
+    free_frozen_table((frozen_table_t*)db->storage);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    free_bitcask((bitcask_t*)db->storage);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    free_lsm_tree((lsm_tree_t*)db->storage);
+  }
   else {
     free(db->storage);
   }
+  db->storage = NULL;
+}
 
-  free(db);
+static void free_db_struct(db_t *db) {
+  kv_allocator_t allocator = db->memory.allocator;
+  allocator.free(allocator.context, db, sizeof(db_t));
 }
 
 extern void print_db(db_t *db) {
   if (db == NULL) {
-    logger(3, "Error: NULL pointer passed to print_db\n");
+    kv_log(3, "Error: NULL pointer passed to print_db\n");
     return;
   }
   printf("==================================================\n");
@@ -272,8 +1201,112 @@ extern void print_db(db_t *db) {
   else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) == 0) {
     hash_print((hash_table_t*)db->storage);
   }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_CUCKOO) == 0) {
+    cuckoo_print((cuckoo_table_t*)db->storage);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_FROZEN) == 0) {
+    frozen_print((frozen_table_t*)db->storage);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_BITCASK) == 0) {
+    bitcask_print((bitcask_t*)db->storage);
+  }
+  else if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_LSM) == 0) {
+    lsm_print((lsm_tree_t*)db->storage);
+  }
   else {
-    logger(3, "Error: Invalid storage structure\n");
+    kv_log(3, "Error: Invalid storage structure\n");
   }
   printf("==================================================\n");
 }
+
+extern int64_t db_stats(db_t *db, db_stats_t *out) {
+  if (db == NULL || out == NULL) {
+    kv_log(3, "Error: NULL pointer passed to db_stats\n");
+    return -1;
+  }
+
+  return stats_merge(db->stats, out);
+}
+
+extern int64_t write_db_stats(db_t *db, FILE *file) {
+  if (db == NULL || file == NULL) {
+    kv_log(3, "Error: NULL pointer passed to write_db_stats\n");
+    return -1;
+  }
+
+  db_stats_t *stats = kv_alloc(&db->memory, KV_ALLOC_BUFFERS, sizeof(db_stats_t));
+  if (stats == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for db_stats_t\n");
+    return KV_OOM;
+  }
+
+  int64_t result = stats_merge(db->stats, stats);
+  if (result == 0) {
+    result = write_stats_prometheus(file, stats) == 0 ? KV_OK : KV_IO;
+  }
+  kv_free(&db->memory, KV_ALLOC_BUFFERS, stats, sizeof(db_stats_t));
+  return result;
+}
+
+extern int64_t reset_db_stats(db_t *db) {
+  if (db == NULL) {
+    kv_log(3, "Error: NULL pointer passed to reset_db_stats\n");
+    return -1;
+  }
+
+  stats_reset(db->stats);
+  return 0;
+}
+
+extern int64_t start_db_trace(db_t *db, uint8_t *path) {
+  if (db == NULL || path == NULL) {
+    kv_log(3, "Error: NULL pointer passed to start_db_trace\n");
+    return KV_ERROR;
+  }
+
+  if (db->trace != NULL) {
+    kv_log(3, "Error: A trace of the database is already being recorded\n");
+    return KV_EXISTS;
+  }
+
+  db->trace = open_trace(path);
+  return db->trace != NULL ? KV_OK : KV_IO;
+}
+
+extern int64_t stop_db_trace(db_t *db) {
+  if (db == NULL) {
+    kv_log(3, "Error: NULL pointer passed to stop_db_trace\n");
+    return KV_ERROR;
+  }
+
+  if (db->trace == NULL) {
+    return KV_NOT_FOUND;
+  }
+
+  int64_t result = close_trace(db->trace);
+  db->trace = NULL;
+  return result == 0 ? KV_OK : KV_IO;
+}
+
+extern int64_t db_hash_stats(db_t *db, hash_stats_t *out) {
+  if (db == NULL || out == NULL) {
+    kv_log(3, "Error: NULL pointer passed to db_hash_stats\n");
+    return -1;
+  }
+
+  if (strcmp(db->storage_type, KV_STORAGE_STRUCTURE_HASH) != 0) {
+    kv_log(3, "Error: Storage structure %s is not a hash table\n", db->storage_type);
+    return -1;
+  }
+
+  return hash_stats((hash_table_t*)db->storage, out);
+}
+
+extern int64_t db_memory_usage(db_t *db, kv_memory_usage_t *out) {
+  if (db == NULL || out == NULL) {
+    kv_log(3, "Error: NULL pointer passed to db_memory_usage\n");
+    return -1;
+  }
+
+  return kv_memory_usage(&db->memory, out);
+}
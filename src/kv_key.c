@@ -0,0 +1,82 @@
+#include "kv_key.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static pthread_once_t key_compare_once = PTHREAD_ONCE_INIT;
+static bool (*key_equal)(const uint8_t *probe, const uint8_t *key);
+
+static bool key_equal_scalar(const uint8_t *probe, const uint8_t *key) {
+  uint64_t diff = 0;
+  for (uint64_t offset = 0; offset < SM_BUFFER_SIZE; offset += sizeof(uint64_t)) {
+    uint64_t left;
+    uint64_t right;
+    memcpy(&left, probe + offset, sizeof(uint64_t));
+    memcpy(&right, key + offset, sizeof(uint64_t));
+    diff |= left ^ right;
+  }
+  return diff == 0;
+}
+
+#if defined(__x86_64__)
+static bool key_equal_sse2(const uint8_t *probe, const uint8_t *key) {
+  __m128i low = _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)probe),
+                               _mm_loadu_si128((const __m128i*)key));
+  __m128i high = _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)(probe + 16)),
+                                _mm_loadu_si128((const __m128i*)(key + 16)));
+  return _mm_movemask_epi8(_mm_and_si128(low, high)) == 0xFFFF;
+}
+
+__attribute__((target("avx2")))
+static bool key_equal_avx2(const uint8_t *probe, const uint8_t *key) {
+  __m256i matches = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)probe),
+                                      _mm256_loadu_si256((const __m256i*)key));
+  return (uint32_t)_mm256_movemask_epi8(matches) == 0xFFFFFFFF;
+}
+#endif
+
+static void init_key_compare() {
+  key_equal = key_equal_scalar;
+#if defined(__x86_64__)
+  key_equal = key_equal_sse2;
+  if (__builtin_cpu_supports("avx2")) {
+    key_equal = key_equal_avx2;
+  }
+#endif
+}
+
+extern uint64_t kv_key_pad(uint8_t *dest, const uint8_t *key) {
+  uint64_t len = strnlen(key, SM_BUFFER_SIZE - 1);
+  if (dest != key) {
+    memcpy(dest, key, len);
+  }
+  memset(dest + len, 0, SM_BUFFER_SIZE - len);
+  return len;
+}
+
+extern uint64_t kv_key_hash(const uint8_t *key) {
+  uint64_t hash = 0;
+  for (uint64_t offset = 0; offset < SM_BUFFER_SIZE; offset += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, key + offset, sizeof(uint64_t));
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+extern bool kv_key_probe(kv_key_probe_t *probe, const uint8_t *key) {
+  pthread_once(&key_compare_once, init_key_compare);
+  probe->equal = key_equal;
+
+  /* Stored keys are truncated, a longer key must not match its prefix */
+  if (key[0] == '\0' || strnlen(key, SM_BUFFER_SIZE) == SM_BUFFER_SIZE) {
+    memset(probe->key, 0xFF, SM_BUFFER_SIZE);
+    probe->hash = 0;
+    return false;
+  }
+  kv_key_pad(probe->key, key);
+  probe->hash = kv_key_hash(probe->key);
+  return true;
+}
@@ -1,26 +1,26 @@
 #include "kv_parser.h"
 
-static int64_t set_integer_value(db_entry_t *dest, uint8_t *str_value, uint64_t type_size) {
+static int64_t set_integer_value(db_entry_t *dest, uint8_t *str_value, uint64_t len, uint64_t type_size) {
   if (dest == NULL || str_value == NULL) {
-    logger(3, "Error: NULL pointer passed to set_integer_value\n");
+    kv_log(3, "Error: NULL pointer passed to set_integer_value\n");
     return -1;
   }
 
-  if (strlen(str_value) == 0) {
-    logger(3, "Error: Empty string passed to set_integer_value\n");
+  if (len == 0) {
+    kv_log(3, "Error: Empty string passed to set_integer_value\n");
     return -1;
   }
   
-  uint64_t value;
-  if (str_to_int64(str_value, &value) < 0) {
-    logger(3, "Error: Failed to convert string to integer\n");
-    return -1;
+  int64_t value;
+  if (span_to_int64(str_value, len, &value) < 0) {
+    kv_log(3, "Error: Failed to convert string to integer\n");
+    return KV_TYPE_MISMATCH;
   }
   
-  dest->value = malloc(type_size);
+  dest->value = kv_alloc(dest->memory, KV_ALLOC_VALUES, type_size);
   if (dest->value == NULL) {
-    logger(3, "Error: Failed to allocate memory for value\n");
-    return -1;
+    kv_log(3, "Error: Failed to allocate memory for value\n");
+    return KV_OOM;
   }
   
   switch (type_size) {
@@ -37,35 +37,36 @@ static int64_t set_integer_value(db_entry_t *dest, uint8_t *str_value, uint64_t
     *(int64_t*)dest->value = (int64_t)value;
     break;
   default:
-    logger(3, "Invalid type size for int value\n");
-    free(dest->value);
+    kv_log(3, "Invalid type size for int value\n");
+    kv_free(dest->memory, KV_ALLOC_VALUES, dest->value, type_size);
+    dest->value = NULL;
     return -1;
   }
 
   return 0;
 }
 
-static int64_t set_float_value(db_entry_t *dest, uint8_t *str_value) {
+static int64_t set_float_value(db_entry_t *dest, uint8_t *str_value, uint64_t len) {
   if (dest == NULL || str_value == NULL) {
-    logger(3, "Error: NULL pointer passed to set_float_value\n");
+    kv_log(3, "Error: NULL pointer passed to set_float_value\n");
     return -1;
   }
 
-  if (strlen(str_value) == 0) {
-    logger(3, "Error: Empty string passed to set_float_value\n");
+  if (len == 0) {
+    kv_log(3, "Error: Empty string passed to set_float_value\n");
     return -1;
   }
   
   float value;
-  if (str_to_float(str_value, &value) < 0) {
-    logger(3, "Error: Failed to convert string to float\n");
-    return -1;
+  if (span_to_float(str_value, len, &value) < 0) {
+    kv_log(3, "Error: Failed to convert string to float\n");
+    return KV_TYPE_MISMATCH;
   }
   
-  dest->value = malloc(sizeof(float));
+  dest->value = kv_alloc(dest->memory, KV_ALLOC_VALUES, sizeof(float));
   if (dest->value == NULL) {
-    logger(3, "Error: Failed to allocate memory\n");
-    return -1;
+    kv_log(3, "Error: Failed to allocate memory\n");
+    return KV_OOM;
   }
   
   *(float*)dest->value = value;
@@ -73,27 +74,27 @@ static int64_t set_float_value(db_entry_t *dest, uint8_t *str_value) {
   return 0;
 }
 
-static int64_t set_double_value(db_entry_t *dest, uint8_t *str_value) {
+static int64_t set_double_value(db_entry_t *dest, uint8_t *str_value, uint64_t len) {
   if (dest == NULL || str_value == NULL) {
-    logger(3, "Error: NULL pointer passed to set_double_value\n");
+    kv_log(3, "Error: NULL pointer passed to set_double_value\n");
     return -1;
   }
 
-  if (strlen(str_value) == 0) {
-    logger(3, "Error: Empty string passed to set_double_value\n");
+  if (len == 0) {
+    kv_log(3, "Error: Empty string passed to set_double_value\n");
     return -1;
   }
   
   double value;
-  if (str_to_double(str_value, &value) < 0) {
-    logger(3, "Error: Failed to convert string to double\n");
-    return -1;
+  if (span_to_double(str_value, len, &value) < 0) {
+    kv_log(3, "Error: Failed to convert string to double\n");
+    return KV_TYPE_MISMATCH;
   }
   
-  dest->value = malloc(sizeof(double));
+  dest->value = kv_alloc(dest->memory, KV_ALLOC_VALUES, sizeof(double));
   if (dest->value == NULL) {
-    logger(3, "Error: Failed to allocate memory\n");
-    return -1;
+    kv_log(3, "Error: Failed to allocate memory\n");
+    return KV_OOM;
   }
   
   *(double*)dest->value = value;
@@ -101,27 +102,27 @@ static int64_t set_double_value(db_entry_t *dest, uint8_t *str_value) {
   return 0;
 }
 
-static int64_t set_bool_value(db_entry_t *dest, uint8_t *str_value) {
+static int64_t set_bool_value(db_entry_t *dest, uint8_t *str_value, uint64_t len) {
   if (dest == NULL || str_value == NULL) {
-    logger(3, "Error: NULL pointer passed to set_bool_value\n");
+    kv_log(3, "Error: NULL pointer passed to set_bool_value\n");
     return -1;
   }
 
-  if (strlen(str_value) == 0) {
-    logger(3, "Error: Empty string passed to set_bool_value\n");
+  if (len == 0) {
+    kv_log(3, "Error: Empty string passed to set_bool_value\n");
     return -1;
   }
   
   bool value;
-  if (str_to_bool(str_value, &value) < 0) {
-    logger(3, "Error: Failed to convert string to bool\n");
-    return -1;
+  if (span_to_bool(str_value, len, &value) < 0) {
+    kv_log(3, "Error: Failed to convert string to bool\n");
+    return KV_TYPE_MISMATCH;
   }
   
-  dest->value = malloc(sizeof(bool));
+  dest->value = kv_alloc(dest->memory, KV_ALLOC_VALUES, sizeof(bool));
   if (dest->value == NULL) {
-    logger(3, "Error: Failed to allocate memory\n");
-    return -1;
+    kv_log(3, "Error: Failed to allocate memory\n");
+    return KV_OOM;
   }
   
   *(bool*)dest->value = value;
@@ -129,131 +130,206 @@ static int64_t set_bool_value(db_entry_t *dest, uint8_t *str_value) {
   return 0;
 }
 
-static int64_t set_string_value(db_entry_t *dest, uint8_t *str_value) {
+static int64_t set_string_value(db_entry_t *dest, uint8_t *str_value, uint64_t len) {
   if (dest == NULL || str_value == NULL) {
-    logger(3, "Error: NULL pointer passed to set_string_value\n");
-    return -1;
-  }
-
-  if (strlen(str_value) == 0) {
-    logger(3, "Error: Empty string passed to set_string_value\n");
+    kv_log(3, "Error: NULL pointer passed to set_string_value\n");
     return -1;
   }
   
-  uint64_t str_len = strlen(str_value);
-  dest->value = calloc(str_len + 1, sizeof(uint8_t));
+  dest->value = kv_calloc(dest->memory, KV_ALLOC_VALUES, len + 1);
   if (dest->value == NULL) {
-    logger(3, "Error: Failed to allocate memory\n");
-    return -1;
+    kv_log(3, "Error: Failed to allocate memory\n");
+    return KV_OOM;
   }
   
-  strcpy(dest->value, str_value);
+  memcpy(dest->value, str_value, len);
   
   return 0;
 }
 
 extern int64_t set_entry_value(db_entry_t *dest, uint8_t *str_value) {
   if (dest == NULL || str_value == NULL) {
-    logger(3, "Error: NULL pointer passed to set_entry_value\n");
+    kv_log(3, "Error: NULL pointer passed to set_entry_value\n");
     return -1;
   }
 
-  if (strlen(str_value) == 0) {
-    logger(3, "Error: Empty string passed to set_entry_value\n");
+  return set_entry_span(dest, str_value, strlen(str_value));
+}
+
+extern int64_t set_entry_span(db_entry_t *dest, uint8_t *str_value, uint64_t len) {
+  if (dest == NULL || str_value == NULL) {
+    kv_log(3, "Error: NULL pointer passed to set_entry_span\n");
     return -1;
   }
-  
-  void *prev_value = NULL;
-  if (dest->value != NULL) {
-    prev_value = dest->value;
-    dest->value = NULL;
-  }
+
+  /* Strings and blobs may be empty, the numbers reject an empty value */
+  return convert_entry_value(dest, dest->type, str_value, len);
+}
+
+static uint64_t value_block_size(int64_t type, uint64_t size) {
+  uint64_t type_size = map_datatype_size(type);
+  return type_size > 0 ? type_size : size + 1;
+}
+
+static int64_t convert_entry_value(db_entry_t *dest, int64_t type, uint8_t *str_value, uint64_t len) {
+  void *prev_value = dest->value;
+  uint64_t prev_size = prev_value != NULL ? value_block_size(dest->type, dest->size) : 0;
+  dest->value = NULL;
 
   int64_t result = -1;
-  switch (dest->type) {
+  switch (type) {
   case INT8_TYPE:
-    result = set_integer_value(dest, str_value, sizeof(int8_t));
+    result = set_integer_value(dest, str_value, len, sizeof(int8_t));
     break;
   case INT16_TYPE:
-    result = set_integer_value(dest, str_value, sizeof(int16_t));
+    result = set_integer_value(dest, str_value, len, sizeof(int16_t));
     break;
   case INT32_TYPE:
-    result = set_integer_value(dest, str_value, sizeof(int32_t));
+    result = set_integer_value(dest, str_value, len, sizeof(int32_t));
     break;
   case INT64_TYPE:
-    result = set_integer_value(dest, str_value, sizeof(int64_t));
+    result = set_integer_value(dest, str_value, len, sizeof(int64_t));
     break;
   case FLOAT_TYPE:
-    result = set_float_value(dest, str_value);
+    result = set_float_value(dest, str_value, len);
     break;
   case DOUBLE_TYPE:
-    result = set_double_value(dest, str_value);
+    result = set_double_value(dest, str_value, len);
     break;
   case BOOL_TYPE:
-    result = set_bool_value(dest, str_value);
+    result = set_bool_value(dest, str_value, len);
+    break;
+  case STRING_TYPE:
+  case BLOB_TYPE:
+    result = set_string_value(dest, str_value, len);
     break;
   default:
-    logger(3, "Error: data type %u is not a valid datatype.\n", dest->type);
-    result = -1;
+    kv_log(3, "Error: data type %ld is not a valid datatype.\n", type);
+    result = KV_TYPE_MISMATCH;
     break;
   }
 
   if (result < 0) {
-    logger(3, "Error: Failed to set entry value\n");
+    kv_log(3, "Error: Failed to set entry value\n");
     dest->value = prev_value;
-    return -1;
+    return result;
   }
 
-  free(prev_value);
+  /* The old value is freed with the size of its own type */
+  kv_free(dest->memory, KV_ALLOC_VALUES, prev_value, prev_size);
+  dest->type = type;
+  dest->size = map_datatype_size(type) > 0 ? map_datatype_size(type) : len;
+  dest->raw_value = NULL;
+  dest->raw_size = 0;
 
   return result;
 }
 
+static int64_t set_escaped_value(db_entry_t *dest, uint8_t *text, uint64_t len) {
+  uint8_t *value = kv_alloc(dest->memory, KV_ALLOC_VALUES, len + 1);
+  if (value == NULL) {
+    kv_log(3, "Error: Failed to allocate memory\n");
+    return KV_OOM;
+  }
+
+  int64_t size = unescape_bytes(text, len, value);
+  if (size < 0) {
+    kv_log(3, "Error: Malformed escape in the value of key \"%s\"\n", dest->key);
+    kv_free(dest->memory, KV_ALLOC_VALUES, value, len + 1);
+    return KV_TYPE_MISMATCH;
+  }
+  value[size] = '\0';
+
+  /* Escapes make the text longer than the value, the block is trimmed to it */
+  if ((uint64_t)size < len) {
+    uint8_t *trimmed = kv_realloc(dest->memory, KV_ALLOC_VALUES, value, len + 1, size + 1);
+    if (trimmed == NULL) {
+      kv_log(3, "Error: Failed to allocate memory\n");
+      kv_free(dest->memory, KV_ALLOC_VALUES, value, len + 1);
+      return KV_OOM;
+    }
+    value = trimmed;
+  }
+
+  if (dest->value != NULL) {
+    kv_free(dest->memory, KV_ALLOC_VALUES, dest->value, value_block_size(dest->type, dest->size));
+  }
+  dest->value = value;
+  dest->size = size;
+  dest->raw_value = NULL;
+  dest->raw_size = 0;
+  return 0;
+}
+
 extern int64_t update_entry(db_entry_t *entry, uint8_t* value, uint8_t* type) {
   if (entry == NULL || value == NULL || type == NULL) {
-    logger(3, "Error: NULL pointer passed to update_entry\n");
+    kv_log(3, "Error: NULL pointer passed to update_entry\n");
     return -1;
   }
-  
-  if (strlen(value) == 0) {
-    logger(3, "Error: Empty string passed to update_entry\n");
+
+  return update_entry_span(entry, value, strlen(value), type);
+}
+
+extern int64_t update_entry_span(db_entry_t *entry, uint8_t *value, uint64_t len, uint8_t *type) {
+  if (entry == NULL || value == NULL || type == NULL) {
+    kv_log(3, "Error: NULL pointer passed to update_entry_span\n");
     return -1;
   }
 
-  entry->type = strlen(type) > 0 ?
-                map_datatype_from_str(type) :
-                entry->type;
-  if (entry->type < 0) {
-    logger(3, "Error: Failed to map datatype\n");
-    return -1;
+  /* The type only changes once the new value converts to it */
+  int64_t new_type = strlen(type) > 0 ?
+                     map_datatype_from_str(type) :
+                     entry->type;
+  if (new_type < 0) {
+    kv_log(3, "Error: Failed to map datatype\n");
+    return KV_TYPE_MISMATCH;
   }
 
-  if (set_entry_value(entry, value) < 0) {
-    logger(4, "Error: Failed to update entry\n");
-    return -1;
+  int64_t result = convert_entry_value(entry, new_type, value, len);
+  if (result < 0) {
+    kv_log(4, "Error: Failed to update entry\n");
+    return result;
   }
 
-  return 0;
+  return KV_OK;
 }
 
 extern db_entry_t* create_entry(uint8_t *key, uint8_t *value, uint8_t *type) {
   if (key == NULL || value == NULL || type == NULL) {
-    logger(3, "Error: NULL pointer passed to create_entry\n");
+    kv_log(3, "Error: NULL pointer passed to create_entry\n");
     return NULL;
   }
 
-  if (strlen(key) == 0 || strlen(value) == 0 || strlen(type) == 0) {
-    logger(3, "Error: Empty string passed to create_entry\n");
+  return create_entry_span(key, value, strlen(value), type);
+}
+
+extern db_entry_t* create_entry_span(uint8_t *key, uint8_t *value, uint64_t len, uint8_t *type) {
+  return create_entry_with_memory(NULL, key, value, len, type);
+}
+
+extern db_entry_t* create_entry_with_memory(kv_memory_t *memory, uint8_t *key, uint8_t *value,
+                                            uint64_t len, uint8_t *type) {
+  if (key == NULL || value == NULL || type == NULL) {
+    kv_log(3, "Error: NULL pointer passed to create_entry_span\n");
+    return NULL;
+  }
+
+  if (strlen(key) == 0 || strlen(type) == 0) {
+    kv_log(3, "Error: Empty string passed to create_entry_span\n");
     return NULL;
   }
   
-  db_entry_t *entry = malloc(sizeof(db_entry_t));
+  db_entry_t *entry = kv_alloc(memory, KV_ALLOC_ENTRIES, sizeof(db_entry_t));
   if (entry == NULL) {
-    logger(3, "Error: failed to allocated memory for database entry\n");
+    kv_log(3, "Error: failed to allocated memory for database entry\n");
     return NULL;
   }
   
+  entry->memory = memory;
   entry->value = NULL;
+  entry->size = 0;
+  entry->raw_value = NULL;
+  entry->raw_size = 0;
 
   strncpy(entry->key, key, SM_BUFFER_SIZE);
   entry->key[SM_BUFFER_SIZE-1] = '\0';
@@ -262,13 +338,13 @@ extern db_entry_t* create_entry(uint8_t *key, uint8_t *value, uint8_t *type) {
                 map_datatype_from_str(type) :
                 entry->type;
   if (entry->type < 0) {
-    logger(3, "Error: Failed to map datatype\n");
+    kv_log(3, "Error: Failed to map datatype\n");
     free_entry(entry);
     return NULL;
   }
 
-  if (set_entry_value(entry, value) < 0) {
-    logger(3, "Error: Failed to set entry value for key \"%s\"\n", key);
+  if (set_entry_span(entry, value, len) < 0) {
+    kv_log(3, "Error: Failed to set entry value for key \"%s\"\n", key);
     free_entry(entry);
     return NULL;
   }
@@ -276,7 +352,7 @@ extern db_entry_t* create_entry(uint8_t *key, uint8_t *value, uint8_t *type) {
   if (entry->type < 0 ||
       entry->key == NULL ||
       entry->value == NULL) {
-    logger(3, "Error: Failed to create entry object\n");
+    kv_log(3, "Error: Failed to create entry object\n");
     free_entry(entry);
     return NULL;
   }
@@ -284,122 +360,339 @@ extern db_entry_t* create_entry(uint8_t *key, uint8_t *value, uint8_t *type) {
   return entry;
 }
 
+static db_entry_t* new_lazy_entry(kv_memory_t *memory, uint8_t *key, uint64_t key_len,
+                                  uint8_t *raw_value, uint64_t raw_size, int64_t type) {
+  db_entry_t *entry = kv_alloc(memory, KV_ALLOC_ENTRIES, sizeof(db_entry_t));
+  if (entry == NULL) {
+    kv_log(3, "Error: failed to allocated memory for database entry\n");
+    return NULL;
+  }
+
+  memcpy(entry->key, key, key_len);
+  memset(entry->key + key_len, 0, SM_BUFFER_SIZE - key_len);
+  entry->type = type;
+  entry->value = NULL;
+  entry->size = 0;
+  entry->raw_value = raw_value;
+  entry->raw_size = raw_size;
+  entry->memory = memory;
+  return entry;
+}
+
+extern db_entry_t* create_lazy_entry(uint8_t *key, uint8_t *raw_value, uint64_t raw_size, uint8_t *type) {
+  if (key == NULL || raw_value == NULL || type == NULL) {
+    kv_log(3, "Error: NULL pointer passed to create_lazy_entry\n");
+    return NULL;
+  }
+
+  if (strlen(key) == 0 || strlen(type) == 0) {
+    kv_log(3, "Error: Empty string passed to create_lazy_entry\n");
+    return NULL;
+  }
+
+  int64_t type_value = map_datatype_from_str(type);
+  if (type_value < 0) {
+    kv_log(3, "Error: Failed to map datatype\n");
+    return NULL;
+  }
+
+  if (raw_size == 0 && map_datatype_size(type_value) != 0) {
+    kv_log(3, "Error: Empty value passed to create_lazy_entry\n");
+    return NULL;
+  }
+
+  uint64_t key_len = strnlen(key, SM_BUFFER_SIZE - 1);
+  return new_lazy_entry(NULL, key, key_len, raw_value, raw_size, type_value);
+}
+
+extern int64_t materialize_entry(db_entry_t *entry) {
+  if (entry == NULL) {
+    kv_log(3, "Error: NULL pointer passed to materialize_entry\n");
+    return -1;
+  }
+
+  if (entry->raw_value == NULL) return 0;
+
+  /* Strings and blobs are escaped in text files, numbers are converted */
+  int64_t result = map_datatype_size(entry->type) == 0 ?
+                   set_escaped_value(entry, entry->raw_value, entry->raw_size) :
+                   set_entry_span(entry, entry->raw_value, entry->raw_size);
+  if (result < 0) {
+    kv_log(3, "Error: Failed to set entry value for key \"%s\"\n", entry->key);
+    return -1;
+  }
+
+  return 0;
+}
+
+extern int64_t get_value_span(db_entry_t *entry, kv_span_t *value) {
+  if (entry == NULL || value == NULL) {
+    kv_log(3, "Error: NULL pointer passed to get_value_span\n");
+    return -1;
+  }
+
+  if (materialize_entry(entry) < 0 || entry->value == NULL) {
+    return -1;
+  }
+
+  value->ptr = entry->value;
+  value->len = entry->size;
+  return 0;
+}
+
+extern db_entry_t* parse_tokens(kv_tokens_t *tokens, bool lazy, kv_memory_t *memory) {
+  if (tokens == NULL) {
+    kv_log(3, "Error: NULL pointer passed to parse_tokens\n");
+    return NULL;
+  }
+
+  if (!tokens->valid) {
+    kv_log(3, "Error: Failed to tokenize an entry\n");
+    return NULL;
+  }
+
+  if (tokens->key.len >= SM_BUFFER_SIZE) {
+    kv_log(3, "Error: Key of an entry is too long\n");
+    return NULL;
+  }
+
+  int64_t type = map_datatype_from_span(tokens->type.ptr, tokens->type.len);
+  if (type < 0) {
+    kv_log(3, "Error: data type %.*s is not a valid datatype.\n", (int)tokens->type.len, tokens->type.ptr);
+    return NULL;
+  }
+
+  /* Only strings and blobs may be empty, lazy numbers are checked here */
+  if (tokens->value.len == 0 && map_datatype_size(type) != 0) {
+    kv_log(3, "Error: Empty value of key \"%.*s\"\n", (int)tokens->key.len, tokens->key.ptr);
+    return NULL;
+  }
+
+  /* Eager entries convert the value straight from the span */
+  db_entry_t *entry = new_lazy_entry(memory, tokens->key.ptr, tokens->key.len,
+                                     tokens->value.ptr, tokens->value.len, type);
+  if (entry != NULL && !lazy && materialize_entry(entry) < 0) {
+    free_entry(entry);
+    entry = NULL;
+  }
+
+  if (entry == NULL) {
+    kv_log(3, "Error: Failed to create entry object\n");
+  }
+
+  return entry;
+}
+
 extern db_entry_t* parse_line(uint8_t *line) {
   if (line == NULL) {
-    logger(3, "Error: NULL pointer passed to parse_line\n");
+    kv_log(3, "Error: NULL pointer passed to parse_line\n");
     return NULL;
   }
 
-  if (strlen(line) == 0) {
-    logger(3, "Error: Empty string passed to parse_line\n");
+  uint64_t len = strlen(line);
+  if (len == 0) {
+    kv_log(3, "Error: Empty string passed to parse_line\n");
     return NULL;
   }
   
-  if (strcmp(line, "\n") == 0 || line[0] == '#') return NULL;  
-  uint8_t *type, *key, *value;
-  if ((type = strtok(line, TYPE_DELIMETER)) == NULL ||
-      (key = strtok(NULL, KEY_DELIMETER)) == NULL ||
-      (value = strtok(NULL, VALUE_DELIMETER)) == NULL) {
-    logger(3, "Error: Failed to tokenize an entry\n");
+  if (line[0] == '\n' || line[0] == '#') return NULL;
+
+  kv_tokens_t tokens;
+  tokenize_line(line, len, &tokens);
+  return parse_tokens(&tokens, false, NULL);
+}
+
+extern db_entry_t* parse_line_lazy(uint8_t *line, uint64_t len) {
+  if (line == NULL) {
+    kv_log(3, "Error: NULL pointer passed to parse_line_lazy\n");
     return NULL;
   }
 
-  db_entry_t *entry = create_entry(key, value, type);
-  if (entry == NULL) {
-    logger(3, "Error: Failed to create entry object\n");
+  if (len == 0) {
+    kv_log(3, "Error: Empty string passed to parse_line_lazy\n");
+    return NULL;
   }
 
-  return entry;
+  if (line[0] == '\n' || line[0] == '#') return NULL;
+
+  kv_tokens_t tokens;
+  tokenize_line(line, len, &tokens);
+  return parse_tokens(&tokens, true, NULL);
+}
+
+static int64_t map_entry_value(db_entry_t *entry, uint8_t *buffer, kv_span_t *value, kv_span_t *allocated) {
+  allocated->ptr = NULL;
+  allocated->len = 0;
+  if (entry->raw_value != NULL) {
+    value->ptr = entry->raw_value;
+    value->len = entry->raw_size;
+    return 0;
+  }
+
+  if (entry->value != NULL && map_datatype_size(entry->type) == 0) {
+    uint64_t len = escaped_length(entry->value, entry->size);
+    if (len > NUMBER_FORMAT_BUFFER_SIZE) {
+      buffer = allocated->ptr = kv_alloc(entry->memory, KV_ALLOC_BUFFERS, len);
+      if (buffer == NULL) {
+        kv_log(3, "Error: Failed to allocate memory\n");
+        return -1;
+      }
+      allocated->len = len;
+    }
+    value->ptr = buffer;
+    value->len = escape_bytes(entry->value, entry->size, buffer, len);
+    return 0;
+  }
+
+  if (map_value_to_str(entry->type, entry->value, buffer, NUMBER_FORMAT_BUFFER_SIZE) < 0) {
+    kv_log(3, "Error: failed to map value\n");
+    return -1;
+  }
+  value->ptr = buffer;
+  value->len = strlen(buffer);
+  return 0;
 }
 
 extern int64_t parse_entry(db_entry_t *entry, uint8_t *dest, uint64_t max_len) {
   if (entry == NULL || dest == NULL) {
-    logger(3, "Error: NULL pointer passed to parse_entry\n");
+    kv_log(3, "Error: NULL pointer passed to parse_entry\n");
     return -1;
   }
   
   if (max_len == 0) {
-    logger(3, "Error: Zero length int passed to parse_entry\n");
+    kv_log(3, "Error: Zero length int passed to parse_entry\n");
     return -1;
   }
   
-  uint8_t type[SM_BUFFER_SIZE];
-  uint8_t key[SM_BUFFER_SIZE];
-  uint8_t value[SM_BUFFER_SIZE];
+  uint8_t buffer[NUMBER_FORMAT_BUFFER_SIZE];
+  kv_span_t allocated;
+  kv_span_t value;
 
-  if (map_datatype_to_str(entry->type, type, SM_BUFFER_SIZE) < 0) {
-    logger(3, "Error: failed to map datatype\n");
+  type_name_t type = map_datatype_name(entry->type);
+  if (type.ptr == NULL) {
+    kv_log(3, "Error: failed to map datatype\n");
     return -1;
   }
   
-  if (map_value_to_str(entry->type, entry->value, value, SM_BUFFER_SIZE) < 0) {
-    logger(3, "Error: failed to map value\n");
+  if (map_entry_value(entry, buffer, &value, &allocated) < 0) {
     return -1;
   }
 
-  strncpy(key, entry->key, SM_BUFFER_SIZE);
-  key[SM_BUFFER_SIZE-1] = '\0';
-
-  if (strlen(type) == 0 || strlen(key) == 0 || strlen(value) == 0) {
-    logger(3, "Error: Mapped string of zero length in parse_entry\n");
+  if (strlen(entry->key) == 0) {
+    kv_log(3, "Error: Mapped string of zero length in parse_entry\n");
+    kv_free(entry->memory, KV_ALLOC_BUFFERS, allocated.ptr, allocated.len);
     return -1;
   }
 
-  snprintf(dest, max_len, "%s%s%s%s%s%s\n", type,
-                                            KV_PARSER_TYPE_DELIMITER,
-                                            key,
-                                            KV_PARSER_KEY_DELIMITER,
-                                            value,
-                                            KV_PARSER_VALUE_DELIMITER);
+  int64_t len = snprintf(dest, max_len, "%.*s%s%s%s%.*s%s\n", (int)type.len, type.ptr,
+                                                           KV_PARSER_TYPE_DELIMITER,
+                                                           entry->key,
+                                                           KV_PARSER_KEY_DELIMITER,
+                                                           (int)value.len, value.ptr,
+                                                           KV_PARSER_VALUE_DELIMITER);
+  kv_free(entry->memory, KV_ALLOC_BUFFERS, allocated.ptr, allocated.len);
+  if (len < 0 || (uint64_t)len >= max_len) {
+    kv_log(3, "Error: Entry of key \"%s\" does not fit in the buffer\n", entry->key);
+    return -1;
+  }
   return 0;
 }
 
+extern int64_t write_entry(FILE *file, db_entry_t *entry) {
+  if (file == NULL || entry == NULL) {
+    kv_log(3, "Error: NULL pointer passed to write_entry\n");
+    return -1;
+  }
+
+  uint8_t buffer[NUMBER_FORMAT_BUFFER_SIZE];
+  kv_span_t allocated;
+  kv_span_t value;
+
+  type_name_t type = map_datatype_name(entry->type);
+  if (type.ptr == NULL) {
+    kv_log(3, "Error: failed to map datatype\n");
+    return -1;
+  }
+
+  if (map_entry_value(entry, buffer, &value, &allocated) < 0) {
+    return -1;
+  }
+
+  int64_t result = 0;
+  if (fwrite(type.ptr, 1, type.len, file) != type.len ||
+      fputs(KV_PARSER_TYPE_DELIMITER, file) == EOF ||
+      fputs(entry->key, file) == EOF ||
+      fputs(KV_PARSER_KEY_DELIMITER, file) == EOF ||
+      fwrite(value.ptr, 1, value.len, file) != value.len ||
+      fputs(KV_PARSER_VALUE_DELIMITER "\n", file) == EOF) {
+    kv_log(3, "Error: Failed to write entry to file\n");
+    result = -1;
+  }
+  kv_free(entry->memory, KV_ALLOC_BUFFERS, allocated.ptr, allocated.len);
+  return result;
+}
+
 extern void free_entry(db_entry_t *entry) {
   if (entry == NULL) return;
   
   if (entry->value != NULL) {
-    free(entry->value);
+    kv_free(entry->memory, KV_ALLOC_VALUES, entry->value, value_block_size(entry->type, entry->size));
   }
-  free(entry);
+  kv_free(entry->memory, KV_ALLOC_ENTRIES, entry, sizeof(db_entry_t));
 }
 
 extern void print_entry(db_entry_t *entry) {
   if (entry == NULL) {
-    logger(3, "Error: NULL pointer passed to print_entry\n");
+    kv_log(3, "Error: NULL pointer passed to print_entry\n");
     return;
   }
   
-  uint8_t type[SM_BUFFER_SIZE];
-  if (map_datatype_to_str(entry->type, type, SM_BUFFER_SIZE) < 0) {
-    logger(3, "Error: failed to map datatype\n");
+  uint8_t value[NUMBER_FORMAT_BUFFER_SIZE];
+  type_name_t type = map_datatype_name(entry->type);
+  if (type.ptr == NULL) {
+    kv_log(3, "Error: failed to map datatype\n");
+    return;
+  }
+
+  if (materialize_entry(entry) < 0) {
+    kv_log(3, "Error: failed to materialize value\n");
     return;
   }
 
-  logger(4, "%s\t%s\t", type, entry->key);
+  kv_log(4, "%.*s\t%s\t", (int)type.len, type.ptr, entry->key);
 
   switch (entry->type) {
   case INT8_TYPE:
-    logger(4, "%" PRId8 "\n", *(int8_t*)entry->value);
+    kv_log(4, "%" PRId8 "\n", *(int8_t*)entry->value);
     break;
   case INT16_TYPE:
-    logger(4, "%" PRId16 "\n", *(int16_t*)entry->value);
+    kv_log(4, "%" PRId16 "\n", *(int16_t*)entry->value);
     break;
   case INT32_TYPE:
-    logger(4, "%" PRId32 "\n", *(int32_t*)entry->value);
+    kv_log(4, "%" PRId32 "\n", *(int32_t*)entry->value);
     break;
   case INT64_TYPE:
-    logger(4, "%" PRId64 "\n", *(int64_t*)entry->value);
+    kv_log(4, "%" PRId64 "\n", *(int64_t*)entry->value);
     break;
   case BOOL_TYPE:
-    logger(4, "%s\n", *(bool*)entry->value ? "true" : "false");
+    kv_log(4, "%s\n", *(bool*)entry->value ? "true" : "false");
     break;
   case FLOAT_TYPE:
-    logger(4, "%.7f\n", *(float*)entry->value);
-    break;
   case DOUBLE_TYPE:
-    logger(4, "%.15lf\n", *(double*)entry->value);
+    map_value_to_str(entry->type, entry->value, value, NUMBER_FORMAT_BUFFER_SIZE);
+    kv_log(4, "%s\n", value);
     break;
+  case STRING_TYPE:
+  case BLOB_TYPE: {
+    kv_span_t text;
+    kv_span_t allocated;
+    if (map_entry_value(entry, value, &text, &allocated) == 0) {
+      kv_log(4, "%.*s\n", (int)text.len, text.ptr);
+      kv_free(entry->memory, KV_ALLOC_BUFFERS, allocated.ptr, allocated.len);
+    }
+    break;
+  }
   default:
-    logger(3, "\nError: Invalid Data Type\n");
+    kv_log(3, "\nError: Invalid Data Type\n");
   }
 }
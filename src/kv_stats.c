@@ -0,0 +1,208 @@
+#include "kv_stats.h"
+
+static const char *op_names[DB_STATS_OP_COUNT] = { "get", "put", "delete", "load", "save" };
+
+static _Atomic uint64_t next_shard = 0;
+static _Thread_local int64_t thread_shard = -1;
+
+static kv_stats_shard_t *stats_shard(kv_stats_t *stats) {
+  if (thread_shard < 0) {
+    thread_shard = atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed) % KV_STATS_SHARDS;
+  }
+  return &stats->shards[thread_shard];
+}
+
+extern kv_stats_t *create_stats() {
+  kv_stats_t *stats = aligned_alloc(64, sizeof(kv_stats_t));
+  if (stats == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for kv_stats_t\n");
+    return NULL;
+  }
+  memset(stats, 0, sizeof(kv_stats_t));
+  return stats;
+}
+
+extern uint64_t stats_now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+extern uint64_t stats_bucket(uint64_t ns) {
+  if (ns < KV_STATS_SUB_BUCKETS) {
+    return ns;
+  }
+
+  uint64_t exponent = 63 - __builtin_clzll(ns);
+  if (exponent > KV_STATS_MAX_EXPONENT) {
+    return KV_STATS_BUCKETS - 1;
+  }
+
+  /* The bits right below the leading one pick the sub-bucket */
+  uint64_t shift = exponent - KV_STATS_SUB_BUCKET_BITS;
+  uint64_t sub_bucket = (ns >> shift) & (KV_STATS_SUB_BUCKETS - 1);
+  return ((shift + 1) << KV_STATS_SUB_BUCKET_BITS) + sub_bucket;
+}
+
+extern uint64_t stats_bucket_limit(uint64_t bucket) {
+  if (bucket < KV_STATS_SUB_BUCKETS) {
+    return bucket + 1;
+  }
+
+  uint64_t shift = (bucket >> KV_STATS_SUB_BUCKET_BITS) - 1;
+  uint64_t sub_bucket = bucket & (KV_STATS_SUB_BUCKETS - 1);
+  return (KV_STATS_SUB_BUCKETS + sub_bucket + 1) << shift;
+}
+
+extern void stats_record_latency(kv_stats_t *stats, int64_t op, uint64_t start_ns) {
+  if (stats == NULL || op < 0 || op >= DB_STATS_OP_COUNT) return;
+
+  uint64_t ns = stats_now_ns() - start_ns;
+  kv_stats_histogram_t *histogram = &stats_shard(stats)->latency[op];
+  atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->sum_ns, ns, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->buckets[stats_bucket(ns)], 1, memory_order_relaxed);
+
+  uint64_t max_ns = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+  while (ns > max_ns &&
+         !atomic_compare_exchange_weak_explicit(&histogram->max_ns, &max_ns, ns,
+                                                memory_order_relaxed, memory_order_relaxed));
+}
+
+extern void stats_add(kv_stats_t *stats, int64_t counter, uint64_t amount) {
+  if (stats == NULL || counter < 0 || counter >= DB_STATS_COUNTER_COUNT) return;
+
+  atomic_fetch_add_explicit(&stats_shard(stats)->counters[counter], amount, memory_order_relaxed);
+}
+
+extern int64_t stats_merge(kv_stats_t *stats, db_stats_t *out) {
+  if (stats == NULL || out == NULL) {
+    kv_log(3, "Error: NULL pointer passed to stats_merge\n");
+    return -1;
+  }
+
+  uint64_t counters[DB_STATS_COUNTER_COUNT] = { 0 };
+  memset(out, 0, sizeof(db_stats_t));
+  for (uint64_t shard_idx = 0; shard_idx < KV_STATS_SHARDS; shard_idx++) {
+    kv_stats_shard_t *shard = &stats->shards[shard_idx];
+    for (uint64_t counter = 0; counter < DB_STATS_COUNTER_COUNT; counter++) {
+      counters[counter] += atomic_load_explicit(&shard->counters[counter], memory_order_relaxed);
+    }
+
+    for (uint64_t op = 0; op < DB_STATS_OP_COUNT; op++) {
+      kv_stats_histogram_t *source = &shard->latency[op];
+      kv_histogram_t *dest = &out->latency[op];
+      dest->count += atomic_load_explicit(&source->count, memory_order_relaxed);
+      dest->sum_ns += atomic_load_explicit(&source->sum_ns, memory_order_relaxed);
+      uint64_t max_ns = atomic_load_explicit(&source->max_ns, memory_order_relaxed);
+      if (max_ns > dest->max_ns) {
+        dest->max_ns = max_ns;
+      }
+      for (uint64_t bucket = 0; bucket < KV_STATS_BUCKETS; bucket++) {
+        dest->buckets[bucket] += atomic_load_explicit(&source->buckets[bucket], memory_order_relaxed);
+      }
+    }
+  }
+
+  out->hits = counters[DB_STATS_HITS];
+  out->misses = counters[DB_STATS_MISSES];
+  out->inserts = counters[DB_STATS_INSERTS];
+  out->updates = counters[DB_STATS_UPDATES];
+  out->bytes_read = counters[DB_STATS_BYTES_READ];
+  out->bytes_written = counters[DB_STATS_BYTES_WRITTEN];
+  return 0;
+}
+
+extern void stats_reset(kv_stats_t *stats) {
+  if (stats == NULL) return;
+
+  for (uint64_t shard_idx = 0; shard_idx < KV_STATS_SHARDS; shard_idx++) {
+    kv_stats_shard_t *shard = &stats->shards[shard_idx];
+    for (uint64_t counter = 0; counter < DB_STATS_COUNTER_COUNT; counter++) {
+      atomic_store_explicit(&shard->counters[counter], 0, memory_order_relaxed);
+    }
+
+    for (uint64_t op = 0; op < DB_STATS_OP_COUNT; op++) {
+      kv_stats_histogram_t *histogram = &shard->latency[op];
+      atomic_store_explicit(&histogram->count, 0, memory_order_relaxed);
+      atomic_store_explicit(&histogram->sum_ns, 0, memory_order_relaxed);
+      atomic_store_explicit(&histogram->max_ns, 0, memory_order_relaxed);
+      for (uint64_t bucket = 0; bucket < KV_STATS_BUCKETS; bucket++) {
+        atomic_store_explicit(&histogram->buckets[bucket], 0, memory_order_relaxed);
+      }
+    }
+  }
+}
+
+extern uint64_t stats_percentile(kv_histogram_t *histogram, double percentile) {
+  if (histogram == NULL || histogram->count == 0) return 0;
+
+  if (percentile < 0) percentile = 0;
+  if (percentile > 100) percentile = 100;
+
+  uint64_t rank = (uint64_t)(percentile / 100 * histogram->count + 0.5);
+  if (rank == 0) rank = 1;
+
+  uint64_t seen = 0;
+  for (uint64_t bucket = 0; bucket < KV_STATS_BUCKETS; bucket++) {
+    seen += histogram->buckets[bucket];
+    if (seen >= rank) {
+      uint64_t limit = stats_bucket_limit(bucket) - 1;
+      return limit < histogram->max_ns ? limit : histogram->max_ns;
+    }
+  }
+  return histogram->max_ns;
+}
+
+extern int64_t write_stats_prometheus(FILE *file, db_stats_t *stats) {
+  if (file == NULL || stats == NULL) {
+    kv_log(3, "Error: NULL pointer passed to write_stats_prometheus\n");
+    return -1;
+  }
+
+  fprintf(file, "# HELP kv_operation_duration_seconds Latency of the database operations.\n");
+  fprintf(file, "# TYPE kv_operation_duration_seconds histogram\n");
+  for (uint64_t op = 0; op < DB_STATS_OP_COUNT; op++) {
+    kv_histogram_t *histogram = &stats->latency[op];
+
+    /* Buckets are aligned on powers of two, so the cumulative counts are exact */
+    uint64_t cumulative = 0;
+    uint64_t bucket = 0;
+    for (uint64_t exponent = KV_STATS_SUB_BUCKET_BITS; exponent <= KV_STATS_MAX_EXPONENT + 1; exponent++) {
+      uint64_t limit = 1ULL << exponent;
+      while (bucket < KV_STATS_BUCKETS && stats_bucket_limit(bucket) <= limit) {
+        cumulative += histogram->buckets[bucket++];
+      }
+      fprintf(file, "kv_operation_duration_seconds_bucket{op=\"%s\",le=\"%.9g\"} %" PRIu64 "\n",
+              op_names[op], limit / 1e9, cumulative);
+    }
+    fprintf(file, "kv_operation_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %" PRIu64 "\n",
+            op_names[op], histogram->count);
+    fprintf(file, "kv_operation_duration_seconds_sum{op=\"%s\"} %.9g\n", op_names[op], histogram->sum_ns / 1e9);
+    fprintf(file, "kv_operation_duration_seconds_count{op=\"%s\"} %" PRIu64 "\n", op_names[op], histogram->count);
+  }
+
+  struct { const char *name; const char *help; uint64_t value; } counters[] = {
+    { "kv_hits_total", "Gets that found their key.", stats->hits },
+    { "kv_misses_total", "Gets of a missing key.", stats->misses },
+    { "kv_inserts_total", "Entries added by inserts and puts of new keys.", stats->inserts },
+    { "kv_updates_total", "Puts that replaced the value of a key.", stats->updates },
+    { "kv_read_bytes_total", "Value bytes returned by gets and bytes of loaded files.", stats->bytes_read },
+    { "kv_written_bytes_total", "Value bytes of puts and bytes of saved files.", stats->bytes_written },
+  };
+  for (uint64_t idx = 0; idx < sizeof(counters) / sizeof(counters[0]); idx++) {
+    fprintf(file, "# HELP %s %s\n", counters[idx].name, counters[idx].help);
+    fprintf(file, "# TYPE %s counter\n", counters[idx].name);
+    fprintf(file, "%s %" PRIu64 "\n", counters[idx].name, counters[idx].value);
+  }
+
+  if (ferror(file)) {
+    kv_log(3, "Error: Failed to write the statistics\n");
+    return -1;
+  }
+  return 0;
+}
+
+extern void free_stats(kv_stats_t *stats) {
+  free(stats);
+}
@@ -0,0 +1,234 @@
+#include "kv_trace.h"
+
+static uint64_t write_varint(uint8_t *dest, uint64_t value) {
+  uint64_t len = 0;
+  while (value >= 0x80) {
+    dest[len++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  dest[len++] = value;
+  return len;
+}
+
+static int64_t read_varint(FILE *file, uint64_t *value) {
+  *value = 0;
+  for (uint64_t shift = 0; shift < 7 * KV_TRACE_VARINT_SIZE; shift += 7) {
+    int byte = fgetc(file);
+    if (byte == EOF) {
+      return shift == 0 ? 0 : -1;
+    }
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return 1;
+    }
+  }
+  return -1;
+}
+
+static int64_t flush_trace(kv_trace_t *trace) {
+  if (trace->used > 0 && fwrite(trace->buffer, 1, trace->used, trace->file) != trace->used) {
+    trace->used = 0;
+    return -1;
+  }
+  trace->used = 0;
+  return 0;
+}
+
+extern kv_trace_t *open_trace(uint8_t *path) {
+  if (path == NULL) {
+    kv_log(3, "Error: NULL pointer passed to open_trace\n");
+    return NULL;
+  }
+
+  kv_trace_t *trace = malloc(sizeof(kv_trace_t));
+  if (trace == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for kv_trace_t\n");
+    return NULL;
+  }
+
+  trace->file = fopen(path, "wb");
+  if (trace->file == NULL || fwrite(KV_TRACE_MAGIC, 1, KV_TRACE_MAGIC_SIZE, trace->file) != KV_TRACE_MAGIC_SIZE) {
+    kv_log(3, "Error: Failed to create trace file %s\n", path);
+    if (trace->file != NULL) fclose(trace->file);
+    free(trace);
+    return NULL;
+  }
+
+  pthread_mutex_init(&trace->lock, NULL);
+  trace->used = 0;
+  trace->last_ns = 0;
+  trace->records = 0;
+  trace->failed = false;
+  return trace;
+}
+
+extern void trace_record(kv_trace_t *trace, int64_t op, int64_t status, uint8_t *key,
+                         uint8_t *value, uint64_t len, uint8_t *type, uint64_t start_ns) {
+  if (trace == NULL || key == NULL) return;
+
+  uint64_t key_len = strnlen(key, SM_BUFFER_SIZE - 1);
+  int64_t type_id = type != NULL && type[0] != '\0' ? map_datatype_from_span(type, strlen(type)) : -1;
+
+  pthread_mutex_lock(&trace->lock);
+  if (trace->failed) {
+    pthread_mutex_unlock(&trace->lock);
+    return;
+  }
+
+  /* Threads may record out of order, hence the zigzag encoding of the delta */
+  int64_t delta = trace->records == 0 ? 0 : (int64_t)(start_ns - trace->last_ns);
+  trace->last_ns = start_ns;
+
+  uint8_t header[3 + 3 * KV_TRACE_VARINT_SIZE];
+  uint64_t header_len = 0;
+  header[header_len++] = op;
+  header[header_len++] = (int8_t)status;
+  header[header_len++] = type_id >= 0 ? type_id : KV_TRACE_NO_TYPE;
+  header_len += write_varint(header + header_len, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+  header_len += write_varint(header + header_len, key_len);
+
+  uint8_t value_header[KV_TRACE_VARINT_SIZE];
+  uint64_t value_header_len = op == KV_TRACE_PUT ? write_varint(value_header, len) : 0;
+  uint64_t value_len = op == KV_TRACE_PUT ? len : 0;
+
+  uint64_t size = header_len + key_len + value_header_len + value_len;
+  int64_t result = 0;
+  if (trace->used + size > KV_TRACE_BUFFER_SIZE) {
+    result = flush_trace(trace);
+  }
+
+  if (result == 0 && size <= KV_TRACE_BUFFER_SIZE) {
+    memcpy(trace->buffer + trace->used, header, header_len);
+    memcpy(trace->buffer + trace->used + header_len, key, key_len);
+    memcpy(trace->buffer + trace->used + header_len + key_len, value_header, value_header_len);
+    if (value_len > 0) {
+      memcpy(trace->buffer + trace->used + header_len + key_len + value_header_len, value, value_len);
+    }
+    trace->used += size;
+  }
+  else if (result == 0) {
+    /* Values larger than the buffer are written straight to the file */
+    if (fwrite(header, 1, header_len, trace->file) != header_len ||
+        fwrite(key, 1, key_len, trace->file) != key_len ||
+        fwrite(value_header, 1, value_header_len, trace->file) != value_header_len ||
+        fwrite(value, 1, value_len, trace->file) != value_len) {
+      result = -1;
+    }
+  }
+
+  if (result == 0) {
+    trace->records++;
+  }
+  else {
+    kv_log(3, "Error: Failed to write the trace, recording stopped\n");
+    trace->failed = true;
+  }
+  pthread_mutex_unlock(&trace->lock);
+}
+
+extern int64_t close_trace(kv_trace_t *trace) {
+  if (trace == NULL) return 0;
+
+  int64_t result = trace->failed ? -1 : 0;
+  if (flush_trace(trace) < 0 || fclose(trace->file) == EOF) {
+    kv_log(3, "Error: Failed to write the end of the trace\n");
+    result = -1;
+  }
+
+  pthread_mutex_destroy(&trace->lock);
+  free(trace);
+  return result;
+}
+
+extern kv_trace_reader_t *open_trace_reader(uint8_t *path) {
+  if (path == NULL) {
+    kv_log(3, "Error: NULL pointer passed to open_trace_reader\n");
+    return NULL;
+  }
+
+  kv_trace_reader_t *reader = calloc(1, sizeof(kv_trace_reader_t));
+  if (reader == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for kv_trace_reader_t\n");
+    return NULL;
+  }
+
+  uint8_t magic[KV_TRACE_MAGIC_SIZE];
+  reader->file = fopen(path, "rb");
+  if (reader->file == NULL ||
+      fread(magic, 1, KV_TRACE_MAGIC_SIZE, reader->file) != KV_TRACE_MAGIC_SIZE ||
+      memcmp(magic, KV_TRACE_MAGIC, KV_TRACE_MAGIC_SIZE) != 0) {
+    kv_log(3, "Error: %s is not a trace file\n", path);
+    close_trace_reader(reader);
+    return NULL;
+  }
+  return reader;
+}
+
+extern int64_t read_trace_record(kv_trace_reader_t *reader, kv_trace_record_t *record) {
+  if (reader == NULL || record == NULL) {
+    kv_log(3, "Error: NULL pointer passed to read_trace_record\n");
+    return -1;
+  }
+
+  uint8_t fixed[3];
+  uint64_t count = fread(fixed, 1, 3, reader->file);
+  if (count == 0 && feof(reader->file)) {
+    return 0;
+  }
+
+  uint64_t delta;
+  uint64_t key_len;
+  if (count != 3 || fixed[0] >= KV_TRACE_OP_COUNT ||
+      read_varint(reader->file, &delta) != 1 ||
+      read_varint(reader->file, &key_len) != 1 || key_len >= SM_BUFFER_SIZE ||
+      fread(record->key, 1, key_len, reader->file) != key_len) {
+    kv_log(3, "Error: Damaged trace record\n");
+    return -1;
+  }
+  record->key[key_len] = '\0';
+  record->op = fixed[0];
+  record->status = (int8_t)fixed[1];
+  record->type = fixed[2] != KV_TRACE_NO_TYPE ? fixed[2] : -1;
+
+  int64_t signed_delta = (int64_t)(delta >> 1) ^ -(int64_t)(delta & 1);
+  reader->last_ns += reader->started ? signed_delta : 0;
+  reader->started = true;
+  record->time_ns = reader->last_ns;
+
+  record->value = NULL;
+  record->value_len = 0;
+  if (record->op == KV_TRACE_PUT) {
+    uint64_t value_len;
+    if (read_varint(reader->file, &value_len) != 1) {
+      kv_log(3, "Error: Damaged trace record\n");
+      return -1;
+    }
+    if (value_len + 1 > reader->value_capacity) {
+      uint8_t *value = realloc(reader->value, value_len + 1);
+      if (value == NULL) {
+        kv_log(3, "Error: Failed to allocate memory for a trace value\n");
+        return -1;
+      }
+      reader->value = value;
+      reader->value_capacity = value_len + 1;
+    }
+    if (fread(reader->value, 1, value_len, reader->file) != value_len) {
+      kv_log(3, "Error: Damaged trace record\n");
+      return -1;
+    }
+    reader->value[value_len] = '\0';
+    record->value = reader->value;
+    record->value_len = value_len;
+  }
+  return 1;
+}
+
+extern void close_trace_reader(kv_trace_reader_t *reader) {
+  if (reader == NULL) return;
+
+  if (reader->file != NULL) {
+    fclose(reader->file);
+  }
+  free(reader->value);
+  free(reader);
+}
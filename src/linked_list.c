@@ -2,127 +2,239 @@
 
 #include "linked_list.h"
 
-extern list_t* create_list() {
-  list_t* new_list = malloc(sizeof(list_t));
+static node_t **index_slot(list_t *list, const kv_key_probe_t *probe) {
+  uint64_t mask = list->index_capacity - 1;
+  uint64_t slot = probe->hash & mask;
+  while (list->index[slot] != NULL && !kv_key_matches(probe, list->index[slot]->entry->key)) {
+    slot = (slot + 1) & mask;
+  }
+  return &list->index[slot];
+}
+
+static int64_t index_resize(list_t *list, uint64_t capacity) {
+  node_t **index = kv_calloc(list->memory, KV_ALLOC_BUCKETS, capacity * sizeof(node_t*));
+  if (index == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for the index of a linked list.\n");
+    return -1;
+  }
+
+  uint64_t mask = capacity - 1;
+  for (node_t *current_node = list->head; current_node != NULL; current_node = current_node->next) {
+    uint64_t slot = kv_key_hash(current_node->entry->key) & mask;
+    while (index[slot] != NULL) {
+      slot = (slot + 1) & mask;
+    }
+    index[slot] = current_node;
+  }
+
+  kv_free(list->memory, KV_ALLOC_BUCKETS, list->index, list->index_capacity * sizeof(node_t*));
+  list->index = index;
+  list->index_capacity = capacity;
+  return 0;
+}
+
+static void index_add(list_t *list, node_t *node, const kv_key_probe_t *probe) {
+  if (list->index == NULL) {
+    if (list->size >= KV_LIST_INDEX_THRESHOLD) {
+      uint64_t capacity = KV_LIST_INDEX_THRESHOLD * 4;
+      while (capacity < list->size * 4) capacity *= 2;
+      index_resize(list, capacity);
+    }
+    return;
+  }
+
+  /* At most half of the slots are used, probe sequences stay short */
+  if (list->size * 2 > list->index_capacity) {
+    if (index_resize(list, list->index_capacity * 2) < 0) {
+      kv_free(list->memory, KV_ALLOC_BUCKETS, list->index, list->index_capacity * sizeof(node_t*));
+      list->index = NULL;
+      list->index_capacity = 0;
+    }
+    return;
+  }
+  *index_slot(list, probe) = node;
+}
+
+static void index_remove(list_t *list, node_t **slot) {
+  uint64_t mask = list->index_capacity - 1;
+  uint64_t empty = slot - list->index;
+  uint64_t current = empty;
+  while (true) {
+    current = (current + 1) & mask;
+    node_t *node = list->index[current];
+    if (node == NULL) break;
+
+    /* A node may fill the hole only if its home slot is not between the two */
+    uint64_t home = kv_key_hash(node->entry->key) & mask;
+    if (((current - home) & mask) >= ((current - empty) & mask)) {
+      list->index[empty] = node;
+      empty = current;
+    }
+  }
+  list->index[empty] = NULL;
+}
+
+static node_t *find_node(list_t *list, const kv_key_probe_t *probe) {
+  if (list->index != NULL) {
+    return *index_slot(list, probe);
+  }
+
+  node_t* current_node = list->head;
+  while (current_node != NULL) {
+    if (kv_key_matches(probe, current_node->entry->key)) {
+      return current_node;
+    }
+    current_node = current_node->next;
+  }
+  return NULL;
+}
+
+extern list_t* create_list(kv_memory_t *memory, int64_t category) {
+  list_t* new_list = kv_alloc(memory, category, sizeof(list_t));
   if (new_list == NULL) {
-    logger(3, "Error: Failed to allocated memory for a linked list.\n");
+    kv_log(3, "Error: Failed to allocated memory for a linked list.\n");
     return NULL;
   }
   new_list->size = 0;
   new_list->head = NULL;
+  new_list->tail = NULL;
+  new_list->index = NULL;
+  new_list->index_capacity = 0;
+  new_list->memory = memory;
+  new_list->category = category;
   return new_list;
 }
 
 extern int64_t list_insert(list_t* list, db_entry_t *entry) {
   if (list == NULL || entry == NULL) {
-    logger(3, "Error: NULL pointer passed to list_insert\n");
+    kv_log(3, "Error: NULL pointer passed to list_insert\n");
     return -1;
   }
+
+  /* Stored keys are compared as whole zero-padded buffers */
+  kv_key_pad(entry->key, entry->key);
+  kv_key_probe_t probe;
+  kv_key_probe(&probe, entry->key);
+  if (find_node(list, &probe) != NULL) {
+    return KV_EXISTS;
+  }
   
-  node_t* new_node = malloc(sizeof(node_t));
+  node_t* new_node = kv_alloc(list->memory, KV_ALLOC_NODES, sizeof(node_t));
   if (new_node == NULL) {
-    logger(3, "Error: Failed to allocated memory for a node.\n");
-    return -1;
+    kv_log(3, "Error: Failed to allocated memory for a node.\n");
+    return KV_OOM;
   }
 
   new_node->entry = entry;
   new_node->next = NULL;
+  new_node->prev = list->tail;
 
   if(list->head == NULL) {
     list->head = new_node;
   }
   else {
-    node_t* current_node = list->head;
-    while(current_node->next != NULL) {
-      if (strcmp(current_node->entry->key, entry->key) == 0) {
-        logger(4, "Error: Entry with key \"%s\" already exists\n", entry->key);
-        free(new_node);
-        return -1;
-      }
-      current_node = current_node->next;
-    }
-
-    if (strcmp(current_node->entry->key, entry->key) == 0) {
-      logger(4, "Error: Entry with key \"%s\" already exists\n", entry->key);
-      free(new_node);
-      return -1;
-    }
-    
-    current_node->next = new_node;
+    list->tail->next = new_node;
   }
-
+  list->tail = new_node;
   list->size++;
 
-  return 0;
+  index_add(list, new_node, &probe);
+  return KV_OK;
 }
 
-extern int64_t list_put(list_t* list, uint8_t* key, uint8_t* value, uint8_t* type) {
+extern int64_t list_put(list_t* list, uint8_t* key, uint8_t* value, uint64_t len, uint8_t* type) {
   if (list == NULL || key == NULL || value == NULL || type == NULL) {
-    logger(3, "Error: NULL pointer passed to list_put\n");
+    kv_log(3, "Error: NULL pointer passed to list_put\n");
     return -1;
   }
   
   db_entry_t *entry = list_get_entry_by_key(list, key);
   if (entry != NULL) {
-    if (update_entry(entry, value, type)) {
-      logger(3, "Error: Failed to update an entry\n");
-      return -1;
+    int64_t result = update_entry_span(entry, value, len, type);
+    if (result < 0) {
+      kv_log(3, "Error: Failed to update an entry\n");
+      return result;
     }
   }
   else {
-    entry = create_entry(key, value, type);
+    /* A new key needs a type, there is no previous one to keep */
+    if (type[0] == '\0') {
+      return KV_NOT_FOUND;
+    }
+
+    errno = 0;
+    entry = create_entry_with_memory(list->memory, key, value, len, type);
     if (entry == NULL) {
-      logger(3, "Error: Failed to create entry.\n");
-      return -1;
+      kv_log(3, "Error: Failed to create entry.\n");
+      return errno == ENOMEM ? KV_OOM : KV_TYPE_MISMATCH;
     }
     
-    if (list_insert(list, entry) < 0) {      
-      logger(3, "Error: Failed to insert entry into list.\n");
-      return -1;
+    int64_t result = list_insert(list, entry);
+    if (result < 0) {      
+      kv_log(3, "Error: Failed to insert entry into list.\n");
+      free_entry(entry);
+      return result;
     }
   }
-  return 0;
+  return KV_OK;
 }
 
 extern int64_t list_delete(list_t* list, uint8_t *key) {
   if (list == NULL || key == NULL) {
-    logger(3, "Error: NULL pointer passed to list_delete\n");
+    kv_log(3, "Error: NULL pointer passed to list_delete\n");
     return -1;
   }
   
-  if (strlen(key) == 0) {
-    logger(3, "Error: Empty string passed to list_delete\n");
+  if (key[0] == '\0') {
+    kv_log(3, "Error: Empty string passed to list_delete\n");
     return -1;
   }
 
-  node_t* previous_node = NULL;
-  node_t* current_node = list->head;
-  while (current_node != NULL) {
-    if (strcmp(current_node->entry->key, key) == 0) {
-      if (current_node == list->head) {
-        list->head = current_node->next;
-      }
-      else {
-        previous_node->next = current_node->next;
-      }
-      free_node(current_node);
-      list->size--;
-      return 0;
+  kv_key_probe_t probe;
+  if (!kv_key_probe(&probe, key)) {
+    return KV_NOT_FOUND;
+  }
+
+  node_t *node;
+  if (list->index != NULL) {
+    node_t **slot = index_slot(list, &probe);
+    node = *slot;
+    if (node != NULL) {
+      index_remove(list, slot);
     }
-    previous_node = current_node;
-    current_node = current_node->next;
   }
-  return -1;
+  else {
+    node = find_node(list, &probe);
+  }
+  if (node == NULL) {
+    return KV_NOT_FOUND;
+  }
+
+  if (node->prev != NULL) {
+    node->prev->next = node->next;
+  }
+  else {
+    list->head = node->next;
+  }
+  if (node->next != NULL) {
+    node->next->prev = node->prev;
+  }
+  else {
+    list->tail = node->prev;
+  }
+  free_node(list, node);
+  list->size--;
+  return 0;
 }
 
 extern db_entry_t *list_get_entry_by_idx(list_t* list, uint64_t idx) {
   if (list == NULL) {
-    logger(3, "Error: NULL pointer passed to list_get_entry_by_idx\n");
+    kv_log(3, "Error: NULL pointer passed to list_get_entry_by_idx\n");
     return NULL;
   }
   
   if (idx >= list->size) {
-    logger(3, "Index %d out of range for list\n", idx);
+    kv_log(3, "Index %d out of range for list\n", idx);
     return NULL;
   }
   uint64_t current_idx = 0;
@@ -139,46 +251,34 @@ extern db_entry_t *list_get_entry_by_idx(list_t* list, uint64_t idx) {
 
 extern db_entry_t *list_get_entry_by_key(list_t* list, uint8_t *key) {
   if (list == NULL || key == NULL) {
-    logger(3, "Error: NULL pointer passed to list_get_entry_by_key\n");
+    kv_log(3, "Error: NULL pointer passed to list_get_entry_by_key\n");
     return NULL;
   }
 
-  if (strlen(key) == 0) {
-    logger(3, "Error: Empty string passed to list_get_entry_by_key\n");
+  if (key[0] == '\0') {
+    kv_log(3, "Error: Empty string passed to list_get_entry_by_key\n");
     return NULL;
   }
-  
-  node_t* current_node = list->head;
-  while (current_node != NULL) {
-    if (strcmp(current_node->entry->key, key) == 0) {
-      return current_node->entry;
-    }
-    current_node = current_node->next;
+
+  kv_key_probe_t probe;
+  if (!kv_key_probe(&probe, key)) {
+    return NULL;
   }
-  return NULL;
+
+  node_t *node = find_node(list, &probe);
+  return node != NULL ? node->entry : NULL;
 }
 
 extern int64_t list_save(FILE *file, list_t *list) {
   if (file == NULL || list == NULL) {
-    logger(3, "Error: NULL pointer passed to list_save\n");
+    kv_log(3, "Error: NULL pointer passed to list_save\n");
     return -1;
   }
   
   node_t *current_node = list->head;
   while (current_node != NULL) {
-    uint8_t entry_str[BG_BUFFER_SIZE];
-    if (parse_entry(current_node->entry, entry_str, BG_BUFFER_SIZE) < 0){
-      logger(3, "Error: Failed to parse entry\n");
-      return -1;
-    }
-
-    if (strlen(entry_str) == 0) {
-      logger(3, "Error: Parsed a zero length entry\n");
-      return -1;
-    }
-
-    if (fputs(entry_str, file) == EOF) {
-      logger(3, "Error: Failed to write entry to file\n");
+    if (write_entry(file, current_node->entry) < 0) {
+      kv_log(3, "Error: Failed to write entry to file\n");
       return -1;
     }
 
@@ -187,17 +287,19 @@ extern int64_t list_save(FILE *file, list_t *list) {
   return 0;
 }
 
-extern void free_node(node_t *node) {
-  if (node == NULL) return;
+extern void free_node(list_t *list, node_t *node) {
+  if (list == NULL || node == NULL) return;
   free_entry(node->entry);
-  free(node);
+  kv_free(list->memory, KV_ALLOC_NODES, node, sizeof(node_t));
 }
 
 extern void free_list(list_t *list) {
   if (list == NULL) return;
 
+  kv_free(list->memory, KV_ALLOC_BUCKETS, list->index, list->index_capacity * sizeof(node_t*));
+
   if (list->head == NULL) {
-    free(list);
+    kv_free(list->memory, list->category, list, sizeof(list_t));
     return;
   }
 
@@ -205,28 +307,28 @@ extern void free_list(list_t *list) {
   node_t *next_node;
   while (current_node != NULL) {
     next_node = current_node->next;
-    free_node(current_node);
+    free_node(list, current_node);
     current_node = next_node;
   }
 
-  free(list);
+  kv_free(list->memory, list->category, list, sizeof(list_t));
 }
 
 extern void list_print(list_t *list) {
   if (list == NULL) {
-    logger(3, "Error: NULL pointer passed to list_print\n");
+    kv_log(3, "Error: NULL pointer passed to list_print\n");
     return;
   }
   
   if (list->size == 0) {
-    logger(3, "Linked list is empty\n");
+    kv_log(3, "Linked list is empty\n");
     return;
   }
 
   for (uint64_t i = 0; i < list->size; i++) {
     db_entry_t *entry = list_get_entry_by_idx(list, i);
     if(entry == NULL) {
-      logger(3, "Error: Entry not found\n");
+      kv_log(3, "Error: Entry not found\n");
       return;
     }
     print_entry(entry);
@@ -0,0 +1,1831 @@
+#include "lsm_tree.h"
+
+static pthread_once_t lsm_reader_once = PTHREAD_ONCE_INIT;
+static pthread_key_t lsm_reader_key;
+
+static uint64_t lsm_hash(uint8_t *key) {
+  uint64_t hash_code = 14695981039346656037ULL;
+
+  uint8_t character;
+  while ((character = *key++) != '\0') {
+    hash_code ^= character;
+    hash_code *= 1099511628211ULL;
+  }
+
+  return hash_code;
+}
+
+static void build_lsm_path(lsm_tree_t *lsm, uint64_t file_id, uint8_t *extension,
+                            uint8_t *dest, uint64_t max_len) {
+  snprintf(dest, max_len, "%s/%09" PRIu64 ".%s", lsm->dir, file_id, extension);
+  dest[max_len-1] = '\0';
+}
+
+static uint8_t random_height(lsm_tree_t *lsm) {
+  uint8_t height = 1;
+  while (height < LSM_MAX_HEIGHT) {
+    lsm->random_state ^= lsm->random_state << 13;
+    lsm->random_state ^= lsm->random_state >> 7;
+    lsm->random_state ^= lsm->random_state << 17;
+    if ((lsm->random_state & 3) != 0) break;
+    height++;
+  }
+  return height;
+}
+
+static lsm_memtable_t *create_memtable(lsm_tree_t *lsm, bool with_wal) {
+  lsm_memtable_t *memtable = calloc(1, sizeof(lsm_memtable_t));
+  if (memtable == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for memtable\n");
+    return NULL;
+  }
+
+  memtable->head = calloc(1, sizeof(lsm_memtable_node_t) + LSM_MAX_HEIGHT * sizeof(lsm_memtable_node_t*));
+  if (memtable->head == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for memtable\n");
+    free(memtable);
+    return NULL;
+  }
+  memtable->head->height = LSM_MAX_HEIGHT;
+  memtable->wal_fd = -1;
+
+  if (with_wal) {
+    memtable->wal_id = lsm->next_id++;
+    uint8_t wal_path[BG_BUFFER_SIZE];
+    build_lsm_path(lsm, memtable->wal_id, "wal", wal_path, BG_BUFFER_SIZE);
+    memtable->wal_fd = open(wal_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (memtable->wal_fd < 0) {
+      kv_log(3, "Error: Failed to create write-ahead log %s\n", wal_path);
+      free(memtable->head);
+      free(memtable);
+      return NULL;
+    }
+  }
+
+  return memtable;
+}
+
+static void free_memtable(lsm_tree_t *lsm, lsm_memtable_t *memtable, bool delete_wal) {
+  if (memtable == NULL) return;
+
+  lsm_memtable_node_t *current = memtable->head;
+  while (current != NULL) {
+    lsm_memtable_node_t *next = current->next[0];
+    if (current->entry.value != current->value_buffer) {
+      free(current->entry.value);
+    }
+    free(current);
+    current = next;
+  }
+
+  if (memtable->wal_fd >= 0) {
+    close(memtable->wal_fd);
+    if (delete_wal) {
+      uint8_t wal_path[BG_BUFFER_SIZE];
+      build_lsm_path(lsm, memtable->wal_id, "wal", wal_path, BG_BUFFER_SIZE);
+      unlink(wal_path);
+    }
+  }
+  free(memtable);
+}
+
+static lsm_memtable_node_t *memtable_find(lsm_memtable_t *memtable, uint8_t *key) {
+  lsm_memtable_node_t *current = memtable->head;
+  for (int64_t level = LSM_MAX_HEIGHT - 1; level >= 0; level--) {
+    while (current->next[level] != NULL && strcmp(current->next[level]->entry.key, key) < 0) {
+      current = current->next[level];
+    }
+  }
+
+  current = current->next[0];
+  if (current != NULL && strcmp(current->entry.key, key) == 0) {
+    return current;
+  }
+  return NULL;
+}
+
+static int64_t memtable_put(lsm_tree_t *lsm, lsm_memtable_t *memtable, uint8_t *key,
+                            int64_t type, void *value, uint32_t value_size) {
+  lsm_memtable_node_t *update[LSM_MAX_HEIGHT];
+  lsm_memtable_node_t *current = memtable->head;
+  for (int64_t level = LSM_MAX_HEIGHT - 1; level >= 0; level--) {
+    while (current->next[level] != NULL && strcmp(current->next[level]->entry.key, key) < 0) {
+      current = current->next[level];
+    }
+    update[level] = current;
+  }
+
+  current = current->next[0];
+  if (current == NULL || strcmp(current->entry.key, key) != 0) {
+    uint8_t height = random_height(lsm);
+    current = calloc(1, sizeof(lsm_memtable_node_t) + height * sizeof(lsm_memtable_node_t*));
+    if (current == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for memtable node\n");
+      return -1;
+    }
+    strncpy(current->entry.key, key, SM_BUFFER_SIZE);
+    current->entry.key[SM_BUFFER_SIZE-1] = '\0';
+    current->entry.value = current->value_buffer;
+    current->height = height;
+
+    for (uint8_t level = 0; level < height; level++) {
+      current->next[level] = update[level]->next[level];
+      update[level]->next[level] = current;
+    }
+    memtable->size += sizeof(lsm_memtable_node_t) + height * sizeof(lsm_memtable_node_t*);
+    memtable->count++;
+  }
+
+  /* Values that do not fit in the node get a NUL-terminated copy of their own */
+  uint8_t *storage = current->value_buffer;
+  uint64_t terminator = map_datatype_size(type) == 0 ? 1 : 0;
+  if (value_size + terminator > sizeof(current->value_buffer)) {
+    storage = malloc(value_size + 1);
+    if (storage == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for a memtable value\n");
+      return -1;
+    }
+    storage[value_size] = '\0';
+  }
+
+  if (current->entry.value != current->value_buffer) {
+    memtable->size -= current->entry.size + 1;
+    free(current->entry.value);
+  }
+  if (storage != current->value_buffer) {
+    memtable->size += value_size + 1;
+  }
+
+  current->entry.type = type;
+  current->entry.value = storage;
+  current->entry.size = value_size;
+  memset(current->value_buffer, 0, sizeof(current->value_buffer));
+  if (value != NULL) {
+    memcpy(storage, value, value_size);
+  }
+  return 0;
+}
+
+static uint64_t encode_record(uint8_t *dest, uint8_t *key, int64_t type, void *value, uint32_t value_size) {
+  lsm_record_header_t header = {
+    .value_size = value_size,
+    .key_size = (uint8_t)strlen(key),
+    .type = (int8_t)type,
+    .reserved = 0
+  };
+
+  memcpy(dest, &header, sizeof(lsm_record_header_t));
+  memcpy(dest + sizeof(lsm_record_header_t), key, header.key_size);
+  if (value_size > 0) {
+    memcpy(dest + sizeof(lsm_record_header_t) + header.key_size, value, value_size);
+  }
+  return sizeof(lsm_record_header_t) + header.key_size + value_size;
+}
+
+static int64_t decode_record(uint8_t *src, uint64_t max_len, uint8_t *key, int64_t *type,
+                             uint8_t **value, uint32_t *value_size) {
+  if (max_len < sizeof(lsm_record_header_t)) return -1;
+
+  lsm_record_header_t header;
+  memcpy(&header, src, sizeof(lsm_record_header_t));
+  uint64_t size = sizeof(lsm_record_header_t) + header.key_size + header.value_size;
+  if (header.key_size == 0 || header.key_size >= SM_BUFFER_SIZE || size > max_len) {
+    return -1;
+  }
+
+  memcpy(key, src + sizeof(lsm_record_header_t), header.key_size);
+  key[header.key_size] = '\0';
+  *value = src + sizeof(lsm_record_header_t) + header.key_size;
+  *type = header.type;
+  *value_size = header.value_size;
+  return size;
+}
+
+static int64_t write_record(lsm_tree_t *lsm, uint8_t *key, int64_t type, void *value, uint32_t value_size) {
+  while (lsm->memtable->size >= lsm->memtable_size) {
+    if (lsm->background_error) {
+      kv_log(3, "Error: LSM tree background worker failed, writes are disabled\n");
+      return -1;
+    }
+
+    if (lsm->immutable == NULL) {
+      lsm_memtable_t *memtable = create_memtable(lsm, true);
+      if (memtable == NULL) return -1;
+
+      lsm->immutable = lsm->memtable;
+      lsm->memtable = memtable;
+      pthread_cond_signal(&lsm->work_cond);
+      break;
+    }
+
+    /* The previous memtable is still being flushed, stall the writer */
+    pthread_cond_wait(&lsm->done_cond, &lsm->lock);
+  }
+
+  /* The value is written from the caller's buffer, whatever its size */
+  uint8_t record[sizeof(uint32_t) + sizeof(lsm_record_header_t) + SM_BUFFER_SIZE];
+  uint64_t prefix_size = encode_record(record + sizeof(uint32_t), key, type, NULL, 0);
+  lsm_record_header_t *header = (lsm_record_header_t*)(record + sizeof(uint32_t));
+  header->value_size = value_size;
+  uint32_t crc = crc32c(crc32c(0, record + sizeof(uint32_t), prefix_size), value, value_size);
+  memcpy(record, &crc, sizeof(uint32_t));
+  prefix_size += sizeof(uint32_t);
+
+  struct iovec parts[2] = {
+    { .iov_base = record, .iov_len = prefix_size },
+    { .iov_base = value, .iov_len = value_size }
+  };
+  uint64_t record_size = prefix_size + value_size;
+  if (writev(lsm->memtable->wal_fd, parts, value_size > 0 ? 2 : 1) != (ssize_t)record_size) {
+    kv_log(3, "Error: Failed to append to the write-ahead log\n");
+    return -1;
+  }
+
+  return memtable_put(lsm, lsm->memtable, key, type, value, value_size);
+}
+
+static int64_t replay_wal(lsm_tree_t *lsm, lsm_memtable_t *memtable, uint8_t *wal_path) {
+  int32_t fd = open(wal_path, O_RDONLY);
+  if (fd < 0) {
+    kv_log(3, "Error: Failed to open write-ahead log %s\n", wal_path);
+    return -1;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0) {
+    kv_log(3, "Error: Failed to stat write-ahead log %s\n", wal_path);
+    close(fd);
+    return -1;
+  }
+
+  uint64_t size = file_stat.st_size;
+  uint8_t *buffer = malloc(size + 1);
+  if (buffer == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for write-ahead log replay\n");
+    close(fd);
+    return -1;
+  }
+
+  if (pread(fd, buffer, size, 0) != (ssize_t)size) {
+    kv_log(3, "Error: Failed to read write-ahead log %s\n", wal_path);
+    free(buffer);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+
+  uint64_t offset = 0;
+  while (offset < size) {
+    uint8_t key[SM_BUFFER_SIZE];
+    uint8_t *value;
+    int64_t type;
+    uint32_t value_size;
+    uint32_t crc;
+    int64_t record_size = -1;
+    if (size - offset > sizeof(uint32_t)) {
+      memcpy(&crc, buffer + offset, sizeof(uint32_t));
+      record_size = decode_record(buffer + offset + sizeof(uint32_t), size - offset - sizeof(uint32_t),
+                                  key, &type, &value, &value_size);
+    }
+    if (record_size < 0 || crc32c(0, buffer + offset + sizeof(uint32_t), record_size) != crc) {
+      /* A write interrupted by a crash, everything before it is intact */
+      kv_log(4, "Warning: Ignoring %lu bytes at the end of %s\n", size - offset, wal_path);
+      break;
+    }
+    record_size += sizeof(uint32_t);
+
+    if (memtable_put(lsm, memtable, key, type, value, value_size) < 0) {
+      free(buffer);
+      return -1;
+    }
+    offset += record_size;
+  }
+
+  free(buffer);
+  return 0;
+}
+
+static lsm_table_t *open_table(lsm_tree_t *lsm, uint64_t file_id) {
+  uint8_t table_path[BG_BUFFER_SIZE];
+  build_lsm_path(lsm, file_id, "sst", table_path, BG_BUFFER_SIZE);
+
+  lsm_table_t *table = calloc(1, sizeof(lsm_table_t));
+  if (table == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for table\n");
+    return NULL;
+  }
+  table->id = file_id;
+
+  table->fd = open(table_path, O_RDONLY);
+  if (table->fd < 0) {
+    kv_log(3, "Error: Failed to open table %s\n", table_path);
+    free(table);
+    return NULL;
+  }
+
+  struct stat file_stat;
+  lsm_table_footer_t footer;
+  if (fstat(table->fd, &file_stat) < 0 || file_stat.st_size < (off_t)sizeof(lsm_table_footer_t) ||
+      pread(table->fd, &footer, sizeof(lsm_table_footer_t),
+            file_stat.st_size - sizeof(lsm_table_footer_t)) != sizeof(lsm_table_footer_t) ||
+      footer.magic != LSM_TABLE_MAGIC || footer.index_count == 0 ||
+      footer.index_offset + footer.index_count * sizeof(lsm_block_handle_t) != footer.bloom_offset ||
+      footer.bloom_offset + footer.bloom_bits / 8 + sizeof(lsm_table_footer_t) != (uint64_t)file_stat.st_size) {
+    kv_log(3, "Error: Table %s is corrupted\n", table_path);
+    close_table(lsm, table, false);
+    return NULL;
+  }
+
+  table->file_size = file_stat.st_size;
+  table->entry_count = footer.entry_count;
+  table->index_count = footer.index_count;
+  table->bloom_bits = footer.bloom_bits;
+  table->bloom_hashes = footer.bloom_hashes;
+  table->index = malloc(table->index_count * sizeof(lsm_block_handle_t));
+  table->bloom = malloc(table->bloom_bits / 8);
+  if (table->index == NULL || table->bloom == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for the index of table %s\n", table_path);
+    close_table(lsm, table, false);
+    return NULL;
+  }
+
+  uint64_t index_size = table->index_count * sizeof(lsm_block_handle_t);
+  if (pread(table->fd, table->index, index_size, footer.index_offset) != (ssize_t)index_size ||
+      pread(table->fd, table->bloom, table->bloom_bits / 8, footer.bloom_offset) != (ssize_t)(table->bloom_bits / 8)) {
+    kv_log(3, "Error: Failed to read the index of table %s\n", table_path);
+    close_table(lsm, table, false);
+    return NULL;
+  }
+
+  if (crc32c(crc32c(0, table->index, index_size), table->bloom, table->bloom_bits / 8) != footer.meta_crc) {
+    kv_log(3, "Error: Checksum mismatch in the index of table %s\n", table_path);
+    close_table(lsm, table, false);
+    return NULL;
+  }
+  memcpy(table->largest, table->index[table->index_count-1].last_key, SM_BUFFER_SIZE);
+
+  lsm_iterator_t iterator;
+  iterator_init_table(&iterator, table, NULL);
+  if (!iterator.valid) {
+    kv_log(3, "Error: Failed to read the first block of table %s\n", table_path);
+    iterator_free(&iterator);
+    close_table(lsm, table, false);
+    return NULL;
+  }
+  memcpy(table->smallest, iterator.key, SM_BUFFER_SIZE);
+  iterator_free(&iterator);
+
+  return table;
+}
+
+static void close_table(lsm_tree_t *lsm, lsm_table_t *table, bool delete_file) {
+  if (table == NULL) return;
+
+  if (table->fd >= 0) {
+    close(table->fd);
+  }
+  if (delete_file) {
+    uint8_t table_path[BG_BUFFER_SIZE];
+    build_lsm_path(lsm, table->id, "sst", table_path, BG_BUFFER_SIZE);
+    unlink(table_path);
+  }
+  free(table->index);
+  free(table->bloom);
+  free(table);
+}
+
+static bool table_may_contain(lsm_table_t *table, uint64_t hash) {
+  uint64_t delta = (hash >> 33) | (hash << 31);
+  for (uint64_t idx = 0; idx < table->bloom_hashes; idx++) {
+    uint64_t bit = hash % table->bloom_bits;
+    if ((table->bloom[bit / 8] & (1 << (bit % 8))) == 0) {
+      return false;
+    }
+    hash += delta;
+  }
+  return true;
+}
+
+static int64_t read_block(lsm_table_t *table, uint64_t block_idx, uint8_t **dest, uint64_t *capacity) {
+  uint64_t size = table->index[block_idx].size;
+  if (size > *capacity) {
+    uint8_t *new_block = realloc(*dest, size);
+    if (new_block == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for table block\n");
+      return -1;
+    }
+    *dest = new_block;
+    *capacity = size;
+  }
+
+  if (pread(table->fd, *dest, size, table->index[block_idx].offset) != (ssize_t)size) {
+    kv_log(3, "Error: Failed to read block %lu of table %lu\n", block_idx, table->id);
+    return -1;
+  }
+
+  if (crc32c(0, *dest, size) != table->index[block_idx].crc) {
+    kv_log(3, "Error: Checksum mismatch in block %lu of table %lu\n", block_idx, table->id);
+    return -1;
+  }
+  return size;
+}
+
+static uint64_t find_block(lsm_table_t *table, uint8_t *key) {
+  uint64_t low = 0;
+  uint64_t high = table->index_count;
+  while (low < high) {
+    uint64_t middle = (low + high) / 2;
+    if (strcmp(table->index[middle].last_key, key) < 0) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+static int64_t table_get(lsm_tree_t *lsm, lsm_table_t *table, uint8_t *key, uint64_t hash,
+                         int64_t *type, uint8_t **value, uint32_t *value_size) {
+  if (strcmp(key, table->smallest) < 0 || strcmp(key, table->largest) > 0 ||
+      !table_may_contain(table, hash)) {
+    return 0;
+  }
+
+  uint64_t block_idx = find_block(table, key);
+  if (block_idx >= table->index_count) return 0;
+
+  int64_t block_size = read_block(table, block_idx, &lsm->block_buffer, &lsm->block_capacity);
+  if (block_size < 0) return -1;
+
+  uint64_t offset = 0;
+  while (offset < (uint64_t)block_size) {
+    uint8_t record_key[SM_BUFFER_SIZE];
+    int64_t record_size = decode_record(lsm->block_buffer + offset, block_size - offset,
+                                        record_key, type, value, value_size);
+    if (record_size < 0) {
+      kv_log(3, "Error: Block %lu of table %lu is corrupted\n", block_idx, table->id);
+      return -1;
+    }
+
+    int32_t comparison = strcmp(record_key, key);
+    if (comparison == 0) return 1;
+    if (comparison > 0) break;
+    offset += record_size;
+  }
+  return 0;
+}
+
+static int64_t lookup(lsm_tree_t *lsm, uint8_t *key, int64_t *type, uint8_t **value, uint32_t *value_size) {
+  lsm_memtable_t *memtables[2] = { lsm->memtable, lsm->immutable };
+  for (uint64_t idx = 0; idx < 2; idx++) {
+    if (memtables[idx] == NULL) continue;
+
+    lsm_memtable_node_t *node = memtable_find(memtables[idx], key);
+    if (node != NULL) {
+      *type = node->entry.type;
+      *value = node->entry.value;
+      *value_size = node->entry.size;
+      return *type == LSM_TOMBSTONE_TYPE ? 0 : 1;
+    }
+  }
+
+  uint64_t hash = lsm_hash(key);
+  for (uint64_t level_idx = 0; level_idx < KV_LSM_MAX_LEVELS; level_idx++) {
+    lsm_level_t *level = &lsm->levels[level_idx];
+    uint64_t first = 0;
+    uint64_t last = level->count;
+
+    /* Deeper levels do not overlap, at most one table can hold the key */
+    if (level_idx > 0) {
+      uint64_t low = 0;
+      uint64_t high = level->count;
+      while (low < high) {
+        uint64_t middle = (low + high) / 2;
+        if (strcmp(level->tables[middle]->largest, key) < 0) {
+          low = middle + 1;
+        }
+        else {
+          high = middle;
+        }
+      }
+      first = low;
+      last = low < level->count ? low + 1 : low;
+    }
+
+    for (uint64_t idx = first; idx < last; idx++) {
+      int64_t result = table_get(lsm, level->tables[idx], key, hash, type, value, value_size);
+      if (result != 0) {
+        return result < 0 ? -1 : (*type == LSM_TOMBSTONE_TYPE ? 0 : 1);
+      }
+    }
+  }
+  return 0;
+}
+
+static int64_t writer_open(lsm_tree_t *lsm, lsm_table_writer_t *writer) {
+  memset(writer, 0, sizeof(lsm_table_writer_t));
+
+  pthread_mutex_lock(&lsm->lock);
+  writer->id = lsm->next_id++;
+  pthread_mutex_unlock(&lsm->lock);
+
+  uint8_t table_path[BG_BUFFER_SIZE];
+  build_lsm_path(lsm, writer->id, "sst", table_path, BG_BUFFER_SIZE);
+  writer->fd = open(table_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (writer->fd < 0) {
+    kv_log(3, "Error: Failed to create table %s\n", table_path);
+    return -1;
+  }
+
+  writer->block_capacity = lsm->block_size + sizeof(lsm_record_header_t) + SM_BUFFER_SIZE + sizeof(int64_t);
+  writer->block = malloc(writer->block_capacity);
+  writer->index_capacity = SM_BUFFER_SIZE;
+  writer->index = malloc(writer->index_capacity * sizeof(lsm_block_handle_t));
+  writer->hash_capacity = BG_BUFFER_SIZE;
+  writer->hashes = malloc(writer->hash_capacity * sizeof(uint64_t));
+  if (writer->block == NULL || writer->index == NULL || writer->hashes == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for table writer\n");
+    writer_abort(lsm, writer);
+    return -1;
+  }
+  return 0;
+}
+
+static int64_t writer_add(lsm_tree_t *lsm, lsm_table_writer_t *writer, uint8_t *key,
+                          int64_t type, void *value, uint32_t value_size) {
+  if (writer->entry_count == writer->hash_capacity) {
+    uint64_t *new_hashes = realloc(writer->hashes, writer->hash_capacity * 2 * sizeof(uint64_t));
+    if (new_hashes == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for table writer\n");
+      return -1;
+    }
+    writer->hashes = new_hashes;
+    writer->hash_capacity *= 2;
+  }
+  writer->hashes[writer->entry_count++] = lsm_hash(key);
+
+  /* Blocks are closed once they reach block_size, a large value still fits in one */
+  uint64_t record_size = sizeof(lsm_record_header_t) + strlen(key) + value_size;
+  if (writer->block_size + record_size > writer->block_capacity) {
+    uint8_t *new_block = realloc(writer->block, writer->block_size + record_size);
+    if (new_block == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for table writer\n");
+      return -1;
+    }
+    writer->block = new_block;
+    writer->block_capacity = writer->block_size + record_size;
+  }
+
+  writer->block_size += encode_record(writer->block + writer->block_size, key, type, value, value_size);
+  strncpy(writer->last_key, key, SM_BUFFER_SIZE);
+  writer->last_key[SM_BUFFER_SIZE-1] = '\0';
+
+  if (writer->block_size >= lsm->block_size) {
+    return writer_flush_block(writer);
+  }
+  return 0;
+}
+
+static int64_t writer_flush_block(lsm_table_writer_t *writer) {
+  if (writer->block_size == 0) return 0;
+
+  if (writer->index_count == writer->index_capacity) {
+    lsm_block_handle_t *new_index = realloc(writer->index,
+                                            writer->index_capacity * 2 * sizeof(lsm_block_handle_t));
+    if (new_index == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for table writer\n");
+      return -1;
+    }
+    writer->index = new_index;
+    writer->index_capacity *= 2;
+  }
+
+  if (write(writer->fd, writer->block, writer->block_size) != (ssize_t)writer->block_size) {
+    kv_log(3, "Error: Failed to write table block\n");
+    return -1;
+  }
+
+  lsm_block_handle_t *handle = &writer->index[writer->index_count++];
+  memset(handle, 0, sizeof(lsm_block_handle_t));
+  memcpy(handle->last_key, writer->last_key, SM_BUFFER_SIZE);
+  handle->offset = writer->offset;
+  handle->size = writer->block_size;
+  handle->crc = crc32c(0, writer->block, writer->block_size);
+
+  writer->offset += writer->block_size;
+  writer->block_size = 0;
+  return 0;
+}
+
+static lsm_table_t *writer_finish(lsm_tree_t *lsm, lsm_table_writer_t *writer) {
+  if (writer_flush_block(writer) < 0) {
+    writer_abort(lsm, writer);
+    return NULL;
+  }
+
+  lsm_table_footer_t footer = {
+    .index_offset = writer->offset,
+    .index_count = writer->index_count,
+    .bloom_offset = writer->offset + writer->index_count * sizeof(lsm_block_handle_t),
+    .bloom_bits = (writer->entry_count * KV_LSM_BLOOM_BITS_PER_KEY + 63) / 64 * 64,
+    .bloom_hashes = KV_LSM_BLOOM_BITS_PER_KEY * 69 / 100,
+    .entry_count = writer->entry_count,
+    .meta_crc = 0,
+    .reserved = 0,
+    .magic = LSM_TABLE_MAGIC
+  };
+  if (footer.bloom_hashes == 0) {
+    footer.bloom_hashes = 1;
+  }
+
+  uint8_t *bloom = calloc(footer.bloom_bits / 8, 1);
+  if (bloom == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for Bloom filter\n");
+    writer_abort(lsm, writer);
+    return NULL;
+  }
+
+  for (uint64_t idx = 0; idx < writer->entry_count; idx++) {
+    uint64_t hash = writer->hashes[idx];
+    uint64_t delta = (hash >> 33) | (hash << 31);
+    for (uint64_t probe = 0; probe < footer.bloom_hashes; probe++) {
+      uint64_t bit = hash % footer.bloom_bits;
+      bloom[bit / 8] |= 1 << (bit % 8);
+      hash += delta;
+    }
+  }
+
+  uint64_t index_size = writer->index_count * sizeof(lsm_block_handle_t);
+  footer.meta_crc = crc32c(crc32c(0, writer->index, index_size), bloom, footer.bloom_bits / 8);
+  bool failed = write(writer->fd, writer->index, index_size) != (ssize_t)index_size ||
+                write(writer->fd, bloom, footer.bloom_bits / 8) != (ssize_t)(footer.bloom_bits / 8) ||
+                write(writer->fd, &footer, sizeof(lsm_table_footer_t)) != sizeof(lsm_table_footer_t) ||
+                fsync(writer->fd) < 0;
+  free(bloom);
+
+  if (failed) {
+    kv_log(3, "Error: Failed to write table %lu\n", writer->id);
+    writer_abort(lsm, writer);
+    return NULL;
+  }
+
+  close(writer->fd);
+  writer->fd = -1;
+  free(writer->block);
+  free(writer->index);
+  free(writer->hashes);
+
+  lsm_table_t *table = open_table(lsm, writer->id);
+  if (table == NULL) {
+    uint8_t table_path[BG_BUFFER_SIZE];
+    build_lsm_path(lsm, writer->id, "sst", table_path, BG_BUFFER_SIZE);
+    unlink(table_path);
+  }
+  return table;
+}
+
+static void writer_abort(lsm_tree_t *lsm, lsm_table_writer_t *writer) {
+  if (writer->fd >= 0) {
+    close(writer->fd);
+    uint8_t table_path[BG_BUFFER_SIZE];
+    build_lsm_path(lsm, writer->id, "sst", table_path, BG_BUFFER_SIZE);
+    unlink(table_path);
+  }
+  free(writer->block);
+  free(writer->index);
+  free(writer->hashes);
+  memset(writer, 0, sizeof(lsm_table_writer_t));
+  writer->fd = -1;
+}
+
+static void iterator_load_node(lsm_iterator_t *iterator) {
+  iterator->valid = iterator->node != NULL;
+  if (!iterator->valid) return;
+
+  memcpy(iterator->key, iterator->node->entry.key, SM_BUFFER_SIZE);
+  iterator->value = iterator->node->entry.value;
+  iterator->type = iterator->node->entry.type;
+  iterator->value_size = iterator->node->entry.size;
+}
+
+static void iterator_read_record(lsm_iterator_t *iterator) {
+  while (iterator->block_pos >= iterator->block_size) {
+    iterator->block_idx++;
+    if (iterator->block_idx >= iterator->table->index_count) {
+      iterator->valid = false;
+      return;
+    }
+
+    int64_t block_size = read_block(iterator->table, iterator->block_idx,
+                                    &iterator->block, &iterator->block_capacity);
+    if (block_size < 0) {
+      iterator->valid = false;
+      iterator->failed = true;
+      return;
+    }
+    iterator->block_size = block_size;
+    iterator->block_pos = 0;
+  }
+
+  int64_t record_size = decode_record(iterator->block + iterator->block_pos,
+                                      iterator->block_size - iterator->block_pos,
+                                      iterator->key, &iterator->type,
+                                      &iterator->value, &iterator->value_size);
+  if (record_size < 0) {
+    kv_log(3, "Error: Block %lu of table %lu is corrupted\n", iterator->block_idx, iterator->table->id);
+    iterator->valid = false;
+    iterator->failed = true;
+    return;
+  }
+  iterator->block_pos += record_size;
+  iterator->valid = true;
+}
+
+static void iterator_init_memtable(lsm_iterator_t *iterator, lsm_memtable_t *memtable, uint8_t *start_key) {
+  memset(iterator, 0, sizeof(lsm_iterator_t));
+
+  lsm_memtable_node_t *current = memtable->head;
+  if (start_key != NULL) {
+    for (int64_t level = LSM_MAX_HEIGHT - 1; level >= 0; level--) {
+      while (current->next[level] != NULL && strcmp(current->next[level]->entry.key, start_key) < 0) {
+        current = current->next[level];
+      }
+    }
+  }
+  iterator->node = current->next[0];
+  iterator_load_node(iterator);
+}
+
+static void iterator_init_table(lsm_iterator_t *iterator, lsm_table_t *table, uint8_t *start_key) {
+  memset(iterator, 0, sizeof(lsm_iterator_t));
+  iterator->table = table;
+
+  /* iterator_read_record() moves to block_idx + 1 first */
+  uint64_t block_idx = start_key != NULL ? find_block(table, start_key) : 0;
+  iterator->block_idx = block_idx - 1;
+  iterator_read_record(iterator);
+
+  while (iterator->valid && start_key != NULL && strcmp(iterator->key, start_key) < 0) {
+    iterator_read_record(iterator);
+  }
+}
+
+static void iterator_next(lsm_iterator_t *iterator) {
+  if (!iterator->valid) return;
+
+  if (iterator->table == NULL) {
+    iterator->node = iterator->node->next[0];
+    iterator_load_node(iterator);
+  }
+  else {
+    iterator_read_record(iterator);
+  }
+}
+
+static void iterator_free(lsm_iterator_t *iterator) {
+  free(iterator->block);
+  iterator->block = NULL;
+  iterator->valid = false;
+}
+
+static int64_t iterator_pick(lsm_iterator_t *iterators, uint64_t iterator_count) {
+  /* Ties go to the first iterator, which holds the newest version */
+  int64_t picked = -1;
+  for (uint64_t idx = 0; idx < iterator_count; idx++) {
+    if (iterators[idx].valid &&
+        (picked < 0 || strcmp(iterators[idx].key, iterators[picked].key) < 0)) {
+      picked = idx;
+    }
+  }
+  return picked;
+}
+
+static void iterator_skip(lsm_iterator_t *iterators, uint64_t iterator_count, uint8_t *key) {
+  for (uint64_t idx = 0; idx < iterator_count; idx++) {
+    if (iterators[idx].valid && strcmp(iterators[idx].key, key) == 0) {
+      iterator_next(&iterators[idx]);
+    }
+  }
+}
+
+static int64_t merge_iterators(lsm_tree_t *lsm, lsm_iterator_t *iterators, uint64_t iterator_count,
+                               bool drop_tombstones, bool split,
+                               lsm_table_t ***outputs, uint64_t *output_count) {
+  *outputs = NULL;
+  *output_count = 0;
+  uint64_t output_capacity = 0;
+
+  lsm_table_writer_t writer;
+  bool writing = false;
+  int64_t result = 0;
+
+  int64_t picked;
+  while (result == 0 && (picked = iterator_pick(iterators, iterator_count)) >= 0) {
+    /* The value points into the iterator, it is added before moving past the key */
+    uint8_t key[SM_BUFFER_SIZE];
+    int64_t type = iterators[picked].type;
+    uint8_t *value = iterators[picked].value;
+    uint32_t value_size = iterators[picked].value_size;
+    memcpy(key, iterators[picked].key, SM_BUFFER_SIZE);
+
+    if (drop_tombstones && type == LSM_TOMBSTONE_TYPE) {
+      iterator_skip(iterators, iterator_count, key);
+      continue;
+    }
+
+    if (!writing) {
+      if (writer_open(lsm, &writer) < 0) {
+        result = -1;
+        break;
+      }
+      writing = true;
+    }
+
+    if (writer_add(lsm, &writer, key, type, value, value_size) < 0) {
+      result = -1;
+      break;
+    }
+    iterator_skip(iterators, iterator_count, key);
+
+    bool full = split && writer.offset + writer.block_size >= lsm->table_size;
+    if (!full) continue;
+
+    if (*output_count == output_capacity) {
+      output_capacity = output_capacity == 0 ? 4 : output_capacity * 2;
+      lsm_table_t **new_outputs = realloc(*outputs, output_capacity * sizeof(lsm_table_t*));
+      if (new_outputs == NULL) {
+        kv_log(3, "Error: Failed to allocate memory for compaction outputs\n");
+        result = -1;
+        break;
+      }
+      *outputs = new_outputs;
+    }
+
+    writing = false;
+    lsm_table_t *table = writer_finish(lsm, &writer);
+    if (table == NULL) {
+      result = -1;
+      break;
+    }
+    (*outputs)[(*output_count)++] = table;
+  }
+
+  for (uint64_t idx = 0; idx < iterator_count; idx++) {
+    if (iterators[idx].failed) {
+      result = -1;
+    }
+  }
+
+  if (writing && result == 0) {
+    lsm_table_t **new_outputs = realloc(*outputs, (*output_count + 1) * sizeof(lsm_table_t*));
+    if (new_outputs == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for compaction outputs\n");
+      result = -1;
+    }
+    else {
+      *outputs = new_outputs;
+      writing = false;
+      lsm_table_t *table = writer_finish(lsm, &writer);
+      if (table == NULL) {
+        result = -1;
+      }
+      else {
+        (*outputs)[(*output_count)++] = table;
+      }
+    }
+  }
+
+  if (result < 0) {
+    if (writing) {
+      writer_abort(lsm, &writer);
+    }
+    for (uint64_t idx = 0; idx < *output_count; idx++) {
+      close_table(lsm, (*outputs)[idx], true);
+    }
+    free(*outputs);
+    *outputs = NULL;
+    *output_count = 0;
+  }
+  return result;
+}
+
+static int64_t level_add(lsm_level_t *level, lsm_table_t *table, uint64_t level_idx) {
+  if (level->count == level->capacity) {
+    uint64_t new_capacity = level->capacity == 0 ? 8 : level->capacity * 2;
+    lsm_table_t **new_tables = realloc(level->tables, new_capacity * sizeof(lsm_table_t*));
+    if (new_tables == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for level tables\n");
+      return -1;
+    }
+    level->tables = new_tables;
+    level->capacity = new_capacity;
+  }
+
+  /* Level 0 is ordered newest first, deeper levels by key */
+  uint64_t position = 0;
+  if (level_idx > 0) {
+    while (position < level->count && strcmp(level->tables[position]->smallest, table->smallest) < 0) {
+      position++;
+    }
+  }
+
+  memmove(&level->tables[position + 1], &level->tables[position],
+          (level->count - position) * sizeof(lsm_table_t*));
+  level->tables[position] = table;
+  level->count++;
+  level->size += table->file_size;
+  return 0;
+}
+
+static void level_remove(lsm_level_t *level, lsm_table_t *table) {
+  for (uint64_t idx = 0; idx < level->count; idx++) {
+    if (level->tables[idx] == table) {
+      memmove(&level->tables[idx], &level->tables[idx + 1],
+              (level->count - idx - 1) * sizeof(lsm_table_t*));
+      level->count--;
+      level->size -= table->file_size;
+      return;
+    }
+  }
+}
+
+static int64_t write_manifest(lsm_tree_t *lsm) {
+  uint8_t manifest_path[BG_BUFFER_SIZE];
+  uint8_t tmp_path[BG_BUFFER_SIZE];
+  snprintf(manifest_path, BG_BUFFER_SIZE, "%s/MANIFEST", lsm->dir);
+  snprintf(tmp_path, BG_BUFFER_SIZE, "%s/MANIFEST.tmp", lsm->dir);
+
+  FILE *manifest = fopen(tmp_path, "w");
+  if (manifest == NULL) {
+    kv_log(3, "Error: Failed to create %s\n", tmp_path);
+    return -1;
+  }
+
+  bool failed = fprintf(manifest, "next %lu\n", lsm->next_id) < 0;
+  for (uint64_t level_idx = 0; level_idx < KV_LSM_MAX_LEVELS && !failed; level_idx++) {
+    lsm_level_t *level = &lsm->levels[level_idx];
+    /* Written oldest first so that reloading level 0 rebuilds its order */
+    for (uint64_t idx = level->count; idx > 0 && !failed; idx--) {
+      failed = fprintf(manifest, "table %lu %lu\n", level_idx, level->tables[idx-1]->id) < 0;
+    }
+  }
+
+  if (failed || fflush(manifest) == EOF || fsync(fileno(manifest)) < 0) {
+    kv_log(3, "Error: Failed to write %s\n", tmp_path);
+    fclose(manifest);
+    unlink(tmp_path);
+    return -1;
+  }
+
+  if (fclose(manifest) == EOF || rename(tmp_path, manifest_path) < 0) {
+    kv_log(3, "Error: Failed to replace %s\n", manifest_path);
+    unlink(tmp_path);
+    return -1;
+  }
+
+  int32_t dir_fd = open(lsm->dir, O_RDONLY | O_DIRECTORY);
+  if (dir_fd < 0 || fsync(dir_fd) < 0) {
+    kv_log(3, "Error: Failed to sync directory %s\n", lsm->dir);
+    if (dir_fd >= 0) close(dir_fd);
+    return -1;
+  }
+  close(dir_fd);
+
+  return 0;
+}
+
+static bool levels_empty(lsm_tree_t *lsm, uint64_t first_level) {
+  for (uint64_t level_idx = first_level; level_idx < KV_LSM_MAX_LEVELS; level_idx++) {
+    if (lsm->levels[level_idx].count > 0) return false;
+  }
+  return true;
+}
+
+static int64_t flush_immutable(lsm_tree_t *lsm) {
+  lsm_memtable_t *immutable = lsm->immutable;
+  bool drop_tombstones = levels_empty(lsm, 0);
+  lsm->working = true;
+  pthread_mutex_unlock(&lsm->lock);
+
+  lsm_iterator_t iterator;
+  iterator_init_memtable(&iterator, immutable, NULL);
+  lsm_table_t **outputs;
+  uint64_t output_count;
+  int64_t result = merge_iterators(lsm, &iterator, 1, drop_tombstones, false, &outputs, &output_count);
+  iterator_free(&iterator);
+
+  pthread_mutex_lock(&lsm->lock);
+  for (uint64_t idx = 0; idx < output_count && result == 0; idx++) {
+    result = level_add(&lsm->levels[0], outputs[idx], 0);
+  }
+  if (result == 0) {
+    result = write_manifest(lsm);
+  }
+  free(outputs);
+
+  if (result == 0) {
+    lsm->immutable = NULL;
+    free_memtable(lsm, immutable, true);
+  }
+  lsm->working = false;
+  return result;
+}
+
+static int64_t pick_compaction(lsm_tree_t *lsm) {
+  if (lsm->levels[0].count >= lsm->level0_tables ||
+      (lsm->force_compaction && lsm->levels[0].count > 0)) {
+    return 0;
+  }
+
+  uint64_t limit = lsm->level_base_size;
+  for (uint64_t level_idx = 1; level_idx < KV_LSM_MAX_LEVELS - 1; level_idx++) {
+    if (lsm->levels[level_idx].size > limit) {
+      return level_idx;
+    }
+    limit *= KV_LSM_LEVEL_MULTIPLIER;
+  }
+  return -1;
+}
+
+static int64_t compact_level(lsm_tree_t *lsm, uint64_t level_idx) {
+  lsm_level_t *level = &lsm->levels[level_idx];
+  lsm_level_t *next_level = &lsm->levels[level_idx + 1];
+
+  uint64_t input_count = 0;
+  lsm_table_t **inputs = malloc((level->count + next_level->count) * sizeof(lsm_table_t*));
+  if (inputs == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for compaction inputs\n");
+    return -1;
+  }
+
+  /* Level 0 tables overlap, so all of them move down together */
+  if (level_idx == 0) {
+    for (uint64_t idx = 0; idx < level->count; idx++) {
+      inputs[input_count++] = level->tables[idx];
+    }
+    lsm->force_compaction = false;
+  }
+  else {
+    inputs[input_count++] = level->tables[lsm->compact_pointer[level_idx] % level->count];
+    lsm->compact_pointer[level_idx]++;
+  }
+  uint64_t level_input_count = input_count;
+
+  uint8_t *smallest = inputs[0]->smallest;
+  uint8_t *largest = inputs[0]->largest;
+  for (uint64_t idx = 1; idx < input_count; idx++) {
+    if (strcmp(inputs[idx]->smallest, smallest) < 0) smallest = inputs[idx]->smallest;
+    if (strcmp(inputs[idx]->largest, largest) > 0) largest = inputs[idx]->largest;
+  }
+  for (uint64_t idx = 0; idx < next_level->count; idx++) {
+    lsm_table_t *table = next_level->tables[idx];
+    if (strcmp(table->largest, smallest) >= 0 && strcmp(table->smallest, largest) <= 0) {
+      inputs[input_count++] = table;
+    }
+  }
+
+  /* Nothing to merge with, move the table down without rewriting it */
+  if (level_input_count == 1 && input_count == 1) {
+    level_remove(level, inputs[0]);
+    int64_t result = level_add(next_level, inputs[0], level_idx + 1);
+    if (result == 0) {
+      result = write_manifest(lsm);
+    }
+    free(inputs);
+    return result;
+  }
+
+  bool drop_tombstones = levels_empty(lsm, level_idx + 2);
+  lsm->working = true;
+  pthread_mutex_unlock(&lsm->lock);
+
+  int64_t result = 0;
+  lsm_iterator_t *iterators = calloc(input_count, sizeof(lsm_iterator_t));
+  if (iterators == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for compaction iterators\n");
+    result = -1;
+  }
+
+  lsm_table_t **outputs = NULL;
+  uint64_t output_count = 0;
+  if (result == 0) {
+    for (uint64_t idx = 0; idx < input_count; idx++) {
+      iterator_init_table(&iterators[idx], inputs[idx], NULL);
+    }
+    result = merge_iterators(lsm, iterators, input_count, drop_tombstones, true, &outputs, &output_count);
+    for (uint64_t idx = 0; idx < input_count; idx++) {
+      iterator_free(&iterators[idx]);
+    }
+  }
+  free(iterators);
+
+  pthread_mutex_lock(&lsm->lock);
+  if (result == 0) {
+    for (uint64_t idx = 0; idx < input_count; idx++) {
+      level_remove(idx < level_input_count ? level : next_level, inputs[idx]);
+    }
+    for (uint64_t idx = 0; idx < output_count && result == 0; idx++) {
+      result = level_add(next_level, outputs[idx], level_idx + 1);
+    }
+    if (result == 0) {
+      result = write_manifest(lsm);
+    }
+    /* Inputs are only deleted once the manifest no longer lists them */
+    if (result == 0) {
+      for (uint64_t idx = 0; idx < input_count; idx++) {
+        close_table(lsm, inputs[idx], true);
+      }
+    }
+  }
+  free(outputs);
+  free(inputs);
+
+  lsm->working = false;
+  return result;
+}
+
+static void *lsm_worker(void *arg) {
+  lsm_tree_t *lsm = (lsm_tree_t*)arg;
+
+  pthread_mutex_lock(&lsm->lock);
+  while (!lsm->shutdown) {
+    if (!lsm->background_error) {
+      int64_t result = 0;
+      bool worked = true;
+      if (lsm->immutable != NULL) {
+        result = flush_immutable(lsm);
+      }
+      else {
+        int64_t level_idx = pick_compaction(lsm);
+        if (level_idx >= 0) {
+          result = compact_level(lsm, level_idx);
+        }
+        else {
+          worked = false;
+        }
+      }
+
+      if (result < 0) {
+        kv_log(3, "Error: LSM tree background work failed in %s\n", lsm->dir);
+        lsm->background_error = true;
+      }
+      pthread_cond_broadcast(&lsm->done_cond);
+      if (worked) continue;
+    }
+
+    pthread_cond_wait(&lsm->work_cond, &lsm->lock);
+  }
+  pthread_mutex_unlock(&lsm->lock);
+
+  return NULL;
+}
+
+extern lsm_tree_t* create_lsm_tree() {
+  lsm_tree_t *lsm = calloc(1, sizeof(lsm_tree_t));
+  if (lsm == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for LSM tree\n");
+    return NULL;
+  }
+
+  lsm->memtable_size = KV_LSM_MEMTABLE_SIZE;
+  lsm->table_size = KV_LSM_TABLE_SIZE;
+  lsm->block_size = KV_LSM_BLOCK_SIZE;
+  lsm->level0_tables = KV_LSM_LEVEL0_TABLES;
+  lsm->level_base_size = KV_LSM_LEVEL_BASE_SIZE;
+  lsm->random_state = 0x9e3779b97f4a7c15ULL;
+  pthread_mutex_init(&lsm->lock, NULL);
+  pthread_cond_init(&lsm->work_cond, NULL);
+  pthread_cond_init(&lsm->done_cond, NULL);
+
+  return lsm;
+}
+
+static bool table_listed(lsm_tree_t *lsm, uint64_t file_id) {
+  for (uint64_t level_idx = 0; level_idx < KV_LSM_MAX_LEVELS; level_idx++) {
+    for (uint64_t idx = 0; idx < lsm->levels[level_idx].count; idx++) {
+      if (lsm->levels[level_idx].tables[idx]->id == file_id) return true;
+    }
+  }
+  return false;
+}
+
+static int compare_lsm_ids(const void *first, const void *second) {
+  uint64_t first_id = *(uint64_t*)first;
+  uint64_t second_id = *(uint64_t*)second;
+  return (first_id > second_id) - (first_id < second_id);
+}
+
+static int64_t load_manifest(lsm_tree_t *lsm) {
+  uint8_t manifest_path[BG_BUFFER_SIZE];
+  snprintf(manifest_path, BG_BUFFER_SIZE, "%s/MANIFEST", lsm->dir);
+
+  FILE *manifest = fopen(manifest_path, "r");
+  if (manifest == NULL) {
+    return errno == ENOENT ? 0 : -1;
+  }
+
+  int64_t result = 0;
+  if (fscanf(manifest, "next %lu\n", &lsm->next_id) != 1) {
+    kv_log(3, "Error: Manifest %s is corrupted\n", manifest_path);
+    result = -1;
+  }
+
+  uint64_t level_idx, file_id;
+  while (result == 0 && fscanf(manifest, "table %lu %lu\n", &level_idx, &file_id) == 2) {
+    if (level_idx >= KV_LSM_MAX_LEVELS) {
+      kv_log(3, "Error: Manifest %s is corrupted\n", manifest_path);
+      result = -1;
+      break;
+    }
+
+    lsm_table_t *table = open_table(lsm, file_id);
+    if (table == NULL || level_add(&lsm->levels[level_idx], table, level_idx) < 0) {
+      close_table(lsm, table, false);
+      result = -1;
+    }
+  }
+  fclose(manifest);
+
+  return result;
+}
+
+extern int64_t lsm_open(lsm_tree_t *lsm, uint8_t *dir) {
+  if (lsm == NULL || dir == NULL) {
+    kv_log(3, "Error: NULL pointer passed to lsm_open\n");
+    return -1;
+  }
+
+  if (strlen(dir) == 0 || strlen(dir) >= BG_BUFFER_SIZE - SM_BUFFER_SIZE) {
+    kv_log(3, "Error: Invalid directory passed to lsm_open\n");
+    return -1;
+  }
+
+  if (lsm->attached) {
+    kv_log(3, "Error: LSM tree is already attached to %s\n", lsm->dir);
+    return -1;
+  }
+
+  if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+    kv_log(3, "Error: Failed to create LSM tree directory %s\n", dir);
+    return -1;
+  }
+
+  strncpy(lsm->dir, dir, BG_BUFFER_SIZE);
+  lsm->dir[BG_BUFFER_SIZE-1] = '\0';
+
+  if (load_manifest(lsm) < 0) {
+    kv_log(3, "Error: Failed to load the manifest of %s\n", dir);
+    return -1;
+  }
+
+  DIR *data_dir = opendir(dir);
+  if (data_dir == NULL) {
+    kv_log(3, "Error: Failed to open LSM tree directory %s\n", dir);
+    return -1;
+  }
+
+  uint64_t wal_count = 0;
+  uint64_t wal_capacity = SM_BUFFER_SIZE;
+  uint64_t *wal_ids = malloc(wal_capacity * sizeof(uint64_t));
+  if (wal_ids == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for write-ahead log ids\n");
+    closedir(data_dir);
+    return -1;
+  }
+
+  struct dirent *dir_entry;
+  while ((dir_entry = readdir(data_dir)) != NULL) {
+    uint8_t *end;
+    uint64_t file_id = strtoull(dir_entry->d_name, (char**)&end, 10);
+    if (end == (uint8_t*)dir_entry->d_name) continue;
+
+    if (file_id >= lsm->next_id) {
+      lsm->next_id = file_id + 1;
+    }
+
+    /* Tables missing from the manifest are leftovers of an interrupted flush or compaction */
+    if (strcmp(end, ".sst") == 0 && !table_listed(lsm, file_id)) {
+      uint8_t table_path[BG_BUFFER_SIZE];
+      build_lsm_path(lsm, file_id, "sst", table_path, BG_BUFFER_SIZE);
+      unlink(table_path);
+    }
+    else if (strcmp(end, ".wal") == 0) {
+      if (wal_count == wal_capacity) {
+        wal_capacity *= 2;
+        uint64_t *new_ids = realloc(wal_ids, wal_capacity * sizeof(uint64_t));
+        if (new_ids == NULL) {
+          kv_log(3, "Error: Failed to allocate memory for write-ahead log ids\n");
+          free(wal_ids);
+          closedir(data_dir);
+          return -1;
+        }
+        wal_ids = new_ids;
+      }
+      wal_ids[wal_count++] = file_id;
+    }
+  }
+  closedir(data_dir);
+  qsort(wal_ids, wal_count, sizeof(uint64_t), compare_lsm_ids);
+
+  /* Replay leftover logs oldest first and persist them as a level 0 table */
+  int64_t result = 0;
+  if (wal_count > 0) {
+    lsm_memtable_t *recovered = create_memtable(lsm, false);
+    if (recovered == NULL) {
+      result = -1;
+    }
+
+    for (uint64_t idx = 0; idx < wal_count && result == 0; idx++) {
+      uint8_t wal_path[BG_BUFFER_SIZE];
+      build_lsm_path(lsm, wal_ids[idx], "wal", wal_path, BG_BUFFER_SIZE);
+      result = replay_wal(lsm, recovered, wal_path);
+    }
+
+    if (result == 0 && recovered->count > 0) {
+      lsm_iterator_t iterator;
+      iterator_init_memtable(&iterator, recovered, NULL);
+      lsm_table_t **outputs;
+      uint64_t output_count;
+      result = merge_iterators(lsm, &iterator, 1, levels_empty(lsm, 0), false, &outputs, &output_count);
+      iterator_free(&iterator);
+
+      for (uint64_t idx = 0; idx < output_count && result == 0; idx++) {
+        result = level_add(&lsm->levels[0], outputs[idx], 0);
+      }
+      free(outputs);
+    }
+
+    if (result == 0) {
+      result = write_manifest(lsm);
+    }
+
+    for (uint64_t idx = 0; idx < wal_count && result == 0; idx++) {
+      uint8_t wal_path[BG_BUFFER_SIZE];
+      build_lsm_path(lsm, wal_ids[idx], "wal", wal_path, BG_BUFFER_SIZE);
+      unlink(wal_path);
+    }
+    free_memtable(lsm, recovered, false);
+  }
+  free(wal_ids);
+
+  if (result == 0) {
+    lsm->memtable = create_memtable(lsm, true);
+    if (lsm->memtable == NULL) {
+      result = -1;
+    }
+  }
+
+  if (result == 0 && pthread_create(&lsm->worker, NULL, lsm_worker, lsm) != 0) {
+    kv_log(3, "Error: Failed to start LSM tree worker thread\n");
+    result = -1;
+  }
+
+  if (result == 0) {
+    lsm->attached = true;
+  }
+  return result;
+}
+
+extern int64_t lsm_insert(lsm_tree_t *lsm, db_entry_t *entry) {
+  if (lsm == NULL || entry == NULL) {
+    kv_log(3, "Error: NULL pointer passed to lsm_insert\n");
+    return -1;
+  }
+
+  if (!lsm->attached) {
+    kv_log(3, "Error: LSM tree is not attached to a directory, call load_db first\n");
+    return -1;
+  }
+
+  if (map_datatype_size(entry->type) < 0 || entry->size > UINT32_MAX) {
+    kv_log(3, "Error: data type %ld is not a valid datatype.\n", entry->type);
+    return -1;
+  }
+
+  pthread_mutex_lock(&lsm->lock);
+  int64_t result = KV_IO;
+  int64_t type;
+  uint8_t *value;
+  uint32_t value_size;
+  int64_t found = lookup(lsm, entry->key, &type, &value, &value_size);
+  if (found > 0) {
+    result = KV_EXISTS;
+  }
+  else if (found == 0) {
+    result = write_record(lsm, entry->key, entry->type, entry->value, entry->size) == 0 ? KV_OK : KV_IO;
+  }
+  pthread_mutex_unlock(&lsm->lock);
+
+  if (result == KV_OK) {
+    free_entry(entry);
+  }
+  return result;
+}
+
+extern int64_t lsm_put(lsm_tree_t *lsm, uint8_t *key, uint8_t *value, uint64_t len, uint8_t *type) {
+  if (lsm == NULL || key == NULL || value == NULL || type == NULL) {
+    kv_log(3, "Error: NULL pointer passed to lsm_put\n");
+    return -1;
+  }
+
+  if (strlen(key) == 0) {
+    kv_log(3, "Error: Empty string passed to lsm_put\n");
+    return -1;
+  }
+
+  if (!lsm->attached) {
+    kv_log(3, "Error: LSM tree is not attached to a directory, call load_db first\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&lsm->lock);
+
+  uint8_t current_type[SM_BUFFER_SIZE];
+  if (strlen(type) == 0) {
+    int64_t existing_type;
+    uint8_t *existing_value;
+    uint32_t existing_size;
+    if (lookup(lsm, key, &existing_type, &existing_value, &existing_size) <= 0 ||
+        map_datatype_to_str(existing_type, current_type, SM_BUFFER_SIZE) < 0) {
+      pthread_mutex_unlock(&lsm->lock);
+      return KV_NOT_FOUND;
+    }
+    type = current_type;
+  }
+
+  errno = 0;
+  db_entry_t *entry = create_entry_span(key, value, len, type);
+  if (entry == NULL) {
+    pthread_mutex_unlock(&lsm->lock);
+    return errno == ENOMEM ? KV_OOM : KV_TYPE_MISMATCH;
+  }
+
+  if (entry->size > UINT32_MAX) {
+    kv_log(3, "Error: Value of key \"%s\" is too large for an LSM tree\n", key);
+    free_entry(entry);
+    pthread_mutex_unlock(&lsm->lock);
+    return KV_ERROR;
+  }
+
+  int64_t result = write_record(lsm, entry->key, entry->type, entry->value, entry->size) == 0 ? KV_OK : KV_IO;
+  pthread_mutex_unlock(&lsm->lock);
+
+  free_entry(entry);
+  return result;
+}
+
+extern int64_t lsm_delete(lsm_tree_t *lsm, uint8_t *key) {
+  if (lsm == NULL || key == NULL) {
+    kv_log(3, "Error: NULL pointer passed to lsm_delete\n");
+    return -1;
+  }
+
+  if (strlen(key) == 0) {
+    kv_log(3, "Error: Empty string passed to lsm_delete\n");
+    return -1;
+  }
+
+  if (!lsm->attached) {
+    kv_log(3, "Error: LSM tree is not attached to a directory, call load_db first\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&lsm->lock);
+  int64_t result = KV_NOT_FOUND;
+  int64_t type;
+  uint8_t *value;
+  uint32_t value_size;
+  int64_t found = lookup(lsm, key, &type, &value, &value_size);
+  if (found > 0) {
+    result = write_record(lsm, key, LSM_TOMBSTONE_TYPE, NULL, 0) == 0 ? KV_OK : KV_IO;
+  }
+  else if (found < 0) {
+    result = KV_IO;
+  }
+  pthread_mutex_unlock(&lsm->lock);
+
+  return result;
+}
+
+static void init_lsm_reader_key() {
+  pthread_key_create(&lsm_reader_key, free_lsm_reader);
+}
+
+static void free_lsm_reader(void *arg) {
+  lsm_reader_t *reader = (lsm_reader_t*)arg;
+  free(reader->buffer);
+  free(reader);
+}
+
+static lsm_reader_t *get_lsm_reader() {
+  pthread_once(&lsm_reader_once, init_lsm_reader_key);
+  lsm_reader_t *reader = pthread_getspecific(lsm_reader_key);
+  if (reader != NULL) {
+    return reader;
+  }
+
+  reader = calloc(1, sizeof(lsm_reader_t));
+  if (reader == NULL || pthread_setspecific(lsm_reader_key, reader) != 0) {
+    kv_log(3, "Error: Failed to allocate the read buffer of a thread\n");
+    free(reader);
+    return NULL;
+  }
+  return reader;
+}
+
+static int64_t set_read_value(lsm_reader_t *reader, uint8_t *value, uint32_t value_size) {
+  if (value_size + 1 > reader->capacity) {
+    uint64_t capacity = reader->capacity == 0 ? BG_BUFFER_SIZE : reader->capacity;
+    while (capacity < value_size + 1) {
+      capacity *= 2;
+    }
+
+    uint8_t *buffer = realloc(reader->buffer, capacity);
+    if (buffer == NULL) {
+      kv_log(3, "Error: Failed to allocate memory for an LSM tree value\n");
+      return -1;
+    }
+    reader->buffer = buffer;
+    reader->capacity = capacity;
+  }
+
+  memcpy(reader->buffer, value, value_size);
+  reader->buffer[value_size] = '\0';
+  reader->entry.value = reader->buffer;
+  reader->entry.size = value_size;
+  return 0;
+}
+
+extern db_entry_t *lsm_get_entry(lsm_tree_t *lsm, uint8_t *key) {
+  if (lsm == NULL || key == NULL) {
+    kv_log(3, "Error: NULL pointer passed to lsm_get_entry\n");
+    return NULL;
+  }
+
+  if (strlen(key) == 0) {
+    kv_log(3, "Error: Empty string passed to lsm_get_entry\n");
+    return NULL;
+  }
+
+  lsm_reader_t *reader = get_lsm_reader();
+  if (reader == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&lsm->lock);
+  db_entry_t *entry = NULL;
+  int64_t type;
+  uint8_t *value;
+  uint32_t value_size;
+  if (lookup(lsm, key, &type, &value, &value_size) > 0 &&
+      set_read_value(reader, value, value_size) == 0) {
+    strncpy(reader->entry.key, key, SM_BUFFER_SIZE);
+    reader->entry.key[SM_BUFFER_SIZE-1] = '\0';
+    reader->entry.type = type;
+    entry = &reader->entry;
+  }
+  pthread_mutex_unlock(&lsm->lock);
+
+  return entry;
+}
+
+extern int64_t lsm_scan(lsm_tree_t *lsm, uint8_t *start_key, uint8_t *end_key,
+                        lsm_scan_callback_t callback, void *context) {
+  if (lsm == NULL || callback == NULL) {
+    kv_log(3, "Error: NULL pointer passed to lsm_scan\n");
+    return -1;
+  }
+
+  lsm_reader_t *reader = get_lsm_reader();
+  if (reader == NULL) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&lsm->lock);
+
+  uint64_t iterator_capacity = 2;
+  for (uint64_t level_idx = 0; level_idx < KV_LSM_MAX_LEVELS; level_idx++) {
+    iterator_capacity += lsm->levels[level_idx].count;
+  }
+
+  lsm_iterator_t *iterators = calloc(iterator_capacity, sizeof(lsm_iterator_t));
+  if (iterators == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for scan iterators\n");
+    pthread_mutex_unlock(&lsm->lock);
+    return -1;
+  }
+
+  /* Sources are ordered newest first so that ties resolve to the latest version */
+  uint64_t iterator_count = 0;
+  lsm_memtable_t *memtables[2] = { lsm->memtable, lsm->immutable };
+  for (uint64_t idx = 0; idx < 2; idx++) {
+    if (memtables[idx] != NULL) {
+      iterator_init_memtable(&iterators[iterator_count++], memtables[idx], start_key);
+    }
+  }
+  for (uint64_t level_idx = 0; level_idx < KV_LSM_MAX_LEVELS; level_idx++) {
+    lsm_level_t *level = &lsm->levels[level_idx];
+    for (uint64_t idx = 0; idx < level->count; idx++) {
+      lsm_table_t *table = level->tables[idx];
+      if ((start_key != NULL && strcmp(table->largest, start_key) < 0) ||
+          (end_key != NULL && strcmp(table->smallest, end_key) >= 0)) {
+        continue;
+      }
+      iterator_init_table(&iterators[iterator_count++], table, start_key);
+    }
+  }
+
+  int64_t count = 0;
+  int64_t picked;
+  while ((picked = iterator_pick(iterators, iterator_count)) >= 0) {
+    lsm_iterator_t *current = &iterators[picked];
+    if (end_key != NULL && strcmp(current->key, end_key) >= 0) break;
+
+    uint8_t key[SM_BUFFER_SIZE];
+    memcpy(key, current->key, SM_BUFFER_SIZE);
+    bool live = current->type != LSM_TOMBSTONE_TYPE;
+    if (live) {
+      if (set_read_value(reader, current->value, current->value_size) < 0) {
+        count = -1;
+        break;
+      }
+      memcpy(reader->entry.key, current->key, SM_BUFFER_SIZE);
+      reader->entry.type = current->type;
+    }
+    iterator_skip(iterators, iterator_count, key);
+    if (!live) continue;
+
+    count++;
+    if (callback(&reader->entry, context) < 0) break;
+  }
+
+  for (uint64_t idx = 0; idx < iterator_count; idx++) {
+    if (iterators[idx].failed) {
+      count = -1;
+    }
+    iterator_free(&iterators[idx]);
+  }
+  free(iterators);
+  pthread_mutex_unlock(&lsm->lock);
+
+  return count;
+}
+
+static int64_t count_callback(db_entry_t *entry, void *context) {
+  (*(uint64_t*)context)++;
+  return 0;
+}
+
+extern uint64_t lsm_count(lsm_tree_t *lsm) {
+  uint64_t count = 0;
+  if (lsm != NULL) {
+    lsm_scan(lsm, NULL, NULL, count_callback, &count);
+  }
+  return count;
+}
+
+extern int64_t lsm_sync(lsm_tree_t *lsm) {
+  if (lsm == NULL) {
+    kv_log(3, "Error: NULL pointer passed to lsm_sync\n");
+    return -1;
+  }
+
+  if (!lsm->attached) return 0;
+
+  pthread_mutex_lock(&lsm->lock);
+  int64_t result = 0;
+  if (fsync(lsm->memtable->wal_fd) < 0 ||
+      (lsm->immutable != NULL && fsync(lsm->immutable->wal_fd) < 0)) {
+    kv_log(3, "Error: Failed to sync the LSM tree write-ahead log\n");
+    result = -1;
+  }
+  pthread_mutex_unlock(&lsm->lock);
+
+  return result;
+}
+
+extern int64_t lsm_compact(lsm_tree_t *lsm) {
+  if (lsm == NULL) {
+    kv_log(3, "Error: NULL pointer passed to lsm_compact\n");
+    return -1;
+  }
+
+  if (!lsm->attached) {
+    kv_log(3, "Error: LSM tree is not attached to a directory, call load_db first\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&lsm->lock);
+  int64_t result = 0;
+  if (lsm->memtable->count > 0) {
+    while (lsm->immutable != NULL && !lsm->background_error) {
+      pthread_cond_wait(&lsm->done_cond, &lsm->lock);
+    }
+
+    lsm_memtable_t *memtable = lsm->background_error ? NULL : create_memtable(lsm, true);
+    if (memtable == NULL) {
+      result = -1;
+    }
+    else {
+      lsm->immutable = lsm->memtable;
+      lsm->memtable = memtable;
+    }
+  }
+
+  if (result == 0) {
+    lsm->force_compaction = true;
+    pthread_cond_signal(&lsm->work_cond);
+  }
+  pthread_mutex_unlock(&lsm->lock);
+
+  return result;
+}
+
+extern int64_t lsm_wait_idle(lsm_tree_t *lsm) {
+  if (lsm == NULL) {
+    kv_log(3, "Error: NULL pointer passed to lsm_wait_idle\n");
+    return -1;
+  }
+
+  if (!lsm->attached) return 0;
+
+  pthread_mutex_lock(&lsm->lock);
+  while (!lsm->background_error &&
+         (lsm->immutable != NULL || lsm->working || pick_compaction(lsm) >= 0)) {
+    pthread_cond_wait(&lsm->done_cond, &lsm->lock);
+  }
+  int64_t result = lsm->background_error ? -1 : 0;
+  pthread_mutex_unlock(&lsm->lock);
+
+  return result;
+}
+
+static int64_t save_callback(db_entry_t *entry, void *context) {
+  lsm_save_context_t *save_context = (lsm_save_context_t*)context;
+
+  if (write_entry(save_context->file, entry) < 0) {
+    kv_log(3, "Error: Failed to write entry to file\n");
+    save_context->result = -1;
+    return -1;
+  }
+  return 0;
+}
+
+extern int64_t lsm_save(FILE *file, lsm_tree_t *lsm) {
+  if (file == NULL || lsm == NULL) {
+    kv_log(3, "Error: NULL pointer passed to lsm_save\n");
+    return -1;
+  }
+
+  lsm_save_context_t context = { .file = file, .result = 0 };
+  if (lsm_scan(lsm, NULL, NULL, save_callback, &context) < 0) {
+    return -1;
+  }
+  return context.result;
+}
+
+extern void free_lsm_tree(lsm_tree_t *lsm) {
+  if (lsm == NULL) return;
+
+  if (lsm->attached) {
+    pthread_mutex_lock(&lsm->lock);
+    lsm->shutdown = true;
+    pthread_cond_signal(&lsm->work_cond);
+    pthread_mutex_unlock(&lsm->lock);
+    pthread_join(lsm->worker, NULL);
+
+    lsm_sync(lsm);
+  }
+
+  free_memtable(lsm, lsm->memtable, false);
+  free_memtable(lsm, lsm->immutable, false);
+
+  for (uint64_t level_idx = 0; level_idx < KV_LSM_MAX_LEVELS; level_idx++) {
+    lsm_level_t *level = &lsm->levels[level_idx];
+    for (uint64_t idx = 0; idx < level->count; idx++) {
+      close_table(lsm, level->tables[idx], false);
+    }
+    free(level->tables);
+  }
+  free(lsm->block_buffer);
+
+  pthread_cond_destroy(&lsm->work_cond);
+  pthread_cond_destroy(&lsm->done_cond);
+  pthread_mutex_destroy(&lsm->lock);
+  free(lsm);
+}
+
+static int64_t print_callback(db_entry_t *entry, void *context) {
+  print_entry(entry);
+  return 0;
+}
+
+extern void lsm_print(lsm_tree_t *lsm) {
+  if (lsm == NULL) {
+    kv_log(3, "Error: NULL pointer passed to lsm_print\n");
+    return;
+  }
+
+  lsm_scan(lsm, NULL, NULL, print_callback, NULL);
+}
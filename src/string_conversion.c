@@ -1,207 +1,994 @@
 #include "string_conversion.h"
+#include "type_hash.h"
+
+#include <math.h>
+
+static const binary_format_t double_format = {
+  .mantissa_bits = 52,
+  .sign_shift = 63,
+  .minimum_exponent = -1023,
+  .infinite_power = 0x7FF,
+  .smallest_power = -342,
+  .largest_power = 308,
+  .min_round_to_even = -4,
+  .max_round_to_even = 23,
+  .max_exact_power = 22,
+  .max_exact_mantissa = (uint64_t)1 << 53
+};
+
+static const binary_format_t float_format = {
+  .mantissa_bits = 23,
+  .sign_shift = 31,
+  .minimum_exponent = -127,
+  .infinite_power = 0xFF,
+  .smallest_power = -65,
+  .largest_power = 38,
+  .min_round_to_even = -17,
+  .max_round_to_even = 10,
+  .max_exact_power = 10,
+  .max_exact_mantissa = (uint64_t)1 << 24
+};
+
+static const double exact_double_powers[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const float exact_float_powers[] = {
+  1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+/* Normalized 64-bit approximations of 10^-348, 10^-340, ..., 10^340 */
+static const uint64_t cached_power_significands[] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+  0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+  0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+  0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+  0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+  0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+  0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+  0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+  0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+  0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+  0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+  0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+  0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+  0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+  0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+  0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+  0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+  0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+  0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+  0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+  0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+  0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t cached_power_exponents[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+  -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+  -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+  -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+  56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+  694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+  1013, 1039, 1066
+};
+
+static const uint32_t decimal_powers_32[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static const uint8_t digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+/* Escape letter of the bytes that cannot appear as is in a text value */
+static const uint8_t escape_codes[256] = {
+  [0x00] = '0', [0x01 ... 0x08] = 'x', ['\t'] = 't', ['\n'] = 'n', [0x0B ... 0x0C] = 'x',
+  ['\r'] = 'r', [0x0E ... 0x1F] = 'x', ['\\'] = '\\', [0x7F] = 'x'
+};
+
+static const uint8_t hex_digits[] = "0123456789abcdef";
+
+#define TYPE_NAME_ENTRY(enum_value, name, size) [enum_value] = { (const uint8_t*)name, sizeof(name) - 1 },
+#define TYPE_SIZE_ENTRY(enum_value, name, size) [enum_value] = size,
+
+static const type_name_t type_names[VALUE_TYPE_COUNT] = { KV_VALUE_TYPES(TYPE_NAME_ENTRY) };
+static const int64_t type_sizes[VALUE_TYPE_COUNT] = { KV_VALUE_TYPES(TYPE_SIZE_ENTRY) };
 
 extern int64_t map_datatype_from_str(uint8_t *type) {
   if (type == NULL) {
-    logger(3, "Error: NULL pointer passed to map_datatype_from_str\n");
+    kv_log(3, "Error: NULL pointer passed to map_datatype_from_str\n");
     return -1;
   }
 
-  if (strlen(type) == 0) {
-    logger(3, "Error: Empty string passed to map_datatype_from_str\n");
+  uint64_t len = strlen(type);
+  if (len == 0) {
+    kv_log(3, "Error: Empty string passed to map_datatype_from_str\n");
     return -1;
   }
 
-  if (strcmp(type, INT8_TYPE_STR) == 0) return INT8_TYPE;
-  else if (strcmp(type, INT16_TYPE_STR) == 0) return INT16_TYPE;
-  else if (strcmp(type, INT32_TYPE_STR) == 0) return INT32_TYPE;
-  else if (strcmp(type, INT64_TYPE_STR) == 0) return INT64_TYPE;
-  else if (strcmp(type, FLOAT_TYPE_STR) == 0) return FLOAT_TYPE;
-  else if (strcmp(type, DOUBLE_TYPE_STR) == 0) return DOUBLE_TYPE;
-  else if (strcmp(type, BOOL_TYPE_STR) == 0) return BOOL_TYPE;
-  else {
-    logger(3, "Error: data type %s is not a valid datatype.\n", type);
+  int64_t result = map_datatype_from_span(type, len);
+  if (result < 0) {
+    kv_log(3, "Error: data type %s is not a valid datatype.\n", type);
+  }
+  return result;
+}
+
+extern int64_t map_datatype_from_span(uint8_t *type, uint64_t len) {
+  if (type == NULL || len < TYPE_HASH_MIN_LEN || len > TYPE_HASH_MAX_LEN) {
     return -1;
   }
+
+  int64_t candidate = type_hash_slots[TYPE_HASH_SLOT(type, len)];
+  if (candidate < 0 || type_names[candidate].len != len ||
+      memcmp(type_names[candidate].ptr, type, len) != 0) {
+    return -1;
+  }
+  return candidate;
+}
+
+extern type_name_t map_datatype_name(int64_t type) {
+  if (type < 0 || type >= VALUE_TYPE_COUNT) {
+    return (type_name_t){ .ptr = NULL, .len = 0 };
+  }
+  return type_names[type];
 }
 
 extern int64_t map_datatype_to_str(uint64_t type, uint8_t *dest, uint64_t max_len) {
   if (dest == NULL) {
-    logger(3, "Error: NULL pointer passed to map_datatype_to_str\n");
+    kv_log(3, "Error: NULL pointer passed to map_datatype_to_str\n");
     return -1;
   }
 
-  switch (type) {
-  case INT8_TYPE:
-    strncpy(dest, INT8_TYPE_STR, max_len);
-    break;
-  case INT16_TYPE:
-    strncpy(dest, INT16_TYPE_STR, max_len);
-    break;
-  case INT32_TYPE:
-    strncpy(dest, INT32_TYPE_STR, max_len);
-    break;
-  case INT64_TYPE:
-    strncpy(dest, INT64_TYPE_STR, max_len);
-    break;
-  case FLOAT_TYPE:
-    strncpy(dest, FLOAT_TYPE_STR, max_len);
-    break;
-  case DOUBLE_TYPE:
-    strncpy(dest, DOUBLE_TYPE_STR, max_len);
-    break;
-  case BOOL_TYPE:
-    strncpy(dest, BOOL_TYPE_STR, max_len);
-    break;
-  default:
+  type_name_t name = map_datatype_name(type);
+  if (name.ptr == NULL || max_len == 0) {
     return -1;
   }
-  dest[max_len-1] = '\0';
+
+  uint64_t len = name.len < max_len ? name.len : max_len - 1;
+  memcpy(dest, name.ptr, len);
+  dest[len] = '\0';
   return 0;
 }
 
+extern int64_t map_datatype_size(int64_t type) {
+  if (type < 0 || type >= VALUE_TYPE_COUNT) {
+    return -1;
+  }
+  return type_sizes[type];
+}
+
+static uint64_t write_uint64(uint64_t value, uint8_t *dest) {
+  uint8_t buffer[NUMBER_MAX_DIGITS + 1];
+  uint8_t *start = buffer + sizeof(buffer);
+
+  /* Two digits per division */
+  while (value >= 100) {
+    uint64_t pair = (value % 100) * 2;
+    value /= 100;
+    start -= 2;
+    memcpy(start, digit_pairs + pair, 2);
+  }
+
+  if (value >= 10) {
+    start -= 2;
+    memcpy(start, digit_pairs + value * 2, 2);
+  }
+  else {
+    *--start = '0' + value;
+  }
+
+  uint64_t len = buffer + sizeof(buffer) - start;
+  memcpy(dest, start, len);
+  return len;
+}
+
+static diy_fp_t diy_fp_normalize(diy_fp_t value) {
+  int32_t shift = __builtin_clzll(value.f);
+  value.f <<= shift;
+  value.e -= shift;
+  return value;
+}
+
+static diy_fp_t diy_fp_multiply(diy_fp_t left, diy_fp_t right) {
+  unsigned __int128 product = (unsigned __int128)left.f * right.f;
+  uint64_t high = (uint64_t)(product >> 64);
+  /* Round the dropped low word */
+  if ((uint64_t)product & ((uint64_t)1 << 63)) high++;
+  return (diy_fp_t){ high, left.e + right.e + 64 };
+}
+
+static diy_fp_t cached_power(int32_t exponent, int32_t *decimal_exponent) {
+  /* Smallest power of ten that brings the product exponent to [-60, -32] */
+  double estimate = (-61 - exponent) * 0.30102999566398114 + 347;
+  int32_t power = (int32_t)estimate;
+  if (estimate - power > 0.0) power++;
+
+  uint64_t index = (power >> 3) + 1;
+  *decimal_exponent = -(-348 + (int32_t)index * 8);
+  return (diy_fp_t){ cached_power_significands[index], cached_power_exponents[index] };
+}
+
+static void grisu_round(uint8_t *digits, uint64_t len, uint64_t delta, uint64_t rest,
+                        uint64_t ten_kappa, uint64_t distance) {
+  /* Move the last digit down while it gets closer to the exact value */
+  while (rest < distance && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < distance || distance - rest > rest + ten_kappa - distance)) {
+    digits[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+static uint64_t grisu2(uint64_t mantissa, int32_t exponent, bool lower_boundary_closer,
+                       uint8_t *digits, int32_t *decimal_exponent) {
+  diy_fp_t plus = diy_fp_normalize((diy_fp_t){ (mantissa << 1) + 1, exponent - 1 });
+  diy_fp_t minus = lower_boundary_closer ?
+                   (diy_fp_t){ (mantissa << 2) - 1, exponent - 2 } :
+                   (diy_fp_t){ (mantissa << 1) - 1, exponent - 1 };
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  diy_fp_t power = cached_power(plus.e, decimal_exponent);
+  diy_fp_t scaled = diy_fp_multiply(diy_fp_normalize((diy_fp_t){ mantissa, exponent }), power);
+  diy_fp_t upper = diy_fp_multiply(plus, power);
+  diy_fp_t lower = diy_fp_multiply(minus, power);
+  /* Stay inside the rounding interval despite the error of the products */
+  upper.f--;
+  lower.f++;
+
+  uint64_t delta = upper.f - lower.f;
+  uint64_t distance = upper.f - scaled.f;
+  int32_t shift = -upper.e;
+  uint64_t one = (uint64_t)1 << shift;
+  uint32_t integral = (uint32_t)(upper.f >> shift);
+  uint64_t fractional = upper.f & (one - 1);
+
+  int32_t kappa = 10;
+  while (kappa > 1 && integral < decimal_powers_32[kappa - 1]) kappa--;
+
+  uint64_t len = 0;
+  while (kappa > 0) {
+    uint32_t digit = integral / decimal_powers_32[kappa - 1];
+    integral %= decimal_powers_32[kappa - 1];
+    if (digit != 0 || len != 0) digits[len++] = '0' + digit;
+    kappa--;
+
+    uint64_t rest = ((uint64_t)integral << shift) + fractional;
+    if (rest <= delta) {
+      *decimal_exponent += kappa;
+      grisu_round(digits, len, delta, rest, (uint64_t)decimal_powers_32[kappa] << shift, distance);
+      return len;
+    }
+  }
+
+  uint64_t scale = 1;
+  while (true) {
+    fractional *= 10;
+    delta *= 10;
+    scale *= 10;
+    uint8_t digit = fractional >> shift;
+    if (digit != 0 || len != 0) digits[len++] = '0' + digit;
+    fractional &= one - 1;
+    kappa--;
+
+    if (fractional < delta) {
+      *decimal_exponent += kappa;
+      grisu_round(digits, len, delta, fractional, one, distance * scale);
+      return len;
+    }
+  }
+}
+
+static uint64_t write_shortest(uint8_t *digits, uint64_t len, int32_t decimal_exponent, uint8_t *dest) {
+  /* The value is digits * 10^decimal_exponent, with 10^(point-1) <= value < 10^point */
+  int32_t point = (int32_t)len + decimal_exponent;
+
+  if (decimal_exponent >= 0 && point <= 21) {
+    /* 1234e7 -> 12340000000.0 */
+    memcpy(dest, digits, len);
+    memset(dest + len, '0', point - len);
+    memcpy(dest + point, ".0", 2);
+    return point + 2;
+  }
+
+  if (point > 0 && point <= 21) {
+    /* 1234e-2 -> 12.34 */
+    memcpy(dest, digits, point);
+    dest[point] = '.';
+    memcpy(dest + point + 1, digits + point, len - point);
+    return len + 1;
+  }
+
+  if (point > -6 && point <= 0) {
+    /* 1234e-6 -> 0.001234 */
+    uint64_t offset = 2 - point;
+    memcpy(dest, "0.", 2);
+    memset(dest + 2, '0', offset - 2);
+    memcpy(dest + offset, digits, len);
+    return len + offset;
+  }
+
+  /* 1234e30 -> 1.234e33 */
+  uint64_t position = 0;
+  dest[position++] = digits[0];
+  if (len > 1) {
+    dest[position++] = '.';
+    memcpy(dest + position, digits + 1, len - 1);
+    position += len - 1;
+  }
+  dest[position++] = 'e';
+  int32_t exponent = point - 1;
+  if (exponent < 0) {
+    dest[position++] = '-';
+    exponent = -exponent;
+  }
+  return position + write_uint64(exponent, dest + position);
+}
+
+static int64_t format_binary_float(uint64_t bits, const binary_format_t *format, uint8_t *dest, uint64_t max_len) {
+  uint8_t buffer[NUMBER_FORMAT_BUFFER_SIZE];
+  uint64_t len = 0;
+
+  uint64_t fraction = bits & (((uint64_t)1 << format->mantissa_bits) - 1);
+  int32_t biased_exponent = (bits >> format->mantissa_bits) & format->infinite_power;
+  if ((bits >> format->sign_shift) & 1) {
+    buffer[len++] = '-';
+  }
+
+  if (biased_exponent == format->infinite_power) {
+    memcpy(buffer + len, fraction == 0 ? "inf" : "nan", 3);
+    len += 3;
+  }
+  else if (biased_exponent == 0 && fraction == 0) {
+    memcpy(buffer + len, "0.0", 3);
+    len += 3;
+  }
+  else {
+    /* Subnormals have no hidden bit and the exponent of the smallest normal */
+    int32_t bias = -format->minimum_exponent + format->mantissa_bits;
+    uint64_t mantissa = biased_exponent == 0 ?
+                        fraction :
+                        fraction | ((uint64_t)1 << format->mantissa_bits);
+    int32_t exponent = (biased_exponent == 0 ? 1 : biased_exponent) - bias;
+    bool lower_boundary_closer = fraction == 0 && biased_exponent > 1;
+
+    uint8_t digits[NUMBER_MAX_DIGITS];
+    int32_t decimal_exponent;
+    uint64_t digit_count = grisu2(mantissa, exponent, lower_boundary_closer, digits, &decimal_exponent);
+    len += write_shortest(digits, digit_count, decimal_exponent, buffer + len);
+  }
+
+  if (len >= max_len) {
+    kv_log(3, "Error: Buffer too small for a formatted number\n");
+    return -1;
+  }
+
+  memcpy(dest, buffer, len);
+  dest[len] = '\0';
+  return len;
+}
+
+extern int64_t format_int64(int64_t value, uint8_t *dest, uint64_t max_len) {
+  if (dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to format_int64\n");
+    return -1;
+  }
+
+  uint8_t buffer[NUMBER_FORMAT_BUFFER_SIZE];
+  uint64_t len = 0;
+  uint64_t magnitude = (uint64_t)value;
+  if (value < 0) {
+    buffer[len++] = '-';
+    magnitude = 0 - magnitude;
+  }
+  len += write_uint64(magnitude, buffer + len);
+
+  if (len >= max_len) {
+    kv_log(3, "Error: Buffer too small for a formatted number\n");
+    return -1;
+  }
+
+  memcpy(dest, buffer, len);
+  dest[len] = '\0';
+  return len;
+}
+
+extern int64_t format_float(float value, uint8_t *dest, uint64_t max_len) {
+  if (dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to format_float\n");
+    return -1;
+  }
+
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(float));
+  return format_binary_float(bits, &float_format, dest, max_len);
+}
+
+extern int64_t format_double(double value, uint8_t *dest, uint64_t max_len) {
+  if (dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to format_double\n");
+    return -1;
+  }
+
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(double));
+  return format_binary_float(bits, &double_format, dest, max_len);
+}
+
 extern int64_t map_value_to_str(uint64_t type, void *value, uint8_t *dest, uint64_t max_len) {
   if (value == NULL || dest == NULL) {
-    logger(3, "Error: NULL pointer passed to map_value_to_str\n");
+    kv_log(3, "Error: NULL pointer passed to map_value_to_str\n");
     return -1;
   }
 
+  int64_t len;
   switch (type) {
   case INT8_TYPE:
-    snprintf(dest, max_len, "%" PRId8, *(int8_t*)value);
+    len = format_int64(*(int8_t*)value, dest, max_len);
     break;
   case INT16_TYPE:
-    snprintf(dest, max_len, "%" PRId16, *(int16_t*)value);
+    len = format_int64(*(int16_t*)value, dest, max_len);
     break;
   case INT32_TYPE:
-    snprintf(dest, max_len, "%" PRId32, *(int32_t*)value);
+    len = format_int64(*(int32_t*)value, dest, max_len);
     break;
   case INT64_TYPE:
-    snprintf(dest, max_len, "%" PRId64, *(int64_t*)value);
+    len = format_int64(*(int64_t*)value, dest, max_len);
     break;
   case FLOAT_TYPE:
-    snprintf(dest, max_len, "%.7f", *(float*)value);
+    len = format_float(*(float*)value, dest, max_len);
     break;
-    case DOUBLE_TYPE:
-    snprintf(dest, max_len, "%.15lf", *(double*)value);
+  case DOUBLE_TYPE:
+    len = format_double(*(double*)value, dest, max_len);
     break;
-    case BOOL_TYPE:
-    snprintf(dest, max_len, "%s", *(bool*)value ? "true" : "false");
+  case BOOL_TYPE:
+    len = snprintf(dest, max_len, "%s", *(bool*)value ? "true" : "false");
+    if (len >= (int64_t)max_len) len = -1;
     break;
   default:
     return -1;
   }
-  dest[max_len-1] = '\0';
+
+  return len < 0 ? -1 : 0;
 }
 
-extern int64_t str_to_int64(uint8_t *str_value, int64_t *dest) {
-  if (str_value == NULL || dest == NULL) {
-    logger(3, "Error: NULL pointer passed to str_to_int64\n");
-    return -1;
+static uint8_t escape_code(uint8_t byte) {
+  return byte == KV_PARSER_VALUE_DELIMITER[0] ? 'x' : escape_codes[byte];
+}
+
+extern uint64_t escaped_length(const uint8_t *src, uint64_t len) {
+  if (src == NULL) return 0;
+
+  uint64_t escaped = len;
+  for (uint64_t idx = 0; idx < len; idx++) {
+    uint8_t code = escape_code(src[idx]);
+    if (code != 0) {
+      escaped += code == 'x' ? 3 : 1;
+    }
   }
+  return escaped;
+}
 
-  if (strlen(str_value) == 0) {
-    logger(3, "Error: Empty string passed to str_to_int64\n");
+extern int64_t escape_bytes(const uint8_t *src, uint64_t len, uint8_t *dest, uint64_t max_len) {
+  if (src == NULL || dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to escape_bytes\n");
     return -1;
   }
 
-  errno = 0;
-  uint8_t *end;
-  int64_t int_value = strtoll(str_value, (char**)&end, 10);
+  uint64_t position = 0;
+  for (uint64_t idx = 0; idx < len; idx++) {
+    uint8_t byte = src[idx];
+    uint8_t code = escape_code(byte);
+    uint64_t needed = code == 0 ? 1 : (code == 'x' ? 4 : 2);
+    if (position + needed > max_len) return -1;
 
-  if (str_value == end) {
-    logger(3, "Error %s is not a number\n", str_value);
-    return -1;
+    if (code == 0) {
+      dest[position++] = byte;
+      continue;
+    }
+
+    dest[position++] = '\\';
+    dest[position++] = code;
+    if (code == 'x') {
+      dest[position++] = hex_digits[byte >> 4];
+      dest[position++] = hex_digits[byte & 0x0F];
+    }
   }
-  else if (errno == ERANGE) {
-    logger(3, "Error %s value is out of range\n", str_value);
+  return position;
+}
+
+static int64_t hex_digit_value(uint8_t character) {
+  if (character >= '0' && character <= '9') return character - '0';
+  if (character >= 'a' && character <= 'f') return character - 'a' + 10;
+  if (character >= 'A' && character <= 'F') return character - 'A' + 10;
+  return -1;
+}
+
+extern int64_t unescape_bytes(const uint8_t *src, uint64_t len, uint8_t *dest) {
+  if (src == NULL || dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to unescape_bytes\n");
     return -1;
   }
 
-  memcpy(dest, &int_value, sizeof(int64_t));
+  uint64_t position = 0;
+  uint64_t idx = 0;
+  while (idx < len) {
+    /* Runs without escapes are copied at once */
+    const uint8_t *backslash = memchr(src + idx, '\\', len - idx);
+    uint64_t run = backslash == NULL ? len - idx : (uint64_t)(backslash - src) - idx;
+    memmove(dest + position, src + idx, run);
+    position += run;
+    idx += run;
+    if (backslash == NULL) break;
+
+    if (idx + 1 >= len) return -1;
+    uint8_t code = src[idx + 1];
+    idx += 2;
+    switch (code) {
+    case '\\': dest[position++] = '\\'; break;
+    case 'n': dest[position++] = '\n'; break;
+    case 'r': dest[position++] = '\r'; break;
+    case 't': dest[position++] = '\t'; break;
+    case '0': dest[position++] = '\0'; break;
+    case 'x': {
+      if (idx + 2 > len) return -1;
+      int64_t high = hex_digit_value(src[idx]);
+      int64_t low = hex_digit_value(src[idx + 1]);
+      if (high < 0 || low < 0) return -1;
+      dest[position++] = (high << 4) | low;
+      idx += 2;
+      break;
+    }
+    default:
+      return -1;
+    }
+  }
+  return position;
+}
+
+static uint64_t load_eight_bytes(const uint8_t *data) {
+  uint64_t word;
+  memcpy(&word, data, sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+static bool is_eight_digits(uint64_t word) {
+  /* Bytes 0x30-0x39 have a high nibble of 3 before and after adding 6 */
+  return ((word & 0xF0F0F0F0F0F0F0F0) |
+          (((word + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) == 0x3333333333333333;
+}
 
+static uint32_t parse_eight_digits(uint64_t word) {
+  const uint64_t mask = 0x000000FF000000FF;
+  const uint64_t mul1 = 0x000F424000000064; /* 100 + (1000000 << 32) */
+  const uint64_t mul2 = 0x0000271000000001; /* 1 + (10000 << 32) */
+
+  word -= 0x3030303030303030;
+  word = (word * 10) + (word >> 8);
+  word = (((word & mask) * mul1) + (((word >> 16) & mask) * mul2)) >> 32;
+  return (uint32_t)word;
+}
+
+static uint64_t parse_digits(uint8_t *str, uint64_t len, uint64_t *value) {
+  uint64_t count = 0;
+  while (len - count >= 8) {
+    uint64_t word = load_eight_bytes(str + count);
+    if (!is_eight_digits(word)) break;
+    *value = *value * 100000000 + parse_eight_digits(word);
+    count += 8;
+  }
+
+  while (count < len && str[count] >= '0' && str[count] <= '9') {
+    *value = *value * 10 + (str[count] - '0');
+    count++;
+  }
+  return count;
+}
+
+static int64_t parse_decimal(uint8_t *str, uint64_t len, decimal_number_t *number) {
+  uint64_t position = 0;
+  number->negative = false;
+  if (position < len && (str[position] == '-' || str[position] == '+')) {
+    number->negative = str[position] == '-';
+    position++;
+  }
+
+  uint64_t digits_start = position;
+  uint64_t mantissa = 0;
+  uint64_t integer_digits = parse_digits(str + position, len - position, &mantissa);
+  position += integer_digits;
+
+  uint64_t fraction_digits = 0;
+  if (position < len && str[position] == '.') {
+    position++;
+    fraction_digits = parse_digits(str + position, len - position, &mantissa);
+    position += fraction_digits;
+  }
+
+  if (integer_digits + fraction_digits == 0) return -1;
+
+  int64_t exponent = -(int64_t)fraction_digits;
+  if (position < len && (str[position] == 'e' || str[position] == 'E')) {
+    position++;
+    bool negative_exponent = false;
+    if (position < len && (str[position] == '-' || str[position] == '+')) {
+      negative_exponent = str[position] == '-';
+      position++;
+    }
+
+    uint64_t exponent_start = position;
+    int64_t explicit_exponent = 0;
+    while (position < len && str[position] >= '0' && str[position] <= '9') {
+      /* Anything past this saturates to zero or infinity anyway */
+      if (explicit_exponent < 0x10000) {
+        explicit_exponent = explicit_exponent * 10 + (str[position] - '0');
+      }
+      position++;
+    }
+
+    if (position == exponent_start) return -1;
+    exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+  }
+
+  if (position != len) return -1;
+
+  /* Leading zeros are not significant */
+  uint64_t digits = integer_digits + fraction_digits;
+  if (digits > NUMBER_MAX_DIGITS) {
+    for (uint64_t idx = digits_start; idx < len && (str[idx] == '0' || str[idx] == '.'); idx++) {
+      if (str[idx] == '0') digits--;
+    }
+  }
+
+  number->mantissa = mantissa;
+  number->exponent = exponent;
+  number->truncated = digits > NUMBER_MAX_DIGITS;
   return 0;
 }
 
-extern int64_t str_to_float(uint8_t *str_value, float *dest) {
-  if (str_value == NULL || dest == NULL) {
-    logger(3, "Error: NULL pointer passed to str_to_float\n");
+static bool compute_binary_float(decimal_number_t *number, const binary_format_t *format, uint64_t *bits) {
+  int64_t power = number->exponent;
+  uint64_t mantissa = number->mantissa;
+  uint64_t sign = (uint64_t)number->negative << format->sign_shift;
+
+  if (mantissa == 0 || power < format->smallest_power) {
+    *bits = sign;
+    return true;
+  }
+
+  if (power > format->largest_power) {
+    *bits = sign | ((uint64_t)format->infinite_power << format->mantissa_bits);
+    return true;
+  }
+
+  int32_t leading_zeros = __builtin_clzll(mantissa);
+  mantissa <<= leading_zeros;
+
+  /* The low word of the power of five is only needed when the bits below
+     the ones kept for rounding are all set */
+  uint64_t index = 2 * (power - NUMBER_SMALLEST_POWER_OF_FIVE);
+  unsigned __int128 product = (unsigned __int128)mantissa * power_of_five_128[index];
+  uint64_t precision_mask = UINT64_MAX >> (format->mantissa_bits + 3);
+  if (((uint64_t)(product >> 64) & precision_mask) == precision_mask) {
+    unsigned __int128 low_product = (unsigned __int128)mantissa * power_of_five_128[index + 1];
+    product += low_product >> 64;
+  }
+
+  uint64_t high = (uint64_t)(product >> 64);
+  uint64_t low = (uint64_t)product;
+  if (low == UINT64_MAX && (power < -27 || power > 55)) {
+    /* The truncated power of five may be off by one unit here */
+    return false;
+  }
+
+  int32_t upper_bit = high >> 63;
+  int32_t shift = upper_bit + 64 - format->mantissa_bits - 3;
+  uint64_t result = high >> shift;
+  int32_t power2 = (int32_t)((((152170 + 65536) * power) >> 16) + 63) +
+                   upper_bit - leading_zeros - format->minimum_exponent;
+
+  if (power2 <= 0) {
+    /* Subnormal result */
+    if (-power2 + 1 >= 64) {
+      *bits = sign;
+      return true;
+    }
+    result >>= -power2 + 1;
+    result += result & 1;
+    result >>= 1;
+    power2 = result < ((uint64_t)1 << format->mantissa_bits) ? 0 : 1;
+    *bits = sign | result | ((uint64_t)power2 << format->mantissa_bits);
+    return true;
+  }
+
+  /* Exact halfway cases round to even */
+  if (low <= 1 && power >= format->min_round_to_even && power <= format->max_round_to_even &&
+      (result & 3) == 1 && (result << shift) == high) {
+    result &= ~(uint64_t)1;
+  }
+
+  result += result & 1;
+  result >>= 1;
+  if (result >= ((uint64_t)2 << format->mantissa_bits)) {
+    result = (uint64_t)1 << format->mantissa_bits;
+    power2++;
+  }
+  result &= ~((uint64_t)1 << format->mantissa_bits);
+
+  if (power2 >= format->infinite_power) {
+    power2 = format->infinite_power;
+    result = 0;
+  }
+
+  *bits = sign | result | ((uint64_t)power2 << format->mantissa_bits);
+  return true;
+}
+
+static int64_t parse_double_fallback(uint8_t *str, uint64_t len, double *dest) {
+  uint8_t buffer[64];
+  uint8_t *copy = len < sizeof(buffer) ? buffer : malloc(len + 1);
+  if (copy == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for a number\n");
     return -1;
   }
-  
-  if (strlen(str_value) == 0) {
-    logger(3, "Error: Empty string passed to str_to_float\n");
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+
+  errno = 0;
+  uint8_t *end;
+  double double_value = strtod(copy, (char**)&end);
+
+  int64_t result = 0;
+  if (copy == end || end != copy + len) {
+    kv_log(3, "Error %s is not a number\n", copy);
+    result = -1;
+  }
+  else if (errno == ERANGE && (isinf(double_value) || double_value == 0)) {
+    /* Subnormal results are kept, only overflows and underflows to zero fail */
+    kv_log(3, "Error %s value is out of range\n", copy);
+    result = -1;
+  }
+  else {
+    memcpy(dest, &double_value, sizeof(double));
+  }
+
+  if (copy != buffer) free(copy);
+  return result;
+}
+
+static int64_t parse_float_fallback(uint8_t *str, uint64_t len, float *dest) {
+  uint8_t buffer[64];
+  uint8_t *copy = len < sizeof(buffer) ? buffer : malloc(len + 1);
+  if (copy == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for a number\n");
     return -1;
   }
+  memcpy(copy, str, len);
+  copy[len] = '\0';
 
   errno = 0;
   uint8_t *end;
-  float float_value = strtof(str_value, (char**)&end);
+  float float_value = strtof(copy, (char**)&end);
+
+  int64_t result = 0;
+  if (copy == end || end != copy + len) {
+    kv_log(3, "Error %s is not a number\n", copy);
+    result = -1;
+  }
+  else if (errno == ERANGE && (isinf(float_value) || float_value == 0)) {
+    /* Subnormal results are kept, only overflows and underflows to zero fail */
+    kv_log(3, "Error %s value is out of range\n", copy);
+    result = -1;
+  }
+  else {
+    memcpy(dest, &float_value, sizeof(float));
+  }
 
-  if (str_value == end) {
-    logger(3, "Error %s is not a number\n", str_value);
+  if (copy != buffer) free(copy);
+  return result;
+}
+
+extern int64_t span_to_int64(uint8_t *str, uint64_t len, int64_t *dest) {
+  if (str == NULL || dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to span_to_int64\n");
     return -1;
   }
-  else if (errno == ERANGE) {
-    logger(3, "Error %s value is out of range\n", str_value);
+
+  if (len == 0) {
+    kv_log(3, "Error: Empty string passed to span_to_int64\n");
     return -1;
   }
 
-  memcpy(dest, &float_value, sizeof(float));
+  uint64_t position = 0;
+  bool negative = false;
+  if (str[position] == '-' || str[position] == '+') {
+    negative = str[position] == '-';
+    position++;
+  }
+
+  while (position + 1 < len && str[position] == '0') {
+    position++;
+  }
+
+  uint64_t value = 0;
+  uint64_t digits = parse_digits(str + position, len - position, &value);
+  if (digits == 0 || position + digits != len) {
+    kv_log(3, "Error %.*s is not a number\n", (int)len, str);
+    return -1;
+  }
+
+  if (digits > NUMBER_MAX_DIGITS || value > (uint64_t)INT64_MAX + negative) {
+    kv_log(3, "Error %.*s value is out of range\n", (int)len, str);
+    return -1;
+  }
+
+  int64_t int_value = negative ? (int64_t)(0 - value) : (int64_t)value;
+  memcpy(dest, &int_value, sizeof(int64_t));
 
   return 0;
 }
 
-extern int64_t str_to_double(uint8_t *str_value, double *dest) {
-  if (str_value == NULL || dest == NULL) {
-    logger(3, "Error: NULL pointer passed to str_to_double\n");
+extern int64_t span_to_float(uint8_t *str, uint64_t len, float *dest) {
+  if (str == NULL || dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to span_to_float\n");
     return -1;
   }
 
-  if (strlen(str_value) == 0) {
-    logger(3, "Error: Empty string passed to str_to_double\n");
+  if (len == 0) {
+    kv_log(3, "Error: Empty string passed to span_to_float\n");
     return -1;
   }
 
-  errno = 0;
-  uint8_t *end;
-  double double_value = strtod(str_value, (char**)&end);
+  decimal_number_t number;
+  if (parse_decimal(str, len, &number) < 0 || number.truncated) {
+    return parse_float_fallback(str, len, dest);
+  }
 
-  if (str_value == end) {
-    logger(3, "Error %s is not a number\n", str_value);
+  float float_value;
+  if (number.mantissa <= float_format.max_exact_mantissa &&
+      number.exponent >= -float_format.max_exact_power &&
+      number.exponent <= float_format.max_exact_power) {
+    /* Clinger fast path: both operands are exact, so is the rounding */
+    float_value = (float)number.mantissa;
+    float_value = number.exponent < 0 ? float_value / exact_float_powers[-number.exponent]
+                                      : float_value * exact_float_powers[number.exponent];
+    if (number.negative) float_value = -float_value;
+  }
+  else {
+    uint64_t bits;
+    if (!compute_binary_float(&number, &float_format, &bits)) {
+      return parse_float_fallback(str, len, dest);
+    }
+
+    uint32_t float_bits = (uint32_t)bits;
+    memcpy(&float_value, &float_bits, sizeof(float));
+    if (isinf(float_value) || (float_value == 0 && number.mantissa != 0)) {
+      kv_log(3, "Error %.*s value is out of range\n", (int)len, str);
+      return -1;
+    }
+  }
+
+  memcpy(dest, &float_value, sizeof(float));
+
+  return 0;
+}
+
+extern int64_t span_to_double(uint8_t *str, uint64_t len, double *dest) {
+  if (str == NULL || dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to span_to_double\n");
     return -1;
   }
-  else if (errno == ERANGE) {
-    logger(3, "Error %s value is out of range\n", str_value);
+
+  if (len == 0) {
+    kv_log(3, "Error: Empty string passed to span_to_double\n");
     return -1;
   }
 
+  decimal_number_t number;
+  if (parse_decimal(str, len, &number) < 0 || number.truncated) {
+    return parse_double_fallback(str, len, dest);
+  }
+
+  double double_value;
+  if (number.mantissa <= double_format.max_exact_mantissa &&
+      number.exponent >= -double_format.max_exact_power &&
+      number.exponent <= double_format.max_exact_power) {
+    /* Clinger fast path: both operands are exact, so is the rounding */
+    double_value = (double)number.mantissa;
+    double_value = number.exponent < 0 ? double_value / exact_double_powers[-number.exponent]
+                                       : double_value * exact_double_powers[number.exponent];
+    if (number.negative) double_value = -double_value;
+  }
+  else {
+    uint64_t bits;
+    if (!compute_binary_float(&number, &double_format, &bits)) {
+      return parse_double_fallback(str, len, dest);
+    }
+
+    memcpy(&double_value, &bits, sizeof(double));
+    if (isinf(double_value) || (double_value == 0 && number.mantissa != 0)) {
+      kv_log(3, "Error %.*s value is out of range\n", (int)len, str);
+      return -1;
+    }
+  }
+
   memcpy(dest, &double_value, sizeof(double));
 
   return 0;
 }
 
-extern int64_t str_to_bool(uint8_t *str_value, bool *dest) {
-  if (str_value == NULL || dest == NULL) {
-    logger(3, "Error: NULL pointer passed to str_to_bool\n");
+extern int64_t span_to_bool(uint8_t *str, uint64_t len, bool *dest) {
+  if (str == NULL || dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to span_to_bool\n");
     return -1;
   }
 
-  if (strlen(str_value) == 0) {
-    logger(3, "Error: Empty string passed to str_to_bool\n");
+  if (len == 0) {
+    kv_log(3, "Error: Empty string passed to span_to_bool\n");
     return -1;
   }
-  
-  if (strcmp(str_value, "true") == 0) {
-    bool bool_value = true;
-    memcpy(dest, &bool_value, sizeof(bool));
+
+  bool bool_value;
+  if (len == strlen("true") && memcmp(str, "true", len) == 0) {
+    bool_value = true;
   }
-  else if (strcmp(str_value, "false") == 0) {
-    bool bool_value = false;
-    memcpy(dest, &bool_value, sizeof(bool));
+  else if (len == strlen("false") && memcmp(str, "false", len) == 0) {
+    bool_value = false;
   }
   else {
-    logger(3, "Error: Invalid boolean value %s\n", str_value);
+    kv_log(3, "Error: Invalid boolean value %.*s\n", (int)len, str);
     return -1;
   }
+
+  memcpy(dest, &bool_value, sizeof(bool));
   return 0;
 }
+
+extern int64_t str_to_int64(uint8_t *str_value, int64_t *dest) {
+  if (str_value == NULL || dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to str_to_int64\n");
+    return -1;
+  }
+
+  return span_to_int64(str_value, strlen(str_value), dest);
+}
+
+extern int64_t str_to_float(uint8_t *str_value, float *dest) {
+  if (str_value == NULL || dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to str_to_float\n");
+    return -1;
+  }
+
+  return span_to_float(str_value, strlen(str_value), dest);
+}
+
+extern int64_t str_to_double(uint8_t *str_value, double *dest) {
+  if (str_value == NULL || dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to str_to_double\n");
+    return -1;
+  }
+
+  return span_to_double(str_value, strlen(str_value), dest);
+}
+
+extern int64_t str_to_bool(uint8_t *str_value, bool *dest) {
+  if (str_value == NULL || dest == NULL) {
+    kv_log(3, "Error: NULL pointer passed to str_to_bool\n");
+    return -1;
+  }
+
+  return span_to_bool(str_value, strlen(str_value), dest);
+}
@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+#include "tokenizer.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static pthread_once_t tokenizer_once = PTHREAD_ONCE_INIT;
+static uint64_t (*index_structurals)(const uint8_t *data, uint64_t len, uint32_t *dest);
+
+static uint64_t index_structurals_scalar(const uint8_t *data, uint64_t len, uint32_t *dest) {
+  uint64_t count = 0;
+  for (uint64_t idx = 0; idx < len; idx++) {
+    uint8_t character = data[idx];
+    if (character == KV_PARSER_TYPE_DELIMITER[0] || character == KV_PARSER_KEY_DELIMITER[0] ||
+        character == KV_PARSER_VALUE_DELIMITER[0] || character == '\n') {
+      dest[count++] = idx;
+    }
+  }
+  return count;
+}
+
+#if defined(__x86_64__)
+static uint64_t index_structurals_sse2(const uint8_t *data, uint64_t len, uint32_t *dest) {
+  const __m128i type_delimiter = _mm_set1_epi8(KV_PARSER_TYPE_DELIMITER[0]);
+  const __m128i key_delimiter = _mm_set1_epi8(KV_PARSER_KEY_DELIMITER[0]);
+  const __m128i value_delimiter = _mm_set1_epi8(KV_PARSER_VALUE_DELIMITER[0]);
+  const __m128i newline = _mm_set1_epi8('\n');
+
+  uint64_t count = 0;
+  uint64_t offset = 0;
+  for (; offset + 16 <= len; offset += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*)(data + offset));
+    __m128i matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, type_delimiter),
+                                                _mm_cmpeq_epi8(chunk, key_delimiter)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(chunk, value_delimiter),
+                                                _mm_cmpeq_epi8(chunk, newline)));
+    uint32_t mask = _mm_movemask_epi8(matches);
+    while (mask != 0) {
+      dest[count++] = offset + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+
+  uint64_t tail = index_structurals_scalar(data + offset, len - offset, dest + count);
+  for (uint64_t idx = count; idx < count + tail; idx++) {
+    dest[idx] += offset;
+  }
+  return count + tail;
+}
+
+__attribute__((target("avx2")))
+static uint64_t index_structurals_avx2(const uint8_t *data, uint64_t len, uint32_t *dest) {
+  const __m256i type_delimiter = _mm256_set1_epi8(KV_PARSER_TYPE_DELIMITER[0]);
+  const __m256i key_delimiter = _mm256_set1_epi8(KV_PARSER_KEY_DELIMITER[0]);
+  const __m256i value_delimiter = _mm256_set1_epi8(KV_PARSER_VALUE_DELIMITER[0]);
+  const __m256i newline = _mm256_set1_epi8('\n');
+
+  uint64_t count = 0;
+  uint64_t offset = 0;
+  for (; offset + 32 <= len; offset += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i*)(data + offset));
+    __m256i matches = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, type_delimiter),
+                                                      _mm256_cmpeq_epi8(chunk, key_delimiter)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, value_delimiter),
+                                                      _mm256_cmpeq_epi8(chunk, newline)));
+    uint32_t mask = _mm256_movemask_epi8(matches);
+    while (mask != 0) {
+      dest[count++] = offset + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+
+  uint64_t tail = index_structurals_sse2(data + offset, len - offset, dest + count);
+  for (uint64_t idx = count; idx < count + tail; idx++) {
+    dest[idx] += offset;
+  }
+  return count + tail;
+}
+#endif
+
+static void init_tokenizer() {
+  index_structurals = index_structurals_scalar;
+#if defined(__x86_64__)
+  index_structurals = index_structurals_sse2;
+  if (__builtin_cpu_supports("avx2")) {
+    index_structurals = index_structurals_avx2;
+  }
+#endif
+}
+
+static bool index_next_window(kv_tokenizer_t *tokenizer) {
+  if (tokenizer->indexed >= tokenizer->len) {
+    return false;
+  }
+
+  uint64_t window_len = tokenizer->len - tokenizer->indexed;
+  if (window_len > TOKENIZER_WINDOW_SIZE) {
+    window_len = TOKENIZER_WINDOW_SIZE;
+  }
+
+  tokenizer->window_start = tokenizer->indexed;
+  tokenizer->structural_count = index_structurals(tokenizer->buffer + tokenizer->indexed,
+                                                  window_len, tokenizer->structurals);
+  tokenizer->cursor = 0;
+  tokenizer->indexed += window_len;
+  return true;
+}
+
+extern int64_t tokenizer_init(kv_tokenizer_t *tokenizer, uint8_t *buffer, uint64_t len) {
+  if (tokenizer == NULL || (buffer == NULL && len > 0)) {
+    kv_log(3, "Error: NULL pointer passed to tokenizer_init\n");
+    return -1;
+  }
+
+  pthread_once(&tokenizer_once, init_tokenizer);
+  tokenizer->buffer = buffer;
+  tokenizer->len = len;
+  tokenizer->position = 0;
+  tokenizer->indexed = 0;
+  tokenizer->window_start = 0;
+  tokenizer->structural_count = 0;
+  tokenizer->cursor = 0;
+  return 0;
+}
+
+extern int64_t tokenizer_next(kv_tokenizer_t *tokenizer, kv_tokens_t *tokens) {
+  if (tokenizer == NULL || tokens == NULL) {
+    kv_log(3, "Error: NULL pointer passed to tokenizer_next\n");
+    return -1;
+  }
+
+  uint64_t start = tokenizer->position;
+  if (start >= tokenizer->len) {
+    return 0;
+  }
+
+  /* Comment and blank lines only need their end */
+  uint8_t first = tokenizer->buffer[start];
+  uint64_t state = first == '#' || first == '\n' ? 4 : 0;
+  uint64_t delimiters[3] = { 0, 0, 0 };
+  uint64_t end = tokenizer->len;
+  while (true) {
+    if (tokenizer->cursor == tokenizer->structural_count && !index_next_window(tokenizer)) {
+      break;
+    }
+    if (tokenizer->cursor == tokenizer->structural_count) {
+      continue;
+    }
+
+    uint64_t position = tokenizer->window_start + tokenizer->structurals[tokenizer->cursor++];
+    uint8_t character = tokenizer->buffer[position];
+    if (character == '\n') {
+      end = position + 1;
+      break;
+    }
+
+    if ((state == 0 && character == KV_PARSER_TYPE_DELIMITER[0]) ||
+        (state == 1 && character == KV_PARSER_KEY_DELIMITER[0]) ||
+        (state == 2 && character == KV_PARSER_VALUE_DELIMITER[0])) {
+      delimiters[state++] = position;
+    }
+  }
+  tokenizer->position = end;
+
+  uint8_t *buffer = tokenizer->buffer;
+  memset(tokens, 0, sizeof(kv_tokens_t));
+  tokens->line.ptr = buffer + start;
+  tokens->line.len = end - start;
+  tokens->valid = state == 3 &&
+                  delimiters[0] > start &&
+                  delimiters[1] > delimiters[0] + 1 &&
+                  delimiters[2] > delimiters[1];
+  if (tokens->valid) {
+    tokens->type.ptr = buffer + start;
+    tokens->type.len = delimiters[0] - start;
+    tokens->key.ptr = buffer + delimiters[0] + 1;
+    tokens->key.len = delimiters[1] - delimiters[0] - 1;
+    tokens->value.ptr = buffer + delimiters[1] + 1;
+    tokens->value.len = delimiters[2] - delimiters[1] - 1;
+  }
+  return 1;
+}
+
+extern int64_t tokenize_line(uint8_t *line, uint64_t len, kv_tokens_t *tokens) {
+  if (line == NULL || tokens == NULL) {
+    kv_log(3, "Error: NULL pointer passed to tokenize_line\n");
+    return -1;
+  }
+
+  kv_tokenizer_t tokenizer;
+  if (tokenizer_init(&tokenizer, line, len) < 0 || tokenizer_next(&tokenizer, tokens) != 1) {
+    return -1;
+  }
+  return tokens->valid ? 0 : -1;
+}
+
+static int64_t fill_reader(kv_reader_t *reader) {
+  /* Drop the lines already returned, keep the partial one */
+  uint64_t tail = reader->len - reader->consumed;
+  memmove(reader->buffer, reader->buffer + reader->consumed, tail);
+  reader->len = tail;
+  reader->consumed = 0;
+
+  while (true) {
+    if (reader->len == reader->capacity) {
+      uint64_t capacity = reader->capacity * 2;
+      uint8_t *buffer = kv_realloc(reader->memory, KV_ALLOC_BUFFERS, reader->buffer, reader->capacity, capacity);
+      if (buffer == NULL) {
+        kv_log(3, "Error: Failed to grow the buffer of a reader\n");
+        return -1;
+      }
+      reader->buffer = buffer;
+      reader->capacity = capacity;
+    }
+
+    ssize_t count = read(reader->fd, reader->buffer + reader->len, reader->capacity - reader->len);
+    if (count < 0) {
+      if (errno == EINTR) continue;
+      kv_log(3, "Error: Failed to read a database file\n");
+      return -1;
+    }
+
+    if (count == 0) {
+      /* The last line does not need a newline */
+      reader->eof = true;
+      reader->consumed = reader->len;
+      break;
+    }
+
+    /* The kept tail has no newline, only the new bytes are searched */
+    uint8_t *newline = memrchr(reader->buffer + reader->len, '\n', count);
+    reader->len += count;
+    if (newline != NULL) {
+      reader->consumed = newline - reader->buffer + 1;
+      break;
+    }
+  }
+
+  return tokenizer_init(&reader->tokenizer, reader->buffer, reader->consumed);
+}
+
+extern kv_reader_t *create_reader(int32_t fd, uint64_t capacity, kv_memory_t *memory) {
+  if (fd < 0 || capacity == 0) {
+    kv_log(3, "Error: Invalid file descriptor or capacity passed to create_reader\n");
+    return NULL;
+  }
+
+  kv_reader_t *reader = kv_alloc(memory, KV_ALLOC_BUFFERS, sizeof(kv_reader_t));
+  if (reader == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for kv_reader_t\n");
+    return NULL;
+  }
+
+  reader->buffer = kv_alloc(memory, KV_ALLOC_BUFFERS, capacity);
+  if (reader->buffer == NULL) {
+    kv_log(3, "Error: Failed to allocate memory for the buffer of a reader\n");
+    kv_free(memory, KV_ALLOC_BUFFERS, reader, sizeof(kv_reader_t));
+    return NULL;
+  }
+
+  reader->fd = fd;
+  reader->memory = memory;
+  reader->capacity = capacity;
+  reader->len = 0;
+  reader->consumed = 0;
+  reader->eof = false;
+  tokenizer_init(&reader->tokenizer, reader->buffer, 0);
+  return reader;
+}
+
+extern int64_t reader_next(kv_reader_t *reader, kv_tokens_t *tokens) {
+  if (reader == NULL || tokens == NULL) {
+    kv_log(3, "Error: NULL pointer passed to reader_next\n");
+    return -1;
+  }
+
+  while (true) {
+    int64_t result = tokenizer_next(&reader->tokenizer, tokens);
+    if (result != 0) return result;
+    if (reader->eof) return 0;
+    if (fill_reader(reader) < 0) return -1;
+  }
+}
+
+extern void free_reader(kv_reader_t *reader) {
+  if (reader == NULL) return;
+
+  kv_free(reader->memory, KV_ALLOC_BUFFERS, reader->buffer, reader->capacity);
+  kv_free(reader->memory, KV_ALLOC_BUFFERS, reader, sizeof(kv_reader_t));
+}
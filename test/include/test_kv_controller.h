@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <dirent.h>
 
 #include "unity.h"
 #include "kv_controller.h"
@@ -19,6 +20,22 @@ static void helper_test_load_null_inputs(db_t *db, uint8_t *path, int64_t  expec
 static void helper_test_nonexistent_key_get(db_t *db);
 static void helper_test_nonexistent_key_delete(db_t *db);
 static int64_t  helper_get_entry_wrapper(db_t *db, uint8_t *key);
+static void helper_snapshot_callback(db_snapshot_status_t *status, void *context);
+static void helper_test_save_db_async(uint8_t *storage_type, uint8_t *file_path);
+static void helper_test_save_durability(int64_t durability);
+static void helper_remove_dir(uint8_t *dir_path);
+static uint64_t helper_count_files(uint8_t *dir_path, uint8_t *extension);
+static int64_t helper_scan_callback(db_entry_t *entry, void *context);
+static void helper_flip_byte(uint8_t *file_path, uint64_t offset);
+static void helper_write_checksummed_file(uint8_t *file_path, uint64_t entry_count);
+static void helper_fill_blob(uint8_t *blob, uint64_t len, uint64_t seed);
+static void helper_validate_blob(db_t *db, uint8_t *key, uint8_t *blob, uint64_t len);
+static uint64_t helper_count_loaded_keys(db_t *db, uint64_t entry_count);
+static void *helper_capped_alloc(void *context, uint64_t size);
+static void *helper_capped_realloc(void *context, void *ptr, uint64_t old_size, uint64_t new_size);
+static void helper_capped_free(void *context, void *ptr, uint64_t size);
+static void *helper_cuckoo_reader(void *arg);
+static void *helper_disk_reader(void *arg);
 
 static void test_create_db_valid_inputs();
 static void test_create_db_null_input();
@@ -45,11 +62,53 @@ static void test_delete_entry_null_inputs();
 static void test_delete_entry_empty_key();
 static void test_save_load_db_valid_list();
 static void test_save_load_db_valid_hash();
+static void test_save_load_db_float_roundtrip();
 static void test_save_db_null_inputs();
 static void test_save_db_empty_path();
 static void test_load_db_null_inputs();
 static void test_load_db_empty_path();
 static void test_load_db_nonexistent_file();
+static void test_save_db_async_list();
+static void test_save_db_async_hash();
+static void test_save_db_async_after_finish();
+static void test_save_db_async_null_inputs();
+static void test_save_db_durability_sync();
+static void test_save_db_durability_relaxed();
+static void test_save_db_durability_invalid();
+static void test_save_db_missing_directory();
+static void test_load_db_lazy();
+static void test_load_db_long_lines();
+static void test_string_and_blob_values();
+static void test_set_db_load_mode_invalid();
+static void test_crc32c();
+static void test_load_db_checksum_corrupt();
+static void test_load_db_without_checksums();
+static void test_status_codes();
+static void test_db_stats();
+static void test_db_hash_stats();
+static void test_db_trace();
+static void test_db_allocator();
+static void test_key_compare();
+static void test_list_index();
+static void test_cuckoo_put_get_delete();
+static void test_cuckoo_concurrent_readers();
+static void test_disk_concurrent_gets();
+static void test_freeze_db();
+static void test_frozen_image();
+static void test_bitcask_put_get_delete();
+static void test_bitcask_unattached();
+static void test_bitcask_reopen();
+static void test_bitcask_merge();
+static void test_bitcask_blobs();
+static void test_bitcask_save_text();
+static void test_bitcask_checksum();
+static void test_lsm_put_get_delete();
+static void test_lsm_reopen();
+static void test_lsm_compaction();
+static void test_lsm_blobs();
+static void test_lsm_scan();
+static void test_lsm_save_text();
+static void test_lsm_checksum();
 static void test_free_db_valid();
 static void test_free_db_null();
 static void test_print_db_valid();
@@ -25,12 +25,23 @@ static void test_parse_entry_valid();
 static void test_parse_entry_all_types();
 static void test_parse_entry_null_inputs();
 static void test_parse_entry_invalid_inputs();
+static void test_write_entry();
+static void test_escape_bytes();
+static void test_string_and_blob_entries();
 static void test_parse_line_valid_entry();
 static void test_parse_line_all_types();
 static void test_parse_line_comment_line();
 static void test_parse_line_empty_line();
 static void test_parse_line_malformed_entry();
 static void test_parse_line_null_input();
+static void test_parse_line_lazy();
+static void test_parse_line_unmodified();
+static void test_tokenizer_buffer();
+static void test_span_to_int64();
+static void test_span_to_double();
+static void test_span_to_float();
+static void test_format_numbers();
+static void test_map_datatype();
 static void test_free_entry_valid();
 static void test_free_entry_null();
 static void test_print_entry_all_types();
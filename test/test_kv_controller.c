@@ -208,8 +208,13 @@ static void test_put_entry_empty_strings() {
   db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
   
   TEST_ASSERT_EQUAL(-1, put_entry(db,         "", "42", INT32_TYPE_STR));
-  TEST_ASSERT_EQUAL(-1, put_entry(db, "test_key",   "", INT32_TYPE_STR));
-  TEST_ASSERT_EQUAL(-1, put_entry(db, "test_key", "42",             ""));
+  TEST_ASSERT_EQUAL(KV_TYPE_MISMATCH, put_entry(db, "test_key", "", INT32_TYPE_STR));
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, put_entry(db, "test_key", "42",             ""));
+
+  /* An empty string is a value like any other */
+  TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "test_key", "", STRING_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, get_entry(db, "test_key")->size);
+  TEST_ASSERT_EQUAL_STRING("", get_entry(db, "test_key")->value);
   
   free_db(db);
 }
@@ -250,7 +255,7 @@ static void helper_test_nonexistent_key_get(db_t *db) {
 }
 
 static void helper_test_nonexistent_key_delete(db_t *db) {
-  TEST_ASSERT_EQUAL(-1, delete_entry(db, "nonexistent_key"));
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, delete_entry(db, "nonexistent_key"));
 }
 
 static void test_get_entry_nonexistent_key() {
@@ -350,6 +355,52 @@ static void test_save_load_db_valid_hash() {
   remove(file_path);
 }
 
+static void test_save_load_db_float_roundtrip() {
+  logger(4, "*** test_save_load_db_float_roundtrip ***\n");
+  uint8_t *file_path = "/tmp/test_db_floats.db";
+  double doubles[] = { 0.1, -1.0 / 3.0, 1e300, 5e-324, 123456789.123456789, -0.0 };
+  float floats[] = { 0.1f, 1.0f / 3.0f, 3.4028235e38f, 1e-40f, 16777217.0f };
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  uint8_t key[SM_BUFFER_SIZE];
+  uint8_t value[NUMBER_FORMAT_BUFFER_SIZE];
+  for (uint64_t idx = 0; idx < sizeof(doubles) / sizeof(double); idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "double_%lu", idx);
+    db_entry_t *entry = create_entry(key, "0", DOUBLE_TYPE_STR);
+    TEST_ASSERT_NOT_NULL(entry);
+    *(double*)entry->value = doubles[idx];
+    TEST_ASSERT_EQUAL(0, insert_entry(db, entry));
+  }
+  for (uint64_t idx = 0; idx < sizeof(floats) / sizeof(float); idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "float_%lu", idx);
+    db_entry_t *entry = create_entry(key, "0", FLOAT_TYPE_STR);
+    TEST_ASSERT_NOT_NULL(entry);
+    *(float*)entry->value = floats[idx];
+    TEST_ASSERT_EQUAL(0, insert_entry(db, entry));
+  }
+  TEST_ASSERT_EQUAL(0, save_db(db, file_path));
+
+  /* Saved values reload with the same bits */
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, file_path));
+  for (uint64_t idx = 0; idx < sizeof(doubles) / sizeof(double); idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "double_%lu", idx);
+    db_entry_t *entry = get_entry(new_db, key);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL_MEMORY(&doubles[idx], entry->value, sizeof(double));
+  }
+  for (uint64_t idx = 0; idx < sizeof(floats) / sizeof(float); idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "float_%lu", idx);
+    db_entry_t *entry = get_entry(new_db, key);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL_MEMORY(&floats[idx], entry->value, sizeof(float));
+  }
+
+  free_db(db);
+  free_db(new_db);
+  remove(file_path);
+}
+
 static void test_save_db_null_inputs() {
   logger(4, "*** test_save_db_null_inputs ***\n");
   db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
@@ -386,111 +437,1931 @@ static void test_load_db_nonexistent_file() {
   logger(4, "*** test_load_db_nonexistent_file ***\n");
   db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
   
-  TEST_ASSERT_EQUAL(-1, load_db(db, "/tmp/nonexistent_file.db"));
+  TEST_ASSERT_EQUAL(KV_IO, load_db(db, "/tmp/nonexistent_file.db"));
   
   free_db(db);
 }
 
-static void test_free_db_valid() {
-  logger(4, "*** test_free_db_valid ***\n");
+static void helper_snapshot_callback(db_snapshot_status_t *status, void *context) {
+  db_snapshot_status_t *last_status = (db_snapshot_status_t*)context;
+  TEST_ASSERT_FALSE(last_status->done);
+  TEST_ASSERT_GREATER_OR_EQUAL(last_status->entries_written, status->entries_written);
+  *last_status = *status;
+}
+
+static void helper_test_save_db_async(uint8_t *storage_type, uint8_t *file_path) {
+  db_snapshot_status_t last_status = {0};
+
+  db_t *db = helper_create_and_validate_db(storage_type);
+  helper_populate_db_with_sample_data(db);
+  TEST_ASSERT_EQUAL(0, save_db_async(db, file_path, helper_snapshot_callback, &last_status));
+  TEST_ASSERT_EQUAL(-1, save_db_async(db, file_path, NULL, NULL));
+
+  TEST_ASSERT_GREATER_OR_EQUAL(0, put_entry(db, "key3", "7", INT8_TYPE_STR));
+  TEST_ASSERT_GREATER_OR_EQUAL(0, delete_entry(db, "key1"));
+  TEST_ASSERT_EQUAL(0, wait_db_snapshot(db));
+
+  TEST_ASSERT_TRUE(last_status.done);
+  TEST_ASSERT_EQUAL(0, last_status.result);
+  TEST_ASSERT_EQUAL(2, last_status.entries_total);
+  TEST_ASSERT_EQUAL(2, last_status.entries_written);
+
+  db_t *new_db = helper_create_and_validate_db(storage_type);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, load_db(new_db, file_path));
+  helper_validate_sample_data(new_db);
+  TEST_ASSERT_NULL(get_entry(new_db, "key3"));
+
+  free_db(db);
+  free_db(new_db);
+  remove(file_path);
+}
+
+static void test_save_db_async_list() {
+  logger(4, "*** test_save_db_async_list ***\n");
+  helper_test_save_db_async(KV_STORAGE_STRUCTURE_LIST, "/tmp/test_db_async_list.db");
+}
+
+static void test_save_db_async_hash() {
+  logger(4, "*** test_save_db_async_hash ***\n");
+  helper_test_save_db_async(KV_STORAGE_STRUCTURE_HASH, "/tmp/test_db_async_hash.db");
+}
+
+static void test_save_db_async_after_finish() {
+  logger(4, "*** test_save_db_async_after_finish ***\n");
+  uint8_t *file_path = "/tmp/test_db_async_twice.db";
+  db_snapshot_status_t last_status = {0};
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  helper_populate_db_with_sample_data(db);
+  TEST_ASSERT_EQUAL(0, save_db_async(db, file_path, helper_snapshot_callback, &last_status));
+
+  struct timespec pause = {0, 1000000};
+  while (!db->snapshot->finished) {
+    nanosleep(&pause, NULL);
+  }
+  TEST_ASSERT_TRUE(last_status.done);
+
+  TEST_ASSERT_GREATER_OR_EQUAL(0, put_entry(db, "key3", "7", INT8_TYPE_STR));
+  last_status = (db_snapshot_status_t){0};
+  TEST_ASSERT_EQUAL(0, save_db_async(db, file_path, helper_snapshot_callback, &last_status));
+  TEST_ASSERT_EQUAL(0, wait_db_snapshot(db));
+  TEST_ASSERT_TRUE(last_status.done);
+  TEST_ASSERT_EQUAL(3, last_status.entries_written);
+
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, load_db(new_db, file_path));
+  helper_validate_sample_data(new_db);
+  TEST_ASSERT_NOT_NULL(get_entry(new_db, "key3"));
+
+  free_db(db);
+  free_db(new_db);
+  remove(file_path);
+}
+
+static void test_save_db_async_null_inputs() {
+  logger(4, "*** test_save_db_async_null_inputs ***\n");
   db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+
+  TEST_ASSERT_EQUAL(-1, save_db_async(NULL, "/tmp/test.db", NULL, NULL));
+  TEST_ASSERT_EQUAL(-1, save_db_async(db, NULL, NULL, NULL));
+  TEST_ASSERT_EQUAL(-1, save_db_async(db, "", NULL, NULL));
+  TEST_ASSERT_EQUAL(0, wait_db_snapshot(db));
+
   free_db(db);
 }
 
-static void test_free_db_null() {
-  logger(4, "*** test_free_db_null ***\n");
-  free_db(NULL);
+static void helper_test_save_durability(int64_t durability) {
+  uint8_t *file_path = "/tmp/test_db_durability.db";
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  TEST_ASSERT_EQUAL(0, set_db_durability(db, durability));
+  helper_populate_db_with_sample_data(db);
+  TEST_ASSERT_EQUAL(0, save_db(db, file_path));
+  TEST_ASSERT_EQUAL(0, save_db(db, file_path));
+  TEST_ASSERT_NULL(fopen("/tmp/test_db_durability.db.tmp", "r"));
+
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, file_path));
+  helper_validate_sample_data(new_db);
+
+  free_db(db);
+  free_db(new_db);
+  remove(file_path);
 }
 
-static void test_print_db_valid() {
-  logger(4, "*** test_print_db_valid ***\n");
+static void test_save_db_durability_sync() {
+  logger(4, "*** test_save_db_durability_sync ***\n");
+  helper_test_save_durability(DB_DURABILITY_SYNC);
+}
+
+static void test_save_db_durability_relaxed() {
+  logger(4, "*** test_save_db_durability_relaxed ***\n");
+  helper_test_save_durability(DB_DURABILITY_RELAXED);
+}
+
+static void test_save_db_durability_invalid() {
+  logger(4, "*** test_save_db_durability_invalid ***\n");
   db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
-  
-  TEST_ASSERT_GREATER_OR_EQUAL(0, put_entry(db, "test_key_1", "42", INT32_TYPE_STR));
-  TEST_ASSERT_GREATER_OR_EQUAL(0, put_entry(db, "test_key_2", "24", INT32_TYPE_STR));
-  
-  print_db(db);
-  
+
+  TEST_ASSERT_EQUAL(-1, set_db_durability(NULL, DB_DURABILITY_SYNC));
+  TEST_ASSERT_EQUAL(-1, set_db_durability(db, 42));
+  TEST_ASSERT_EQUAL(DB_DURABILITY_SYNC, db->durability);
+
   free_db(db);
 }
 
-static void test_print_db_null() {
-  logger(4, "*** test_print_db_null ***\n");
-  print_db(NULL);
+static void test_save_db_missing_directory() {
+  logger(4, "*** test_save_db_missing_directory ***\n");
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  helper_populate_db_with_sample_data(db);
+
+  TEST_ASSERT_EQUAL(KV_IO, save_db(db, "/tmp/nonexistent_dir/test.db"));
+
+  free_db(db);
 }
 
-static void test_multiple_entries_operations() {
-  logger(4, "*** test_multiple_entries_operations ***\n");
+static void test_load_db_lazy() {
+  logger(4, "*** test_load_db_lazy ***\n");
+  uint8_t *file_path = "/tmp/test_db_lazy.db";
+  uint8_t *copy_path = "/tmp/test_db_lazy_copy.db";
+  uint8_t *storage_types[] = { KV_STORAGE_STRUCTURE_LIST, KV_STORAGE_STRUCTURE_HASH };
+
   db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
-  
-  for (uint64_t  i = 0; i < 10; i++) {
-    char key[32];
-    char value[32];
-    snprintf(key, sizeof(key), "key_%u", i);
-    snprintf(value, sizeof(value), "%u", i * 10);
-    TEST_ASSERT_GREATER_OR_EQUAL(0, put_entry(db, key, value, INT32_TYPE_STR));
+  helper_test_put_entry_all_types(db);
+  helper_populate_db_with_sample_data(db);
+  TEST_ASSERT_EQUAL(0, save_db(db, file_path));
+  free_db(db);
+
+  for (uint64_t idx = 0; idx < 2; idx++) {
+    db_t *lazy_db = helper_create_and_validate_db(storage_types[idx]);
+    TEST_ASSERT_EQUAL(0, set_db_load_mode(lazy_db, DB_LOAD_LAZY));
+    TEST_ASSERT_EQUAL(0, load_db(lazy_db, file_path));
+    TEST_ASSERT_NOT_NULL(lazy_db->mappings);
+
+    db_entry_t *stored = idx == 0 ?
+                         list_get_entry_by_key((list_t*)lazy_db->storage, "int64_key") :
+                         hash_get_entry((hash_table_t*)lazy_db->storage, "int64_key");
+    TEST_ASSERT_NOT_NULL(stored);
+    TEST_ASSERT_NULL(stored->value);
+
+    db_entry_t *entry = get_entry(lazy_db, "int64_key");
+    TEST_ASSERT_EQUAL_PTR(stored, entry);
+    TEST_ASSERT_EQUAL_INT64(9223372036854775807LL, *(int64_t*)entry->value);
+    void *value = entry->value;
+    TEST_ASSERT_EQUAL_PTR(value, get_entry(lazy_db, "int64_key")->value);
+
+    TEST_ASSERT_EQUAL(0, put_entry(lazy_db, "bool_key", "false", ""));
+    TEST_ASSERT_FALSE(*(bool*)get_entry(lazy_db, "bool_key")->value);
+    TEST_ASSERT_EQUAL(0, delete_entry(lazy_db, "int8_key"));
+
+    TEST_ASSERT_EQUAL(0, save_db(lazy_db, copy_path));
+    free_db(lazy_db);
+
+    db_t *copy_db = helper_create_and_validate_db(storage_types[idx]);
+    TEST_ASSERT_EQUAL(0, load_db(copy_db, copy_path));
+    helper_validate_sample_data(copy_db);
+    TEST_ASSERT_EQUAL_DOUBLE(3.141592653589793, *(double*)get_entry(copy_db, "double_key")->value);
+    TEST_ASSERT_FALSE(*(bool*)get_entry(copy_db, "bool_key")->value);
+    TEST_ASSERT_NULL(get_entry(copy_db, "int8_key"));
+    free_db(copy_db);
   }
-  
-  for (uint64_t  i = 0; i < 10; i++) {
-    char key[32];
-    snprintf(key, sizeof(key), "key_%u", i);
-    
-    db_entry_t *entry = get_entry(db, key);
+
+  remove(file_path);
+  remove(copy_path);
+}
+
+static void test_load_db_long_lines() {
+  logger(4, "*** test_load_db_long_lines ***\n");
+  uint8_t *file_path = "/tmp/test_db_long_lines.db";
+  uint8_t *copy_path = "/tmp/test_db_long_lines_copy.db";
+  uint64_t comment_len = 300 * 1024;
+  uint64_t zeros_len = 200 * 1024;
+
+  FILE *file = fopen(file_path, "w");
+  TEST_ASSERT_NOT_NULL(file);
+  fputs("int32:key1=42;\n#", file);
+  for (uint64_t idx = 0; idx < comment_len; idx++) fputc('c', file);
+  fputs("\nint64:long_key=", file);
+  for (uint64_t idx = 0; idx < zeros_len; idx++) fputc('0', file);
+  fputs("123;\nfloat:key2=3.14;\n", file);
+  fclose(file);
+
+  uint8_t load_modes[] = { DB_LOAD_EAGER, DB_LOAD_LAZY };
+  for (uint64_t idx = 0; idx < 2; idx++) {
+    db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+    TEST_ASSERT_EQUAL(0, set_db_load_mode(db, load_modes[idx]));
+    TEST_ASSERT_EQUAL(0, load_db(db, file_path));
+    helper_validate_sample_data(db);
+    TEST_ASSERT_EQUAL_INT64(123, *(int64_t*)get_entry(db, "long_key")->value);
+
+    TEST_ASSERT_EQUAL(0, save_db(db, copy_path));
+    free_db(db);
+
+    db_t *copy_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+    TEST_ASSERT_EQUAL(0, load_db(copy_db, copy_path));
+    helper_validate_sample_data(copy_db);
+    TEST_ASSERT_EQUAL_INT64(123, *(int64_t*)get_entry(copy_db, "long_key")->value);
+    free_db(copy_db);
+  }
+
+  remove(file_path);
+  remove(copy_path);
+}
+
+static void helper_fill_blob(uint8_t *blob, uint64_t len, uint64_t seed) {
+  for (uint64_t idx = 0; idx < len; idx++) {
+    blob[idx] = (uint8_t)(idx * 31 + seed);
+  }
+}
+
+static void helper_validate_blob(db_t *db, uint8_t *key, uint8_t *blob, uint64_t len) {
+  kv_span_t value;
+  TEST_ASSERT_EQUAL(0, get_entry_span(db, key, &value));
+  TEST_ASSERT_EQUAL_UINT64(len, value.len);
+  TEST_ASSERT_EQUAL_MEMORY(blob, value.ptr, len);
+}
+
+static void test_string_and_blob_values() {
+  logger(4, "*** test_string_and_blob_values ***\n");
+  uint8_t *file_path = "/tmp/test_db_blobs.db";
+  uint8_t blob[10 * 1024];
+  helper_fill_blob(blob, sizeof(blob), 0);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  helper_populate_db_with_sample_data(db);
+  TEST_ASSERT_EQUAL(0, put_entry_span(db, "blob", blob, sizeof(blob), BLOB_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, put_entry(db, "name", "semi;colon\nnew\\line", STRING_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, put_entry(db, "empty", "", STRING_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, put_entry_span(db, "empty_blob", "", 0, BLOB_TYPE_STR));
+  helper_validate_blob(db, "blob", blob, sizeof(blob));
+  TEST_ASSERT_EQUAL(0, save_db(db, file_path));
+  free_db(db);
+
+  uint8_t load_modes[] = { DB_LOAD_EAGER, DB_LOAD_LAZY };
+  for (uint64_t idx = 0; idx < 2; idx++) {
+    db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+    TEST_ASSERT_EQUAL(0, set_db_load_mode(new_db, load_modes[idx]));
+    TEST_ASSERT_EQUAL(0, load_db(new_db, file_path));
+    helper_validate_sample_data(new_db);
+    helper_validate_blob(new_db, "blob", blob, sizeof(blob));
+
+    db_entry_t *entry = get_entry(new_db, "name");
     TEST_ASSERT_NOT_NULL(entry);
-    TEST_ASSERT_EQUAL(INT32_TYPE, entry->type);
-    TEST_ASSERT_EQUAL(i * 10, *(int32_t*)entry->value);
+    TEST_ASSERT_EQUAL(STRING_TYPE, entry->type);
+    TEST_ASSERT_EQUAL_STRING("semi;colon\nnew\\line", entry->value);
+
+    /* Empty strings and blobs are saved as an empty field */
+    entry = get_entry(new_db, "empty");
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL(STRING_TYPE, entry->type);
+    TEST_ASSERT_EQUAL_STRING("", entry->value);
+    helper_validate_blob(new_db, "empty", "", 0);
+    helper_validate_blob(new_db, "empty_blob", "", 0);
+    free_db(new_db);
   }
-  
-  for (uint64_t  i = 0; i < 5; i++) {
-    char key[32];
-    snprintf(key, sizeof(key), "key_%u", i);
-    TEST_ASSERT_GREATER_OR_EQUAL(0, delete_entry(db, key));
+
+  kv_span_t value;
+  db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, get_entry_span(db, "missing", &value));
+  TEST_ASSERT_EQUAL(-1, get_entry_span(db, NULL, &value));
+  TEST_ASSERT_EQUAL(-1, put_entry_span(NULL, "key", blob, sizeof(blob), BLOB_TYPE_STR));
+  free_db(db);
+  remove(file_path);
+}
+
+static void test_set_db_load_mode_invalid() {
+  logger(4, "*** test_set_db_load_mode_invalid ***\n");
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+
+  TEST_ASSERT_EQUAL(-1, set_db_load_mode(NULL, DB_LOAD_LAZY));
+  TEST_ASSERT_EQUAL(-1, set_db_load_mode(db, 7));
+  TEST_ASSERT_EQUAL(DB_LOAD_EAGER, db->load_mode);
+  TEST_ASSERT_EQUAL(0, set_db_load_mode(db, DB_LOAD_LAZY));
+  TEST_ASSERT_EQUAL(KV_IO, load_db(db, "/tmp/nonexistent_lazy.db"));
+
+  free_db(db);
+}
+
+static void helper_remove_dir(uint8_t *dir_path) {
+  DIR *dir = opendir(dir_path);
+  if (dir == NULL) return;
+
+  struct dirent *dir_entry;
+  while ((dir_entry = readdir(dir)) != NULL) {
+    if (dir_entry->d_name[0] == '.') continue;
+    uint8_t file_path[BG_BUFFER_SIZE];
+    snprintf(file_path, BG_BUFFER_SIZE, "%s/%s", dir_path, dir_entry->d_name);
+    remove(file_path);
   }
-  
-  for (uint64_t  i = 0; i < 5; i++) {
-    char key[32];
-    snprintf(key, sizeof(key), "key_%u", i);
-    TEST_ASSERT_NULL(get_entry(db, key));
+  closedir(dir);
+  remove(dir_path);
+}
+
+static uint64_t helper_count_files(uint8_t *dir_path, uint8_t *extension) {
+  DIR *dir = opendir(dir_path);
+  TEST_ASSERT_NOT_NULL(dir);
+
+  uint64_t count = 0;
+  struct dirent *dir_entry;
+  while ((dir_entry = readdir(dir)) != NULL) {
+    uint8_t *dot = strrchr(dir_entry->d_name, '.');
+    if (dot != NULL && strcmp(dot + 1, extension) == 0) {
+      count++;
+    }
   }
-  
-  for (uint64_t  i = 5; i < 10; i++) {
-    char key[32];
-    snprintf(key, sizeof(key), "key_%u", i);
+  closedir(dir);
+  return count;
+}
+
+static void helper_flip_byte(uint8_t *file_path, uint64_t offset) {
+  int32_t fd = open(file_path, O_RDWR);
+  TEST_ASSERT_TRUE(fd >= 0);
+
+  uint8_t byte;
+  TEST_ASSERT_EQUAL(1, pread(fd, &byte, 1, offset));
+  byte ^= 0x01;
+  TEST_ASSERT_EQUAL(1, pwrite(fd, &byte, 1, offset));
+  close(fd);
+}
+
+static void helper_write_checksummed_file(uint8_t *file_path, uint64_t entry_count) {
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  for (uint64_t i = 0; i < entry_count; i++) {
+    uint8_t key[SM_BUFFER_SIZE];
+    uint8_t value[SM_BUFFER_SIZE];
+    snprintf(key, SM_BUFFER_SIZE, "key_%lu", i);
+    snprintf(value, SM_BUFFER_SIZE, "%lu", i);
+    TEST_ASSERT_EQUAL(0, put_entry(db, key, value, INT32_TYPE_STR));
+  }
+  TEST_ASSERT_EQUAL(0, save_db(db, file_path));
+  free_db(db);
+}
+
+static uint64_t helper_count_loaded_keys(db_t *db, uint64_t entry_count) {
+  uint64_t count = 0;
+  for (uint64_t i = 0; i < entry_count; i++) {
+    uint8_t key[SM_BUFFER_SIZE];
+    snprintf(key, SM_BUFFER_SIZE, "key_%lu", i);
     db_entry_t *entry = get_entry(db, key);
-    TEST_ASSERT_NOT_NULL(entry);
-    TEST_ASSERT_EQUAL(INT32_TYPE, entry->type);
-    TEST_ASSERT_EQUAL(i * 10, *(int32_t*)entry->value);
+    if (entry != NULL) {
+      TEST_ASSERT_EQUAL_INT32(i, *(int32_t*)entry->value);
+      count++;
+    }
   }
-  
+  return count;
+}
+
+/* Blocks handed out by the capped allocator of test_db_allocator() */
+typedef struct {
+  uint64_t limit;
+  uint64_t used;
+  uint64_t blocks;
+} helper_capped_memory_t;
+
+static void *helper_capped_alloc(void *context, uint64_t size) {
+  helper_capped_memory_t *memory = context;
+  if (memory->used + size > memory->limit) return NULL;
+  memory->used += size;
+  memory->blocks++;
+  return malloc(size);
+}
+
+static void *helper_capped_realloc(void *context, void *ptr, uint64_t old_size, uint64_t new_size) {
+  helper_capped_memory_t *memory = context;
+  if (memory->used - old_size + new_size > memory->limit) return NULL;
+  void *resized = realloc(ptr, new_size);
+  if (resized != NULL) {
+    memory->used = memory->used - old_size + new_size;
+  }
+  return resized;
+}
+
+static void helper_capped_free(void *context, void *ptr, uint64_t size) {
+  helper_capped_memory_t *memory = context;
+  memory->used -= size;
+  memory->blocks--;
+  free(ptr);
+}
+
+static void test_crc32c() {
+  logger(4, "*** test_crc32c ***\n");
+  uint8_t data[64];
+  for (uint64_t i = 0; i < sizeof(data); i++) {
+    data[i] = i * 7;
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(0xE3069283, crc32c(0, "123456789", 9));
+  TEST_ASSERT_EQUAL_UINT32(0, crc32c(0, NULL, 0));
+  TEST_ASSERT_EQUAL_UINT32(crc32c(0, data, sizeof(data)),
+                          crc32c(crc32c(0, data, 13), data + 13, sizeof(data) - 13));
+  TEST_ASSERT_NOT_EQUAL(crc32c(0, data, sizeof(data)), crc32c(0, data + 1, sizeof(data) - 1));
+
+  uint32_t crc;
+  uint64_t lines;
+  TEST_ASSERT_EQUAL(1, parse_checksum_line("#crc32c:e3069283:1024\n", 22, &crc, &lines));
+  TEST_ASSERT_EQUAL_UINT32(0xE3069283, crc);
+  TEST_ASSERT_EQUAL(1024, lines);
+  TEST_ASSERT_EQUAL(0, parse_checksum_line("int8:key=1;\n", 12, &crc, &lines));
+  TEST_ASSERT_EQUAL(-1, parse_checksum_line("#crc32c:e30692:1024\n", 20, &crc, &lines));
+}
+
+static void test_load_db_checksum_corrupt() {
+  logger(4, "*** test_load_db_checksum_corrupt ***\n");
+  uint8_t *file_path = "/tmp/test_db_checksum.db";
+  uint64_t entry_count = KV_CHECKSUM_BLOCK_LINES * 3 - 100;
+  helper_write_checksummed_file(file_path, entry_count);
+
+  /* Change a digit of a value in the second block, the line still parses */
+  FILE *file = fopen(file_path, "r");
+  TEST_ASSERT_NOT_NULL(file);
+  uint8_t line[BG_BUFFER_SIZE];
+  uint64_t offset = 0;
+  uint64_t checksum_lines = 0;
+  while (checksum_lines < 1 && fgets(line, BG_BUFFER_SIZE, file) != NULL) {
+    offset += strlen(line);
+    checksum_lines += strncmp(line, CHECKSUM_LINE_PREFIX, strlen(CHECKSUM_LINE_PREFIX)) == 0;
+  }
+  TEST_ASSERT_NOT_NULL(fgets(line, BG_BUFFER_SIZE, file));
+  fclose(file);
+  helper_flip_byte(file_path, offset + (strchr(line, '=') - (char*)line) + 1);
+
+  db_t *strict_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  TEST_ASSERT_EQUAL(KV_IO, load_db(strict_db, file_path));
+  TEST_ASSERT_EQUAL(1, strict_db->load_report.corrupt_blocks);
+  TEST_ASSERT_EQUAL(KV_CHECKSUM_BLOCK_LINES + 2, strict_db->load_report.first_corrupt_line);
+  TEST_ASSERT_EQUAL(KV_CHECKSUM_BLOCK_LINES, helper_count_loaded_keys(strict_db, entry_count));
+  free_db(strict_db);
+
+  int64_t modes[] = { DB_LOAD_RECOVER, DB_LOAD_LAZY | DB_LOAD_RECOVER };
+  for (uint64_t idx = 0; idx < 2; idx++) {
+    db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+    TEST_ASSERT_EQUAL(0, set_db_load_mode(db, modes[idx]));
+    TEST_ASSERT_EQUAL(0, load_db(db, file_path));
+    TEST_ASSERT_EQUAL(2, db->load_report.blocks_verified);
+    TEST_ASSERT_EQUAL(1, db->load_report.corrupt_blocks);
+    TEST_ASSERT_EQUAL(KV_CHECKSUM_BLOCK_LINES, db->load_report.lines_skipped);
+    TEST_ASSERT_EQUAL(KV_CHECKSUM_BLOCK_LINES + 2, db->load_report.first_corrupt_line);
+    TEST_ASSERT_EQUAL(entry_count - KV_CHECKSUM_BLOCK_LINES, helper_count_loaded_keys(db, entry_count));
+    free_db(db);
+  }
+
+  /* A file cut after its last checksum line loses its tail */
+  helper_write_checksummed_file(file_path, entry_count);
+  file = fopen(file_path, "r");
+  TEST_ASSERT_NOT_NULL(file);
+  fseek(file, 0, SEEK_END);
+  uint64_t size = ftell(file);
+  fclose(file);
+  TEST_ASSERT_EQUAL(0, truncate(file_path, size - 30));
+
+  db_t *torn_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  TEST_ASSERT_EQUAL(KV_IO, load_db(torn_db, file_path));
+  free_db(torn_db);
+
+  torn_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  TEST_ASSERT_EQUAL(0, set_db_load_mode(torn_db, DB_LOAD_RECOVER));
+  TEST_ASSERT_EQUAL(0, load_db(torn_db, file_path));
+  TEST_ASSERT_EQUAL(2, torn_db->load_report.blocks_verified);
+  TEST_ASSERT_EQUAL(KV_CHECKSUM_BLOCK_LINES * 2, helper_count_loaded_keys(torn_db, entry_count));
+  free_db(torn_db);
+
+  remove(file_path);
+}
+
+static void test_load_db_without_checksums() {
+  logger(4, "*** test_load_db_without_checksums ***\n");
+  uint8_t *file_path = "/tmp/test_db_no_checksum.db";
+
+  FILE *file = fopen(file_path, "w");
+  TEST_ASSERT_NOT_NULL(file);
+  fputs("int32:key1=42;\n# comment\n\nfloat:key2=3.14;\n", file);
+  fclose(file);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  TEST_ASSERT_EQUAL(0, load_db(db, file_path));
+  helper_validate_sample_data(db);
+  TEST_ASSERT_EQUAL(0, db->load_report.blocks_verified);
+  TEST_ASSERT_EQUAL(0, db->load_report.corrupt_blocks);
   free_db(db);
+
+  file = fopen(file_path, "a");
+  TEST_ASSERT_NOT_NULL(file);
+  fputs("int32:key3=;\n", file);
+  fclose(file);
+
+  db_t *strict_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  TEST_ASSERT_EQUAL(KV_IO, load_db(strict_db, file_path));
+  TEST_ASSERT_NULL(get_entry(strict_db, "key1"));
+  TEST_ASSERT_EQUAL(5, strict_db->load_report.first_corrupt_line);
+  free_db(strict_db);
+
+  db_t *recover_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  TEST_ASSERT_EQUAL(0, set_db_load_mode(recover_db, DB_LOAD_RECOVER));
+  TEST_ASSERT_EQUAL(0, load_db(recover_db, file_path));
+  helper_validate_sample_data(recover_db);
+  TEST_ASSERT_EQUAL(1, recover_db->load_report.lines_skipped);
+  free_db(recover_db);
+
+  remove(file_path);
 }
 
-extern void setUp(void) {
-  // set stuff up here
+static void helper_test_status_codes(db_t *db) {
+  TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "key1", "42", INT32_TYPE_STR));
+
+  db_entry_t *entry = helper_create_and_validate_entry("key1", "7", INT32_TYPE_STR);
+  TEST_ASSERT_EQUAL(KV_EXISTS, insert_entry(db, entry));
+  free_entry(entry);
+
+  TEST_ASSERT_EQUAL(KV_TYPE_MISMATCH, put_entry(db, "key1", "not_a_number", INT32_TYPE_STR));
+  TEST_ASSERT_EQUAL(KV_TYPE_MISMATCH, put_entry(db, "key2", "1", "no_such_type"));
+  TEST_ASSERT_EQUAL(42, *(int32_t*)get_entry(db, "key1")->value);
+
+  kv_span_t value;
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, get_entry_span(db, "missing", &value));
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, delete_entry(db, "missing"));
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, put_entry(db, "missing", "1", ""));
 }
 
-extern void tearDown(void) {
-  // clean stuff up here
+static void helper_test_silent_misses(db_t *db) {
+  TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "key1", "42", INT32_TYPE_STR));
+  db_entry_t *entry = helper_create_and_validate_entry("key1", "7", INT32_TYPE_STR);
+
+  /* Expected outcomes are only reported through the status, errors are
+     logged to stderr and warnings to stdout */
+  fflush(stdout);
+  fflush(stderr);
+  int32_t saved_stdout = dup(STDOUT_FILENO);
+  int32_t saved_stderr = dup(STDERR_FILENO);
+  FILE *capture = tmpfile();
+  TEST_ASSERT_NOT_NULL(capture);
+  dup2(fileno(capture), STDOUT_FILENO);
+  dup2(fileno(capture), STDERR_FILENO);
+
+  kv_span_t value;
+  db_entry_t *missing = get_entry(db, "missing");
+  int64_t get_result = get_entry_span(db, "missing", &value);
+  int64_t delete_result = delete_entry(db, "missing");
+  int64_t insert_result = insert_entry(db, entry);
+
+  fflush(stdout);
+  fflush(stderr);
+  dup2(saved_stdout, STDOUT_FILENO);
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stdout);
+  close(saved_stderr);
+
+  TEST_ASSERT_NULL(missing);
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, get_result);
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, delete_result);
+  TEST_ASSERT_EQUAL(KV_EXISTS, insert_result);
+  TEST_ASSERT_EQUAL(0, ftell(capture));
+
+  fclose(capture);
+  free_entry(entry);
 }
 
-extern int main() {
-  UNITY_BEGIN();
-  
-  // create_db tests
-  RUN_TEST(test_create_db_valid_inputs);
-  RUN_TEST(test_create_db_null_input);
-  RUN_TEST(test_create_db_empty_input);
-  RUN_TEST(test_create_db_invalid_storage_type);
-  
-  // insert_entry tests
-  RUN_TEST(test_insert_entry_valid_list);
-  RUN_TEST(test_insert_entry_valid_hash);
-  RUN_TEST(test_insert_entry_null_inputs);
-  
-  // put_entry tests
-  RUN_TEST(test_put_entry_valid_list);
-  RUN_TEST(test_put_entry_valid_hash);
-  RUN_TEST(test_put_entry_all_types_list);
+static void test_status_codes() {
+  logger(4, "*** test_status_codes ***\n");
+  helper_test_both_storage_types(helper_test_status_codes);
+  helper_test_both_storage_types(helper_test_silent_misses);
+
+  uint8_t *dir_path = "/tmp/test_status_codes";
+  uint8_t *storage_types[] = { KV_STORAGE_STRUCTURE_BITCASK, KV_STORAGE_STRUCTURE_LSM };
+  for (uint64_t idx = 0; idx < 2; idx++) {
+    helper_remove_dir(dir_path);
+    db_t *db = helper_create_and_validate_db(storage_types[idx]);
+    TEST_ASSERT_EQUAL(KV_OK, load_db(db, dir_path));
+    helper_test_status_codes(db);
+    TEST_ASSERT_EQUAL(KV_OK, delete_entry(db, "key1"));
+    helper_test_silent_misses(db);
+    free_db(db);
+  }
+  helper_remove_dir(dir_path);
+}
+
+static void *helper_stats_worker(void *arg) {
+  db_t *db = (db_t*)arg;
+  for (uint64_t idx = 0; idx < 1000; idx++) {
+    get_entry(db, "key1");
+  }
+  return NULL;
+}
+
+static void test_db_stats() {
+  logger(4, "*** test_db_stats ***\n");
+  for (uint64_t bucket = 0; bucket + 1 < KV_STATS_BUCKETS; bucket++) {
+    TEST_ASSERT_EQUAL(bucket, stats_bucket(stats_bucket_limit(bucket) - 1));
+    TEST_ASSERT_EQUAL(bucket + 1, stats_bucket(stats_bucket_limit(bucket)));
+  }
+  TEST_ASSERT_EQUAL(KV_STATS_BUCKETS - 1, stats_bucket(UINT64_MAX));
+  if (!KV_STATS_ENABLED) {
+    logger(4, "Statistics are compiled out, skipping\n");
+    return;
+  }
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  TEST_ASSERT_EQUAL(0, put_entry(db, "key1", "42", INT32_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, put_entry(db, "key2", "hello", STRING_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, put_entry(db, "key1", "43", INT32_TYPE_STR));
+  TEST_ASSERT_NOT_NULL(get_entry(db, "key2"));
+  TEST_ASSERT_NULL(get_entry(db, "missing"));
+  TEST_ASSERT_EQUAL(0, delete_entry(db, "key2"));
+  TEST_ASSERT_EQUAL(0, save_db(db, "/tmp/test_db_stats.db"));
+
+  db_stats_t *stats = malloc(sizeof(db_stats_t));
+  TEST_ASSERT_NOT_NULL(stats);
+  TEST_ASSERT_EQUAL(0, db_stats(db, stats));
+  TEST_ASSERT_EQUAL(1, stats->hits);
+  TEST_ASSERT_EQUAL(1, stats->misses);
+  TEST_ASSERT_EQUAL(2, stats->inserts);
+  TEST_ASSERT_EQUAL(1, stats->updates);
+  TEST_ASSERT_EQUAL(5, stats->bytes_read);
+  TEST_ASSERT_GREATER_THAN(2 + 5 + 2, stats->bytes_written);
+  TEST_ASSERT_EQUAL(2, stats->latency[DB_STATS_GET].count);
+  TEST_ASSERT_EQUAL(3, stats->latency[DB_STATS_PUT].count);
+  TEST_ASSERT_EQUAL(1, stats->latency[DB_STATS_DELETE].count);
+  TEST_ASSERT_EQUAL(1, stats->latency[DB_STATS_SAVE].count);
+  TEST_ASSERT_EQUAL(0, stats->latency[DB_STATS_LOAD].count);
+
+  kv_histogram_t *puts = &stats->latency[DB_STATS_PUT];
+  TEST_ASSERT_LESS_OR_EQUAL(puts->max_ns, stats_percentile(puts, 50));
+  TEST_ASSERT_EQUAL(puts->max_ns, stats_percentile(puts, 100));
+
+  /* Every thread updates its own shard, the read merges them */
+  TEST_ASSERT_EQUAL(0, reset_db_stats(db));
+  pthread_t threads[4];
+  for (uint64_t idx = 0; idx < 4; idx++) {
+    TEST_ASSERT_EQUAL(0, pthread_create(&threads[idx], NULL, helper_stats_worker, db));
+  }
+  for (uint64_t idx = 0; idx < 4; idx++) {
+    pthread_join(threads[idx], NULL);
+  }
+  TEST_ASSERT_EQUAL(0, db_stats(db, stats));
+  TEST_ASSERT_EQUAL(4000, stats->hits);
+  TEST_ASSERT_EQUAL(4000, stats->latency[DB_STATS_GET].count);
+  TEST_ASSERT_EQUAL(0, stats->latency[DB_STATS_PUT].count);
+
+  FILE *file = tmpfile();
+  TEST_ASSERT_NOT_NULL(file);
+  TEST_ASSERT_EQUAL(0, write_db_stats(db, file));
+  rewind(file);
+  uint8_t line[BG_BUFFER_SIZE];
+  bool found_count = false;
+  bool found_hits = false;
+  while (fgets(line, BG_BUFFER_SIZE, file) != NULL) {
+    found_count |= strcmp(line, "kv_operation_duration_seconds_count{op=\"get\"} 4000\n") == 0;
+    found_hits |= strcmp(line, "kv_hits_total 4000\n") == 0;
+  }
+  TEST_ASSERT_TRUE(found_count);
+  TEST_ASSERT_TRUE(found_hits);
+  fclose(file);
+
+  free(stats);
+  free_db(db);
+  remove("/tmp/test_db_stats.db");
+}
+
+static void test_db_hash_stats() {
+  logger(4, "*** test_db_hash_stats ***\n");
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+
+  /* "ab" and "ba" share a bucket, "d" has its own */
+  TEST_ASSERT_EQUAL(0, put_entry(db, "ab", "1", INT8_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, put_entry(db, "ba", "2", INT8_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, put_entry(db, "d", "3", INT8_TYPE_STR));
+
+  hash_stats_t stats;
+  TEST_ASSERT_EQUAL(0, db_hash_stats(db, &stats));
+  TEST_ASSERT_EQUAL(3, stats.entries);
+  TEST_ASSERT_EQUAL(KV_STORAGE_HASH_SIZE, stats.buckets);
+  TEST_ASSERT_EQUAL_DOUBLE(3.0 / KV_STORAGE_HASH_SIZE, stats.load_factor);
+  TEST_ASSERT_EQUAL(KV_STORAGE_HASH_SIZE - 2, stats.empty_buckets);
+  TEST_ASSERT_EQUAL(2, stats.max_chain);
+  TEST_ASSERT_EQUAL_DOUBLE(1.5, stats.mean_chain);
+  TEST_ASSERT_EQUAL_DOUBLE(4.0 / 3, stats.expected_hit_probes);
+  TEST_ASSERT_EQUAL_DOUBLE(5.0 / 3, stats.expected_miss_probes);
+  TEST_ASSERT_EQUAL(KV_STORAGE_HASH_SIZE - 2, stats.chain_lengths[0]);
+  TEST_ASSERT_EQUAL(1, stats.chain_lengths[1]);
+  TEST_ASSERT_EQUAL(1, stats.chain_lengths[2]);
+
+  TEST_ASSERT_EQUAL(0, delete_entry(db, "ab"));
+  TEST_ASSERT_EQUAL(0, db_hash_stats(db, &stats));
+  TEST_ASSERT_EQUAL(2, stats.entries);
+  TEST_ASSERT_EQUAL(2, ((hash_table_t*)db->storage)->count);
+  TEST_ASSERT_EQUAL(1, stats.max_chain);
+  TEST_ASSERT_EQUAL_DOUBLE(1.0, stats.expected_miss_probes);
+  free_db(db);
+
+  /* Keys with the same digit sum share a bucket, long chains are indexed */
+  db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  uint64_t chain = 0;
+  for (uint64_t number = 0; number < 1000 && chain < 4 * KV_LIST_INDEX_THRESHOLD; number++) {
+    if (number / 100 + number / 10 % 10 + number % 10 != 13) continue;
+    uint8_t key[SM_BUFFER_SIZE];
+    snprintf(key, SM_BUFFER_SIZE, "c%03lu", number);
+    TEST_ASSERT_EQUAL(0, put_entry(db, key, "1", INT8_TYPE_STR));
+    chain++;
+  }
+  TEST_ASSERT_EQUAL(0, db_hash_stats(db, &stats));
+  TEST_ASSERT_EQUAL(chain, stats.max_chain);
+  TEST_ASSERT_TRUE(stats.expected_hit_probes >= 1.0 && stats.expected_hit_probes < 4.0);
+  TEST_ASSERT_TRUE(stats.expected_miss_probes > 0.0 && stats.expected_miss_probes < 4.0);
+  free_db(db);
+
+  db_t *list_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  TEST_ASSERT_EQUAL(-1, db_hash_stats(list_db, &stats));
+  TEST_ASSERT_EQUAL(-1, db_hash_stats(NULL, &stats));
+  free_db(list_db);
+}
+
+static void test_db_trace() {
+  logger(4, "*** test_db_trace ***\n");
+  uint8_t *trace_path = "/tmp/test_db_trace.trace";
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, stop_db_trace(db));
+  TEST_ASSERT_EQUAL(KV_OK, start_db_trace(db, trace_path));
+  TEST_ASSERT_EQUAL(KV_EXISTS, start_db_trace(db, trace_path));
+
+  uint8_t blob[] = { 'a', 0, ';', '\n' };
+  TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "key1", "42", INT32_TYPE_STR));
+  TEST_ASSERT_EQUAL(KV_OK, put_entry_span(db, "key2", blob, sizeof(blob), BLOB_TYPE_STR));
+  TEST_ASSERT_NOT_NULL(get_entry(db, "key1"));
+  TEST_ASSERT_NULL(get_entry(db, "missing"));
+  TEST_ASSERT_EQUAL(KV_OK, delete_entry(db, "key1"));
+  TEST_ASSERT_EQUAL(KV_OK, stop_db_trace(db));
+
+  /* Operations after the trace stopped are not recorded */
+  TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "key3", "1", INT8_TYPE_STR));
+  free_db(db);
+
+  kv_trace_reader_t *reader = open_trace_reader(trace_path);
+  TEST_ASSERT_NOT_NULL(reader);
+
+  int64_t ops[] = { KV_TRACE_PUT, KV_TRACE_PUT, KV_TRACE_GET, KV_TRACE_GET, KV_TRACE_DELETE };
+  int64_t statuses[] = { KV_OK, KV_OK, KV_OK, KV_NOT_FOUND, KV_OK };
+  uint8_t *keys[] = { "key1", "key2", "key1", "missing", "key1" };
+  kv_trace_record_t record;
+  uint64_t previous_ns = 0;
+  for (uint64_t idx = 0; idx < 5; idx++) {
+    TEST_ASSERT_EQUAL(1, read_trace_record(reader, &record));
+    TEST_ASSERT_EQUAL(ops[idx], record.op);
+    TEST_ASSERT_EQUAL(statuses[idx], record.status);
+    TEST_ASSERT_EQUAL_STRING(keys[idx], record.key);
+    TEST_ASSERT_TRUE(record.time_ns >= previous_ns);
+    previous_ns = record.time_ns;
+
+    if (idx == 0) {
+      TEST_ASSERT_EQUAL(INT32_TYPE, record.type);
+      TEST_ASSERT_EQUAL(2, record.value_len);
+      TEST_ASSERT_EQUAL_MEMORY("42", record.value, 2);
+    }
+    else if (idx == 1) {
+      TEST_ASSERT_EQUAL(BLOB_TYPE, record.type);
+      TEST_ASSERT_EQUAL(sizeof(blob), record.value_len);
+      TEST_ASSERT_EQUAL_MEMORY(blob, record.value, sizeof(blob));
+    }
+    else {
+      TEST_ASSERT_EQUAL(-1, record.type);
+      TEST_ASSERT_NULL(record.value);
+    }
+  }
+  TEST_ASSERT_EQUAL(0, read_trace_record(reader, &record));
+  close_trace_reader(reader);
+
+  TEST_ASSERT_NULL(open_trace_reader("README.md"));
+  TEST_ASSERT_EQUAL(KV_ERROR, start_db_trace(NULL, trace_path));
+  remove(trace_path);
+}
+
+static void test_db_allocator() {
+  logger(4, "*** test_db_allocator ***\n");
+  uint8_t *file_path = "/tmp/test_db_allocator.db";
+  helper_capped_memory_t capped = { .limit = UINT64_MAX };
+  kv_allocator_t allocator = {
+    .alloc = helper_capped_alloc,
+    .realloc = helper_capped_realloc,
+    .free = helper_capped_free,
+    .context = &capped
+  };
+
+  db_t *db = create_db_with_allocator(KV_STORAGE_STRUCTURE_LIST, &allocator);
+  TEST_ASSERT_NOT_NULL(db);
+
+  uint8_t blob[] = { 'a', 0, ';', '\n' };
+  TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "key1", "42", INT32_TYPE_STR));
+  TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "key2", "hello", STRING_TYPE_STR));
+  TEST_ASSERT_EQUAL(KV_OK, put_entry_span(db, "key3", blob, sizeof(blob), BLOB_TYPE_STR));
+
+  /* Everything but the db_t goes through the accounting */
+  kv_memory_usage_t usage;
+  TEST_ASSERT_EQUAL(0, db_memory_usage(db, &usage));
+  TEST_ASSERT_EQUAL(3, usage.blocks[KV_ALLOC_ENTRIES]);
+  TEST_ASSERT_EQUAL(3 * sizeof(db_entry_t), usage.bytes[KV_ALLOC_ENTRIES]);
+  TEST_ASSERT_EQUAL(3 * sizeof(node_t), usage.bytes[KV_ALLOC_NODES]);
+  TEST_ASSERT_EQUAL(sizeof(int32_t) + 6 + sizeof(blob) + 1, usage.bytes[KV_ALLOC_VALUES]);
+  TEST_ASSERT_EQUAL(sizeof(list_t), usage.bytes[KV_ALLOC_BUFFERS]);
+  TEST_ASSERT_EQUAL(capped.used, usage.total_bytes + sizeof(db_t));
+  TEST_ASSERT_EQUAL(capped.blocks, usage.total_blocks + 1);
+
+  /* A new type frees the old value with its own size */
+  TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "key1", "42", INT64_TYPE_STR));
+  TEST_ASSERT_EQUAL(KV_OK, delete_entry(db, "key2"));
+  TEST_ASSERT_EQUAL(0, db_memory_usage(db, &usage));
+  TEST_ASSERT_EQUAL(2, usage.blocks[KV_ALLOC_ENTRIES]);
+  TEST_ASSERT_EQUAL(sizeof(int64_t) + sizeof(blob) + 1, usage.bytes[KV_ALLOC_VALUES]);
+  TEST_ASSERT_EQUAL(capped.used, usage.total_bytes + sizeof(db_t));
+
+  /* A full allocator fails the put without touching the stored entries */
+  capped.limit = capped.used;
+  TEST_ASSERT_EQUAL(KV_OOM, put_entry(db, "key4", "1", INT8_TYPE_STR));
+  TEST_ASSERT_EQUAL(KV_OOM, put_entry(db, "key1", "a longer string", STRING_TYPE_STR));
+  TEST_ASSERT_EQUAL(42, *(int64_t*)get_entry(db, "key1")->value);
+  capped.limit = UINT64_MAX;
+
+  TEST_ASSERT_EQUAL(0, save_db(db, file_path));
+  free_db(db);
+  TEST_ASSERT_EQUAL(0, capped.used);
+  TEST_ASSERT_EQUAL(0, capped.blocks);
+
+  /* Lazy values are materialized from the same allocator */
+  db = create_db_with_allocator(KV_STORAGE_STRUCTURE_HASH, &allocator);
+  TEST_ASSERT_NOT_NULL(db);
+  TEST_ASSERT_EQUAL(0, set_db_load_mode(db, DB_LOAD_LAZY));
+  TEST_ASSERT_EQUAL(0, load_db(db, file_path));
+  TEST_ASSERT_EQUAL(0, db_memory_usage(db, &usage));
+  TEST_ASSERT_EQUAL(0, usage.bytes[KV_ALLOC_VALUES]);
+  TEST_ASSERT_EQUAL(KV_STORAGE_HASH_SIZE * sizeof(list_t*) + KV_STORAGE_HASH_SIZE * sizeof(list_t),
+                    usage.bytes[KV_ALLOC_BUCKETS]);
+  helper_validate_blob(db, "key3", blob, sizeof(blob));
+  TEST_ASSERT_EQUAL(0, db_memory_usage(db, &usage));
+  TEST_ASSERT_EQUAL(sizeof(blob) + 1, usage.bytes[KV_ALLOC_VALUES]);
+  free_db(db);
+  TEST_ASSERT_EQUAL(0, capped.used);
+  TEST_ASSERT_EQUAL(0, capped.blocks);
+
+  kv_allocator_t no_free = { .alloc = helper_capped_alloc, .context = &capped };
+  TEST_ASSERT_NULL(create_db_with_allocator(KV_STORAGE_STRUCTURE_LIST, &no_free));
+  TEST_ASSERT_EQUAL(-1, db_memory_usage(NULL, &usage));
+  remove(file_path);
+}
+
+static void test_key_compare() {
+  logger(4, "*** test_key_compare ***\n");
+  uint8_t *long_key = "key_of_exactly_31_characters_00";
+  uint8_t *too_long = "key_of_exactly_31_characters_00_and_more";
+
+  /* Padding clears whatever followed the terminating NUL */
+  uint8_t padded[SM_BUFFER_SIZE];
+  memset(padded, 'x', SM_BUFFER_SIZE);
+  TEST_ASSERT_EQUAL(3, kv_key_pad(padded, "key"));
+  uint8_t expected[SM_BUFFER_SIZE] = "key";
+  TEST_ASSERT_EQUAL_MEMORY(expected, padded, SM_BUFFER_SIZE);
+  TEST_ASSERT_EQUAL(SM_BUFFER_SIZE - 1, kv_key_pad(padded, too_long));
+  TEST_ASSERT_EQUAL_STRING(long_key, padded);
+
+  kv_key_probe_t probe;
+  TEST_ASSERT_TRUE(kv_key_probe(&probe, "key"));
+  kv_key_pad(padded, "key");
+  TEST_ASSERT_TRUE(kv_key_matches(&probe, padded));
+  kv_key_pad(padded, "key1");
+  TEST_ASSERT_FALSE(kv_key_matches(&probe, padded));
+  kv_key_pad(padded, "ke");
+  TEST_ASSERT_FALSE(kv_key_matches(&probe, padded));
+  TEST_ASSERT_FALSE(kv_key_probe(&probe, ""));
+  TEST_ASSERT_FALSE(kv_key_probe(&probe, too_long));
+  kv_key_pad(padded, long_key);
+  TEST_ASSERT_FALSE(kv_key_matches(&probe, padded));
+
+  /* Keys sharing a prefix, differing in their last byte or truncated */
+  uint8_t *types[] = { KV_STORAGE_STRUCTURE_LIST, KV_STORAGE_STRUCTURE_HASH };
+  for (uint64_t idx = 0; idx < sizeof(types) / sizeof(types[0]); idx++) {
+    db_t *db = helper_create_and_validate_db(types[idx]);
+    TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "key", "1", INT32_TYPE_STR));
+    TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "key1", "2", INT32_TYPE_STR));
+    TEST_ASSERT_EQUAL(KV_OK, put_entry(db, long_key, "3", INT32_TYPE_STR));
+    TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "key_of_exactly_31_characters_01", "4", INT32_TYPE_STR));
+
+    TEST_ASSERT_EQUAL(1, *(int32_t*)get_entry(db, "key")->value);
+    TEST_ASSERT_EQUAL(2, *(int32_t*)get_entry(db, "key1")->value);
+    TEST_ASSERT_EQUAL(3, *(int32_t*)get_entry(db, long_key)->value);
+    TEST_ASSERT_EQUAL(4, *(int32_t*)get_entry(db, "key_of_exactly_31_characters_01")->value);
+    TEST_ASSERT_NULL(get_entry(db, "ke"));
+    TEST_ASSERT_NULL(get_entry(db, too_long));
+
+    TEST_ASSERT_EQUAL(KV_NOT_FOUND, delete_entry(db, too_long));
+    TEST_ASSERT_EQUAL(KV_OK, delete_entry(db, "key"));
+    TEST_ASSERT_NULL(get_entry(db, "key"));
+    TEST_ASSERT_EQUAL(2, *(int32_t*)get_entry(db, "key1")->value);
+    free_db(db);
+  }
+}
+
+static void test_list_index() {
+  logger(4, "*** test_list_index ***\n");
+  uint64_t count = 2000;
+  list_t *list = create_list(NULL, KV_ALLOC_BUFFERS);
+  TEST_ASSERT_NOT_NULL(list);
+
+  uint8_t key[SM_BUFFER_SIZE];
+  uint8_t value[SM_BUFFER_SIZE];
+  for (uint64_t idx = 0; idx < count; idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "key_%lu", idx);
+    snprintf(value, SM_BUFFER_SIZE, "%lu", idx);
+    TEST_ASSERT_EQUAL(KV_OK, list_put(list, key, value, strlen(value), INT64_TYPE_STR));
+    TEST_ASSERT_EQUAL(idx + 1 >= KV_LIST_INDEX_THRESHOLD, list->index != NULL);
+  }
+  TEST_ASSERT_EQUAL(count, list->size);
+
+  db_entry_t *duplicate = create_entry("key_7", "1", INT64_TYPE_STR);
+  TEST_ASSERT_EQUAL(KV_EXISTS, list_insert(list, duplicate));
+  free_entry(duplicate);
+
+  /* Deleting from the head, the tail and the middle keeps the order */
+  for (uint64_t idx = 0; idx < count; idx += 3) {
+    snprintf(key, SM_BUFFER_SIZE, "key_%lu", idx);
+    TEST_ASSERT_EQUAL(KV_OK, list_delete(list, key));
+    TEST_ASSERT_EQUAL(KV_NOT_FOUND, list_delete(list, key));
+  }
+  snprintf(key, SM_BUFFER_SIZE, "key_%lu", count - 1);
+  TEST_ASSERT_EQUAL(KV_OK, list_delete(list, key));
+  TEST_ASSERT_EQUAL(KV_OK, list_put(list, "key_0", "0", 1, INT64_TYPE_STR));
+
+  uint64_t seen = 0;
+  node_t *previous = NULL;
+  for (node_t *node = list->head; node != NULL; node = node->next) {
+    TEST_ASSERT_EQUAL_PTR(previous, node->prev);
+    TEST_ASSERT_EQUAL_PTR(node->entry, list_get_entry_by_key(list, node->entry->key));
+    previous = node;
+    seen++;
+  }
+  TEST_ASSERT_EQUAL_PTR(previous, list->tail);
+  TEST_ASSERT_EQUAL(list->size, seen);
+  TEST_ASSERT_EQUAL_STRING("key_1", list->head->entry->key);
+  TEST_ASSERT_EQUAL_STRING("key_0", list->tail->entry->key);
+
+  for (uint64_t idx = 1; idx < count - 1; idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "key_%lu", idx);
+    db_entry_t *entry = list_get_entry_by_key(list, key);
+    if (idx % 3 == 0) {
+      TEST_ASSERT_NULL(entry);
+    }
+    else {
+      TEST_ASSERT_NOT_NULL(entry);
+      TEST_ASSERT_EQUAL(idx, *(int64_t*)entry->value);
+    }
+  }
+  free_list(list);
+}
+
+static void test_cuckoo_put_get_delete() {
+  logger(4, "*** test_cuckoo_put_get_delete ***\n");
+  uint8_t *file_path = "/tmp/test_cuckoo.db";
+  uint64_t count = 20000;
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_CUCKOO);
+  helper_test_put_entry_all_types(db);
+  helper_populate_db_with_sample_data(db);
+  helper_validate_sample_data(db);
+  helper_test_status_codes(db);
+  TEST_ASSERT_EQUAL(KV_OK, delete_entry(db, "key1"));
+  helper_test_silent_misses(db);
+  free_db(db);
+
+  /* Enough keys to fill the first arrays, displace entries and grow */
+  db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_CUCKOO);
+  cuckoo_table_t *cuckoo = (cuckoo_table_t*)db->storage;
+  uint8_t key[SM_BUFFER_SIZE];
+  uint8_t value[SM_BUFFER_SIZE];
+  for (uint64_t idx = 0; idx < count; idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "key_%lu", idx);
+    snprintf(value, SM_BUFFER_SIZE, "%lu", idx);
+    TEST_ASSERT_EQUAL(KV_OK, put_entry(db, key, value, INT64_TYPE_STR));
+  }
+
+  cuckoo_stats_t stats;
+  TEST_ASSERT_EQUAL(0, cuckoo_stats(cuckoo, &stats));
+  TEST_ASSERT_EQUAL(count, stats.entries);
+  TEST_ASSERT_GREATER_THAN(0, stats.resizes);
+  TEST_ASSERT_GREATER_THAN(0, stats.displacements);
+  TEST_ASSERT_LESS_OR_EQUAL(KV_CUCKOO_MAX_PATH, stats.max_path);
+  TEST_ASSERT_LESS_OR_EQUAL(KV_CUCKOO_STASH_SIZE, stats.stash_entries);
+  TEST_ASSERT_TRUE(stats.load_factor > 0.25 && stats.load_factor <= 1.0);
+  TEST_ASSERT_EQUAL(-1, cuckoo_stats(NULL, &stats));
+
+  for (uint64_t idx = 0; idx < count; idx += 2) {
+    snprintf(key, SM_BUFFER_SIZE, "key_%lu", idx);
+    TEST_ASSERT_EQUAL(KV_OK, delete_entry(db, key));
+  }
+  TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "key_1", "-1", ""));
+  TEST_ASSERT_EQUAL(0, save_db(db, file_path));
+  free_db(db);
+
+  db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_CUCKOO);
+  TEST_ASSERT_EQUAL(0, load_db(db, file_path));
+  TEST_ASSERT_EQUAL(count / 2, ((cuckoo_table_t*)db->storage)->count);
+  for (uint64_t idx = 0; idx < count; idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "key_%lu", idx);
+    db_entry_t *entry = get_entry(db, key);
+    if (idx % 2 == 0) {
+      TEST_ASSERT_NULL(entry);
+    }
+    else {
+      TEST_ASSERT_NOT_NULL(entry);
+      TEST_ASSERT_EQUAL(idx == 1 ? -1 : (int64_t)idx, *(int64_t*)entry->value);
+    }
+  }
+  free_db(db);
+  remove(file_path);
+}
+
+static void *helper_cuckoo_reader(void *arg) {
+  cuckoo_table_t *cuckoo = (cuckoo_table_t*)arg;
+  uint8_t key[SM_BUFFER_SIZE];
+  uint64_t errors = 0;
+  for (uint64_t round = 0; round < 50; round++) {
+    for (uint64_t idx = 0; idx < 500; idx++) {
+      snprintf(key, SM_BUFFER_SIZE, "stable_%lu", idx);
+      db_entry_t *entry = cuckoo_get_entry(cuckoo, key);
+      if (entry == NULL || strcmp(entry->key, key) != 0 || *(int8_t*)entry->value != 1) {
+        errors++;
+      }
+    }
+
+    /* Hot keys are rewritten and deleted meanwhile, a value must never be torn */
+    for (uint64_t idx = 0; idx < 8; idx++) {
+      snprintf(key, SM_BUFFER_SIZE, "hot_%lu", idx);
+      db_entry_t *entry = cuckoo_get_entry(cuckoo, key);
+      if (entry == NULL) continue;
+
+      uint8_t *value = entry->value;
+      if (strcmp(entry->key, key) != 0 || entry->size == 0 || value[entry->size] != '\0') {
+        errors++;
+        continue;
+      }
+      for (uint64_t byte = 1; byte < entry->size; byte++) {
+        errors += value[byte] != value[0];
+      }
+    }
+  }
+  return (void*)errors;
+}
+
+static void test_cuckoo_concurrent_readers() {
+  logger(4, "*** test_cuckoo_concurrent_readers ***\n");
+  cuckoo_table_t *cuckoo = create_cuckoo_table(NULL);
+  TEST_ASSERT_NOT_NULL(cuckoo);
+
+  uint8_t key[SM_BUFFER_SIZE];
+  uint8_t value[BG_BUFFER_SIZE];
+  bool hot[8] = { false };
+  for (uint64_t idx = 0; idx < 500; idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "stable_%lu", idx);
+    TEST_ASSERT_EQUAL(KV_OK, cuckoo_put(cuckoo, key, "1", 1, INT8_TYPE_STR));
+  }
+
+  /* Stable keys are displaced and rehashed under the readers, never lost */
+  pthread_t readers[4];
+  for (uint64_t idx = 0; idx < 4; idx++) {
+    TEST_ASSERT_EQUAL(0, pthread_create(&readers[idx], NULL, helper_cuckoo_reader, cuckoo));
+  }
+  for (uint64_t idx = 0; idx < 20000; idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "churn_%lu", idx);
+    TEST_ASSERT_EQUAL(KV_OK, cuckoo_put(cuckoo, key, "2", 1, INT8_TYPE_STR));
+    if (idx % 3 == 0) {
+      TEST_ASSERT_EQUAL(KV_OK, cuckoo_delete(cuckoo, key));
+    }
+
+    /* Each value repeats one byte, with a length that changes on every put */
+    snprintf(key, SM_BUFFER_SIZE, "hot_%lu", idx % 8);
+    uint64_t len = 1 + idx % (BG_BUFFER_SIZE - 1);
+    memset(value, 'a' + idx % 26, len);
+    if (idx % 5 == 0) {
+      TEST_ASSERT_EQUAL(hot[idx % 8] ? KV_OK : KV_NOT_FOUND, cuckoo_delete(cuckoo, key));
+    }
+    else {
+      TEST_ASSERT_EQUAL(KV_OK, cuckoo_put(cuckoo, key, value, len, STRING_TYPE_STR));
+    }
+    hot[idx % 8] = idx % 5 != 0;
+  }
+  for (uint64_t idx = 0; idx < 4; idx++) {
+    void *errors;
+    pthread_join(readers[idx], &errors);
+    TEST_ASSERT_EQUAL(0, (uint64_t)errors);
+  }
+
+  cuckoo_stats_t stats;
+  TEST_ASSERT_EQUAL(0, cuckoo_stats(cuckoo, &stats));
+  uint64_t hot_count = 0;
+  for (uint64_t idx = 0; idx < 8; idx++) {
+    hot_count += hot[idx];
+  }
+  TEST_ASSERT_EQUAL(500 + 20000 - 6667 + hot_count, stats.entries);
+  free_cuckoo_table(cuckoo);
+}
+
+static void *helper_disk_reader(void *arg) {
+  db_t *db = (db_t*)arg;
+  uint8_t key[SM_BUFFER_SIZE];
+  uint64_t errors = 0;
+  for (uint64_t round = 0; round < 100; round++) {
+    for (uint64_t idx = 0; idx < 64; idx++) {
+      snprintf(key, SM_BUFFER_SIZE, "shared_%lu", idx);
+      db_entry_t *entry = get_entry(db, key);
+      if (entry == NULL || strcmp(entry->key, key) != 0 || entry->size != 8 * (idx + 1)) {
+        errors++;
+        continue;
+      }
+
+      /* Gets of the other threads must not overwrite the value being checked */
+      uint8_t *value = entry->value;
+      for (uint64_t byte = 0; byte < entry->size; byte++) {
+        errors += value[byte] != 'a' + idx % 26;
+      }
+    }
+  }
+  return (void*)errors;
+}
+
+static void test_disk_concurrent_gets() {
+  logger(4, "*** test_disk_concurrent_gets ***\n");
+  uint8_t *dir_path = "/tmp/test_disk_concurrent_gets";
+  uint8_t *storage_types[] = { KV_STORAGE_STRUCTURE_BITCASK, KV_STORAGE_STRUCTURE_LSM };
+  uint8_t key[SM_BUFFER_SIZE];
+  uint8_t value[8 * 64];
+
+  for (uint64_t type = 0; type < 2; type++) {
+    helper_remove_dir(dir_path);
+    db_t *db = helper_create_and_validate_db(storage_types[type]);
+    TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+    for (uint64_t idx = 0; idx < 64; idx++) {
+      snprintf(key, SM_BUFFER_SIZE, "shared_%lu", idx);
+      memset(value, 'a' + idx % 26, 8 * (idx + 1));
+      TEST_ASSERT_EQUAL(KV_OK, put_entry_span(db, key, value, 8 * (idx + 1), STRING_TYPE_STR));
+    }
+
+    /* Entries of two gets on one thread share its buffer */
+    db_entry_t *first = get_entry(db, "shared_0");
+    TEST_ASSERT_EQUAL_PTR(first, get_entry(db, "shared_1"));
+
+    pthread_t readers[4];
+    for (uint64_t idx = 0; idx < 4; idx++) {
+      TEST_ASSERT_EQUAL(0, pthread_create(&readers[idx], NULL, helper_disk_reader, db));
+    }
+    for (uint64_t idx = 0; idx < 2000; idx++) {
+      snprintf(key, SM_BUFFER_SIZE, "other_%lu", idx % 100);
+      TEST_ASSERT_EQUAL(KV_OK, put_entry(db, key, "1", INT8_TYPE_STR));
+    }
+    for (uint64_t idx = 0; idx < 4; idx++) {
+      void *errors;
+      pthread_join(readers[idx], &errors);
+      TEST_ASSERT_EQUAL(0, (uint64_t)errors);
+    }
+
+    free_db(db);
+  }
+  helper_remove_dir(dir_path);
+}
+
+static void test_freeze_db() {
+  logger(4, "*** test_freeze_db ***\n");
+  uint8_t *storage_types[] = {
+    KV_STORAGE_STRUCTURE_LIST, KV_STORAGE_STRUCTURE_HASH, KV_STORAGE_STRUCTURE_CUCKOO
+  };
+  uint8_t key[SM_BUFFER_SIZE];
+  uint8_t value[SM_BUFFER_SIZE];
+
+  for (uint64_t type = 0; type < 3; type++) {
+    db_t *db = helper_create_and_validate_db(storage_types[type]);
+    helper_populate_db_with_sample_data(db);
+    TEST_ASSERT_EQUAL(KV_OK, put_entry(db, "text_key", "frozen text", STRING_TYPE_STR));
+    for (uint64_t idx = 0; idx < 1000; idx++) {
+      snprintf(key, SM_BUFFER_SIZE, "key_%lu", idx);
+      snprintf(value, SM_BUFFER_SIZE, "%lu", idx);
+      TEST_ASSERT_EQUAL(KV_OK, put_entry(db, key, value, INT64_TYPE_STR));
+    }
+
+    TEST_ASSERT_EQUAL(KV_OK, freeze_db(db));
+    TEST_ASSERT_EQUAL_STRING(KV_STORAGE_STRUCTURE_FROZEN, db->storage_type);
+    TEST_ASSERT_EQUAL(1003, ((frozen_table_t*)db->storage)->count);
+    helper_validate_sample_data(db);
+
+    db_entry_t *entry = get_entry(db, "text_key");
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL_STRING("frozen text", entry->value);
+    for (uint64_t idx = 0; idx < 1000; idx++) {
+      snprintf(key, SM_BUFFER_SIZE, "key_%lu", idx);
+      entry = get_entry(db, key);
+      TEST_ASSERT_NOT_NULL(entry);
+      TEST_ASSERT_EQUAL_STRING(key, entry->key);
+      TEST_ASSERT_EQUAL((int64_t)idx, *(int64_t*)entry->value);
+    }
+    TEST_ASSERT_NULL(get_entry(db, "key_1000"));
+    TEST_ASSERT_NULL(get_entry(db, "key_"));
+
+    kv_span_t span;
+    TEST_ASSERT_EQUAL(KV_OK, get_entry_span(db, "text_key", &span));
+    TEST_ASSERT_EQUAL(11, span.len);
+    TEST_ASSERT_EQUAL(KV_NOT_FOUND, get_entry_span(db, "missing", &span));
+
+    /* Writes are rejected and leave the table as it was */
+    TEST_ASSERT_EQUAL(KV_READ_ONLY, put_entry(db, "key1", "7", INT32_TYPE_STR));
+    TEST_ASSERT_EQUAL(KV_READ_ONLY, put_entry(db, "new_key", "7", INT32_TYPE_STR));
+    TEST_ASSERT_EQUAL(KV_READ_ONLY, delete_entry(db, "key2"));
+    db_entry_t *new_entry = create_entry("new_key", "7", INT32_TYPE_STR);
+    TEST_ASSERT_EQUAL(KV_READ_ONLY, insert_entry(db, new_entry));
+    free_entry(new_entry);
+    helper_validate_sample_data(db);
+
+    TEST_ASSERT_EQUAL(KV_OK, freeze_db(db));
+    free_db(db);
+  }
+
+  /* Power of two counts keep the low bits of the key hashes out of the slot */
+  for (uint64_t count = 512; count <= 4096; count *= 2) {
+    db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_CUCKOO);
+    for (uint64_t idx = 0; idx < count; idx++) {
+      snprintf(key, SM_BUFFER_SIZE, "key%lu", idx);
+      snprintf(value, SM_BUFFER_SIZE, "%lu", idx);
+      TEST_ASSERT_EQUAL(KV_OK, put_entry(db, key, value, INT64_TYPE_STR));
+    }
+    TEST_ASSERT_EQUAL(KV_OK, freeze_db(db));
+    TEST_ASSERT_EQUAL(count, ((frozen_table_t*)db->storage)->count);
+    for (uint64_t idx = 0; idx < count; idx++) {
+      snprintf(key, SM_BUFFER_SIZE, "key%lu", idx);
+      db_entry_t *entry = get_entry(db, key);
+      TEST_ASSERT_NOT_NULL(entry);
+      TEST_ASSERT_EQUAL((int64_t)idx, *(int64_t*)entry->value);
+    }
+    free_db(db);
+  }
+
+  db_t *empty_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  TEST_ASSERT_EQUAL(KV_OK, freeze_db(empty_db));
+  TEST_ASSERT_NULL(get_entry(empty_db, "key1"));
+  free_db(empty_db);
+
+  TEST_ASSERT_EQUAL(KV_ERROR, freeze_db(NULL));
+  db_t *lsm_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  TEST_ASSERT_EQUAL(KV_ERROR, freeze_db(lsm_db));
+  free_db(lsm_db);
+}
+
+static void test_frozen_image() {
+  logger(4, "*** test_frozen_image ***\n");
+  uint8_t *text_path = "/tmp/test_frozen_image.db";
+  uint8_t *image_path = "/tmp/test_frozen_image.frozen";
+  uint8_t key[SM_BUFFER_SIZE];
+  uint8_t value[SM_BUFFER_SIZE];
+
+  /* Lazy values are parsed while freezing */
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  for (uint64_t idx = 0; idx < 5000; idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "user_%lu", idx);
+    snprintf(value, SM_BUFFER_SIZE, "name %lu", idx);
+    TEST_ASSERT_EQUAL(KV_OK, put_entry(db, key, value, STRING_TYPE_STR));
+  }
+  TEST_ASSERT_EQUAL(KV_OK, save_db(db, text_path));
+  free_db(db);
+
+  db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  TEST_ASSERT_EQUAL(0, set_db_load_mode(db, DB_LOAD_LAZY));
+  TEST_ASSERT_EQUAL(KV_OK, load_db(db, text_path));
+  TEST_ASSERT_EQUAL(KV_OK, freeze_db(db));
+  TEST_ASSERT_EQUAL(KV_OK, save_db(db, image_path));
+  free_db(db);
+
+  db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_FROZEN);
+  TEST_ASSERT_NULL(get_entry(db, "user_0"));
+  TEST_ASSERT_EQUAL(KV_OK, load_db(db, image_path));
+  frozen_table_t *frozen = (frozen_table_t*)db->storage;
+  TEST_ASSERT_TRUE(frozen->mapped);
+  TEST_ASSERT_EQUAL(5000, frozen->count);
+  for (uint64_t idx = 0; idx < 5000; idx++) {
+    snprintf(key, SM_BUFFER_SIZE, "user_%lu", idx);
+    snprintf(value, SM_BUFFER_SIZE, "name %lu", idx);
+    db_entry_t *entry = get_entry(db, key);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL_STRING(value, entry->value);
+  }
+  TEST_ASSERT_NULL(get_entry(db, "user_5000"));
+  TEST_ASSERT_EQUAL(KV_READ_ONLY, put_entry(db, "user_0", "renamed", STRING_TYPE_STR));
+
+  /* The mapped image is not allocated, only the table structure is */
+  kv_memory_usage_t usage;
+  TEST_ASSERT_EQUAL(0, db_memory_usage(db, &usage));
+  TEST_ASSERT_EQUAL(0, usage.bytes[KV_ALLOC_BUCKETS]);
+
+  /* Saving a mapped image copies it unchanged */
+  TEST_ASSERT_EQUAL(KV_OK, save_db(db, text_path));
+  free_db(db);
+
+  db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_FROZEN);
+  TEST_ASSERT_EQUAL(KV_OK, load_db(db, text_path));
+  db_entry_t *entry = get_entry(db, "user_42");
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL_STRING("name 42", entry->value);
+
+  /* Damaged, truncated and text files are refused, the mapped image stays */
+  FILE *file = fopen(image_path, "r+");
+  TEST_ASSERT_NOT_NULL(file);
+  fseek(file, -3, SEEK_END);
+  fputc('#', file);
+  fclose(file);
+  TEST_ASSERT_EQUAL(KV_IO, load_db(db, image_path));
+  TEST_ASSERT_EQUAL(0, truncate(image_path, 100));
+  TEST_ASSERT_EQUAL(KV_IO, load_db(db, image_path));
+  file = fopen(image_path, "w");
+  fputs("int32:key1=42;\n", file);
+  fclose(file);
+  TEST_ASSERT_EQUAL(KV_IO, load_db(db, image_path));
+  TEST_ASSERT_EQUAL(KV_IO, load_db(db, "/tmp/nonexistent_image.frozen"));
+  entry = get_entry(db, "user_42");
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL_STRING("name 42", entry->value);
+
+  free_db(db);
+  remove(text_path);
+  remove(image_path);
+}
+
+static void test_bitcask_put_get_delete() {
+  logger(4, "*** test_bitcask_put_get_delete ***\n");
+  uint8_t *dir_path = "/tmp/test_bitcask_crud";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+  helper_test_put_entry_all_types(db);
+  helper_populate_db_with_sample_data(db);
+  helper_validate_sample_data(db);
+
+  db_entry_t *entry = get_entry(db, "int64_key");
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL(INT64_TYPE, entry->type);
+  TEST_ASSERT_EQUAL_INT64(9223372036854775807LL, *(int64_t*)entry->value);
+
+  TEST_ASSERT_EQUAL(0, put_entry(db, "key1", "-7", ""));
+  entry = get_entry(db, "key1");
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL(INT32_TYPE, entry->type);
+  TEST_ASSERT_EQUAL(-7, *(int32_t*)entry->value);
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, put_entry(db, "new_key", "1", ""));
+
+  TEST_ASSERT_EQUAL(0, delete_entry(db, "key1"));
+  TEST_ASSERT_NULL(get_entry(db, "key1"));
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, delete_entry(db, "key1"));
+
+  db_entry_t *new_entry = helper_create_and_validate_entry("key2", "1.5", FLOAT_TYPE_STR);
+  TEST_ASSERT_EQUAL(KV_EXISTS, insert_entry(db, new_entry));
+  free_entry(new_entry);
+  new_entry = helper_create_and_validate_entry("key1", "1.5", FLOAT_TYPE_STR);
+  TEST_ASSERT_EQUAL(0, insert_entry(db, new_entry));
+  TEST_ASSERT_EQUAL_FLOAT(1.5, *(float*)get_entry(db, "key1")->value);
+
+  free_db(db);
+  helper_remove_dir(dir_path);
+}
+
+static void test_bitcask_unattached() {
+  logger(4, "*** test_bitcask_unattached ***\n");
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+
+  TEST_ASSERT_EQUAL(-1, put_entry(db, "key1", "42", INT32_TYPE_STR));
+  TEST_ASSERT_NULL(get_entry(db, "key1"));
+  TEST_ASSERT_EQUAL(-1, delete_entry(db, "key1"));
+  TEST_ASSERT_EQUAL(-1, compact_db(db));
+
+  free_db(db);
+}
+
+static void test_bitcask_reopen() {
+  logger(4, "*** test_bitcask_reopen ***\n");
+  uint8_t *dir_path = "/tmp/test_bitcask_reopen";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+  helper_populate_db_with_sample_data(db);
+  TEST_ASSERT_EQUAL(0, put_entry(db, "key3", "true", BOOL_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, delete_entry(db, "key3"));
+  TEST_ASSERT_EQUAL(0, save_db(db, dir_path));
+  free_db(db);
+
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, dir_path));
+  TEST_ASSERT_EQUAL(-1, load_db(new_db, dir_path));
+  helper_validate_sample_data(new_db);
+  TEST_ASSERT_NULL(get_entry(new_db, "key3"));
+  TEST_ASSERT_EQUAL(2, ((bitcask_t*)new_db->storage)->count);
+
+  free_db(new_db);
+  helper_remove_dir(dir_path);
+}
+
+static void test_bitcask_merge() {
+  logger(4, "*** test_bitcask_merge ***\n");
+  uint8_t *dir_path = "/tmp/test_bitcask_merge";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+  bitcask_t *bitcask = (bitcask_t*)db->storage;
+  bitcask->max_file_size = 256;
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+
+  for (uint64_t round = 0; round < 20; round++) {
+    for (uint64_t i = 0; i < 10; i++) {
+      uint8_t key[SM_BUFFER_SIZE];
+      uint8_t value[SM_BUFFER_SIZE];
+      snprintf(key, SM_BUFFER_SIZE, "key_%lu", i);
+      snprintf(value, SM_BUFFER_SIZE, "%lu", round * 100 + i);
+      TEST_ASSERT_EQUAL(0, put_entry(db, key, value, INT64_TYPE_STR));
+    }
+  }
+  TEST_ASSERT_EQUAL(0, delete_entry(db, "key_9"));
+
+  bitcask_merge_wait(bitcask);
+  TEST_ASSERT_EQUAL(0, compact_db(db));
+  bitcask_merge_wait(bitcask);
+  TEST_ASSERT_GREATER_OR_EQUAL(1, helper_count_files(dir_path, "hint"));
+  TEST_ASSERT_LESS_THAN(10, helper_count_files(dir_path, "data"));
+
+  TEST_ASSERT_EQUAL(0, put_entry(db, "key_0", "-1", INT64_TYPE_STR));
+  free_db(db);
+
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, dir_path));
+  TEST_ASSERT_EQUAL(9, ((bitcask_t*)new_db->storage)->count);
+  TEST_ASSERT_EQUAL_INT64(-1, *(int64_t*)get_entry(new_db, "key_0")->value);
+  for (uint64_t i = 1; i < 9; i++) {
+    uint8_t key[SM_BUFFER_SIZE];
+    snprintf(key, SM_BUFFER_SIZE, "key_%lu", i);
+    db_entry_t *entry = get_entry(new_db, key);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL_INT64(1900 + i, *(int64_t*)entry->value);
+  }
+  TEST_ASSERT_NULL(get_entry(new_db, "key_9"));
+
+  free_db(new_db);
+  helper_remove_dir(dir_path);
+}
+
+static void test_bitcask_blobs() {
+  logger(4, "*** test_bitcask_blobs ***\n");
+  uint8_t *dir_path = "/tmp/test_bitcask_blobs";
+  helper_remove_dir(dir_path);
+
+  uint8_t blobs[3][10 * 1024];
+  for (uint64_t idx = 0; idx < 3; idx++) {
+    helper_fill_blob(blobs[idx], sizeof(blobs[idx]), idx);
+  }
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+  bitcask_t *bitcask = (bitcask_t*)db->storage;
+  bitcask->max_file_size = 16 * 1024;
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+  for (uint64_t round = 0; round < 3; round++) {
+    TEST_ASSERT_EQUAL(0, put_entry_span(db, "blob", blobs[round], sizeof(blobs[round]), BLOB_TYPE_STR));
+    TEST_ASSERT_EQUAL(0, put_entry(db, "name", round == 2 ? "last" : "first", STRING_TYPE_STR));
+  }
+  TEST_ASSERT_EQUAL(0, put_entry(db, "empty", "", STRING_TYPE_STR));
+  helper_validate_blob(db, "blob", blobs[2], sizeof(blobs[2]));
+  TEST_ASSERT_EQUAL(0, compact_db(db));
+  bitcask_merge_wait(bitcask);
+  free_db(db);
+
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, dir_path));
+  helper_validate_blob(new_db, "blob", blobs[2], sizeof(blobs[2]));
+  TEST_ASSERT_EQUAL_STRING("last", get_entry(new_db, "name")->value);
+  helper_validate_blob(new_db, "empty", "", 0);
+
+  free_db(new_db);
+  helper_remove_dir(dir_path);
+}
+
+static void test_bitcask_save_text() {
+  logger(4, "*** test_bitcask_save_text ***\n");
+  uint8_t *dir_path = "/tmp/test_bitcask_text";
+  uint8_t *file_path = "/tmp/test_bitcask_text.db";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+  helper_populate_db_with_sample_data(db);
+  TEST_ASSERT_EQUAL(0, save_db(db, file_path));
+
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, file_path));
+  helper_validate_sample_data(new_db);
+
+  free_db(db);
+  free_db(new_db);
+  remove(file_path);
+  helper_remove_dir(dir_path);
+}
+
+static void test_bitcask_checksum() {
+  logger(4, "*** test_bitcask_checksum ***\n");
+  uint8_t *dir_path = "/tmp/test_bitcask_checksum";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+  helper_populate_db_with_sample_data(db);
+
+  uint8_t data_path[BG_BUFFER_SIZE];
+  snprintf(data_path, BG_BUFFER_SIZE, "%s/%09lu.data", dir_path, ((bitcask_t*)db->storage)->files[0].id);
+  helper_flip_byte(data_path, sizeof(bitcask_record_header_t) + strlen("key1"));
+
+  TEST_ASSERT_NULL(get_entry(db, "key1"));
+  TEST_ASSERT_EQUAL_FLOAT(3.14f, *(float*)get_entry(db, "key2")->value);
+  free_db(db);
+
+  /* Replay stops at the damaged record like at a torn write */
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, dir_path));
+  TEST_ASSERT_NULL(get_entry(new_db, "key1"));
+  TEST_ASSERT_EQUAL(0, ((bitcask_t*)new_db->storage)->count);
+  TEST_ASSERT_EQUAL(0, put_entry(new_db, "key5", "value", STRING_TYPE_STR));
+  uint64_t size = ((bitcask_t*)new_db->storage)->files[0].size;
+  free_db(new_db);
+
+  /* A torn header asking for a huge value is not trusted */
+  bitcask_record_header_t header = { 0, UINT32_MAX - 64, strlen("key6"), STRING_TYPE, 0 };
+  FILE *file = fopen(data_path, "a");
+  TEST_ASSERT_NOT_NULL(file);
+  fwrite(&header, sizeof(bitcask_record_header_t), 1, file);
+  fputs("key6torn", file);
+  fclose(file);
+
+  new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_BITCASK);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, dir_path));
+  TEST_ASSERT_EQUAL_STRING("value", get_entry(new_db, "key5")->value);
+  TEST_ASSERT_NULL(get_entry(new_db, "key6"));
+  TEST_ASSERT_EQUAL(size, ((bitcask_t*)new_db->storage)->files[0].size);
+
+  free_db(new_db);
+  helper_remove_dir(dir_path);
+}
+
+static void test_lsm_put_get_delete() {
+  logger(4, "*** test_lsm_put_get_delete ***\n");
+  uint8_t *dir_path = "/tmp/test_lsm_crud";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  TEST_ASSERT_EQUAL(-1, put_entry(db, "key1", "42", INT32_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+  helper_test_put_entry_all_types(db);
+  helper_populate_db_with_sample_data(db);
+  helper_validate_sample_data(db);
+
+  TEST_ASSERT_EQUAL(0, put_entry(db, "key1", "-7", ""));
+  db_entry_t *entry = get_entry(db, "key1");
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL(INT32_TYPE, entry->type);
+  TEST_ASSERT_EQUAL(-7, *(int32_t*)entry->value);
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, put_entry(db, "new_key", "1", ""));
+
+  TEST_ASSERT_EQUAL(0, delete_entry(db, "key1"));
+  TEST_ASSERT_NULL(get_entry(db, "key1"));
+  TEST_ASSERT_EQUAL(KV_NOT_FOUND, delete_entry(db, "key1"));
+
+  db_entry_t *new_entry = helper_create_and_validate_entry("key2", "1.5", FLOAT_TYPE_STR);
+  TEST_ASSERT_EQUAL(KV_EXISTS, insert_entry(db, new_entry));
+  free_entry(new_entry);
+  new_entry = helper_create_and_validate_entry("key1", "1.5", FLOAT_TYPE_STR);
+  TEST_ASSERT_EQUAL(0, insert_entry(db, new_entry));
+  TEST_ASSERT_EQUAL_FLOAT(1.5, *(float*)get_entry(db, "key1")->value);
+
+  free_db(db);
+  helper_remove_dir(dir_path);
+}
+
+static void test_lsm_reopen() {
+  logger(4, "*** test_lsm_reopen ***\n");
+  uint8_t *dir_path = "/tmp/test_lsm_reopen";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+  helper_populate_db_with_sample_data(db);
+  TEST_ASSERT_EQUAL(0, put_entry(db, "key3", "true", BOOL_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, delete_entry(db, "key3"));
+  TEST_ASSERT_EQUAL(0, save_db(db, dir_path));
+  free_db(db);
+
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, dir_path));
+  TEST_ASSERT_EQUAL(-1, load_db(new_db, dir_path));
+  helper_validate_sample_data(new_db);
+  TEST_ASSERT_NULL(get_entry(new_db, "key3"));
+  TEST_ASSERT_EQUAL(2, lsm_count((lsm_tree_t*)new_db->storage));
+  TEST_ASSERT_EQUAL(1, helper_count_files(dir_path, "sst"));
+
+  free_db(new_db);
+  helper_remove_dir(dir_path);
+}
+
+static void test_lsm_compaction() {
+  logger(4, "*** test_lsm_compaction ***\n");
+  uint8_t *dir_path = "/tmp/test_lsm_compaction";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  lsm_tree_t *lsm = (lsm_tree_t*)db->storage;
+  lsm->memtable_size = 4096;
+  lsm->block_size = 256;
+  lsm->table_size = 2048;
+  lsm->level0_tables = 2;
+  lsm->level_base_size = 8192;
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+
+  for (uint64_t round = 0; round < 5; round++) {
+    for (uint64_t i = 0; i < 500; i++) {
+      uint8_t key[SM_BUFFER_SIZE];
+      uint8_t value[SM_BUFFER_SIZE];
+      snprintf(key, SM_BUFFER_SIZE, "key_%03lu", (i * 7) % 500);
+      snprintf(value, SM_BUFFER_SIZE, "%lu", round * 1000 + (i * 7) % 500);
+      TEST_ASSERT_EQUAL(0, put_entry(db, key, value, INT64_TYPE_STR));
+    }
+  }
+  for (uint64_t i = 0; i < 500; i += 5) {
+    uint8_t key[SM_BUFFER_SIZE];
+    snprintf(key, SM_BUFFER_SIZE, "key_%03lu", i);
+    TEST_ASSERT_EQUAL(0, delete_entry(db, key));
+  }
+
+  TEST_ASSERT_EQUAL(0, compact_db(db));
+  TEST_ASSERT_EQUAL(0, lsm_wait_idle(lsm));
+  TEST_ASSERT_EQUAL(0, lsm->levels[0].count);
+  TEST_ASSERT_GREATER_THAN(1, lsm->levels[1].count + lsm->levels[2].count);
+  TEST_ASSERT_EQUAL(400, lsm_count(lsm));
+  free_db(db);
+
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, dir_path));
+  for (uint64_t i = 0; i < 500; i++) {
+    uint8_t key[SM_BUFFER_SIZE];
+    snprintf(key, SM_BUFFER_SIZE, "key_%03lu", i);
+    db_entry_t *entry = get_entry(new_db, key);
+    if (i % 5 == 0) {
+      TEST_ASSERT_NULL(entry);
+    }
+    else {
+      TEST_ASSERT_NOT_NULL(entry);
+      TEST_ASSERT_EQUAL_INT64(4000 + i, *(int64_t*)entry->value);
+    }
+  }
+
+  free_db(new_db);
+  helper_remove_dir(dir_path);
+}
+
+static void test_lsm_blobs() {
+  logger(4, "*** test_lsm_blobs ***\n");
+  uint8_t *dir_path = "/tmp/test_lsm_blobs";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  lsm_tree_t *lsm = (lsm_tree_t*)db->storage;
+  lsm->memtable_size = 32 * 1024;
+  lsm->block_size = 256;
+  lsm->level0_tables = 2;
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+
+  uint8_t blob[10 * 1024];
+  for (uint64_t round = 0; round < 3; round++) {
+    for (uint64_t i = 0; i < 10; i++) {
+      uint8_t key[SM_BUFFER_SIZE];
+      snprintf(key, SM_BUFFER_SIZE, "blob_%lu", i);
+      helper_fill_blob(blob, sizeof(blob), round * 10 + i);
+      TEST_ASSERT_EQUAL(0, put_entry_span(db, key, blob, sizeof(blob), BLOB_TYPE_STR));
+    }
+  }
+  TEST_ASSERT_EQUAL(0, put_entry(db, "name", "12345678", STRING_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, compact_db(db));
+  TEST_ASSERT_EQUAL(0, lsm_wait_idle(lsm));
+  TEST_ASSERT_EQUAL(0, put_entry_span(db, "blob_0", "\0;\n", 3, BLOB_TYPE_STR));
+  TEST_ASSERT_EQUAL(0, put_entry(db, "empty", "", STRING_TYPE_STR));
+  free_db(db);
+
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, dir_path));
+  helper_validate_blob(new_db, "blob_0", "\0;\n", 3);
+  helper_validate_blob(new_db, "empty", "", 0);
+  for (uint64_t i = 1; i < 10; i++) {
+    uint8_t key[SM_BUFFER_SIZE];
+    snprintf(key, SM_BUFFER_SIZE, "blob_%lu", i);
+    helper_fill_blob(blob, sizeof(blob), 20 + i);
+    helper_validate_blob(new_db, key, blob, sizeof(blob));
+  }
+  TEST_ASSERT_EQUAL_STRING("12345678", get_entry(new_db, "name")->value);
+  TEST_ASSERT_EQUAL(12, lsm_count((lsm_tree_t*)new_db->storage));
+
+  free_db(new_db);
+  helper_remove_dir(dir_path);
+}
+
+static int64_t helper_scan_callback(db_entry_t *entry, void *context) {
+  uint8_t *keys = (uint8_t*)context;
+  strcat(keys, entry->key);
+  strcat(keys, ",");
+  return strcmp(entry->key, "key_8") == 0 ? -1 : 0;
+}
+
+static void test_lsm_scan() {
+  logger(4, "*** test_lsm_scan ***\n");
+  uint8_t *dir_path = "/tmp/test_lsm_scan";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+  uint8_t *keys[] = { "key_5", "key_2", "key_7", "key_1", "key_4", "key_3", "key_6", "key_9", "key_8" };
+  for (uint64_t i = 0; i < 5; i++) {
+    TEST_ASSERT_EQUAL(0, put_entry(db, keys[i], "1", INT32_TYPE_STR));
+  }
+  TEST_ASSERT_EQUAL(0, compact_db(db));
+  TEST_ASSERT_EQUAL(0, lsm_wait_idle((lsm_tree_t*)db->storage));
+  for (uint64_t i = 5; i < 9; i++) {
+    TEST_ASSERT_EQUAL(0, put_entry(db, keys[i], "1", INT32_TYPE_STR));
+  }
+  TEST_ASSERT_EQUAL(0, delete_entry(db, "key_4"));
+
+  uint8_t scanned[BG_BUFFER_SIZE] = "";
+  TEST_ASSERT_EQUAL(4, scan_db(db, "key_2", "key_7", helper_scan_callback, scanned));
+  TEST_ASSERT_EQUAL_STRING("key_2,key_3,key_5,key_6,", scanned);
+
+  scanned[0] = '\0';
+  TEST_ASSERT_EQUAL(7, scan_db(db, NULL, NULL, helper_scan_callback, scanned));
+  TEST_ASSERT_EQUAL_STRING("key_1,key_2,key_3,key_5,key_6,key_7,key_8,", scanned);
+
+  TEST_ASSERT_EQUAL(-1, scan_db(db, NULL, NULL, NULL, NULL));
+  free_db(db);
+
+  db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  TEST_ASSERT_EQUAL(-1, scan_db(db, NULL, NULL, helper_scan_callback, scanned));
+  free_db(db);
+  helper_remove_dir(dir_path);
+}
+
+static void test_lsm_save_text() {
+  logger(4, "*** test_lsm_save_text ***\n");
+  uint8_t *dir_path = "/tmp/test_lsm_text";
+  uint8_t *file_path = "/tmp/test_lsm_text.db";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+  helper_populate_db_with_sample_data(db);
+  TEST_ASSERT_EQUAL(0, save_db(db, file_path));
+  TEST_ASSERT_EQUAL(0, save_db_async(db, file_path, NULL, NULL));
+  TEST_ASSERT_EQUAL(0, wait_db_snapshot(db));
+
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_HASH);
+  TEST_ASSERT_EQUAL(0, load_db(new_db, file_path));
+  helper_validate_sample_data(new_db);
+
+  free_db(db);
+  free_db(new_db);
+  remove(file_path);
+  helper_remove_dir(dir_path);
+}
+
+static void test_lsm_checksum() {
+  logger(4, "*** test_lsm_checksum ***\n");
+  uint8_t *dir_path = "/tmp/test_lsm_checksum";
+  helper_remove_dir(dir_path);
+
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  TEST_ASSERT_EQUAL(0, load_db(db, dir_path));
+  helper_populate_db_with_sample_data(db);
+  TEST_ASSERT_EQUAL(0, compact_db(db));
+  lsm_tree_t *lsm = (lsm_tree_t*)db->storage;
+  TEST_ASSERT_EQUAL(0, lsm_wait_idle(lsm));
+
+  lsm_table_t *table = NULL;
+  for (uint64_t level_idx = 0; level_idx < KV_LSM_MAX_LEVELS && table == NULL; level_idx++) {
+    if (lsm->levels[level_idx].count > 0) {
+      table = lsm->levels[level_idx].tables[0];
+    }
+  }
+  TEST_ASSERT_NOT_NULL(table);
+
+  uint8_t table_path[BG_BUFFER_SIZE];
+  snprintf(table_path, BG_BUFFER_SIZE, "%s/%09lu.sst", dir_path, table->id);
+  helper_flip_byte(table_path, sizeof(lsm_record_header_t) + 1);
+  TEST_ASSERT_NULL(get_entry(db, "key1"));
+  free_db(db);
+
+  db_t *new_db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LSM);
+  TEST_ASSERT_EQUAL(-1, load_db(new_db, dir_path));
+
+  free_db(new_db);
+  helper_remove_dir(dir_path);
+}
+
+static void test_free_db_valid() {
+  logger(4, "*** test_free_db_valid ***\n");
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  free_db(db);
+}
+
+static void test_free_db_null() {
+  logger(4, "*** test_free_db_null ***\n");
+  free_db(NULL);
+}
+
+static void test_print_db_valid() {
+  logger(4, "*** test_print_db_valid ***\n");
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  
+  TEST_ASSERT_GREATER_OR_EQUAL(0, put_entry(db, "test_key_1", "42", INT32_TYPE_STR));
+  TEST_ASSERT_GREATER_OR_EQUAL(0, put_entry(db, "test_key_2", "24", INT32_TYPE_STR));
+  
+  print_db(db);
+  
+  free_db(db);
+}
+
+static void test_print_db_null() {
+  logger(4, "*** test_print_db_null ***\n");
+  print_db(NULL);
+}
+
+static void test_multiple_entries_operations() {
+  logger(4, "*** test_multiple_entries_operations ***\n");
+  db_t *db = helper_create_and_validate_db(KV_STORAGE_STRUCTURE_LIST);
+  
+  for (uint64_t  i = 0; i < 10; i++) {
+    char key[32];
+    char value[32];
+    snprintf(key, sizeof(key), "key_%u", i);
+    snprintf(value, sizeof(value), "%u", i * 10);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, put_entry(db, key, value, INT32_TYPE_STR));
+  }
+  
+  for (uint64_t  i = 0; i < 10; i++) {
+    char key[32];
+    snprintf(key, sizeof(key), "key_%u", i);
+    
+    db_entry_t *entry = get_entry(db, key);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL(INT32_TYPE, entry->type);
+    TEST_ASSERT_EQUAL(i * 10, *(int32_t*)entry->value);
+  }
+  
+  for (uint64_t  i = 0; i < 5; i++) {
+    char key[32];
+    snprintf(key, sizeof(key), "key_%u", i);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, delete_entry(db, key));
+  }
+  
+  for (uint64_t  i = 0; i < 5; i++) {
+    char key[32];
+    snprintf(key, sizeof(key), "key_%u", i);
+    TEST_ASSERT_NULL(get_entry(db, key));
+  }
+  
+  for (uint64_t  i = 5; i < 10; i++) {
+    char key[32];
+    snprintf(key, sizeof(key), "key_%u", i);
+    db_entry_t *entry = get_entry(db, key);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL(INT32_TYPE, entry->type);
+    TEST_ASSERT_EQUAL(i * 10, *(int32_t*)entry->value);
+  }
+  
+  free_db(db);
+}
+
+extern void setUp(void) {
+  // set stuff up here
+}
+
+extern void tearDown(void) {
+  // clean stuff up here
+}
+
+extern int main() {
+  UNITY_BEGIN();
+  
+  // create_db tests
+  RUN_TEST(test_create_db_valid_inputs);
+  RUN_TEST(test_create_db_null_input);
+  RUN_TEST(test_create_db_empty_input);
+  RUN_TEST(test_create_db_invalid_storage_type);
+  
+  // insert_entry tests
+  RUN_TEST(test_insert_entry_valid_list);
+  RUN_TEST(test_insert_entry_valid_hash);
+  RUN_TEST(test_insert_entry_null_inputs);
+  
+  // put_entry tests
+  RUN_TEST(test_put_entry_valid_list);
+  RUN_TEST(test_put_entry_valid_hash);
+  RUN_TEST(test_put_entry_all_types_list);
   RUN_TEST(test_put_entry_all_types_hash);
   RUN_TEST(test_put_entry_null_inputs);
   RUN_TEST(test_put_entry_empty_strings);
@@ -512,11 +2383,57 @@ extern int main() {
   // save_db and load_db tests
   RUN_TEST(test_save_load_db_valid_list);
   RUN_TEST(test_save_load_db_valid_hash);
+  RUN_TEST(test_save_load_db_float_roundtrip);
   RUN_TEST(test_save_db_null_inputs);
   RUN_TEST(test_save_db_empty_path);
   RUN_TEST(test_load_db_null_inputs);
   RUN_TEST(test_load_db_empty_path);
   RUN_TEST(test_load_db_nonexistent_file);
+  RUN_TEST(test_save_db_async_list);
+  RUN_TEST(test_save_db_async_hash);
+  RUN_TEST(test_save_db_async_after_finish);
+  RUN_TEST(test_save_db_async_null_inputs);
+  RUN_TEST(test_save_db_durability_sync);
+  RUN_TEST(test_save_db_durability_relaxed);
+  RUN_TEST(test_save_db_durability_invalid);
+  RUN_TEST(test_save_db_missing_directory);
+  RUN_TEST(test_load_db_lazy);
+  RUN_TEST(test_load_db_long_lines);
+  RUN_TEST(test_string_and_blob_values);
+  RUN_TEST(test_set_db_load_mode_invalid);
+  RUN_TEST(test_crc32c);
+  RUN_TEST(test_load_db_checksum_corrupt);
+  RUN_TEST(test_load_db_without_checksums);
+  RUN_TEST(test_status_codes);
+  RUN_TEST(test_db_stats);
+  RUN_TEST(test_db_hash_stats);
+  RUN_TEST(test_db_trace);
+  RUN_TEST(test_db_allocator);
+  RUN_TEST(test_key_compare);
+  RUN_TEST(test_list_index);
+  RUN_TEST(test_cuckoo_put_get_delete);
+  RUN_TEST(test_cuckoo_concurrent_readers);
+  RUN_TEST(test_disk_concurrent_gets);
+  RUN_TEST(test_freeze_db);
+  RUN_TEST(test_frozen_image);
+  
+  // bitcask tests
+  RUN_TEST(test_bitcask_put_get_delete);
+  RUN_TEST(test_bitcask_unattached);
+  RUN_TEST(test_bitcask_reopen);
+  RUN_TEST(test_bitcask_merge);
+  RUN_TEST(test_bitcask_blobs);
+  RUN_TEST(test_bitcask_save_text);
+  RUN_TEST(test_bitcask_checksum);
+
+  // lsm tree tests
+  RUN_TEST(test_lsm_put_get_delete);
+  RUN_TEST(test_lsm_reopen);
+  RUN_TEST(test_lsm_compaction);
+  RUN_TEST(test_lsm_blobs);
+  RUN_TEST(test_lsm_scan);
+  RUN_TEST(test_lsm_save_text);
+  RUN_TEST(test_lsm_checksum);
   
   // free_db and print_db tests
   RUN_TEST(test_free_db_valid);
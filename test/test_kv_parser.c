@@ -75,7 +75,7 @@ static void test_create_entry_invalid_inputs() {
 
 static void test_set_entry_value_all_types() {
   logger(4, "*** test_set_entry_value_all_types ***\n");
-  db_entry_t *entry = malloc(sizeof(db_entry_t));
+  db_entry_t *entry = calloc(1, sizeof(db_entry_t));
 
   entry->type = INT8_TYPE;
   entry->value = NULL;
@@ -150,9 +150,9 @@ static void test_set_entry_value_invalid_inputs() {
   logger(4, "*** test_set_entry_value_invalid_inputs ***\n");
   db_entry_t *entry = helper_create_and_validate_entry("key", "10", INT8_TYPE_STR);
   TEST_ASSERT_EQUAL(-1, set_entry_value(entry, ""));
-  TEST_ASSERT_EQUAL(-1, set_entry_value(entry, "string"));
+  TEST_ASSERT_EQUAL(KV_TYPE_MISMATCH, set_entry_value(entry, "string"));
   entry->type = 999;
-  TEST_ASSERT_EQUAL(-1, set_entry_value(entry, "42"));
+  TEST_ASSERT_EQUAL(KV_TYPE_MISMATCH, set_entry_value(entry, "42"));
   TEST_ASSERT_NOT_NULL(entry->value);
   TEST_ASSERT_EQUAL_INT8(10, *(int8_t*)entry->value);
   free_entry(entry);
@@ -211,13 +211,14 @@ static void test_update_entry_null_inputs() {
 static void test_update_entry_invalid_inputs() {
   logger(4, "*** test_update_entry_invalid_inputs ***\n");
   db_entry_t *entry = helper_create_and_validate_entry("key", "10", INT8_TYPE_STR);
-  TEST_ASSERT_EQUAL(-1, update_entry(entry, "value", "type"));
-  TEST_ASSERT_EQUAL(-1, update_entry(entry, "value", INT8_TYPE_STR));
-  TEST_ASSERT_EQUAL(-1, update_entry(entry, "12", "type"));
+  TEST_ASSERT_EQUAL(KV_TYPE_MISMATCH, update_entry(entry, "value", "type"));
+  TEST_ASSERT_EQUAL(KV_TYPE_MISMATCH, update_entry(entry, "value", INT8_TYPE_STR));
+  TEST_ASSERT_EQUAL(KV_TYPE_MISMATCH, update_entry(entry, "12", "type"));
   TEST_ASSERT_EQUAL(-1, update_entry(entry, "", ""));
-  TEST_ASSERT_EQUAL(-1, update_entry(entry, "12", ""));
+  TEST_ASSERT_EQUAL(KV_TYPE_MISMATCH, update_entry(entry, "twelve", ""));
   TEST_ASSERT_EQUAL(-1, update_entry(entry, "", INT8_TYPE_STR));
   TEST_ASSERT_NOT_NULL((int8_t*)entry->value);
+  TEST_ASSERT_EQUAL(INT8_TYPE, entry->type);
   TEST_ASSERT_EQUAL_INT8(10, *(int8_t*)entry->value);
   free_entry(entry);
 }
@@ -329,6 +330,135 @@ static void test_parse_entry_invalid_inputs() {
   free_entry(entry);
 }
 
+static void test_write_entry() {
+  logger(4, "*** test_write_entry ***\n");
+  uint8_t *output = NULL;
+  size_t output_len = 0;
+  FILE *stream = open_memstream((char**)&output, &output_len);
+  TEST_ASSERT_NOT_NULL(stream);
+
+  db_entry_t *entry = helper_create_and_validate_entry("testkey", "42", INT32_TYPE_STR);
+  TEST_ASSERT_EQUAL(0, write_entry(stream, entry));
+
+  /* Raw values are written unconverted, whatever their length */
+  uint8_t raw_value[4096];
+  memset(raw_value, '0', sizeof(raw_value));
+  raw_value[sizeof(raw_value) - 1] = '7';
+  db_entry_t *lazy_entry = create_lazy_entry("lazykey", raw_value, sizeof(raw_value), INT64_TYPE_STR);
+  TEST_ASSERT_NOT_NULL(lazy_entry);
+  TEST_ASSERT_EQUAL(0, write_entry(stream, lazy_entry));
+  TEST_ASSERT_EQUAL(0, fclose(stream));
+
+  uint8_t *expected = INT32_TYPE_STR TYPE_DELIMETER "testkey" KEY_DELIMETER "42" VALUE_DELIMETER "\n"
+                      INT64_TYPE_STR TYPE_DELIMETER "lazykey" KEY_DELIMETER;
+  uint64_t expected_len = strlen(expected);
+  TEST_ASSERT_EQUAL_UINT64(expected_len + sizeof(raw_value) + 2, output_len);
+  TEST_ASSERT_EQUAL_MEMORY(expected, output, expected_len);
+  TEST_ASSERT_EQUAL_MEMORY(raw_value, output + expected_len, sizeof(raw_value));
+  TEST_ASSERT_EQUAL_MEMORY(VALUE_DELIMETER "\n", output + expected_len + sizeof(raw_value), 2);
+
+  uint8_t line[BG_BUFFER_SIZE];
+  TEST_ASSERT_EQUAL(-1, parse_entry(lazy_entry, line, BG_BUFFER_SIZE));
+  TEST_ASSERT_EQUAL(-1, write_entry(NULL, entry));
+  TEST_ASSERT_EQUAL(-1, write_entry(stdout, NULL));
+
+  free(output);
+  free_entry(entry);
+  free_entry(lazy_entry);
+}
+
+static void test_escape_bytes() {
+  logger(4, "*** test_escape_bytes ***\n");
+  uint8_t value[] = { 'a', '\0', ';', '\n', '\\', 0x01, '\t', 'b', 0xFF };
+  uint8_t *expected = "a\\0\\x3b\\n\\\\\\x01\\tb\xff";
+  uint64_t expected_len = strlen(expected);
+
+  uint8_t text[BG_BUFFER_SIZE];
+  TEST_ASSERT_EQUAL_UINT64(expected_len, escaped_length(value, sizeof(value)));
+  TEST_ASSERT_EQUAL(expected_len, escape_bytes(value, sizeof(value), text, BG_BUFFER_SIZE));
+  TEST_ASSERT_EQUAL_MEMORY(expected, text, expected_len);
+  TEST_ASSERT_EQUAL(-1, escape_bytes(value, sizeof(value), text, expected_len - 1));
+
+  uint8_t bytes[BG_BUFFER_SIZE];
+  TEST_ASSERT_EQUAL(sizeof(value), unescape_bytes(text, expected_len, bytes));
+  TEST_ASSERT_EQUAL_MEMORY(value, bytes, sizeof(value));
+  TEST_ASSERT_EQUAL(2, unescape_bytes("\\x4a\\x4A", 8, bytes));
+  TEST_ASSERT_EQUAL_MEMORY("JJ", bytes, 2);
+
+  TEST_ASSERT_EQUAL(-1, unescape_bytes("abc\\", 4, bytes));
+  TEST_ASSERT_EQUAL(-1, unescape_bytes("\\q", 2, bytes));
+  TEST_ASSERT_EQUAL(-1, unescape_bytes("\\x4", 3, bytes));
+  TEST_ASSERT_EQUAL(-1, unescape_bytes("\\xg0", 4, bytes));
+}
+
+static void test_string_and_blob_entries() {
+  logger(4, "*** test_string_and_blob_entries ***\n");
+  uint8_t blob[] = { 0x00, 0x01, ';', '\n', 0x00 };
+  db_entry_t *entry = create_entry_span("blobkey", blob, sizeof(blob), BLOB_TYPE_STR);
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL(BLOB_TYPE, entry->type);
+  TEST_ASSERT_EQUAL_UINT64(sizeof(blob), entry->size);
+  TEST_ASSERT_EQUAL_MEMORY(blob, entry->value, sizeof(blob));
+
+  kv_span_t value;
+  TEST_ASSERT_EQUAL(0, get_value_span(entry, &value));
+  TEST_ASSERT_EQUAL_UINT64(sizeof(blob), value.len);
+  TEST_ASSERT_EQUAL_PTR(entry->value, value.ptr);
+
+  uint8_t entry_str[BG_BUFFER_SIZE];
+  TEST_ASSERT_EQUAL(0, parse_entry(entry, entry_str, BG_BUFFER_SIZE));
+  TEST_ASSERT_EQUAL_STRING(BLOB_TYPE_STR ":blobkey=\\0\\x01\\x3b\\n\\0;\n", entry_str);
+  free_entry(entry);
+
+  /* The text form of the value reloads to the same bytes */
+  entry = parse_line(entry_str);
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL(BLOB_TYPE, entry->type);
+  TEST_ASSERT_EQUAL_UINT64(sizeof(blob), entry->size);
+  TEST_ASSERT_EQUAL_MEMORY(blob, entry->value, sizeof(blob));
+  free_entry(entry);
+
+  entry = parse_line_lazy(entry_str, strlen(entry_str));
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL(0, get_value_span(entry, &value));
+  TEST_ASSERT_EQUAL_UINT64(sizeof(blob), value.len);
+  TEST_ASSERT_EQUAL_MEMORY(blob, value.ptr, sizeof(blob));
+  free_entry(entry);
+
+  /* Strings are null-terminated and can be updated to any length */
+  entry = create_entry("strkey", "hello world", STRING_TYPE_STR);
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL(STRING_TYPE, entry->type);
+  TEST_ASSERT_EQUAL_STRING("hello world", entry->value);
+  TEST_ASSERT_EQUAL_UINT64(11, entry->size);
+
+  uint8_t long_value[4096];
+  memset(long_value, 'x', sizeof(long_value) - 1);
+  long_value[sizeof(long_value) - 1] = '\0';
+  TEST_ASSERT_EQUAL(0, update_entry(entry, long_value, STRING_TYPE_STR));
+  TEST_ASSERT_EQUAL_STRING(long_value, entry->value);
+  TEST_ASSERT_EQUAL_UINT64(sizeof(long_value) - 1, entry->size);
+  TEST_ASSERT_EQUAL(0, update_entry(entry, "7", INT8_TYPE_STR));
+  TEST_ASSERT_EQUAL(7, *(int8_t*)entry->value);
+  free_entry(entry);
+
+  TEST_ASSERT_NULL(parse_line(STRING_TYPE_STR ":badkey=abc\\q;"));
+  uint8_t line[BG_BUFFER_SIZE];
+  TEST_ASSERT_NULL(parse_line(INT8_TYPE_STR ":emptykey=;"));
+  entry = parse_line(BLOB_TYPE_STR ":emptykey=;");
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL_UINT64(0, entry->size);
+  TEST_ASSERT_EQUAL(0, parse_entry(entry, line, BG_BUFFER_SIZE));
+  TEST_ASSERT_EQUAL_STRING(BLOB_TYPE_STR ":emptykey=;\n", line);
+  free_entry(entry);
+  entry = create_entry_span("emptykey", "", 0, STRING_TYPE_STR);
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL_UINT64(0, entry->size);
+  TEST_ASSERT_EQUAL_STRING("", entry->value);
+  free_entry(entry);
+  TEST_ASSERT_EQUAL(-1, get_value_span(NULL, &value));
+}
+
 static void test_parse_line_valid_entry() {
   logger(4, "*** test_parse_line_valid_entry ***\n");
   uint8_t line[BG_BUFFER_SIZE] = INT8_TYPE_STR TYPE_DELIMETER
@@ -462,6 +592,322 @@ static void test_parse_line_null_input() {
   TEST_ASSERT_NULL(parse_line(NULL));
 }
 
+static void test_parse_line_lazy() {
+  logger(4, "*** test_parse_line_lazy ***\n");
+  uint8_t *text = INT32_TYPE_STR TYPE_DELIMETER "lazykey" KEY_DELIMETER "-42" VALUE_DELIMETER "\n"
+                  "#comment\n";
+  uint64_t line_len = strchr(text, '\n') - (char*)text + 1;
+
+  db_entry_t *entry = parse_line_lazy(text, line_len);
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL_STRING("lazykey", entry->key);
+  TEST_ASSERT_EQUAL(INT32_TYPE, entry->type);
+  TEST_ASSERT_NULL(entry->value);
+  TEST_ASSERT_EQUAL(3, entry->raw_size);
+
+  uint8_t entry_str[BG_BUFFER_SIZE];
+  TEST_ASSERT_EQUAL(0, parse_entry(entry, entry_str, BG_BUFFER_SIZE));
+  TEST_ASSERT_EQUAL_STRING(INT32_TYPE_STR ":lazykey=-42;\n", entry_str);
+  TEST_ASSERT_NULL(entry->value);
+
+  TEST_ASSERT_EQUAL(0, materialize_entry(entry));
+  TEST_ASSERT_NULL(entry->raw_value);
+  TEST_ASSERT_EQUAL(-42, *(int32_t*)entry->value);
+  void *value = entry->value;
+  TEST_ASSERT_EQUAL(0, materialize_entry(entry));
+  TEST_ASSERT_EQUAL_PTR(value, entry->value);
+  free_entry(entry);
+
+  TEST_ASSERT_NULL(parse_line_lazy(text + line_len, strlen(text) - line_len));
+  TEST_ASSERT_NULL(parse_line_lazy("int32:key=42", 12));
+  TEST_ASSERT_NULL(parse_line_lazy("int32:=42;", 10));
+  TEST_ASSERT_NULL(parse_line_lazy(NULL, 10));
+
+  entry = parse_line_lazy("int32:badkey=abc;", 17);
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL(-1, materialize_entry(entry));
+  free_entry(entry);
+}
+
+static void test_parse_line_unmodified() {
+  logger(4, "*** test_parse_line_unmodified ***\n");
+  uint8_t line[BG_BUFFER_SIZE] = INT16_TYPE_STR TYPE_DELIMETER "key" KEY_DELIMETER "-7" VALUE_DELIMETER "\n";
+  uint8_t copy[BG_BUFFER_SIZE];
+  memcpy(copy, line, BG_BUFFER_SIZE);
+
+  for (uint64_t i = 0; i < 2; i++) {
+    db_entry_t *entry = parse_line(line);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL_STRING("key", entry->key);
+    TEST_ASSERT_EQUAL(-7, *(int16_t*)entry->value);
+    free_entry(entry);
+  }
+  TEST_ASSERT_EQUAL_MEMORY(copy, line, BG_BUFFER_SIZE);
+}
+
+static void test_tokenizer_buffer() {
+  logger(4, "*** test_tokenizer_buffer ***\n");
+  uint64_t capacity = TOKENIZER_WINDOW_SIZE * 3;
+  uint8_t *buffer = malloc(capacity);
+  TEST_ASSERT_NOT_NULL(buffer);
+
+  /* Lines of varying length cross the window boundaries at every offset */
+  uint64_t len = 0;
+  uint64_t entry_count = 0;
+  while (len + BG_BUFFER_SIZE < capacity) {
+    if (entry_count % 50 == 7) {
+      len += snprintf(buffer + len, capacity - len, "# a:comment=with;delimiters\n\n");
+    }
+    len += snprintf(buffer + len, capacity - len, "int32:key_%lu_%.*s=%lu;\n",
+                    entry_count, (int)(entry_count % 17), "xxxxxxxxxxxxxxxxx", entry_count);
+    entry_count++;
+  }
+  len += snprintf(buffer + len, capacity - len, "int32:bad_key;1=\n" "int8:last=1;");
+
+  kv_tokenizer_t *tokenizer = malloc(sizeof(kv_tokenizer_t));
+  TEST_ASSERT_NOT_NULL(tokenizer);
+  TEST_ASSERT_EQUAL(0, tokenizer_init(tokenizer, buffer, len));
+
+  kv_tokens_t tokens;
+  uint64_t valid = 0;
+  uint64_t invalid = 0;
+  uint64_t covered = 0;
+  while (tokenizer_next(tokenizer, &tokens) == 1) {
+    TEST_ASSERT_EQUAL_PTR(buffer + covered, tokens.line.ptr);
+    covered += tokens.line.len;
+    if (!tokens.valid) {
+      invalid++;
+      continue;
+    }
+
+    if (valid < entry_count) {
+      uint8_t expected[BG_BUFFER_SIZE];
+      uint64_t key_len = snprintf(expected, BG_BUFFER_SIZE, "key_%lu_%.*s",
+                                  valid, (int)(valid % 17), "xxxxxxxxxxxxxxxxx");
+      TEST_ASSERT_EQUAL(key_len, tokens.key.len);
+      TEST_ASSERT_EQUAL_MEMORY(expected, tokens.key.ptr, key_len);
+      uint64_t value_len = snprintf(expected, BG_BUFFER_SIZE, "%lu", valid);
+      TEST_ASSERT_EQUAL(value_len, tokens.value.len);
+      TEST_ASSERT_EQUAL_MEMORY(expected, tokens.value.ptr, value_len);
+      TEST_ASSERT_EQUAL_MEMORY(INT32_TYPE_STR, tokens.type.ptr, tokens.type.len);
+    }
+    else {
+      TEST_ASSERT_EQUAL_MEMORY("last", tokens.key.ptr, tokens.key.len);
+    }
+    valid++;
+  }
+  TEST_ASSERT_EQUAL(len, covered);
+  TEST_ASSERT_EQUAL(entry_count + 1, valid);
+  TEST_ASSERT_EQUAL((entry_count + 42) / 50 * 2 + 1, invalid);
+  TEST_ASSERT_EQUAL(0, tokenizer_next(tokenizer, &tokens));
+
+  TEST_ASSERT_EQUAL(-1, tokenize_line("int8:key=1", 10, &tokens));
+  TEST_ASSERT_EQUAL(0, tokenize_line("int8:k=v=1;", 11, &tokens));
+  TEST_ASSERT_EQUAL(3, tokens.value.len);
+  TEST_ASSERT_EQUAL(-1, tokenizer_init(NULL, buffer, len));
+
+  free(tokenizer);
+  free(buffer);
+}
+
+static void test_span_to_int64() {
+  logger(4, "*** test_span_to_int64 ***\n");
+  int64_t value;
+
+  /* The span ends before the trailing bytes */
+  uint8_t text[] = "1234567890123;junk";
+  TEST_ASSERT_EQUAL(0, span_to_int64(text, 13, &value));
+  TEST_ASSERT_EQUAL_INT64(1234567890123, value);
+  TEST_ASSERT_EQUAL(0, span_to_int64("-9223372036854775808", 20, &value));
+  TEST_ASSERT_EQUAL_INT64(INT64_MIN, value);
+  TEST_ASSERT_EQUAL(0, span_to_int64("+000000000000000000000042", 25, &value));
+  TEST_ASSERT_EQUAL_INT64(42, value);
+
+  TEST_ASSERT_EQUAL(-1, span_to_int64("9223372036854775808", 19, &value));
+  TEST_ASSERT_EQUAL(-1, span_to_int64("123456789012345678901", 21, &value));
+  TEST_ASSERT_EQUAL(-1, span_to_int64("12345678a", 9, &value));
+  TEST_ASSERT_EQUAL(-1, span_to_int64("-", 1, &value));
+  TEST_ASSERT_EQUAL(-1, span_to_int64("1", 0, &value));
+  TEST_ASSERT_EQUAL(-1, span_to_int64(NULL, 1, &value));
+
+  /* Every length around the 8 digit chunks */
+  uint8_t buffer[SM_BUFFER_SIZE];
+  int64_t expected = 0;
+  for (uint8_t digits = 1; digits <= 18; digits++) {
+    expected = expected * 10 + digits % 10;
+    uint64_t len = snprintf(buffer, SM_BUFFER_SIZE, "%" PRId64, -expected);
+    TEST_ASSERT_EQUAL(0, span_to_int64(buffer, len, &value));
+    TEST_ASSERT_EQUAL_INT64(-expected, value);
+  }
+}
+
+static void test_span_to_double() {
+  logger(4, "*** test_span_to_double ***\n");
+  double value;
+
+  TEST_ASSERT_EQUAL(0, span_to_double("3.141592653589793", 17, &value));
+  TEST_ASSERT_EQUAL_DOUBLE(3.141592653589793, value);
+  TEST_ASSERT_EQUAL(0, span_to_double("-0.0", 4, &value));
+  TEST_ASSERT_EQUAL_UINT64(0x8000000000000000, *(uint64_t*)&value);
+  TEST_ASSERT_EQUAL(0, span_to_double("1e308", 5, &value));
+  TEST_ASSERT_EQUAL_DOUBLE(1e308, value);
+  TEST_ASSERT_EQUAL(0, span_to_double("2.2250738585072014e-308", 23, &value));
+  TEST_ASSERT_EQUAL_DOUBLE(2.2250738585072014e-308, value);
+  /* Halfway between two doubles, rounded to even */
+  TEST_ASSERT_EQUAL(0, span_to_double("9007199254740993", 16, &value));
+  TEST_ASSERT_EQUAL_DOUBLE(9007199254740992.0, value);
+  /* More digits than the fast paths handle */
+  TEST_ASSERT_EQUAL(0, span_to_double("0.1000000000000000000000000001", 30, &value));
+  TEST_ASSERT_EQUAL_DOUBLE(0.1, value);
+
+  TEST_ASSERT_EQUAL(0, span_to_double("5e-324", 6, &value));
+  TEST_ASSERT_EQUAL_DOUBLE(5e-324, value);
+
+  TEST_ASSERT_EQUAL(-1, span_to_double("1e309", 5, &value));
+  TEST_ASSERT_EQUAL(-1, span_to_double("1e-400", 6, &value));
+  TEST_ASSERT_EQUAL(-1, span_to_double("1.5x", 4, &value));
+  TEST_ASSERT_EQUAL(-1, span_to_double("1e", 2, &value));
+  TEST_ASSERT_EQUAL(-1, span_to_double(".", 1, &value));
+
+  /* Same bits as strtod for shortest and fixed point representations */
+  uint64_t state = 0x9E3779B97F4A7C15;
+  uint8_t buffer[BG_BUFFER_SIZE];
+  for (uint64_t idx = 0; idx < 10000; idx++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    /* Any normal double */
+    double random;
+    uint64_t bits = (state >> 12) | (((state % 2046) + 1) << 52);
+    memcpy(&random, &bits, sizeof(double));
+    uint64_t len = idx % 2 == 0 ?
+                   snprintf(buffer, BG_BUFFER_SIZE, "%.17g", random) :
+                   snprintf(buffer, BG_BUFFER_SIZE, "%.15lf", (double)(int64_t)state / 1e12);
+
+    double expected = strtod(buffer, NULL);
+    TEST_ASSERT_EQUAL(0, span_to_double(buffer, len, &value));
+    TEST_ASSERT_EQUAL_MEMORY(&expected, &value, sizeof(double));
+  }
+}
+
+static void test_span_to_float() {
+  logger(4, "*** test_span_to_float ***\n");
+  float value;
+
+  TEST_ASSERT_EQUAL(0, span_to_float("3.1400001", 9, &value));
+  TEST_ASSERT_EQUAL_FLOAT(3.14f, value);
+  TEST_ASSERT_EQUAL(0, span_to_float("3.4028235e38", 12, &value));
+  TEST_ASSERT_EQUAL_FLOAT(3.4028235e38f, value);
+  TEST_ASSERT_EQUAL(0, span_to_float("1.00000005960464477539062500001", 31, &value));
+  TEST_ASSERT_EQUAL_FLOAT(1.0000001f, value);
+
+  TEST_ASSERT_EQUAL(-1, span_to_float("3.5e38", 6, &value));
+  TEST_ASSERT_EQUAL(-1, span_to_float("1e-50", 5, &value));
+
+  uint32_t state = 0x2545F491;
+  uint8_t buffer[SM_BUFFER_SIZE];
+  for (uint64_t idx = 0; idx < 10000; idx++) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    /* Any normal float */
+    float random;
+    uint32_t bits = (state >> 9) | (((state % 254) + 1) << 23);
+    memcpy(&random, &bits, sizeof(float));
+
+    uint64_t len = snprintf(buffer, SM_BUFFER_SIZE, "%.9g", random);
+    TEST_ASSERT_EQUAL(0, span_to_float(buffer, len, &value));
+    TEST_ASSERT_EQUAL_MEMORY(&random, &value, sizeof(float));
+  }
+}
+
+static void test_map_datatype() {
+  logger(4, "*** test_map_datatype ***\n");
+  uint8_t *names[] = { INT8_TYPE_STR, INT16_TYPE_STR, INT32_TYPE_STR, INT64_TYPE_STR, FLOAT_TYPE_STR,
+                       DOUBLE_TYPE_STR, BOOL_TYPE_STR, STRING_TYPE_STR, BLOB_TYPE_STR };
+  TEST_ASSERT_EQUAL(VALUE_TYPE_COUNT, sizeof(names) / sizeof(names[0]));
+
+  for (int64_t type = 0; type < VALUE_TYPE_COUNT; type++) {
+    TEST_ASSERT_EQUAL(type, map_datatype_from_str(names[type]));
+    TEST_ASSERT_EQUAL(type, map_datatype_from_span(names[type], strlen(names[type])));
+
+    type_name_t name = map_datatype_name(type);
+    TEST_ASSERT_EQUAL_UINT64(strlen(names[type]), name.len);
+    TEST_ASSERT_EQUAL_MEMORY(names[type], name.ptr, name.len);
+
+    uint8_t dest[SM_BUFFER_SIZE];
+    TEST_ASSERT_EQUAL(0, map_datatype_to_str(type, dest, SM_BUFFER_SIZE));
+    TEST_ASSERT_EQUAL_STRING(names[type], dest);
+  }
+
+  /* Names sharing the length and hashed character of a type */
+  uint8_t *invalid[] = { "int9", "intx", "bolb", "int17", "inx32", "flo", "doublf", "strinx",
+                         "doubles", "i", "INT8", "int8 " };
+  for (uint64_t idx = 0; idx < sizeof(invalid) / sizeof(invalid[0]); idx++) {
+    TEST_ASSERT_EQUAL(-1, map_datatype_from_span(invalid[idx], strlen(invalid[idx])));
+    TEST_ASSERT_EQUAL(-1, map_datatype_from_str(invalid[idx]));
+  }
+
+  TEST_ASSERT_EQUAL(INT32_TYPE, map_datatype_from_span("int32:key", 5));
+  TEST_ASSERT_EQUAL(-1, map_datatype_from_span(NULL, 4));
+  TEST_ASSERT_EQUAL(-1, map_datatype_from_str(""));
+  TEST_ASSERT_NULL(map_datatype_name(-1).ptr);
+  TEST_ASSERT_NULL(map_datatype_name(VALUE_TYPE_COUNT).ptr);
+  TEST_ASSERT_EQUAL(-1, map_datatype_size(VALUE_TYPE_COUNT));
+  TEST_ASSERT_EQUAL(sizeof(double), map_datatype_size(DOUBLE_TYPE));
+  TEST_ASSERT_EQUAL(0, map_datatype_size(BLOB_TYPE));
+}
+
+static void test_format_numbers() {
+  logger(4, "*** test_format_numbers ***\n");
+  uint8_t buffer[NUMBER_FORMAT_BUFFER_SIZE];
+
+  TEST_ASSERT_EQUAL(20, format_int64(INT64_MIN, buffer, NUMBER_FORMAT_BUFFER_SIZE));
+  TEST_ASSERT_EQUAL_STRING("-9223372036854775808", buffer);
+  TEST_ASSERT_EQUAL(1, format_int64(0, buffer, NUMBER_FORMAT_BUFFER_SIZE));
+  TEST_ASSERT_EQUAL_STRING("0", buffer);
+  TEST_ASSERT_EQUAL(-1, format_int64(12345, buffer, 5));
+
+  /* Shortest digits, without trailing zeros */
+  format_double(0.1, buffer, NUMBER_FORMAT_BUFFER_SIZE);
+  TEST_ASSERT_EQUAL_STRING("0.1", buffer);
+  format_double(100.0, buffer, NUMBER_FORMAT_BUFFER_SIZE);
+  TEST_ASSERT_EQUAL_STRING("100.0", buffer);
+  format_double(-0.0, buffer, NUMBER_FORMAT_BUFFER_SIZE);
+  TEST_ASSERT_EQUAL_STRING("-0.0", buffer);
+  format_double(1.5e-7, buffer, NUMBER_FORMAT_BUFFER_SIZE);
+  TEST_ASSERT_EQUAL_STRING("1.5e-7", buffer);
+  format_double(1.7976931348623157e308, buffer, NUMBER_FORMAT_BUFFER_SIZE);
+  TEST_ASSERT_EQUAL_STRING("1.7976931348623157e308", buffer);
+  format_float(3.14f, buffer, NUMBER_FORMAT_BUFFER_SIZE);
+  TEST_ASSERT_EQUAL_STRING("3.14", buffer);
+  format_float(1e-45f, buffer, NUMBER_FORMAT_BUFFER_SIZE);
+  TEST_ASSERT_EQUAL_STRING("1e-45", buffer);
+  TEST_ASSERT_EQUAL(-1, format_double(0.1, buffer, 3));
+
+  /* Any double parses back to the same bits */
+  uint64_t state = 0x9E3779B97F4A7C15;
+  for (uint64_t idx = 0; idx < 10000; idx++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    double random;
+    uint64_t bits = state & 0xFFEFFFFFFFFFFFFF;
+    memcpy(&random, &bits, sizeof(double));
+
+    double value;
+    int64_t len = format_double(random, buffer, NUMBER_FORMAT_BUFFER_SIZE);
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL(random, strtod(buffer, NULL));
+
+    TEST_ASSERT_EQUAL(0, span_to_double(buffer, len, &value));
+    TEST_ASSERT_EQUAL_MEMORY(&random, &value, sizeof(double));
+  }
+}
+
 static void test_free_entry_valid() {
   logger(4, "*** test_free_entry_valid ***\n");
   db_entry_t *entry = helper_create_and_validate_entry("key", "42", INT32_TYPE_STR);
@@ -556,6 +1002,9 @@ extern int main() {
   RUN_TEST(test_parse_entry_all_types);
   RUN_TEST(test_parse_entry_null_inputs);
   RUN_TEST(test_parse_entry_invalid_inputs);
+  RUN_TEST(test_write_entry);
+  RUN_TEST(test_escape_bytes);
+  RUN_TEST(test_string_and_blob_entries);
 
   // parse_line
   RUN_TEST(test_parse_line_valid_entry);
@@ -564,6 +1013,16 @@ extern int main() {
   RUN_TEST(test_parse_line_empty_line);
   RUN_TEST(test_parse_line_malformed_entry);
   RUN_TEST(test_parse_line_null_input);
+  RUN_TEST(test_parse_line_lazy);
+  RUN_TEST(test_parse_line_unmodified);
+  RUN_TEST(test_tokenizer_buffer);
+
+  // string_conversion
+  RUN_TEST(test_span_to_int64);
+  RUN_TEST(test_span_to_double);
+  RUN_TEST(test_span_to_float);
+  RUN_TEST(test_format_numbers);
+  RUN_TEST(test_map_datatype);
 
   // free_entry
   RUN_TEST(test_free_entry_valid);
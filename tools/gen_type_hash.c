@@ -0,0 +1,161 @@
+/**
+ * @file gen_type_hash.c
+ * @brief Generates the perfect hash of the datatype names
+ *
+ * Run at build time with the path of the header to write. The names of
+ * KV_VALUE_TYPES are hashed on their length and one of their characters,
+ * the first position that tells every pair of names of the same length
+ * apart. A multiplier is then searched so that the multiplicative hash of
+ * (length, character) sends every name to its own slot of the smallest
+ * power-of-two table, and the table of slots is written as a header.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "value_types.h"
+
+
+#define NAME_ENTRY(enum_value, name, size) name,
+
+static const char *names[] = { KV_VALUE_TYPES(NAME_ENTRY) };
+
+/* Character at offset, counted from the end of the name when negative */
+static uint8_t name_char(const char *name, int64_t offset) {
+  int64_t len = strlen(name);
+  return offset >= 0 ? name[offset] : name[len + offset];
+}
+
+static uint32_t hash_slot(const char *name, int64_t offset, uint32_t multiplier, uint32_t bits) {
+  uint32_t key = (uint32_t)strlen(name) << 8 | name_char(name, offset);
+  return (key * multiplier) >> (32 - bits);
+}
+
+static bool offset_is_unique(int64_t offset) {
+  for (uint64_t first = 0; first < VALUE_TYPE_COUNT; first++) {
+    for (uint64_t second = first + 1; second < VALUE_TYPE_COUNT; second++) {
+      if (strlen(names[first]) == strlen(names[second]) &&
+          name_char(names[first], offset) == name_char(names[second], offset)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool multiplier_is_perfect(int64_t offset, uint32_t multiplier, uint32_t bits) {
+  bool used[1 << 8] = { false };
+  for (uint64_t idx = 0; idx < VALUE_TYPE_COUNT; idx++) {
+    uint32_t slot = hash_slot(names[idx], offset, multiplier, bits);
+    if (used[slot]) return false;
+    used[slot] = true;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <output header>\n", argv[0]);
+    return 1;
+  }
+
+  uint64_t min_len = UINT64_MAX;
+  uint64_t max_len = 0;
+  for (uint64_t idx = 0; idx < VALUE_TYPE_COUNT; idx++) {
+    uint64_t len = strlen(names[idx]);
+    if (len < min_len) min_len = len;
+    if (len > max_len) max_len = len;
+  }
+
+  /* Offsets from the start first, then from the end */
+  int64_t offset = 0;
+  bool found = false;
+  for (int64_t candidate = 0; candidate < (int64_t)min_len && !found; candidate++) {
+    if (offset_is_unique(candidate)) {
+      offset = candidate;
+      found = true;
+    }
+  }
+  for (int64_t candidate = -1; candidate >= -(int64_t)min_len && !found; candidate--) {
+    if (offset_is_unique(candidate)) {
+      offset = candidate;
+      found = true;
+    }
+  }
+  if (!found) {
+    fprintf(stderr, "Error: No character position tells the datatype names apart\n");
+    return 1;
+  }
+
+  uint32_t bits = 1;
+  while ((1u << bits) < VALUE_TYPE_COUNT) bits++;
+
+  /* Grow the table until a multiplier is found */
+  uint32_t multiplier = 0;
+  found = false;
+  while (!found && bits <= 8) {
+    /* Odd multipliers drawn from an LCG, so the top bits of the products vary */
+    uint32_t state = 0x9E3779B9u;
+    for (uint32_t attempt = 0; attempt < (1u << 20) && !found; attempt++) {
+      state = state * 1664525u + 1013904223u;
+      uint32_t candidate = state | 1;
+      if (multiplier_is_perfect(offset, candidate, bits)) {
+        multiplier = candidate;
+        found = true;
+      }
+    }
+    if (!found) bits++;
+  }
+  if (!found) {
+    fprintf(stderr, "Error: No perfect hash found for the datatype names\n");
+    return 1;
+  }
+
+  int8_t slots[1 << 8];
+  memset(slots, -1, sizeof(slots));
+  for (uint64_t idx = 0; idx < VALUE_TYPE_COUNT; idx++) {
+    slots[hash_slot(names[idx], offset, multiplier, bits)] = idx;
+  }
+
+  FILE *file = fopen(argv[1], "w");
+  if (file == NULL) {
+    fprintf(stderr, "Error: Failed to open %s\n", argv[1]);
+    return 1;
+  }
+
+  fprintf(file, "/* Generated by tools/gen_type_hash.c from value_types.h, do not edit */\n");
+  fprintf(file, "#pragma once\n\n");
+  fprintf(file, "/** @brief Length of the shortest datatype name */\n");
+  fprintf(file, "#define TYPE_HASH_MIN_LEN %" PRIu64 "\n", min_len);
+  fprintf(file, "/** @brief Length of the longest datatype name */\n");
+  fprintf(file, "#define TYPE_HASH_MAX_LEN %" PRIu64 "\n", max_len);
+  fprintf(file, "/** @brief log2 of the number of slots of the hash table */\n");
+  fprintf(file, "#define TYPE_HASH_BITS %" PRIu32 "\n", bits);
+  fprintf(file, "/** @brief Multiplier of the hash of (length, character) */\n");
+  fprintf(file, "#define TYPE_HASH_MULTIPLIER 0x%08" PRIX32 "u\n", multiplier);
+  fprintf(file, "/** @brief Character of a name of length len that is hashed */\n");
+  if (offset >= 0) {
+    fprintf(file, "#define TYPE_HASH_CHAR(name, len) ((name)[%" PRId64 "])\n", offset);
+  }
+  else {
+    fprintf(file, "#define TYPE_HASH_CHAR(name, len) ((name)[(len) - %" PRId64 "])\n", -offset);
+  }
+  fprintf(file, "/** @brief Slot of a name of TYPE_HASH_MIN_LEN to TYPE_HASH_MAX_LEN bytes */\n");
+  fprintf(file, "#define TYPE_HASH_SLOT(name, len) \\\n"
+                "  ((((uint32_t)(len) << 8 | TYPE_HASH_CHAR(name, len)) * TYPE_HASH_MULTIPLIER) >> (32 - TYPE_HASH_BITS))\n\n");
+  fprintf(file, "/** @brief ENTRY_VALUE_TYPE of the name hashed to each slot, -1 for empty slots */\n");
+  fprintf(file, "static const int8_t type_hash_slots[1 << TYPE_HASH_BITS] = {");
+  for (uint32_t slot = 0; slot < (1u << bits); slot++) {
+    fprintf(file, "%s%d", slot % 16 == 0 ? "\n  " : " ", slots[slot]);
+    if (slot + 1 < (1u << bits)) fputc(',', file);
+  }
+  fprintf(file, "\n};\n");
+
+  if (fclose(file) != 0) {
+    fprintf(stderr, "Error: Failed to write %s\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}